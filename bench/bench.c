@@ -0,0 +1,243 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* Run pdshpy.so through the module lifecycle pdsh would (init, option
+ * callbacks, read_wcoll, postop, exit) against the stubs in stubs.c, with a
+ * synthetic working collective of each of a range of sizes, and report how
+ * long each step took and what it did to the process's RSS.
+ *
+ * Each size runs in its own forked process, so interpreter startup and peak
+ * RSS are measured from scratch every time. The driver module is
+ * bench/pdshpy_bench.py unless PDSHPY_MODULE says otherwise; PDSHPY_SERVER
+ * etc. work as usual, so server mode can be measured the same way.
+ *
+ * usage: bench [-r repeats] [size ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "src/common/hostlist.h"
+#include "src/pdsh/mod.h"
+#include "src/pdsh/opt.h"
+#include "src/common/xmalloc.h"
+
+#include "metrics.h"
+#include "stubs.h"
+
+/* the option pdshpy_bench.py registers */
+#define BENCH_OPTION 'B'
+
+static const long default_sizes[] = {
+    10, 100, 1000, 10000, 100000, 1000000
+};
+
+extern struct pdsh_module pdsh_module_info;
+
+static long
+rss_kb(void)
+{
+    FILE *f = NULL;
+    long size = 0, resident = 0;
+
+    if ((f = fopen("/proc/self/statm", "r")) == NULL)
+        return -1;
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2)
+        resident = -1;
+    fclose(f);
+    return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static long
+maxrss_kb(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+static void
+report(long nhosts, const char *phase, int calls, uint64_t ns,
+       long rss_before)
+{
+    long rss = rss_kb();
+
+    printf("%9ld  %-12s %6d %12.3f %12.3f %10ld %+10ld\n",
+           nhosts, phase, calls, ns / 1e6, ns / 1e6 / calls,
+           rss, rss - rss_before);
+    fflush(stdout);
+}
+
+static struct pdsh_module_option *
+find_option(int letter)
+{
+    int i;
+
+    for (i = 0; i < stub_noptions; i++)
+        if (stub_options[i].opt == letter)
+            return &stub_options[i];
+    return NULL;
+}
+
+/* one complete module lifecycle with 'nhosts' hosts in the wcoll */
+static int
+run_one(long nhosts, int repeats)
+{
+    struct pdsh_module_operations *ops = pdsh_module_info.mod_ops;
+    struct pdsh_module_option *bopt = NULL;
+    hostlist_t hl = NULL;
+    char hosts[64];
+    opt_t opt;
+    uint64_t start = 0, ns = 0;
+    long rss = 0;
+    int i;
+
+    memset(&opt, 0, sizeof(opt));
+    opt.progname = Strdup("pdsh");
+    opt.luser = Strdup("bench");
+    opt.fanout = 32;
+    opt.connect_timeout = 10;
+    snprintf(hosts, sizeof(hosts), "bnode[1-%ld]", nhosts);
+    if ((opt.wcoll = hostlist_create(hosts)) == NULL)
+    {
+        fprintf(stderr, "bench: could not create %s\n", hosts);
+        return 1;
+    }
+
+    rss = rss_kb();
+    start = metrics_now();
+    if (ops->init() < 0)
+    {
+        fprintf(stderr, "bench: module init failed\n");
+        return 1;
+    }
+    report(nhosts, "init", 1, metrics_now() - start, rss);
+
+    if ((bopt = find_option(BENCH_OPTION)) != NULL)
+    {
+        rss = rss_kb();
+        start = metrics_now();
+        for (i = 0; i < repeats; i++)
+        {
+            if (bopt->f(&opt, BENCH_OPTION, "64") < 0)
+            {
+                fprintf(stderr, "bench: option callback failed\n");
+                return 1;
+            }
+        }
+        report(nhosts, "process_opt", repeats, metrics_now() - start, rss);
+    }
+
+    rss = rss_kb();
+    for (i = 0, ns = 0; i < repeats; i++)
+    {
+        start = metrics_now();
+        hl = ops->read_wcoll(&opt);
+        ns += metrics_now() - start;
+        hostlist_destroy(hl);
+    }
+    report(nhosts, "read_wcoll", repeats, ns, rss);
+
+    rss = rss_kb();
+    start = metrics_now();
+    for (i = 0; i < repeats; i++)
+        ops->postop(&opt);
+    report(nhosts, "postop", repeats, metrics_now() - start, rss);
+
+    rss = rss_kb();
+    start = metrics_now();
+    ops->exit();
+    report(nhosts, "exit", 1, metrics_now() - start, rss);
+
+    printf("%9ld  %-12s %6s %12s %12s %10ld\n",
+           nhosts, "(maxrss)", "", "", "", maxrss_kb());
+    fflush(stdout);
+    hostlist_destroy(opt.wcoll);
+    return 0;
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "usage: bench [-r repeats] [size ...]\n");
+    exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+    const long *sizes = default_sizes;
+    long *argsizes = NULL;
+    int nsizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+    int repeats = 3;
+    int i, c, status, failed = 0;
+    pid_t pid;
+
+    while ((c = getopt(argc, argv, "r:")) != -1)
+    {
+        switch (c)
+        {
+        case 'r':
+            if ((repeats = atoi(optarg)) < 1)
+                usage();
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind < argc)
+    {
+        nsizes = argc - optind;
+        argsizes = Malloc(nsizes * sizeof(long));
+        for (i = 0; i < nsizes; i++)
+            if ((argsizes[i] = atol(argv[optind + i])) < 1)
+                usage();
+        sizes = argsizes;
+    }
+
+    /* don't clobber an explicit choice of driver */
+    setenv("PDSHPY_MODULE", "pdshpy_bench", 0);
+
+    printf("%9s  %-12s %6s %12s %12s %10s %10s\n", "hosts", "phase", "calls",
+           "total_ms", "per_call_ms", "rss_kb", "delta_kb");
+    fflush(stdout);
+
+    for (i = 0; i < nsizes; i++)
+    {
+        if ((pid = fork()) < 0)
+        {
+            perror("bench: fork");
+            return 1;
+        }
+        if (pid == 0)
+            _exit(run_one(sizes[i], repeats));
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0)
+        {
+            fprintf(stderr, "bench: run with %ld hosts failed\n", sizes[i]);
+            failed = 1;
+        }
+    }
+
+    free(argsizes);
+    return failed;
+}
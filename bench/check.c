@@ -0,0 +1,588 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* Checks of pdshpy's behaviour which need nothing but the local machine,
+ * run against the stubs in stubs.c like bench.c; "make check". Each check
+ * is a function in checks[] below, returning nonzero if it found something
+ * wrong. Most of them run the module through the lifecycle pdsh would (see
+ * run_pdsh()), in a process of its own, with one of the drivers in
+ * bench/pdshpy_check_*.py, and look at what came of it.
+ *
+ * Every check gets an empty directory of its own, named by
+ * PDSHPY_CHECK_DIR, which is also PDSHPY_CACHE_DIR's parent; the drivers
+ * leave things there for the check to look at (see bench/checkutil.py).
+ * PDSHPY_* variables from outside are cleared first, other than
+ * PDSHPY_PYTHON, so that they can't change the outcome.
+ *
+ * usage: check [-v] [name ...]
+ */
+
+/* for nftw() */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "src/common/hostlist.h"
+#include "src/pdsh/mod.h"
+#include "src/pdsh/opt.h"
+#include "src/common/xmalloc.h"
+
+#include "metrics.h"
+#include "stubs.h"
+#include "check.h"
+
+/* how long a run or a server gets before it's taken to be stuck */
+#define CHECK_RUN_TIMEOUT 60
+#define CHECK_SERVER_TIMEOUT 15
+
+extern char **environ;
+extern struct pdsh_module pdsh_module_info;
+
+int check_verbose = 0;
+
+/* the current check's own directory */
+static char check_dir[PATH_MAX];
+
+int
+expect_int(const char *what, long long got, long long want)
+{
+    if (got != want || check_verbose)
+        printf("  %s: %lld%s%lld\n", what, got,
+               got == want ? " == " : ", wanted ", want);
+    return got != want;
+}
+
+int
+expect_str(const char *what, const char *got, const char *want)
+{
+    int wrong = strcmp(got, want) != 0;
+
+    if (wrong || check_verbose)
+        printf("  %s: \"%s\"%s\"%s\"\n", what, got,
+               wrong ? ", wanted " : " == ", want);
+    return wrong;
+}
+
+/* 'hosts' sorted, without duplicates, into 'buf' */
+static void
+sorted_hosts(const char *hosts, char *buf, size_t n)
+{
+    hostlist_t hl = hostlist_create(hosts);
+
+    snprintf(buf, n, "%s", hosts);
+    if (hl == NULL)
+        return;
+    hostlist_uniq(hl);
+    if (hostlist_ranged_string(hl, n, buf) < 0)
+        snprintf(buf, n, "(too long)");
+    hostlist_destroy(hl);
+}
+
+int
+expect_hosts(const char *what, const char *got, const char *want)
+{
+    char sgot[CHECK_MAX_HOSTS], swant[CHECK_MAX_HOSTS];
+    int wrong;
+
+    sorted_hosts(got, sgot, sizeof(sgot));
+    sorted_hosts(want, swant, sizeof(swant));
+    wrong = strcmp(sgot, swant) != 0;
+    if (wrong || check_verbose)
+        printf("  %s: \"%s\"%s\"%s\"\n", what, got,
+               wrong ? ", wanted the same hosts as " : " ~ ", want);
+    return wrong;
+}
+
+int
+expect_output(const char *what, const struct outcome *out,
+              const char *text, int present)
+{
+    int wrong = (strstr(out->output, text) != NULL) != present;
+
+    if (wrong || check_verbose)
+        printf("  %s: \"%s\" %s the output%s\n", what, text,
+               present ? "in" : "not in", wrong ? ", but it isn't so" : "");
+    return wrong;
+}
+
+void
+show_outcome(const struct outcome *out)
+{
+    const char *p = NULL;
+    const char *nl = NULL;
+
+    printf("  (init %d, options %d, postop %d; collected \"%s\" in %.0fms,"
+           " wcoll \"%s\")\n", out->init, out->opt, out->postop,
+           out->collected, out->collect_ms, out->wcoll);
+    for (p = out->output; *p != '\0'; p = nl + 1)
+    {
+        if ((nl = strchr(p, '\n')) == NULL)
+            nl = p + strlen(p) - 1;
+        printf("  | %.*s\n", (int)(nl - p), p);
+    }
+}
+
+int
+check_path(char *path, size_t n, const char *name)
+{
+    if (snprintf(path, n, "%s/%s", check_dir, name) >= (int)n)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+long
+check_counter(const char *name)
+{
+    char path[PATH_MAX];
+    FILE *f = NULL;
+    long n = 0;
+
+    if (check_path(path, sizeof(path), name) < 0
+        || (f = fopen(path, "r")) == NULL)
+        return 0;
+    if (fscanf(f, "%ld", &n) != 1)
+        n = 0;
+    fclose(f);
+    return n;
+}
+
+const char *
+check_python(void)
+{
+    const char *python = getenv("PDSHPY_PYTHON");
+
+    return python != NULL ? python : PDSHPY_PYTHON_EXECUTABLE;
+}
+
+static struct pdsh_module_option *
+find_option(int letter)
+{
+    int i;
+
+    for (i = 0; i < stub_noptions; i++)
+        if (stub_options[i].opt == letter)
+            return &stub_options[i];
+    return NULL;
+}
+
+static void
+ranged(hostlist_t hl, char *buf, size_t n)
+{
+    if (hl == NULL)
+        snprintf(buf, n, "(null)");
+    else if (hostlist_ranged_string(hl, n, buf) < 0)
+        snprintf(buf, n, "(too long)");
+}
+
+/* the pdsh side of run_pdsh(), in the child */
+static void
+run_in_child(const struct run *r, int resultfd)
+{
+    struct pdsh_module_operations *ops = pdsh_module_info.mod_ops;
+    struct pdsh_module_option *o = NULL;
+    struct outcome out;
+    hostlist_t hl = NULL;
+    uint64_t start;
+    opt_t opt;
+    int i;
+
+    memset(&out, 0, sizeof(out));
+    strcpy(out.collected, "-");
+    strcpy(out.wcoll, "-");
+    for (i = 0; i < CHECK_MAX_ENV && r->env[i] != NULL; i++)
+        putenv(Strdup(r->env[i]));
+    setenv("PDSHPY_MODULE", r->driver, 1);
+
+    memset(&opt, 0, sizeof(opt));
+    opt.progname = Strdup("pdsh");
+    opt.luser = Strdup("check");
+    opt.fanout = 32;
+    opt.connect_timeout = 10;
+    if (r->wcoll != NULL)
+        opt.wcoll = hostlist_create(r->wcoll);
+
+    if ((out.init = ops->init()) < 0)
+        goto done;
+    for (i = 0; i < CHECK_MAX_OPTS && r->opts[i].letter != 0; i++)
+    {
+        if ((o = find_option(r->opts[i].letter)) == NULL)
+        {
+            fprintf(stderr, "check: no option -%c\n", r->opts[i].letter);
+            out.opt = -1;
+            goto done;
+        }
+        if (o->f(&opt, r->opts[i].letter, (char *)r->opts[i].arg) < 0)
+            out.opt = -1;
+    }
+
+    /* as pdsh does, only without -w */
+    if (opt.wcoll == NULL)
+    {
+        start = metrics_now();
+        hl = ops->read_wcoll(&opt);
+        out.collect_ms = (metrics_now() - start) / 1e6;
+        ranged(hl, out.collected, sizeof(out.collected));
+        opt.wcoll = hl;
+    }
+    out.postop = ops->postop(&opt);
+    ranged(opt.wcoll, out.wcoll, sizeof(out.wcoll));
+    ops->exit();
+    out.finished = 1;
+
+done:
+    fflush(stdout);
+    fflush(stderr);
+    if (write(resultfd, &out, sizeof(out)) != sizeof(out))
+        _exit(1);
+    _exit(0);
+}
+
+int
+run_pdsh(const struct run *r, struct outcome *out)
+{
+    char path[PATH_MAX];
+    struct pollfd pfd;
+    size_t got = 0;
+    ssize_t len;
+    pid_t pid;
+    int fds[2];
+    int outfd, status;
+
+    memset(out, 0, sizeof(*out));
+    if (check_path(path, sizeof(path), "output.XXXXXX") < 0
+        || (outfd = mkstemp(path)) < 0)
+        return -1;
+    unlink(path);
+    if (pipe(fds) < 0)
+    {
+        close(outfd);
+        return -1;
+    }
+
+    fflush(stdout);
+    if ((pid = fork()) < 0)
+    {
+        close(outfd);
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        dup2(outfd, STDOUT_FILENO);
+        dup2(outfd, STDERR_FILENO);
+        close(outfd);
+        run_in_child(r, fds[1]);
+    }
+    close(fds[1]);
+
+    /* the result comes in one piece once the run is over */
+    pfd.fd = fds[0];
+    pfd.events = POLLIN;
+    while (got < sizeof(*out))
+    {
+        if (poll(&pfd, 1, CHECK_RUN_TIMEOUT * 1000) <= 0)
+        {
+            fprintf(stderr, "check: run with %s got stuck\n", r->driver);
+            kill(pid, SIGKILL);
+            break;
+        }
+        if ((len = read(fds[0], (char *)out + got, sizeof(*out) - got)) <= 0)
+            break;
+        got += len;
+    }
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+    if (got < sizeof(*out))
+        memset(out, 0, sizeof(*out));
+
+    len = pread(outfd, out->output, sizeof(out->output) - 1, 0);
+    out->output[len > 0 ? len : 0] = '\0';
+    close(outfd);
+    if (!out->finished)
+        out->init = out->init < 0 ? out->init : -1;
+    return 0;
+}
+
+int
+run_python(const char *const *args)
+{
+    const char *argv[16];
+    pid_t pid;
+    int i, status;
+
+    argv[0] = check_python();
+    for (i = 0; args[i] != NULL && i < 14; i++)
+        argv[i + 1] = args[i];
+    argv[i + 1] = NULL;
+
+    fflush(stdout);
+    if ((pid = fork()) < 0)
+        return -1;
+    if (pid == 0)
+    {
+        execvp(argv[0], (char *const *)argv);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) < 0)
+        return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int
+server_up(const char *sock)
+{
+    struct sockaddr_un addr;
+    int fd, up;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return 0;
+    up = connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    close(fd);
+    return up;
+}
+
+int
+wait_for_server(const char *sock)
+{
+    int i;
+
+    for (i = 0; i < CHECK_SERVER_TIMEOUT * 20; i++)
+    {
+        if (server_up(sock))
+            return 0;
+        usleep(50000);
+    }
+    return -1;
+}
+
+pid_t
+start_server(const char *sock, const char *driver, int forking)
+{
+    const char *python = check_python();
+    char log[PATH_MAX];
+    pid_t pid;
+    int fd;
+
+    fflush(stdout);
+    if ((pid = fork()) < 0)
+        return -1;
+    if (pid == 0)
+    {
+        /* what it has to say goes in server.log */
+        if (check_path(log, sizeof(log), "server.log") == 0
+            && (fd = open(log, O_WRONLY | O_CREAT | O_APPEND, 0600)) >= 0)
+        {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        if (forking)
+            execlp(python, python, "-m", "pdshpy.server", "--fork",
+                   "--socket", sock, "--module", driver, (char *)NULL);
+        else
+            execlp(python, python, "-m", "pdshpy.server",
+                   "--socket", sock, "--module", driver, (char *)NULL);
+        _exit(127);
+    }
+    if (wait_for_server(sock) < 0)
+    {
+        fprintf(stderr, "check: pdshpy server for %s didn't start\n",
+                driver);
+        stop_server(pid);
+        return -1;
+    }
+    return pid;
+}
+
+void
+stop_server(pid_t pid)
+{
+    if (pid <= 0)
+        return;
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+static const struct check {
+    const char *name;
+    int (*run)(void);
+} checks[] = {
+    { "server", check_server },
+    { "server_turns", check_server_turns },
+    { "fork_server", check_fork_server },
+    { "autostart", check_autostart },
+    { "cache", check_cache },
+    { "cache_refresh", check_cache_refresh },
+    { "deadline", check_deadline },
+    { "deadline_server", check_deadline_server },
+    { "prefetch", check_prefetch },
+    { "sources", check_sources },
+    { "sources_server", check_sources_server },
+    { "coro", check_coro },
+    { "coro_server", check_coro_server },
+    { "hostlist", check_hostlist },
+    { "hostlist_server", check_hostlist_server },
+    { "interp", check_interp },
+    { "interp_server", check_interp_server },
+    { "liveness", check_liveness },
+    { "hostdb", check_hostdb },
+    { "hostdb_server", check_hostdb_server },
+    { "hostexpr", check_hostexpr },
+    { "hostexpr_server", check_hostexpr_server },
+    { "rangeset", check_rangeset },
+    { "hostpat", check_hostpat },
+    { "hostpat_server", check_hostpat_server },
+    { "filter", check_filter },
+    { "filter_server", check_filter_server },
+    { "deadhosts", check_deadhosts },
+    { "deadhosts_server", check_deadhosts_server },
+    { NULL, NULL }
+};
+
+static int
+remove_entry(const char *path, const struct stat *st, int flag,
+             struct FTW *ftw)
+{
+    remove(path);
+    return 0;
+}
+
+/* clear PDSHPY_* settings from outside, other than PDSHPY_PYTHON */
+static void
+clear_environment(void)
+{
+    char name[256];
+    size_t len;
+    int i = 0;
+
+    while (environ[i] != NULL)
+    {
+        len = strcspn(environ[i], "=");
+        if (strncmp(environ[i], "PDSHPY_", 7) != 0 || len >= sizeof(name)
+            || strncmp(environ[i], "PDSHPY_PYTHON=", 14) == 0)
+        {
+            i++;
+            continue;
+        }
+        memcpy(name, environ[i], len);
+        name[len] = '\0';
+        unsetenv(name);
+    }
+}
+
+static int
+wanted(const char *name, int argc, char **argv)
+{
+    int i;
+
+    if (argc == 0)
+        return 1;
+    for (i = 0; i < argc; i++)
+        if (strcmp(argv[i], name) == 0)
+            return 1;
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    const struct check *c = NULL;
+    char top[] = "/tmp/pdshpy-check.XXXXXX";
+    char cache[PATH_MAX];
+    int opt, failed = 0, ran = 0;
+
+    while ((opt = getopt(argc, argv, "v")) != -1)
+    {
+        if (opt != 'v')
+        {
+            fprintf(stderr, "usage: check [-v] [name ...]\n");
+            return 2;
+        }
+        check_verbose = 1;
+    }
+    argc -= optind;
+    argv += optind;
+
+    clear_environment();
+    if (mkdtemp(top) == NULL)
+    {
+        perror("check: mkdtemp");
+        return 1;
+    }
+
+    for (c = checks; c->name != NULL; c++)
+    {
+        if (!wanted(c->name, argc, argv))
+            continue;
+        snprintf(check_dir, sizeof(check_dir), "%s/%s", top, c->name);
+        if (check_path(cache, sizeof(cache), "cache") < 0
+            || mkdir(check_dir, 0700) < 0)
+        {
+            perror(check_dir);
+            failed++;
+            continue;
+        }
+        setenv("PDSHPY_CHECK_DIR", check_dir, 1);
+        setenv("PDSHPY_CACHE_DIR", cache, 1);
+        if (check_verbose)
+            printf("%s:\n", c->name);
+        fflush(stdout);
+        if (c->run() != 0)
+        {
+            printf("%-24s FAILED\n", c->name);
+            failed++;
+        }
+        else
+            printf("%-24s ok\n", c->name);
+        fflush(stdout);
+        ran++;
+    }
+
+    nftw(top, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    if (ran == 0)
+    {
+        fprintf(stderr, "check: no such check\n");
+        return 2;
+    }
+    if (failed)
+        printf("check: %d of %d failed\n", failed, ran);
+    else
+        printf("check: all %d passed\n", ran);
+    return failed != 0;
+}
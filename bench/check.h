@@ -0,0 +1,136 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#ifndef _PDSHPY_BENCH_CHECK_H
+#define _PDSHPY_BENCH_CHECK_H
+
+#include <sys/types.h>
+
+#define CHECK_MAX_ENV 8
+#define CHECK_MAX_OPTS 4
+#define CHECK_MAX_HOSTS 4096
+#define CHECK_MAX_OUTPUT 16384
+
+/* One pdsh run, for run_pdsh(): the driver to load (PDSHPY_MODULE), extra
+ * "NAME=value" settings for the environment, the options to give it, in
+ * order, and the hosts given with -w, or NULL to have the module collect
+ * them. */
+struct run {
+    const char *driver;
+    const char *env[CHECK_MAX_ENV];
+    struct {
+        int letter;
+        const char *arg;
+    } opts[CHECK_MAX_OPTS];
+    const char *wcoll;
+};
+
+/* What came of a run: what init, the option callbacks (the first that
+ * failed, if any) and postop returned, the hosts read_wcoll collected and
+ * how long that took, the hosts left after postop, and everything the run
+ * wrote on stdout and stderr. finished is zero if the run didn't make it
+ * to the end, whether init failed or the process died. */
+struct outcome {
+    int init;
+    int opt;
+    int postop;
+    int finished;
+    double collect_ms;
+    char collected[CHECK_MAX_HOSTS];
+    char wcoll[CHECK_MAX_HOSTS];
+    char output[CHECK_MAX_OUTPUT];
+};
+
+/* nonzero to show every expectation, not only those which weren't met */
+extern int check_verbose;
+
+/* Each of these prints what's wrong, and returns nonzero, if 'got' isn't
+ * what was wanted. */
+int expect_int(const char *what, long long got, long long want);
+int expect_str(const char *what, const char *got, const char *want);
+
+/* the same, for hosts in any order, duplicates and all */
+int expect_hosts(const char *what, const char *got, const char *want);
+
+/* 'text' should be somewhere in the run's output if 'present', else not */
+int expect_output(const char *what, const struct outcome *out,
+                  const char *text, int present);
+
+/* print an outcome, for when what went wrong needs explaining */
+void show_outcome(const struct outcome *out);
+
+/* Run the module through pdsh's lifecycle in a child process, as
+ * described by 'r', and fill in 'out'; -1 if the child couldn't be run. */
+int run_pdsh(const struct run *r, struct outcome *out);
+
+/* the path of 'name' in the current check's directory */
+int check_path(char *path, size_t n, const char *name);
+
+/* the number in the file 'name' in the check's directory, or 0 if there
+ * isn't one (see bump() in bench/checkutil.py) */
+long check_counter(const char *name);
+
+/* the Python pdshpy runs with: PDSHPY_PYTHON, or the one it was built for */
+const char *check_python(void);
+
+/* run Python with the NULL-terminated 'args'; its exit status, or -1 */
+int run_python(const char *const *args);
+
+/* Start "python -m pdshpy.server" for 'driver' listening on 'sock', with
+ * --fork if 'forking', and wait until it takes connections; its pid, or
+ * -1. What it prints goes in server.log in the check's directory.
+ * stop_server() asks it to stop and waits for it. */
+pid_t start_server(const char *sock, const char *driver, int forking);
+void stop_server(pid_t pid);
+
+/* nonzero if something takes connections on 'sock'; wait_for_server()
+ * waits a while for that to be so, returning -1 if it never is */
+int server_up(const char *sock);
+int wait_for_server(const char *sock);
+
+/* the checks, by the files they live in */
+int check_server(void);
+int check_server_turns(void);
+int check_fork_server(void);
+int check_autostart(void);
+int check_cache(void);
+int check_cache_refresh(void);
+int check_deadline(void);
+int check_deadline_server(void);
+int check_prefetch(void);
+int check_sources(void);
+int check_sources_server(void);
+int check_coro(void);
+int check_coro_server(void);
+int check_hostlist(void);
+int check_hostlist_server(void);
+int check_interp(void);
+int check_interp_server(void);
+int check_liveness(void);
+int check_hostdb(void);
+int check_hostdb_server(void);
+int check_hostexpr(void);
+int check_hostexpr_server(void);
+int check_rangeset(void);
+int check_hostpat(void);
+int check_hostpat_server(void);
+int check_filter(void);
+int check_filter_server(void);
+int check_deadhosts(void);
+int check_deadhosts_server(void);
+
+#endif /* !_PDSHPY_BENCH_CHECK_H */
@@ -0,0 +1,186 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* checks of the host cache (cache.c), with bench/pdshpy_check_cache.py,
+ * whose hosts say how many times collect_hosts() has been called */
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "src/common/hostlist.h"
+
+#include "cache.h"
+#include "check.h"
+
+#define CHECK_CACHE_DRIVER "pdshpy_check_cache"
+
+/* how long a background refresh gets to be done, in seconds */
+#define CHECK_REFRESH_TIMEOUT 10
+
+/* Make the cache entry at 'path' look 'seconds' older than it is, by
+ * rewriting the time it was created in its header. */
+static int
+age_entry(const char *path, long seconds)
+{
+    char buf[CHECK_MAX_HOSTS + 256];
+    char *line = NULL;
+    long created;
+    size_t len;
+    FILE *f = NULL;
+    int skip = 0;
+
+    if ((f = fopen(path, "r")) == NULL)
+        return -1;
+    len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+    if ((line = strchr(buf, '\n')) == NULL
+        || sscanf(line + 1, "%ld%n", &created, &skip) != 1)
+        return -1;
+    if ((f = fopen(path, "w")) == NULL)
+        return -1;
+    fwrite(buf, 1, line + 1 - buf, f);
+    fprintf(f, "%ld", created - seconds);
+    fwrite(line + 1 + skip, 1, len - (line + 1 + skip - buf), f);
+    return fclose(f);
+}
+
+/* Age every entry cached for 'driver' by 'seconds'; how many there were. */
+static int
+age_entries(const char *driver, long seconds)
+{
+    char dir[PATH_MAX], path[2 * PATH_MAX];
+    size_t len = strlen(driver);
+    struct dirent *e = NULL;
+    DIR *d = NULL;
+    int aged = 0;
+
+    if (check_path(dir, sizeof(dir), "cache") < 0
+        || (d = opendir(dir)) == NULL)
+        return 0;
+    while ((e = readdir(d)) != NULL)
+    {
+        /* <driver>.<hash>, not <driver>.<hash>.refresh */
+        if (strncmp(e->d_name, driver, len) != 0 || e->d_name[len] != '.'
+            || strchr(e->d_name + len + 1, '.') != NULL)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        aged += age_entry(path, seconds) == 0;
+    }
+    closedir(d);
+    return aged;
+}
+
+/* a run asking for the hosts under 'key' */
+static int
+run_key(const char *key, const char *env, struct outcome *out)
+{
+    struct run r = { CHECK_CACHE_DRIVER, { env }, { { 'K', key } }, NULL };
+
+    return run_pdsh(&r, out);
+}
+
+/* Runs with the same key share the hosts collected by the first, until
+ * they're older than the TTL; those with another key don't. */
+int
+check_cache(void)
+{
+    struct outcome out;
+    int failed;
+
+    failed = run_key("a", NULL, &out) < 0
+        || expect_str("first run", out.collected, "gen1")
+        || run_key("a", NULL, &out) < 0
+        || expect_str("same key", out.collected, "gen1")
+        || expect_int("collections", check_counter("collections"), 1)
+        || run_key("b", NULL, &out) < 0
+        || expect_str("another key", out.collected, "gen2")
+        || expect_int("entries aged past the TTL",
+                      age_entries(CHECK_CACHE_DRIVER,
+                                  PDSHPY_CACHE_DEFAULT_TTL + 1), 2)
+        || run_key("a", NULL, &out) < 0
+        || expect_str("same key, expired", out.collected, "gen3")
+        || run_key("a", NULL, &out) < 0
+        || expect_str("same key, cached again", out.collected, "gen3")
+        || run_key("a", PDSHPY_ENVIRON_CACHE_TTL "=0", &out) < 0
+        || expect_str("cache turned off", out.collected, "gen4")
+        || expect_int("collections", check_counter("collections"), 4);
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
+
+/* Wait for the entry under 'key' to be fresh and hold 'hosts'; nonzero if
+ * it never comes to that. */
+static int
+wait_for_entry(const char *key, const char *hosts)
+{
+    char buf[CHECK_MAX_HOSTS];
+    hostlist_t hl = NULL;
+    int i, stale = 1;
+
+    for (i = 0; i < CHECK_REFRESH_TIMEOUT * 10; i++)
+    {
+        if ((hl = cache_lookup(CHECK_CACHE_DRIVER, key, -1, &stale)) != NULL)
+        {
+            if (hostlist_ranged_string(hl, sizeof(buf), buf) < 0)
+                buf[0] = '\0';
+            hostlist_destroy(hl);
+            if (!stale && strcmp(buf, hosts) == 0)
+                return 0;
+        }
+        usleep(100000);
+    }
+    return 1;
+}
+
+/* With PDSHPY_CACHE_MAX_STALE, an expired entry is still served, straight
+ * away, and refreshed in the background for the runs after; past that,
+ * it's a miss. */
+int
+check_cache_refresh(void)
+{
+    const char *env = PDSHPY_ENVIRON_CACHE_MAX_STALE "=300";
+    struct outcome out;
+    int failed;
+
+    failed = run_key("a", env, &out) < 0
+        || expect_str("first run", out.collected, "gen1")
+        || expect_int("entries aged past the TTL",
+                      age_entries(CHECK_CACHE_DRIVER,
+                                  PDSHPY_CACHE_DEFAULT_TTL + 30), 1)
+        || run_key("a", env, &out) < 0
+        || expect_str("stale entry served", out.collected, "gen1")
+        || expect_int("refreshed in the background",
+                      wait_for_entry("a", "gen2"), 0)
+        || run_key("a", env, &out) < 0
+        || expect_str("refreshed entry served", out.collected, "gen2")
+        || expect_int("collections", check_counter("collections"), 2)
+        || expect_int("entries aged past staleness",
+                      age_entries(CHECK_CACHE_DRIVER,
+                                  PDSHPY_CACHE_DEFAULT_TTL + 400), 1)
+        || run_key("a", env, &out) < 0
+        || expect_str("too stale to serve", out.collected, "gen3")
+        || expect_int("collections", check_counter("collections"), 3);
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
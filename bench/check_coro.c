@@ -0,0 +1,125 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* checks of coroutine callbacks, with bench/pdshpy_check_coro.py, whose
+ * callbacks are all coroutine functions, and bench/pdshpy_check_sync.py,
+ * whose callbacks aren't */
+
+#include <limits.h>
+#include <stdio.h>
+
+#include "check.h"
+
+#define CHECK_CORO_DRIVER "pdshpy_check_coro"
+#define CHECK_SYNC_DRIVER "pdshpy_check_sync"
+
+/* Five queries of 0.3 seconds, and a host source of as long, take 0.3
+ * seconds side by side, where they'd take 1.8 one after another; this
+ * leaves room for a slow machine. */
+#define CHECK_CORO_QUERIES "5"
+#define CHECK_CORO_HOSTS "q[1-5],src1"
+#define CHECK_CORO_MS 1000
+
+/* nonzero if the Python pdshpy runs with has 'async def' */
+static int
+has_async_def(void)
+{
+    const char *const args[] = {
+        "-c", "import sys; sys.exit(sys.version_info < (3, 5))", NULL
+    };
+
+    return run_python(args) == 0;
+}
+
+/* A driver with no coroutines never loads asyncio. */
+static int
+check_sync(const char *env)
+{
+    struct run r = { CHECK_SYNC_DRIVER, { env }, { { 0 } }, NULL };
+    struct outcome out;
+    int failed;
+
+    failed = run_pdsh(&r, &out) < 0
+        || expect_str("collected, synchronously", out.collected, "sync1")
+        || expect_int("asyncio loaded", check_counter("asyncio_loaded"), 0);
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
+
+/* Coroutine callbacks are run to completion, with their queries in flight
+ * at once, all on the one event loop. */
+static int
+check_async(const char *env)
+{
+    struct run r = {
+        CHECK_CORO_DRIVER, { env }, { { 'Q', CHECK_CORO_QUERIES } }, NULL
+    };
+    struct outcome out;
+    int failed;
+
+    failed = run_pdsh(&r, &out) < 0
+        || expect_int("option", out.opt, 0)
+        || expect_hosts("collected by coroutines", out.collected,
+                        CHECK_CORO_HOSTS)
+        || expect_int("queries side by side",
+                      out.collect_ms < CHECK_CORO_MS, 1)
+        || expect_int("postop", out.postop, 0)
+        || expect_int("event loops", check_counter("loops"), 1);
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
+
+int
+check_coro(void)
+{
+    if (check_sync(NULL))
+        return 1;
+    if (!has_async_def())
+    {
+        printf("  no 'async def' in %s; only checked a driver without "
+               "coroutines\n", check_python());
+        return 0;
+    }
+    return check_async(NULL);
+}
+
+/* the same, through a server */
+int
+check_coro_server(void)
+{
+    char sock[PATH_MAX], env[PATH_MAX + 16];
+    pid_t pid;
+    int failed;
+
+    if (check_path(sock, sizeof(sock), "sock") < 0)
+        return 1;
+    snprintf(env, sizeof(env), "PDSHPY_SERVER=%s", sock);
+    if ((pid = start_server(sock, CHECK_SYNC_DRIVER, 0)) < 0)
+        return 1;
+    failed = check_sync(env);
+    stop_server(pid);
+    if (failed || !has_async_def())
+        return failed;
+
+    if ((pid = start_server(sock, CHECK_CORO_DRIVER, 0)) < 0)
+        return 1;
+    failed = check_async(env);
+    stop_server(pid);
+    return failed;
+}
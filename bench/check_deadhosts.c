@@ -0,0 +1,193 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* checks of remembering unreachable hosts (deadhosts.c, and
+ * check_deadhosts() and util.record_unreachable() in pdshpy.c), through
+ * deadhosts.h and through bench/pdshpy_check_deadhosts.py */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "deadhosts.h"
+#include "check.h"
+
+#define CHECK_DEADHOSTS_DRIVER "pdshpy_check_deadhosts"
+
+/* whether 'host' is taken to be down: 1 or 0, or -1 if that can't be told */
+static int
+is_dead(const char *host)
+{
+    char *hosts[1];
+    unsigned char dead = 2;
+
+    hosts[0] = (char *)host;
+    if (deadhosts_lookup(hosts, 1, &dead) < 0)
+        return -1;
+    return dead;
+}
+
+/* record 'host' as unreachable, with 'down', or reachable */
+static int
+record(const char *host, int down)
+{
+    char *hosts[1];
+    unsigned char flag = down;
+
+    hosts[0] = (char *)host;
+    return deadhosts_update(hosts, 1, &flag);
+}
+
+/* Sleep until it's 'when', to the second. */
+static void
+wait_until(time_t when)
+{
+    while (time(NULL) < when)
+        usleep(20000);
+}
+
+/* With a first TTL of a second, a host is down for 1 second, then 2, then
+ * 4, each time it's recorded after the last has run out; recording it
+ * again before then changes nothing, and once it's been recorded as
+ * reachable it starts over. Each step starts as a second does, so that
+ * it's done well within it. */
+static int
+check_ttl(void)
+{
+    static const char host[] = "ttl1";
+    char name[DEADHOSTS_NAME_MAX + 2];
+    time_t t0;
+    int failed;
+
+    setenv(PDSHPY_ENVIRON_DEADHOSTS_TTL, "1", 1);
+    memset(name, 'x', sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    t0 = time(NULL) + 1;
+    wait_until(t0);
+    failed = expect_int("recorded", record(host, 1), 0)
+        | expect_int("down", is_dead(host), 1)
+        | expect_int("another host", is_dead("ttl2"), 0)
+        | expect_int("recorded again", record(host, 1), 0)
+        | expect_int("too long a name", record(name, 1), 0)
+        | expect_int("too long a name down", is_dead(name), 0);
+    wait_until(t0 + 1);
+    failed |= expect_int("after a second", is_dead(host), 0)
+        | expect_int("recorded a second time", record(host, 1), 0);
+    wait_until(t0 + 2);
+    failed |= expect_int("a second into two", is_dead(host), 1);
+    wait_until(t0 + 3);
+    failed |= expect_int("after two seconds", is_dead(host), 0)
+        | expect_int("recorded a third time", record(host, 1), 0);
+    wait_until(t0 + 6);
+    failed |= expect_int("three seconds into four", is_dead(host), 1);
+    wait_until(t0 + 7);
+    failed |= expect_int("after four seconds", is_dead(host), 0)
+        | expect_int("recorded reachable", record(host, 0), 0)
+        | expect_int("recorded after that", record(host, 1), 0)
+        | expect_int("down after that", is_dead(host), 1);
+    wait_until(t0 + 8);
+    failed |= expect_int("after a second again", is_dead(host), 0);
+    unsetenv(PDSHPY_ENVIRON_DEADHOSTS_TTL);
+    return failed;
+}
+
+/* a run of the driver on 'wcoll' with PDSHPY_DEADHOSTS set to 'mode', and
+ * -R if 'reachable'; nonzero if it couldn't be run */
+static int
+run_driver(const char *env, const char *mode, const char *wcoll,
+           int reachable, struct outcome *out)
+{
+    char setting[64];
+    struct run r = {
+        CHECK_DEADHOSTS_DRIVER, { setting, env },
+        { { reachable ? 'R' : 0, "1" } }, wcoll
+    };
+
+    snprintf(setting, sizeof(setting), "%s=%s", PDSHPY_ENVIRON_DEADHOSTS,
+             mode);
+    return run_pdsh(&r, out) < 0;
+}
+
+/* Hosts the driver records as unreachable are left out, or tried last, in
+ * that run and the next, and reported in one line; once it records them
+ * as reachable, they're not. */
+static int
+check_driver(const char *env)
+{
+    struct outcome out;
+    int failed;
+
+    if (run_driver(env, "skip", "n[1-4],dead[1-2]", 0, &out))
+        return 1;
+    failed = expect_int("postop", out.postop, 0)
+        | expect_str("skipped", out.wcoll, "n[1-4]")
+        | expect_output("reported", &out,
+                        "2 hosts unreachable lately, left out: dead[1-2]",
+                        1);
+    if (failed)
+        show_outcome(&out);
+    if (failed || run_driver(env, "last", "dead1,n[1-2]", 0, &out))
+        return 1;
+    failed = expect_int("postop", out.postop, 0)
+        | expect_str("last", out.wcoll, "n[1-2],dead1")
+        | expect_output("reported", &out,
+                        "1 host unreachable lately, tried last: dead1", 1);
+    if (failed)
+        show_outcome(&out);
+    if (failed || run_driver(env, "skip", "dead1,n1", 1, &out))
+        return 1;
+    failed = expect_int("postop", out.postop, 0)
+        | expect_str("reachable", out.wcoll, "dead1,n1")
+        | expect_output("reported", &out, "unreachable lately", 0);
+    if (failed)
+        show_outcome(&out);
+    if (failed || run_driver(env, "sometimes", "dead2,n1", 0, &out))
+        return 1;
+    failed = expect_int("postop with a bad mode", out.postop != 0, 1)
+        | expect_output("bad mode", &out,
+                        "should be \"skip\" or \"last\", not \"sometimes\"",
+                        1);
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
+
+int
+check_deadhosts(void)
+{
+    return check_driver(NULL) | check_ttl();
+}
+
+/* the driver through a server, which hands what it records to the client */
+int
+check_deadhosts_server(void)
+{
+    char sock[PATH_MAX], env[PATH_MAX + 16];
+    pid_t pid;
+    int failed;
+
+    if (check_path(sock, sizeof(sock), "sock") < 0
+        || (pid = start_server(sock, CHECK_DEADHOSTS_DRIVER, 0)) < 0)
+        return 1;
+    snprintf(env, sizeof(env), "PDSHPY_SERVER=%s", sock);
+    failed = check_driver(env);
+    stop_server(pid);
+    return failed;
+}
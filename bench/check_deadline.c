@@ -0,0 +1,109 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* checks of PDSHPY_CALLBACK_TIMEOUT, with bench/pdshpy_check_deadline.py,
+ * whose collect_hosts() can be made to hang after its first two hosts */
+
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "check.h"
+
+#define CHECK_DEADLINE_DRIVER "pdshpy_check_deadline"
+#define CHECK_DEADLINE_BUDGET "PDSHPY_CALLBACK_TIMEOUT=0.5"
+
+/* how long a run which gives up on collect_hosts() may take, in ms */
+#define CHECK_DEADLINE_MS 3000
+
+/* A collect_hosts() which runs over gives way to the hosts it had found by
+ * then, or to those last cached for its key, however old, with a warning
+ * either way. */
+int
+check_deadline(void)
+{
+    struct run r = {
+        CHECK_DEADLINE_DRIVER, { CHECK_DEADLINE_BUDGET },
+        { { 'S', "10" } }, NULL
+    };
+    struct run cached = {
+        CHECK_DEADLINE_DRIVER,
+        { CHECK_DEADLINE_BUDGET, "PDSHPY_CACHE_TTL=1" },
+        { { 'K', "k" } }, NULL
+    };
+    struct outcome out;
+    int failed;
+
+    failed = run_pdsh(&r, &out) < 0
+        || expect_str("partial hosts", out.collected, "node[1-2]")
+        || expect_int("gave up in time", out.collect_ms < CHECK_DEADLINE_MS,
+                      1)
+        || expect_output("warning", &out, "using the 2 hosts found", 1)
+        || expect_int("postop", out.postop, 0);
+    if (failed)
+    {
+        show_outcome(&out);
+        return failed;
+    }
+
+    /* cached, then expired, then hung */
+    failed = run_pdsh(&cached, &out) < 0
+        || expect_str("all hosts, cached", out.collected, "node[1-3]");
+    sleep(2);
+    cached.opts[1].letter = 'S';
+    cached.opts[1].arg = "10";
+    failed = failed || run_pdsh(&cached, &out) < 0
+        || expect_str("hosts last cached", out.collected, "node[1-3]")
+        || expect_int("gave up in time", out.collect_ms < CHECK_DEADLINE_MS,
+                      1)
+        || expect_output("warning", &out, "using the hosts cached", 1);
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
+
+/* In server mode, the client stops waiting for the server instead, and
+ * having dropped the connection, fails postop rather than let pdsh go on
+ * with hosts the driver hasn't had its say on. */
+int
+check_deadline_server(void)
+{
+    struct run r = {
+        CHECK_DEADLINE_DRIVER, { CHECK_DEADLINE_BUDGET },
+        { { 'S', "10" } }, NULL
+    };
+    char sock[PATH_MAX], env[PATH_MAX + 16];
+    struct outcome out;
+    pid_t pid;
+    int failed;
+
+    if (check_path(sock, sizeof(sock), "sock") < 0
+        || (pid = start_server(sock, r.driver, 0)) < 0)
+        return 1;
+    snprintf(env, sizeof(env), "PDSHPY_SERVER=%s", sock);
+    r.env[1] = env;
+    failed = run_pdsh(&r, &out) < 0
+        || expect_int("gave up in time", out.collect_ms < CHECK_DEADLINE_MS,
+                      1)
+        || expect_output("warning", &out, "did not answer in time", 1)
+        || expect_int("postop fails", out.postop > 0, 1)
+        || expect_output("postop error", &out, "refusing to go on", 1);
+    if (failed)
+        show_outcome(&out);
+    stop_server(pid);
+    return failed;
+}
@@ -0,0 +1,152 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* checks of a driver's filter_hosts() (filter_in_module() in pdshpy.c,
+ * pyhostbatch.c, and HostBatch and filter_batches() in pdshpy/hostlist.py),
+ * through bench/pdshpy_check_filter.py */
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+
+#define CHECK_FILTER_DRIVER "pdshpy_check_filter"
+
+/* One run of the driver: the wcoll it starts with, what the masks should
+ * leave of it, the sizes of the batches it should go through in, and
+ * what's in the output if the mask is refused (else NULL). */
+struct filtering {
+    const char *wcoll;
+    const char *left;
+    const char *batches;
+    const char *refused;
+};
+
+/* the kept hosts of bits[1-10000] */
+static char bits_left[512];
+
+static const struct filtering filterings[] = {
+    { "bytes[1-10]", "bytes[1-2,9]", "10", NULL },
+    { "ff[0-1010]", "ff[1-2,9,500,1001-1002,1009]", "1011", NULL },
+    { "list[1-10]", "list[1-2,9]", "10", NULL },
+    { "none[1-3]", "none[1-3]", "3", NULL },
+    /* one host, and a byte which keeps it, though its low bit is clear */
+    { "one3", "one3", "1", NULL },
+    { "bits[1-10000]", bits_left, "4096,4096,1808", NULL },
+    { "short[1-10]", "short[1-10]", "10", "is not a mask for the batch" },
+    { "text[1-10]", "text[1-10]", "10", "is not a mask for the batch" },
+    /* turned down in the second batch, after the first was decided */
+    { "late[1-5000]", "late[1-5000]", "4096,904",
+      "is not a mask for the batch" },
+    { "fail[1-10]", "fail[1-10]", "10", "filter_hosts() function failed" },
+    { NULL },
+};
+
+/* the first word of the file 'name' in the check's directory, or "" */
+static void
+read_word(const char *name, char *buf, size_t n)
+{
+    char path[PATH_MAX];
+    FILE *f = NULL;
+
+    buf[0] = '\0';
+    if (check_path(path, sizeof(path), name) < 0
+        || (f = fopen(path, "r")) == NULL)
+        return;
+    if (fgets(buf, n, f) == NULL)
+        buf[0] = '\0';
+    buf[strcspn(buf, " \n")] = '\0';
+    fclose(f);
+}
+
+/* what filterings[] says bits[1-10000] comes to */
+static void
+make_bits_left(void)
+{
+    size_t len = 0;
+    int k;
+
+    len = snprintf(bits_left, sizeof(bits_left), "bits[1-2,9,500");
+    for (k = 1; k < 10; k++)
+        len += snprintf(bits_left + len, sizeof(bits_left) - len,
+                        ",%d-%d,%d,%d", k * 1000 + 1, k * 1000 + 2,
+                        k * 1000 + 9, k * 1000 + 500);
+    snprintf(bits_left + len, sizeof(bits_left) - len, "]");
+}
+
+/* Each mask leaves what it says, however many batches it takes; a mask
+ * that's refused, even in a later batch, leaves the wcoll as it was. */
+static int
+check_filterings(const char *env)
+{
+    const struct filtering *f = NULL;
+    struct outcome out;
+    char batches[64], what[64], path[PATH_MAX];
+    int failed = 0, wrong;
+
+    make_bits_left();
+    if (check_path(path, sizeof(path), "batches") < 0)
+        return 1;
+    for (f = filterings; f->wcoll != NULL; f++)
+    {
+        struct run r = { CHECK_FILTER_DRIVER, { env }, { { 0 } }, f->wcoll };
+
+        unlink(path);
+        if (run_pdsh(&r, &out) < 0)
+            return 1;
+        read_word("batches", batches, sizeof(batches));
+        snprintf(what, sizeof(what), "%s left", f->wcoll);
+        wrong = expect_int("finished", out.finished, 1)
+            | expect_str(what, out.wcoll, f->left);
+        snprintf(what, sizeof(what), "%s in batches", f->wcoll);
+        wrong |= expect_str(what, batches, f->batches);
+        snprintf(what, sizeof(what), "%s refused", f->wcoll);
+        wrong |= expect_int(what, out.postop != 0, f->refused != NULL);
+        /* through a server, what goes wrong goes to the server's log */
+        if (f->refused != NULL && env == NULL)
+            wrong |= expect_output(what, &out, f->refused, 1);
+        if (wrong)
+            show_outcome(&out);
+        failed |= wrong;
+    }
+    return failed;
+}
+
+int
+check_filter(void)
+{
+    return check_filterings(NULL);
+}
+
+/* the same through a server, where the batches are pdshpy.hostlist's */
+int
+check_filter_server(void)
+{
+    char sock[PATH_MAX], env[PATH_MAX + 16];
+    pid_t pid;
+    int failed;
+
+    if (check_path(sock, sizeof(sock), "sock") < 0
+        || (pid = start_server(sock, CHECK_FILTER_DRIVER, 0)) < 0)
+        return 1;
+    snprintf(env, sizeof(env), "PDSHPY_SERVER=%s", sock);
+    failed = check_filterings(env);
+    stop_server(pid);
+    return failed;
+}
@@ -0,0 +1,252 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* checks of host databases (hostdb.c, pyhostdb.c and pdshpy/hostdb.py),
+ * compiled by "python -m pdshpy.hostdb compile" from the inventory below,
+ * through hostdb.h and through bench/pdshpy_check_hostdb.py */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "src/common/hostlist.h"
+
+#include "bitmap.h"
+#include "hostdb.h"
+#include "check.h"
+
+#define CHECK_HOSTDB_DRIVER "pdshpy_check_hostdb"
+
+static const char inventory[] =
+    "# written by check_hostdb() in bench/check_hostdb.c\n"
+    "node[01-20]     compute rack=1\n"
+    "node[01-04]     gpu\n"
+    "node03          down\n"
+    "login1          login\n"
+    "gpu[8-10]       gpu rack=2\n"
+    "storage\n";
+
+/* another, compiled over the first while it is still open */
+static const char inventory2[] = "node[1-100] compute\n";
+
+/* Compile 'text' into 'db' in the check's directory. */
+static int
+compile_inventory(const char *text, char *db, size_t n)
+{
+    char path[PATH_MAX];
+    const char *args[] = {
+        "-m", "pdshpy.hostdb", "compile", path, db, NULL
+    };
+    FILE *f = NULL;
+
+    if (check_path(path, sizeof(path), "inventory.txt") < 0
+        || check_path(db, n, "inventory.db") < 0
+        || (f = fopen(path, "w")) == NULL)
+        return -1;
+    fputs(text, f);
+    if (fclose(f) != 0)
+        return -1;
+    return expect_int("compiled", run_python(args), 0) ? -1 : 0;
+}
+
+/* 'hl' as a ranged string, destroying it */
+static const char *
+ranged(hostlist_t hl)
+{
+    static char buf[CHECK_MAX_HOSTS];
+
+    snprintf(buf, sizeof(buf), "(null)");
+    if (hl != NULL)
+    {
+        if (hostlist_ranged_string(hl, sizeof(buf), buf) < 0)
+            snprintf(buf, sizeof(buf), "(too long)");
+        hostlist_destroy(hl);
+    }
+    return buf;
+}
+
+/* the name of the host called 'host', looked up by its ID */
+static const char *
+round_trip(const struct hostdb *db, const char *host)
+{
+    static char name[64];
+    int64_t id = hostdb_host_id(db, host);
+
+    if (id < 0 || hostdb_host_name(db, id, name, sizeof(name)) < 0)
+        return "(none)";
+    return name;
+}
+
+/* the hosts with attribute 'a' and not 'b', through the index */
+static const char *
+and_not(const struct hostdb *db, const char *a, const char *b)
+{
+    struct bitmap *x = hostdb_attr_bitmap(db, hostdb_attr_id(db, a));
+    struct bitmap *y = hostdb_attr_bitmap(db, hostdb_attr_id(db, b));
+    struct bitmap *both = NULL;
+    hostlist_t hl = NULL;
+
+    if (x != NULL && y != NULL && (both = bitmap_andnot(x, y)) != NULL
+        && (hl = hostlist_create(NULL)) != NULL
+        && hostdb_push_bitmap(db, hl, both) < 0)
+    {
+        hostlist_destroy(hl);
+        hl = NULL;
+    }
+    if (x != NULL)
+        bitmap_free(x);
+    if (y != NULL)
+        bitmap_free(y);
+    if (both != NULL)
+        bitmap_free(both);
+    return ranged(hl);
+}
+
+/* The database through hostdb.h: hosts by ID and in ranged form, and
+ * attributes through each host and through the index. Ranged forms are in
+ * ID order, where node10 (unpadded) comes before node01. */
+static int
+check_queries(const struct hostdb *db)
+{
+    int64_t gpu = hostdb_attr_id(db, "gpu");
+
+    return expect_int("hosts", hostdb_nhosts(db), 25)
+        | expect_int("attributes", hostdb_nattrs(db), 6)
+        | expect_str("node05, by its ID", round_trip(db, "node05"), "node05")
+        | expect_str("storage, by its ID", round_trip(db, "storage"),
+                     "storage")
+        | expect_int("node5's ID", hostdb_host_id(db, "node5"), -1)
+        | expect_int("node21's ID", hostdb_host_id(db, "node21"), -1)
+        | expect_int("attribute nothing", hostdb_attr_id(db, "nothing"), -1)
+        | expect_str("first attribute from rack",
+                     hostdb_attr_name(db, hostdb_attr_lower_bound(db,
+                                                                  "rack")),
+                     "rack=1")
+        | expect_int("node03 is down",
+                     hostdb_host_has_attr(db, hostdb_host_id(db, "node03"),
+                                          hostdb_attr_id(db, "down")), 1)
+        | expect_int("node04 is down",
+                     hostdb_host_has_attr(db, hostdb_host_id(db, "node04"),
+                                          hostdb_attr_id(db, "down")), 0)
+        | expect_str("every host", ranged(hostdb_hostlist(db)),
+                     "gpu[8-10],login1,node[10-20],node[01-09],storage")
+        | expect_str("gpu", ranged(gpu < 0 ? NULL
+                                   : hostdb_with_attr(db, gpu)),
+                     "gpu[8-10],node[01-04]")
+        | expect_str("gpu & !down", and_not(db, "gpu", "down"),
+                     "gpu[8-10],node[01-02,04]");
+}
+
+/* A database which is recompiled is replaced, not changed under the feet
+ * of whatever has it open; something that isn't one isn't opened. */
+static int
+check_recompile(const struct hostdb *db, const char *path)
+{
+    char text[PATH_MAX];
+    struct hostdb *db2 = NULL;
+    FILE *f = NULL;
+    int failed;
+
+    if (compile_inventory(inventory2, text, sizeof(text)) < 0)
+        return 1;
+    failed = expect_int("hosts, still", hostdb_nhosts(db), 25)
+        | expect_str("node05, still", round_trip(db, "node05"), "node05");
+    if ((db2 = hostdb_open(path)) == NULL)
+        return expect_int("reopened", 0, 1);
+    failed |= expect_int("hosts, recompiled", hostdb_nhosts(db2), 100);
+    hostdb_close(db2);
+
+    if (check_path(text, sizeof(text), "inventory.txt") < 0
+        || (f = fopen(text, "r")) == NULL)
+        return 1;
+    fclose(f);
+    errno = 0;
+    db2 = hostdb_open(text);
+    failed |= expect_int("opened text", db2 != NULL, 0)
+        | expect_int("errno for text", errno, EINVAL);
+    if (db2 != NULL)
+        hostdb_close(db2);
+    return failed;
+}
+
+/* a run of the driver, reading 'path' */
+static int
+check_driver(const char *env, const char *checked)
+{
+    struct run r = { CHECK_HOSTDB_DRIVER, { env }, { { 0 } }, NULL };
+    char got[64] = "";
+    struct outcome out;
+    FILE *f = NULL;
+    char path[PATH_MAX];
+    int failed;
+
+    if (run_pdsh(&r, &out) < 0)
+        return 1;
+    if (check_path(path, sizeof(path), "checked") == 0
+        && (f = fopen(path, "r")) != NULL)
+    {
+        if (fscanf(f, "%63s", got) != 1)
+            got[0] = '\0';
+        fclose(f);
+    }
+    failed = expect_str("collected", out.collected,
+                        "gpu[8-10],node[01-02,04]")
+        || expect_str("HostDBs checked", got, checked)
+        || expect_int("answers gone wrong", out.postop, 0);
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
+
+int
+check_hostdb(void)
+{
+    char path[PATH_MAX];
+    struct hostdb *db = NULL;
+    int failed;
+
+    if (compile_inventory(inventory, path, sizeof(path)) < 0)
+        return 1;
+    failed = check_driver(NULL, "native,python");
+    if ((db = hostdb_open(path)) == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+    failed |= check_queries(db) | check_recompile(db, path);
+    hostdb_close(db);
+    return failed;
+}
+
+/* the driver through a server, where there's only pdshpy.hostdb's */
+int
+check_hostdb_server(void)
+{
+    char path[PATH_MAX], sock[PATH_MAX], env[PATH_MAX + 16];
+    pid_t pid;
+    int failed;
+
+    if (compile_inventory(inventory, path, sizeof(path)) < 0
+        || check_path(sock, sizeof(sock), "sock") < 0
+        || (pid = start_server(sock, CHECK_HOSTDB_DRIVER, 0)) < 0)
+        return 1;
+    snprintf(env, sizeof(env), "PDSHPY_SERVER=%s", sock);
+    failed = check_driver(env, "python");
+    stop_server(pid);
+    return failed;
+}
@@ -0,0 +1,247 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* checks of host expressions (hostexpr.c, pyhostexpr.c, pdshpy/hostexpr.py
+ * and util.HostExprOption), through hostexpr.h and through
+ * bench/pdshpy_check_hostexpr.py */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "src/common/hostlist.h"
+
+#include "bitmap.h"
+#include "hostdb.h"
+#include "hostexpr.h"
+#include "check.h"
+
+#define CHECK_HOSTEXPR_DRIVER "pdshpy_check_hostexpr"
+
+/* 'text', compiled and evaluated on the hostlist 'hosts', as a ranged
+ * string */
+static const char *
+selected(const char *text, const char *hosts)
+{
+    static char buf[CHECK_MAX_HOSTS];
+    char err[128];
+    struct hostexpr *e = NULL;
+    hostlist_t hl = NULL, got = NULL;
+
+    snprintf(buf, sizeof(buf), "(failed)");
+    if ((e = hostexpr_compile(text, err, sizeof(err))) != NULL
+        && (hl = hostlist_create(hosts)) != NULL
+        && (got = hostexpr_select_hostlist(e, hl)) != NULL
+        && hostlist_ranged_string(got, sizeof(buf), buf) < 0)
+        snprintf(buf, sizeof(buf), "(too long)");
+    if (got != NULL)
+        hostlist_destroy(got);
+    if (hl != NULL)
+        hostlist_destroy(hl);
+    hostexpr_release(e);
+    return buf;
+}
+
+/* 'text' compiled and evaluated on the database at 'path' */
+static const char *
+selected_db(const char *text, const char *path)
+{
+    static char buf[CHECK_MAX_HOSTS];
+    char err[128];
+    struct hostdb *db = NULL;
+    struct hostexpr *e = NULL;
+    struct bitmap *bm = NULL;
+    hostlist_t hl = NULL;
+
+    snprintf(buf, sizeof(buf), "(failed)");
+    if ((db = hostdb_open(path)) != NULL
+        && (e = hostexpr_compile(text, err, sizeof(err))) != NULL
+        && (bm = hostexpr_select_db(e, db)) != NULL
+        && (hl = hostlist_create(NULL)) != NULL
+        && (hostdb_push_bitmap(db, hl, bm) < 0
+            || hostlist_ranged_string(hl, sizeof(buf), buf) < 0))
+        snprintf(buf, sizeof(buf), "(failed)");
+    if (hl != NULL)
+        hostlist_destroy(hl);
+    if (bm != NULL)
+        bitmap_free(bm);
+    hostexpr_release(e);
+    if (db != NULL)
+        hostdb_close(db);
+    return buf;
+}
+
+/* what's wrong with 'text', as hostexpr_compile() puts it, with errno */
+static const char *
+compile_error(const char *text, int *error)
+{
+    static char err[128];
+    struct hostexpr *e = NULL;
+
+    err[0] = '\0';
+    errno = 0;
+    e = hostexpr_compile(text, err, sizeof(err));
+    *error = errno;
+    if (e != NULL)
+    {
+        hostexpr_release(e);
+        return "(compiled)";
+    }
+    return err;
+}
+
+/* A plan is compiled once and looked up after that, until enough others
+ * have been compiled to push it out of the cache; what has it then still
+ * works. */
+static int
+check_plan_cache(void)
+{
+    struct hostexpr *e = NULL, *again = NULL, *other = NULL;
+    char text[32], err[128];
+    int failed, i;
+
+    if ((e = hostexpr_compile("a & b", err, sizeof(err))) == NULL
+        || (again = hostexpr_compile("a & b", err, sizeof(err))) == NULL)
+        return expect_str("compiled a & b", err, "");
+    failed = expect_int("compiled again", again == e, 1);
+    hostexpr_release(again);
+
+    for (i = 0; i < HOSTEXPR_CACHE_SIZE; i++)
+    {
+        snprintf(text, sizeof(text), "n%d", i);
+        if ((other = hostexpr_compile(text, err, sizeof(err))) == NULL)
+            return expect_str(text, err, "");
+        hostexpr_release(other);
+    }
+    if ((again = hostexpr_compile("a & b", err, sizeof(err))) == NULL)
+        return expect_str("compiled a & b after the others", err, "");
+    failed |= expect_int("compiled again after the others", again != e, 1)
+        | expect_str("pushed out", hostexpr_text(e), "a & b")
+        | expect_str("compiled again", hostexpr_text(again), "a & b");
+    hostexpr_release(again);
+    hostexpr_release(e);
+    return failed;
+}
+
+/* hostexpr.h: selecting from hostlists and from the database the driver
+ * compiled, errors, and the cache */
+static int
+check_plans(void)
+{
+    char path[PATH_MAX];
+    int error = 0;
+
+    if (check_path(path, sizeof(path), "hosts.db") < 0)
+        return 1;
+    return expect_str("from a hostlist",
+                      selected("node[1-10] & !(node[3-4] | node9)",
+                               "node[1-12],login1"),
+                      "node[1-2,5-8,10]")
+        | expect_str("nothing from a hostlist",
+                     selected("a & !a", "node[1-12],login1"), "")
+        | expect_str("in the hostlist's order",
+                     selected("*", "node3,login1,node1"),
+                     "node3,login1,node1")
+        | expect_str("from the database",
+                     selected_db("gpu & !down", path),
+                     "gpu[8-10],node[01-02,04]")
+        | expect_str("every host in the database", selected_db("*", path),
+                     "gpu[8-10],login1,node[10-20],node[01-09]")
+        | expect_str("error", compile_error("node[1-", &error),
+                     "unmatched '[' at column 1")
+        | expect_int("errno", error, EINVAL)
+        | expect_str("error at the end", compile_error("a &", &error),
+                     "expression ends too soon at column 4")
+        | check_plan_cache();
+}
+
+/* a run of the driver, with 'args' for -g; nonzero if it went wrong */
+static int
+run_driver(const char *env, const char *arg1, const char *arg2,
+           struct outcome *out)
+{
+    struct run r = {
+        CHECK_HOSTEXPR_DRIVER, { env }, { { 'g', arg1 }, { 'g', arg2 } },
+        NULL
+    };
+
+    return run_pdsh(&r, out) < 0;
+}
+
+/* -g twice compiles two expressions, once each, and selects the hosts both
+ * match; every HostExpr makes the same of the driver's expressions. An
+ * argument which doesn't compile on its own is refused, even where it
+ * would inside parentheses with the others. */
+static int
+check_driver(const char *env, const char *checked)
+{
+    char got[64] = "";
+    struct outcome out;
+    FILE *f = NULL;
+    char path[PATH_MAX];
+    int failed;
+
+    if (run_driver(env, "gpu", "!down", &out))
+        return 1;
+    if (check_path(path, sizeof(path), "checked") == 0
+        && (f = fopen(path, "r")) != NULL)
+    {
+        if (fscanf(f, "%63s", got) != 1)
+            got[0] = '\0';
+        fclose(f);
+    }
+    failed = expect_int("options", out.opt, 0)
+        | expect_str("collected", out.collected, "gpu[8-10],node[01-02,04]")
+        | expect_int("compiled", check_counter("compiled"), 2)
+        | expect_str("HostExprs checked", got, checked)
+        | expect_int("answers gone wrong", out.postop, 0);
+    if (failed)
+        show_outcome(&out);
+    if (failed || run_driver(env, "gpu", "down) | (login1", &out))
+        return 1;
+    /* through a server, what the driver writes goes to the server's log */
+    failed = expect_int("option refused", out.opt != 0, 1)
+        | (env == NULL
+           && expect_output("error", &out, "bad host expression", 1));
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
+
+int
+check_hostexpr(void)
+{
+    return check_driver(NULL, "native,python") || check_plans();
+}
+
+/* the driver through a server, where there's only pdshpy.hostexpr's */
+int
+check_hostexpr_server(void)
+{
+    char sock[PATH_MAX], env[PATH_MAX + 16];
+    pid_t pid;
+    int failed;
+
+    if (check_path(sock, sizeof(sock), "sock") < 0
+        || (pid = start_server(sock, CHECK_HOSTEXPR_DRIVER, 0)) < 0)
+        return 1;
+    snprintf(env, sizeof(env), "PDSHPY_SERVER=%s", sock);
+    failed = check_driver(env, "python");
+    stop_server(pid);
+    return failed;
+}
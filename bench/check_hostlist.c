@@ -0,0 +1,149 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* checks of HostList, the native one (pyhostlist.c) and pdshpy.hostlist's,
+ * as a list and cut into parts, and of drivers chained to work on one,
+ * in-process and through a server, with bench/pdshpy_check_hostlist.py,
+ * bench/pdshpy_check_partition.py and bench/pdshpy_check_chain_*.py */
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+
+#define CHECK_HOSTLIST_DRIVER "pdshpy_check_hostlist"
+#define CHECK_PARTITION_DRIVER "pdshpy_check_partition"
+#define CHECK_CHAIN_DRIVERS "pdshpy_check_chain_a,pdshpy_check_chain_b"
+
+/* the first word of the file 'name' in the check's directory, or "" */
+static void
+read_word(const char *name, char *buf, size_t n)
+{
+    char path[PATH_MAX];
+    FILE *f = NULL;
+
+    buf[0] = '\0';
+    if (check_path(path, sizeof(path), name) < 0
+        || (f = fopen(path, "r")) == NULL)
+        return;
+    if (fgets(buf, n, f) == NULL)
+        buf[0] = '\0';
+    buf[strcspn(buf, " \n")] = '\0';
+    fclose(f);
+}
+
+/* Each HostList does what a list would (see the driver), and the wcoll
+ * changed through one is what pdsh is left with. */
+static int
+check_sequence(const char *env, const char *checked)
+{
+    struct run r = {
+        CHECK_HOSTLIST_DRIVER, { env }, { { 0 } }, "w[1-5]"
+    };
+    char got[64];
+    struct outcome out;
+    int failed;
+
+    if (run_pdsh(&r, &out) < 0)
+        return 1;
+    read_word("checked", got, sizeof(got));
+    failed = expect_str("HostLists checked", got, checked)
+        || expect_int("operations gone wrong", out.postop, 0)
+        || expect_str("wcoll after postop", out.wcoll, "x[1-2],w[4-5]");
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
+
+/* Each HostList cuts lists into the parts slicing would, and samples the
+ * same hosts as the others (see the driver). */
+static int
+check_partition(const char *env, const char *checked)
+{
+    struct run r = {
+        CHECK_PARTITION_DRIVER, { env }, { { 0 } }, "p[1-3]"
+    };
+    char got[64];
+    struct outcome out;
+    int failed;
+
+    if (run_pdsh(&r, &out) < 0)
+        return 1;
+    read_word("partitioned", got, sizeof(got));
+    failed = expect_int("finished", out.finished, 1)
+        || expect_str("HostLists checked", got, checked)
+        || expect_int("answers gone wrong", out.postop, 0);
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
+
+/* Chained drivers' hosts are merged, sorted and without duplicates, and
+ * each postop sees the wcoll as the one before left it. */
+static int
+check_chain(const char *env)
+{
+    struct run r = { CHECK_CHAIN_DRIVERS, { env }, { { 0 } }, NULL };
+    char seen[CHECK_MAX_HOSTS];
+    struct outcome out;
+    int failed;
+
+    failed = run_pdsh(&r, &out) < 0
+        || expect_str("merged", out.collected, "b1,c[1-3]");
+    read_word("seen_by_b", seen, sizeof(seen));
+    failed = failed
+        || expect_str("wcoll the first postop left", seen, "b1,c[1,3]")
+        || expect_int("postop", out.postop, 0)
+        || expect_str("wcoll after postop", out.wcoll, "b1,c3");
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
+
+int
+check_hostlist(void)
+{
+    return check_sequence(NULL, "native,python")
+        || check_partition(NULL, "native,python") || check_chain(NULL);
+}
+
+/* the same, through a server, where there's only pdshpy.hostlist's */
+int
+check_hostlist_server(void)
+{
+    char sock[PATH_MAX], env[PATH_MAX + 16];
+    pid_t pid;
+    int failed;
+
+    if (check_path(sock, sizeof(sock), "sock") < 0)
+        return 1;
+    snprintf(env, sizeof(env), "PDSHPY_SERVER=%s", sock);
+    if ((pid = start_server(sock, CHECK_HOSTLIST_DRIVER, 0)) < 0)
+        return 1;
+    failed = check_sequence(env, "python");
+    stop_server(pid);
+    if (failed || (pid = start_server(sock, CHECK_PARTITION_DRIVER, 0)) < 0)
+        return 1;
+    failed = check_partition(env, "python");
+    stop_server(pid);
+    if (failed || (pid = start_server(sock, CHECK_CHAIN_DRIVERS, 0)) < 0)
+        return 1;
+    failed = check_chain(env);
+    stop_server(pid);
+    return failed;
+}
@@ -0,0 +1,320 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* checks of host patterns (hostpat.c, pyhostpat.c and pdshpy/hostpat.py),
+ * through hostpat.h and through bench/pdshpy_check_hostpat.py */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/common/hostlist.h"
+
+#include "cache.h"
+#include "hostpat.h"
+#include "check.h"
+
+#define CHECK_HOSTPAT_DRIVER "pdshpy_check_hostpat"
+
+#define MAINTENANCE "# comment\nnode[1-10],login1\nrack1*\nre:^gpu\\d+$\n"
+
+/* what the DFA check's patterns are tried on, and which of them match */
+#define SAVED "re:^(ab|ba)+[0-9]$\nn?-ib\nrack[12]*"
+#define SAVED_HOSTS "ab1,abba2,aba3,n1-ib,n12-ib,rack1x,rack3,x,abab"
+#define SAVED_MATCHED "ab1,abba2,n1-ib,rack1x"
+
+/* 'text' compiled, with 'persist', and what's picked from the hostlist
+ * 'hosts', or left of it with 'invert', as a ranged string */
+static const char *
+selected(const char *text, int persist, const char *hosts, int invert)
+{
+    static char buf[CHECK_MAX_HOSTS];
+    char err[128];
+    struct hostpat *p = NULL;
+    hostlist_t hl = NULL, got = NULL;
+
+    snprintf(buf, sizeof(buf), "(failed)");
+    if ((p = hostpat_compile(text, persist, err, sizeof(err))) != NULL
+        && (hl = hostlist_create(hosts)) != NULL
+        && (got = hostpat_select(p, hl, invert)) != NULL
+        && hostlist_ranged_string(got, sizeof(buf), buf) < 0)
+        snprintf(buf, sizeof(buf), "(too long)");
+    if (got != NULL)
+        hostlist_destroy(got);
+    if (hl != NULL)
+        hostlist_destroy(hl);
+    if (p != NULL)
+        hostpat_release(p);
+    return buf;
+}
+
+/* hostpat_match() of each of the ','-separated 'hosts', as a string of
+ * digits */
+static const char *
+matches(const char *text, const char *hosts)
+{
+    static char buf[64];
+    char names[256], err[128];
+    struct hostpat *p = NULL;
+    char *host = NULL, *save = NULL;
+    size_t n = 0;
+
+    snprintf(buf, sizeof(buf), "(failed)");
+    snprintf(names, sizeof(names), "%s", hosts);
+    if ((p = hostpat_compile(text, 0, err, sizeof(err))) == NULL)
+        return buf;
+    for (host = strtok_r(names, ",", &save); host != NULL && n < 63;
+         host = strtok_r(NULL, ",", &save))
+        buf[n++] = '0' + hostpat_match(p, host);
+    buf[n] = '\0';
+    hostpat_release(p);
+    return buf;
+}
+
+/* what's left of the hostlist 'hosts' after taking out what 'text'
+ * matches, and how many that was in 'removed' */
+static const char *
+removed_from(const char *text, const char *hosts, int *removed)
+{
+    static char buf[CHECK_MAX_HOSTS];
+    char err[128];
+    struct hostpat *p = NULL;
+    hostlist_t hl = NULL;
+
+    snprintf(buf, sizeof(buf), "(failed)");
+    *removed = -1;
+    if ((p = hostpat_compile(text, 0, err, sizeof(err))) != NULL
+        && (hl = hostlist_create(hosts)) != NULL
+        && (*removed = hostpat_remove(p, hl)) >= 0
+        && hostlist_ranged_string(hl, sizeof(buf), buf) < 0)
+        snprintf(buf, sizeof(buf), "(too long)");
+    if (hl != NULL)
+        hostlist_destroy(hl);
+    if (p != NULL)
+        hostpat_release(p);
+    return buf;
+}
+
+/* what's wrong with 'text', as hostpat_compile() puts it, with errno */
+static const char *
+compile_error(const char *text, int *error)
+{
+    static char err[128];
+    struct hostpat *p = NULL;
+
+    err[0] = '\0';
+    errno = 0;
+    p = hostpat_compile(text, 0, err, sizeof(err));
+    *error = errno;
+    if (p != NULL)
+    {
+        hostpat_release(p);
+        return "(compiled)";
+    }
+    return err;
+}
+
+/* Compile enough other sets to push everything else out of the cache. */
+static int
+push_out(void)
+{
+    struct hostpat *p = NULL;
+    char text[32], err[128];
+    int i;
+
+    for (i = 0; i < HOSTPAT_CACHE_SIZE; i++)
+    {
+        snprintf(text, sizeof(text), "other%d*", i);
+        if ((p = hostpat_compile(text, 0, err, sizeof(err))) == NULL)
+            return expect_str(text, err, "");
+        hostpat_release(p);
+    }
+    return 0;
+}
+
+/* A set is compiled once and looked up after that, until enough others
+ * have been compiled to push it out of the cache; what has it then still
+ * works. */
+static int
+check_compiled_cache(void)
+{
+    struct hostpat *p = NULL, *again = NULL;
+    char err[128];
+    int failed;
+
+    if ((p = hostpat_compile(MAINTENANCE, 0, err, sizeof(err))) == NULL
+        || (again = hostpat_compile(MAINTENANCE, 0, err,
+                                    sizeof(err))) == NULL)
+        return expect_str("compiled", err, "");
+    failed = expect_int("compiled again", again == p, 1)
+        | expect_int("patterns", hostpat_count(p), 3);
+    hostpat_release(again);
+    if (push_out())
+        return 1;
+    if ((again = hostpat_compile(MAINTENANCE, 0, err, sizeof(err))) == NULL)
+        return expect_str("compiled after the others", err, "");
+    failed |= expect_int("compiled again after the others", again != p, 1)
+        | expect_str("pushed out", hostpat_text(p), MAINTENANCE)
+        | expect_int("pushed out still matches", hostpat_match(p, "node7"),
+                     1);
+    hostpat_release(again);
+    hostpat_release(p);
+    return failed;
+}
+
+/* With 'persist', the DFA a set makes is saved in the cache directory, and
+ * the next time the set is compiled it starts from that, matching as it
+ * did; what's saved is ignored if it doesn't check out. */
+static int
+check_saved(void)
+{
+    static const char garbage[] = "not a DFA at all";
+    char *saved = NULL;
+    size_t len = 0;
+    int failed;
+
+    failed = expect_str("nothing saved yet",
+                        (saved = cache_get("hostpat", SAVED, &len)) == NULL
+                        ? "" : "saved", "")
+        | expect_str("selected to save", selected(SAVED, 1, SAVED_HOSTS, 0),
+                     SAVED_MATCHED);
+    free(saved);
+    if ((saved = cache_get("hostpat", SAVED, &len)) == NULL)
+        return expect_str("saved", "nothing", "the DFA");
+
+    if (push_out())
+        failed = 1;
+    else
+        failed |= expect_str("selected from what was saved",
+                             selected(SAVED, 1, SAVED_HOSTS, 0),
+                             SAVED_MATCHED);
+
+    /* half of it, then something else altogether */
+    if (cache_put("hostpat", SAVED, saved, len / 2) < 0 || push_out())
+        failed = 1;
+    else
+        failed |= expect_str("selected after half was saved",
+                             selected(SAVED, 1, SAVED_HOSTS, 0),
+                             SAVED_MATCHED);
+    if (cache_put("hostpat", SAVED, garbage, sizeof(garbage)) < 0
+        || push_out())
+        failed = 1;
+    else
+        failed |= expect_str("selected after garbage was saved",
+                             selected(SAVED, 1, SAVED_HOSTS, 0),
+                             SAVED_MATCHED);
+    free(saved);
+    return failed;
+}
+
+/* hostpat.h: matching, selecting and removing, errors, and caching */
+static int
+check_patterns(void)
+{
+    int removed = 0, error = 0;
+
+    return expect_str("matches",
+                      matches(MAINTENANCE,
+                              "node7,node11,rack12,gpu12,gpu12x,login1"),
+                      "101101")
+        | expect_str("selected", selected(MAINTENANCE, 0,
+                                          "node[9-12],rack1a,gpu3,other",
+                                          0),
+                     "node[9-10],rack1a,gpu3")
+        | expect_str("selected, inverted",
+                     selected(MAINTENANCE, 0,
+                              "other,node[9-12],rack1a,gpu3", 1),
+                     "other,node[11-12]")
+        | expect_str("left", removed_from(MAINTENANCE,
+                                          "node[9-12],rack1a,gpu3,other",
+                                          &removed),
+                     "node[11-12],other")
+        | expect_int("removed", removed, 4)
+        | expect_str("only comments", matches("# none\n\n", "node1"), "0")
+        | expect_str("error", compile_error("re:(a", &error),
+                     "line 1 ('re:(a'): missing ), unterminated subpattern")
+        | expect_int("errno", error, EINVAL)
+        | expect_str("not a DFA", compile_error("re:(a)\\1", &error),
+                     "line 1 ('re:(a)\\1'): group references and octal "
+                     "escapes aren't supported")
+        | expect_int("errno for a backreference", error, EINVAL)
+        | check_compiled_cache()
+        | check_saved();
+}
+
+/* a run of the driver; nonzero if it couldn't be run */
+static int
+run_driver(const char *env, struct outcome *out)
+{
+    struct run r = { CHECK_HOSTPAT_DRIVER, { env }, { { 0, NULL } }, NULL };
+
+    return run_pdsh(&r, out) < 0;
+}
+
+/* Every HostPatterns makes the same of the driver's pattern sets, and
+ * util.HostPatterns takes the maintenance list out of pdsh's wcoll. */
+static int
+check_driver(const char *env, const char *checked)
+{
+    char got[64] = "";
+    struct outcome out;
+    FILE *f = NULL;
+    char path[PATH_MAX];
+    int failed;
+
+    if (run_driver(env, &out))
+        return 1;
+    if (check_path(path, sizeof(path), "checked") == 0
+        && (f = fopen(path, "r")) != NULL)
+    {
+        if (fscanf(f, "%63s", got) != 1)
+            got[0] = '\0';
+        fclose(f);
+    }
+    failed = expect_int("finished", out.finished, 1)
+        | expect_str("HostPatterns checked", got, checked)
+        | expect_int("answers gone wrong", out.postop, 0)
+        | expect_str("wcoll", out.wcoll, "node[11-12],other");
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
+
+int
+check_hostpat(void)
+{
+    return check_driver(NULL, "native,python") | check_patterns();
+}
+
+/* the driver through a server, where there's only pdshpy.hostpat's */
+int
+check_hostpat_server(void)
+{
+    char sock[PATH_MAX], env[PATH_MAX + 16];
+    pid_t pid;
+    int failed;
+
+    if (check_path(sock, sizeof(sock), "sock") < 0
+        || (pid = start_server(sock, CHECK_HOSTPAT_DRIVER, 0)) < 0)
+        return 1;
+    snprintf(env, sizeof(env), "PDSHPY_SERVER=%s", sock);
+    failed = check_driver(env, "python");
+    stop_server(pid);
+    return failed;
+}
@@ -0,0 +1,109 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* checks of chained drivers in subinterpreters (PDSHPY_SUBINTERPRETERS),
+ * and of hosts given as bytes, with bench/pdshpy_check_interp_[ab].py */
+
+#include <limits.h>
+#include <stdio.h>
+
+#include "check.h"
+
+#define CHECK_INTERP_DRIVERS "pdshpy_check_interp_a,pdshpy_check_interp_b"
+#define CHECK_INTERP_HOSTS "byt[1-2],hold_a,hold_b,str1"
+
+/* Each driver's host source holds its GIL for half a second, after a fifth
+ * of one: 1.2 seconds if they share one, 0.7 if they don't. */
+#define CHECK_SHARED_GIL_MS 1100
+#define CHECK_OWN_GIL_MS 1000
+
+/* nonzero if the Python pdshpy runs with has subinterpreters */
+static int
+has_subinterpreters(void)
+{
+    const char *const args[] = {
+        "-c", "import sys; sys.exit(sys.version_info < (3, 12))", NULL
+    };
+
+    return run_python(args) == 0;
+}
+
+/* The chain's hosts, bytes as UTF-8 rather than as "b'byt1'", and whether
+ * the drivers shared an interpreter; its outcome in 'out'. */
+static int
+run_chain(const char *env, int shared, struct outcome *out)
+{
+    struct run r = { CHECK_INTERP_DRIVERS, { env }, { { 0 } }, NULL };
+    int failed;
+
+    failed = run_pdsh(&r, out) < 0
+        || expect_str("collected", out->collected, CHECK_INTERP_HOSTS)
+        || expect_int("pdshpy.util shared", check_counter("shared_util"),
+                      shared);
+    if (failed)
+        show_outcome(out);
+    return failed;
+}
+
+/* Drivers share an interpreter, and so a GIL, unless asked not to; then
+ * the second one's host source runs alongside the first one's. */
+int
+check_interp(void)
+{
+    struct outcome out;
+
+    if (run_chain(NULL, 1, &out))
+        return 1;
+    if (expect_int("host sources one after another, with one GIL",
+                   out.collect_ms >= CHECK_SHARED_GIL_MS, 1))
+    {
+        show_outcome(&out);
+        return 1;
+    }
+    if (!has_subinterpreters())
+    {
+        printf("  no subinterpreters in %s; only checked drivers sharing "
+               "one\n", check_python());
+        return 0;
+    }
+    if (run_chain("PDSHPY_SUBINTERPRETERS=1", 0, &out)
+        || expect_int("host sources side by side, with a GIL each",
+                      out.collect_ms < CHECK_OWN_GIL_MS, 1))
+    {
+        show_outcome(&out);
+        return 1;
+    }
+    return 0;
+}
+
+/* A server takes hosts as bytes the same way. */
+int
+check_interp_server(void)
+{
+    char sock[PATH_MAX], env[PATH_MAX + 16];
+    struct outcome out;
+    pid_t pid;
+    int failed;
+
+    if (check_path(sock, sizeof(sock), "sock") < 0
+        || (pid = start_server(sock, CHECK_INTERP_DRIVERS, 0)) < 0)
+        return 1;
+    snprintf(env, sizeof(env), "PDSHPY_SERVER=%s", sock);
+    failed = run_chain(env, 1, &out);
+    stop_server(pid);
+    return failed;
+}
@@ -0,0 +1,178 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* checks of the liveness pre-check (liveness.c), against a port listening
+ * on the loopback address and one which isn't */
+
+/* for RTLD_NEXT */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <dlfcn.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "liveness.h"
+#include "metrics.h"
+#include "check.h"
+
+#define CHECK_UP_HOST "127.0.0.1"
+#define CHECK_DOWN_HOST "127.0.0.2"
+
+/* names in this domain take CHECK_SLOW_LOOKUP_MS to come to nothing, as if
+ * the DNS server weren't answering (see getaddrinfo() below) */
+#define CHECK_SLOW_DOMAIN ".slow.invalid"
+#define CHECK_SLOW_LOOKUP_MS 1000
+#define CHECK_SLOW_HOSTS 40
+
+/* Stands in for the C library's, for the lookups liveness.c does, and
+ * hands everything but CHECK_SLOW_DOMAIN on to it. */
+int
+getaddrinfo(const char *node, const char *service,
+            const struct addrinfo *hints, struct addrinfo **res)
+{
+    int (*real)(const char *, const char *, const struct addrinfo *,
+                struct addrinfo **) = NULL;
+    size_t len = node != NULL ? strlen(node) : 0;
+    size_t dlen = strlen(CHECK_SLOW_DOMAIN);
+
+    if (len > dlen && strcmp(node + len - dlen, CHECK_SLOW_DOMAIN) == 0)
+    {
+        usleep(CHECK_SLOW_LOOKUP_MS * 1000);
+        return EAI_AGAIN;
+    }
+    *(void **)&real = dlsym(RTLD_NEXT, "getaddrinfo");
+    return real != NULL ? real(node, service, hints, res) : EAI_SYSTEM;
+}
+
+/* Listen on an ephemeral port on CHECK_UP_HOST, returning the socket and
+ * setting *port; -1 if that can't be done. */
+static int
+listen_local(int *port)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd;
+
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(CHECK_UP_HOST);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+        || listen(fd, 16) < 0
+        || getsockname(fd, (struct sockaddr *)&addr, &len) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static int
+check_states(int port)
+{
+    char *hosts[] = { CHECK_UP_HOST, CHECK_DOWN_HOST };
+    unsigned char state[2];
+    int up;
+
+    up = liveness_check(hosts, 2, port, LIVENESS_DEFAULT_TIMEOUT, state);
+    return expect_int("hosts up", up, 1)
+        | expect_str(CHECK_UP_HOST, liveness_describe(state[0]),
+                     liveness_describe(LIVENESS_UP))
+        | expect_str(CHECK_DOWN_HOST, liveness_describe(state[1]),
+                     liveness_describe(LIVENESS_REFUSED));
+}
+
+/* Lookups which hang take no more than the timeout between them, rather
+ * than each its own: CHECK_SLOW_HOSTS of them would take 40 seconds one
+ * after another. Names which can be looked up still are. */
+static int
+check_slow_lookups(int port)
+{
+    char *hosts[CHECK_SLOW_HOSTS + 2];
+    unsigned char state[CHECK_SLOW_HOSTS + 2];
+    char names[CHECK_SLOW_HOSTS][32];
+    int timeout_ms = 300;
+    double ms;
+    uint64_t start;
+    int i, unresolved = 0, up;
+
+    hosts[0] = CHECK_UP_HOST;
+    hosts[1] = "localhost";
+    for (i = 0; i < CHECK_SLOW_HOSTS; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "node%d" CHECK_SLOW_DOMAIN, i);
+        hosts[i + 2] = names[i];
+    }
+    start = metrics_now();
+    up = liveness_check(hosts, CHECK_SLOW_HOSTS + 2, port, timeout_ms, state);
+    ms = (metrics_now() - start) / 1e6;
+    for (i = 0; i < CHECK_SLOW_HOSTS; i++)
+        unresolved += state[i + 2] == LIVENESS_UNRESOLVED;
+    return expect_int("hosts up, with slow lookups", up, 2)
+        | expect_int("slow lookups unresolved", unresolved, CHECK_SLOW_HOSTS)
+        | expect_int("done within the timeout, and then some",
+                     ms < timeout_ms + 500, 1);
+}
+
+/* the whole module, as pdsh would run it, with PDSHPY_LIVENESS=remove */
+static int
+check_postop(int port)
+{
+    struct run r = {
+        "pdshpy_bench",
+        { PDSHPY_ENVIRON_LIVENESS "=remove" },
+        { { 0 } },
+        CHECK_UP_HOST "," CHECK_DOWN_HOST
+    };
+    struct outcome out;
+    char env[64];
+    int failed;
+
+    snprintf(env, sizeof(env), "%s=%d", PDSHPY_ENVIRON_LIVENESS_PORT, port);
+    r.env[1] = env;
+    if (run_pdsh(&r, &out) < 0)
+        return 1;
+    failed = expect_int("postop", out.postop, 0)
+        | expect_str("wcoll after postop", out.wcoll, CHECK_UP_HOST)
+        | expect_output("report", &out, "left out: " CHECK_DOWN_HOST, 1);
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
+
+int
+check_liveness(void)
+{
+    int fd, port, failed;
+
+    if ((fd = listen_local(&port)) < 0)
+    {
+        perror("check: can't listen on " CHECK_UP_HOST);
+        return 1;
+    }
+    failed = check_states(port) | check_slow_lookups(port)
+        | check_postop(port);
+    close(fd);
+    return failed;
+}
@@ -0,0 +1,65 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* checks of prefetch_hosts(), with bench/pdshpy_check_prefetch.py, whose
+ * prefetch finds pf[1-2] and whose collect_hosts() finds col1 */
+
+#include <stdio.h>
+
+#include "check.h"
+
+#define CHECK_PREFETCH_DRIVER "pdshpy_check_prefetch"
+
+/* The prefetch's hosts are used instead of calling collect_hosts(), unless
+ * an option cancels it or it fails. */
+int
+check_prefetch(void)
+{
+    struct run r = { CHECK_PREFETCH_DRIVER, { NULL }, { { 0 } }, NULL };
+    struct outcome out;
+    int failed;
+
+    failed = run_pdsh(&r, &out) < 0
+        || expect_str("prefetched", out.collected, "pf[1-2]")
+        || expect_int("collections", check_counter("collections"), 0)
+        || expect_int("prefetches", check_counter("prefetches"), 1);
+    if (failed)
+    {
+        show_outcome(&out);
+        return failed;
+    }
+
+    r.opts[0].letter = 'X';
+    failed = run_pdsh(&r, &out) < 0
+        || expect_str("cancelled", out.collected, "col1")
+        || expect_int("collections", check_counter("collections"), 1);
+    if (failed)
+    {
+        show_outcome(&out);
+        return failed;
+    }
+
+    r.opts[0].letter = 0;
+    r.env[0] = "PDSHPY_CHECK_FAIL=1";
+    failed = run_pdsh(&r, &out) < 0
+        || expect_str("prefetch failed", out.collected, "col1")
+        || expect_output("error", &out, "prefetch failed, as asked", 1)
+        || expect_int("collections", check_counter("collections"), 2);
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
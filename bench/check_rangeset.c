@@ -0,0 +1,371 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* checks of host range sets (rangeset.c), with pdsh's own hostlist and
+ * hostset as the reference where the check is built with them (see
+ * PDSH_SRC in the Makefile) */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/common/hostlist.h"
+
+#include "rangeset.h"
+#include "check.h"
+
+/* how many made-up lists to compare on */
+#define CHECK_RANGESET_ROUNDS 300
+
+/* every host the made-up lists can have, and more */
+#define CHECK_RANGESET_HOSTS \
+    "n,login,n[0-60],n[00-60],n[000-060],node[0-60],node[00-60]," \
+    "r[0-200],r[00-60],r1n[0-60],r1n[00-60]"
+
+/* 'rs' as a ranged string */
+static const char *
+ranged(const struct rangeset *rs)
+{
+    static char buf[CHECK_MAX_HOSTS];
+    char *s = rs != NULL ? rangeset_ranged(rs) : NULL;
+
+    snprintf(buf, sizeof(buf), "%s", s != NULL ? s : "(null)");
+    free(s);
+    return buf;
+}
+
+/* The sets from the old stand-alone check: counts, the sets themselves,
+ * and lookups, which need no hostlist. */
+static int
+check_fixed(void)
+{
+    struct rangeset *a = rangeset_parse("node[01-10],login1", 0);
+    struct rangeset *b = rangeset_parse("node0[5-9],node[10-12]", 0);
+    struct rangeset *both = NULL, *either = NULL, *only_a = NULL;
+    int failed;
+
+    if (a == NULL || b == NULL)
+        return expect_int("parsed", 0, 1);
+    both = rangeset_intersect(a, b);
+    either = rangeset_union(a, b);
+    only_a = rangeset_difference(a, b);
+    failed = expect_int("hosts in a", rangeset_count(a), 11)
+        | expect_int("in both", rangeset_count(both), 6)
+        | expect_str("both", ranged(both), "node[05-10]")
+        | expect_int("in either", rangeset_count(either), 13)
+        | expect_str("either", ranged(either), "login1,node[01-12]")
+        | expect_int("only in a", rangeset_count(only_a), 5)
+        | expect_str("only in a", ranged(only_a), "login1,node[01-04]")
+        | expect_int("node05 in a", rangeset_contains(a, "node05"), 1)
+        | expect_int("node5 in a", rangeset_contains(a, "node5"), 0)
+        | expect_int("node11 in a", rangeset_contains(a, "node11"), 0)
+        | expect_int("login1 in a", rangeset_contains(a, "login1"), 1)
+        | expect_int("login in a", rangeset_contains(a, "login"), 0);
+    rangeset_free(a);
+    rangeset_free(b);
+    rangeset_free(both);
+    rangeset_free(either);
+    rangeset_free(only_a);
+
+    a = rangeset_parse("node[8-12],node[09-10]", 0);
+    /* node10 is the same host either way it's written */
+    failed |= expect_str("numbers of each width",
+                         ranged(a), "node[8-9,09-12]")
+        | expect_int("hosts of each width", rangeset_count(a), 6);
+    rangeset_free(a);
+    a = rangeset_parse("node[1-", 0);
+    failed |= expect_int("bad list", a == NULL, 1);
+    rangeset_free(a);
+    return failed;
+}
+
+#ifdef CHECK_PDSH_HOSTLIST
+
+/* what make_list() makes lists of */
+static const char *const prefixes[] = { "n", "node", "r1n", "r", "r1" };
+static const int widths[] = { 0, 0, 2, 3 };
+
+static uint64_t rand_state = 88172645463325252ULL;
+
+/* xorshift64: the same lists every time */
+static unsigned
+next_rand(unsigned n)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+    return (unsigned)(rand_state % n);
+}
+
+/* a number for a list made up by make_list(), zero-padded to 'width' */
+static int
+put_number(char *buf, size_t n, unsigned num, int width)
+{
+    return snprintf(buf, n, "%0*u", width, num);
+}
+
+/* A made-up ranged list, of plain names, single hosts, and ranges which
+ * overlap each other, meet, and go across a change in the number of
+ * digits; some with a prefix ending in digits, and some zero-padded. */
+static void
+make_list(char *buf, size_t n)
+{
+    size_t len = 0;
+    int pieces = 1 + next_rand(4), i, j, spans, width;
+    unsigned lo, hi;
+    const char *prefix = NULL;
+
+    buf[0] = '\0';
+    for (i = 0; i < pieces && len < n; i++)
+    {
+        if (i > 0)
+            len += snprintf(buf + len, n - len, ",");
+        prefix = prefixes[next_rand(5)];
+        width = widths[next_rand(4)];
+        switch (next_rand(4))
+        {
+        case 0:
+            len += snprintf(buf + len, n - len, "%s",
+                            next_rand(2) ? "login" : "n");
+            break;
+        case 1:
+            len += snprintf(buf + len, n - len, "%s", prefix);
+            len += put_number(buf + len, n - len, next_rand(61), width);
+            break;
+        default:
+            len += snprintf(buf + len, n - len, "%s[", prefix);
+            spans = 1 + next_rand(3);
+            for (j = 0; j < spans; j++)
+            {
+                lo = next_rand(50);
+                hi = lo + next_rand(15);
+                len += snprintf(buf + len, n - len, j > 0 ? "," : "");
+                len += put_number(buf + len, n - len, lo, width);
+                if (hi > lo)
+                {
+                    len += snprintf(buf + len, n - len, "-");
+                    len += put_number(buf + len, n - len, hi, width);
+                }
+            }
+            len += snprintf(buf + len, n - len, "]");
+        }
+    }
+}
+
+/* Whether 'rs' has the same hosts as 'set', which is destroyed: as many,
+ * and all of its in 'set'. Ranged strings aren't compared, as there's more
+ * than one way to write the same hosts. */
+static int
+expect_same(const char *what, const struct rangeset *rs, hostset_t set)
+{
+    char want[CHECK_MAX_HOSTS];
+    char *got = rangeset_ranged(rs);
+    int failed = 1;
+
+    if (got != NULL && set != NULL)
+    {
+        failed = rangeset_count(rs) != (uint64_t)hostset_count(set)
+            || !hostset_within(set, got);
+        if (failed && hostset_ranged_string(set, sizeof(want), want) >= 0)
+            printf("  %s: \"%s\", wanted \"%s\"\n", what, got, want);
+    }
+    free(got);
+    if (set != NULL)
+        hostset_destroy(set);
+    return failed;
+}
+
+/* the hosts in both 'a' and 'b', by pdsh */
+static hostset_t
+hostset_intersect(const char *a, const char *b)
+{
+    hostset_t set_b = hostset_create(b), both = hostset_create(NULL);
+    hostlist_t hl = hostlist_create(a);
+    hostlist_iterator_t it = NULL;
+    char *name = NULL;
+
+    if (set_b != NULL && both != NULL && hl != NULL
+        && (it = hostlist_iterator_create(hl)) != NULL)
+    {
+        while ((name = hostlist_next(it)) != NULL)
+        {
+            if (hostset_within(set_b, name))
+                hostset_insert(both, name);
+            free(name);
+        }
+        hostlist_iterator_destroy(it);
+    }
+    if (hl != NULL)
+        hostlist_destroy(hl);
+    if (set_b != NULL)
+        hostset_destroy(set_b);
+    return both;
+}
+
+/* Set operations on two lists, as rangesets and as pdsh's hostsets. */
+static int
+compare_sets(const char *a, const char *b)
+{
+    struct rangeset *ra = rangeset_parse(a, 0);
+    struct rangeset *rb = rangeset_parse(b, 0);
+    struct rangeset *either = NULL, *both = NULL, *only_a = NULL;
+    hostset_t set = NULL;
+    int failed;
+
+    if (ra == NULL || rb == NULL)
+        return expect_int("parsed", 0, 1);
+    either = rangeset_union(ra, rb);
+    both = rangeset_intersect(ra, rb);
+    only_a = rangeset_difference(ra, rb);
+
+    failed = expect_same("set", ra, hostset_create(a));
+    if ((set = hostset_create(a)) != NULL)
+        hostset_insert(set, b);
+    failed |= expect_same("union", either, set);
+    failed |= expect_same("intersection", both, hostset_intersect(a, b));
+    if ((set = hostset_create(a)) != NULL)
+        hostset_delete(set, b);
+    failed |= expect_same("difference", only_a, set);
+
+    rangeset_free(ra);
+    rangeset_free(rb);
+    rangeset_free(either);
+    rangeset_free(both);
+    rangeset_free(only_a);
+    return failed;
+}
+
+/* Lookups of every host the lists could have, and then some. */
+static int
+compare_lookups(const char *a)
+{
+    struct rangeset *rs = rangeset_parse(a, 0);
+    hostset_t set = hostset_create(a);
+    hostlist_t every = hostlist_create(CHECK_RANGESET_HOSTS);
+    hostlist_iterator_t it = NULL;
+    char *name = NULL;
+    int failed = 0;
+
+    if (rs == NULL || set == NULL || every == NULL
+        || (it = hostlist_iterator_create(every)) == NULL)
+        failed = expect_int("parsed", 0, 1);
+    while (!failed && (name = hostlist_next(it)) != NULL)
+    {
+        failed = expect_int(name, rangeset_contains(rs, name) != 0,
+                            hostset_within(set, name) != 0);
+        free(name);
+    }
+    if (it != NULL)
+        hostlist_iterator_destroy(it);
+    if (every != NULL)
+        hostlist_destroy(every);
+    if (set != NULL)
+        hostset_destroy(set);
+    rangeset_free(rs);
+    return failed;
+}
+
+/* hostlist's string of the hosts in 'hl', one by one, which is destroyed */
+static const char *
+listed(hostlist_t hl, char *buf, size_t n)
+{
+    snprintf(buf, n, "(null)");
+    if (hl != NULL)
+    {
+        if (hostlist_deranged_string(hl, n, buf) < 0)
+            snprintf(buf, n, "(too long)");
+        hostlist_destroy(hl);
+    }
+    return buf;
+}
+
+/* A list kept in order, as it is and in slices, against pdsh's hostlist
+ * of the same. */
+static int
+compare_order(const char *a)
+{
+    struct rangeset *rs = rangeset_parse(a, 1);
+    hostlist_t hl = hostlist_create(a), want = NULL;
+    char got_s[CHECK_MAX_HOSTS], want_s[CHECK_MAX_HOSTS];
+    uint64_t start, step, count, i;
+    char *name = NULL;
+    int failed;
+
+    if (rs == NULL || hl == NULL)
+        return expect_int("parsed in order", 0, 1);
+    failed = expect_int("count in order", rangeset_count(rs),
+                        hostlist_count(hl))
+        | expect_str("in order", listed(rangeset_hostlist(rs), got_s,
+                                        sizeof(got_s)),
+                     listed(hostlist_copy(hl), want_s, sizeof(want_s)));
+
+    start = next_rand(hostlist_count(hl) + 2);
+    step = 1 + next_rand(4);
+    count = next_rand(hostlist_count(hl) + 2);
+    want = hostlist_create(NULL);
+    for (i = 0; i < count; i++)
+    {
+        if ((name = hostlist_nth(hl, (int)(start + i * step))) == NULL)
+            break;
+        hostlist_push_host(want, name);
+        free(name);
+    }
+    failed |= expect_str("slice", listed(rangeset_slice(rs, start, step,
+                                                       count),
+                                         got_s, sizeof(got_s)),
+                         listed(want, want_s, sizeof(want_s)));
+    hostlist_destroy(hl);
+    rangeset_free(rs);
+    return failed;
+}
+
+/* Made-up lists, compared with what pdsh makes of them. */
+static int
+check_against_pdsh(void)
+{
+    char a[512], b[512];
+    int i;
+
+    for (i = 0; i < CHECK_RANGESET_ROUNDS; i++)
+    {
+        make_list(a, sizeof(a));
+        make_list(b, sizeof(b));
+        if (compare_sets(a, b) | compare_lookups(a) | compare_order(a))
+        {
+            printf("  with a = \"%s\", b = \"%s\"\n", a, b);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#endif /* CHECK_PDSH_HOSTLIST */
+
+int
+check_rangeset(void)
+{
+    if (check_fixed())
+        return 1;
+#ifdef CHECK_PDSH_HOSTLIST
+    return check_against_pdsh();
+#else
+    printf("  built with the stand-in hostlist; build with pdsh's to "
+           "compare with it\n  (make check PDSH_SRC=<pdsh source>)\n");
+    return 0;
+#endif
+}
@@ -0,0 +1,321 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* checks of server mode (pdshpy/server.py, client.c), with
+ * bench/pdshpy_check_server.py loaded in a server listening on a socket in
+ * the check's directory */
+
+/* for struct ucred */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "check.h"
+
+#define CHECK_SERVER_DRIVER "pdshpy_check_server"
+
+/* how many runs to have going at once */
+#define CHECK_RUNS 3
+
+/* the driver check_fork_server() writes into the check's directory, to
+ * change under the server's feet: each run's hosts say which version of it
+ * they came from and how many runs it has seen */
+#define CHECK_FORK_DRIVER "pdshpy_check_fork"
+static const char fork_driver[] =
+    "# written by check_fork_server() in bench/check_server.c\n"
+    "VERSION = %d\n"
+    "runs = []\n"
+    "\n"
+    "def collect_hosts(pdshopt, session):\n"
+    "    runs.append(1)\n"
+    "    return ['v%%d-run%%d' %% (VERSION, len(runs))]\n"
+    "\n"
+    "def perform_postop(pdshopt, session):\n"
+    "    return 0\n";
+
+/* the socket in the check's directory, and PDSHPY_SERVER naming it */
+static int
+server_paths(char *sock, size_t n, char *env, size_t envn)
+{
+    if (check_path(sock, n, "sock") < 0)
+        return -1;
+    snprintf(env, envn, "PDSHPY_SERVER=%s", sock);
+    return 0;
+}
+
+/* A run through the server: the option callback, collect_hosts() and
+ * perform_postop() all run there, and what they do comes back. With the
+ * server gone, the next run loads the driver itself. */
+int
+check_server(void)
+{
+    struct run r = {
+        CHECK_SERVER_DRIVER, { NULL }, { { 'P', "srv" } }, NULL
+    };
+    char sock[PATH_MAX], env[PATH_MAX + 16];
+    struct outcome out;
+    pid_t pid;
+    int failed;
+
+    if (server_paths(sock, sizeof(sock), env, sizeof(env)) < 0
+        || (pid = start_server(sock, r.driver, 0)) < 0)
+        return 1;
+    r.env[0] = env;
+    if (run_pdsh(&r, &out) < 0)
+    {
+        stop_server(pid);
+        return 1;
+    }
+    failed = expect_int("postop", out.postop, 0)
+        | expect_str("collected", out.collected, "srv[1-3]")
+        | expect_str("wcoll after postop", out.wcoll, "srv[2-3]")
+        | expect_int("collected by the server", check_counter("collect_pid"),
+                     pid);
+    stop_server(pid);
+    if (failed)
+        show_outcome(&out);
+
+    if (run_pdsh(&r, &out) < 0)
+        return 1;
+    if (expect_str("collected without a server", out.collected, "srv[1-3]")
+        | expect_int("collected in-process",
+                     check_counter("collect_pid") != pid, 1))
+    {
+        show_outcome(&out);
+        failed = 1;
+    }
+    return failed;
+}
+
+/* CHECK_RUNS runs through the server at once, each taking a while in
+ * collect_hosts(); how many of them went wrong */
+static int
+concurrent_runs(const char *env)
+{
+    struct run r = {
+        CHECK_SERVER_DRIVER, { env }, { { 'S', "0.5" } }, NULL
+    };
+    struct outcome out;
+    pid_t pids[CHECK_RUNS];
+    int i, status, wrong = 0;
+
+    fflush(stdout);
+    for (i = 0; i < CHECK_RUNS; i++)
+    {
+        if ((pids[i] = fork()) < 0)
+            return CHECK_RUNS;
+        if (pids[i] > 0)
+            continue;
+        if (run_pdsh(&r, &out) < 0 || out.postop != 0
+            || strcmp(out.wcoll, "node[2-3]") != 0)
+        {
+            show_outcome(&out);
+            _exit(1);
+        }
+        _exit(0);
+    }
+    for (i = 0; i < CHECK_RUNS; i++)
+        if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0)
+            wrong++;
+    return wrong;
+}
+
+/* Runs take turns in a driver's callbacks, unless it's threadsafe. */
+int
+check_server_turns(void)
+{
+    char sock[PATH_MAX], env[PATH_MAX + 16];
+    pid_t pid;
+    int failed;
+
+    if (server_paths(sock, sizeof(sock), env, sizeof(env)) < 0
+        || (pid = start_server(sock, CHECK_SERVER_DRIVER, 0)) < 0)
+        return 1;
+    failed = expect_int("runs gone wrong", concurrent_runs(env), 0)
+        | expect_int("most runs in collect_hosts at once",
+                     check_counter("most_inside"), 1);
+    stop_server(pid);
+
+    setenv("PDSHPY_CHECK_THREADSAFE", "1", 1);
+    pid = start_server(sock, CHECK_SERVER_DRIVER, 0);
+    unsetenv("PDSHPY_CHECK_THREADSAFE");
+    if (pid < 0)
+        return 1;
+    failed |= expect_int("runs gone wrong, threadsafe", concurrent_runs(env),
+                         0)
+        | expect_int("runs in collect_hosts side by side, threadsafe",
+                     check_counter("most_inside") > 1, 1);
+    stop_server(pid);
+    return failed;
+}
+
+/* Write version 'version' of the fork check's driver, dated 'when'. */
+static int
+write_fork_driver(int version, time_t when)
+{
+    char path[PATH_MAX];
+    struct timeval times[2];
+    FILE *f = NULL;
+
+    if (check_path(path, sizeof(path), CHECK_FORK_DRIVER ".py") < 0
+        || (f = fopen(path, "w")) == NULL)
+        return -1;
+    fprintf(f, fork_driver, version);
+    if (fclose(f) != 0)
+        return -1;
+    times[0].tv_sec = times[1].tv_sec = when;
+    times[0].tv_usec = times[1].tv_usec = 0;
+    return utimes(path, times);
+}
+
+/* With --fork, each run starts from the driver as initialize() left it,
+ * not as the run before left it, and a changed driver is picked up by the
+ * next run. */
+int
+check_fork_server(void)
+{
+    struct run r = { CHECK_FORK_DRIVER, { NULL }, { { 0 } }, NULL };
+    char sock[PATH_MAX], env[PATH_MAX + 16], path[2 * PATH_MAX];
+    const char *pythonpath = getenv("PYTHONPATH");
+    char *saved = pythonpath != NULL ? strdup(pythonpath) : NULL;
+    struct outcome out;
+    time_t now = time(NULL);
+    pid_t pid;
+    int failed = 0;
+
+    /* the driver lives in the check's directory */
+    if (server_paths(sock, sizeof(sock), env, sizeof(env)) < 0
+        || check_path(path, sizeof(path), "") < 0
+        || write_fork_driver(1, now - 10) < 0)
+    {
+        free(saved);
+        return 1;
+    }
+    if (saved != NULL)
+        snprintf(path + strlen(path), sizeof(path) - strlen(path), ":%s",
+                 saved);
+    setenv("PYTHONPATH", path, 1);
+    pid = start_server(sock, r.driver, 1);
+    r.env[0] = env;
+
+    failed = pid < 0 || run_pdsh(&r, &out) < 0
+        || expect_str("first run", out.collected, "v1-run1")
+        || run_pdsh(&r, &out) < 0
+        || expect_str("second run, from a fresh copy", out.collected,
+                      "v1-run1")
+        || write_fork_driver(2, now) < 0
+        || run_pdsh(&r, &out) < 0
+        || expect_str("run after the driver changed", out.collected,
+                      "v2-run1")
+        || expect_int("server still up", server_up(sock), 1);
+    if (failed && pid >= 0)
+        show_outcome(&out);
+    stop_server(pid);
+
+    if (saved != NULL)
+        setenv("PYTHONPATH", saved, 1);
+    else
+        unsetenv("PYTHONPATH");
+    free(saved);
+    return failed;
+}
+
+/* the pid of the process listening on 'sock', or -1 */
+static pid_t
+server_pid(const char *sock)
+{
+    struct sockaddr_un addr;
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    int fd;
+
+    if (strlen(sock) >= sizeof(addr.sun_path))
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, sock, strlen(sock));
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+        || getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+        cred.pid = -1;
+    close(fd);
+    return cred.pid;
+}
+
+/* With PDSHPY_SERVER_AUTOSTART, a run with no server to go to starts one
+ * for the runs after it, which keeps none of pdsh's file descriptors: once
+ * the run is over, the other end of a pipe it was given sees end of file
+ * with the server still running. */
+int
+check_autostart(void)
+{
+    struct run r = {
+        CHECK_SERVER_DRIVER, { "PDSHPY_SERVER_AUTOSTART=1" },
+        { { 'P', "auto" } }, NULL
+    };
+    char sock[PATH_MAX], env[PATH_MAX + 16];
+    struct pollfd pfd;
+    struct outcome out;
+    pid_t pid = -1;
+    int fds[2];
+    char c;
+    int failed;
+
+    if (server_paths(sock, sizeof(sock), env, sizeof(env)) < 0
+        || pipe(fds) < 0)
+        return 1;
+    r.env[1] = env;
+    failed = run_pdsh(&r, &out) < 0
+        || expect_str("collected in-process", out.collected, "auto[1-3]")
+        || expect_int("server started", wait_for_server(sock), 0)
+        || (pid = server_pid(sock)) < 0;
+    if (failed)
+        show_outcome(&out);
+    close(fds[1]);
+
+    pfd.fd = fds[0];
+    pfd.events = POLLIN;
+    if (!failed)
+        failed = expect_int("pipe closed by all but the server",
+                            poll(&pfd, 1, 2000) == 1
+                            && read(fds[0], &c, 1) == 0, 1)
+            | expect_int("run through the started server",
+                         run_pdsh(&r, &out) == 0
+                         && check_counter("collect_pid") != pid
+                         && strcmp(out.collected, "auto[1-3]") == 0, 1);
+    close(fds[0]);
+
+    /* not ours to wait for: it's been on its own since it started */
+    if (pid > 0)
+        kill(pid, SIGTERM);
+    return failed;
+}
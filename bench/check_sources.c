@@ -0,0 +1,129 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* checks of host sources, with bench/pdshpy_check_sources.py, in-process
+ * and through a server */
+
+#include <limits.h>
+#include <stdio.h>
+
+#include "src/common/hostlist.h"
+
+#include "cache.h"
+#include "check.h"
+
+#define CHECK_SOURCES_DRIVER "pdshpy_check_sources"
+#define CHECK_SOURCES_HOSTS "a[1-2],b1,c1,s1"
+
+/* The two half-second sources take half a second between them, not a
+ * whole one; this leaves room for a slow machine. */
+#define CHECK_SOURCES_MS 900
+
+/* the hosts cached under the key host source "a" sets, if any */
+static void
+cached_hosts(char *buf, size_t n)
+{
+    hostlist_t hl = NULL;
+    int stale = 0;
+
+    snprintf(buf, n, "(none)");
+    if ((hl = cache_lookup(CHECK_SOURCES_DRIVER, "sources", -1, &stale))
+        == NULL)
+        return;
+    if (hostlist_ranged_string(hl, n, buf) < 0)
+        snprintf(buf, n, "(too long)");
+    hostlist_destroy(hl);
+}
+
+/* Every source's hosts are merged, found side by side, and the cache key
+ * one of them sets takes effect: the hosts are cached under it. */
+static int
+check_merged(const char *env)
+{
+    struct run r = { CHECK_SOURCES_DRIVER, { env }, { { 0 } }, NULL };
+    char cached[CHECK_MAX_HOSTS];
+    struct outcome out;
+    int failed;
+
+    failed = run_pdsh(&r, &out) < 0
+        || expect_hosts("merged", out.collected, CHECK_SOURCES_HOSTS)
+        || expect_int("sources side by side",
+                      out.collect_ms < CHECK_SOURCES_MS, 1);
+    cached_hosts(cached, sizeof(cached));
+    failed = failed
+        || expect_hosts("cached under the source's key", cached,
+                        CHECK_SOURCES_HOSTS);
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
+
+int
+check_sources(void)
+{
+    struct run r = {
+        CHECK_SOURCES_DRIVER, { "PDSHPY_CACHE_TTL=0" },
+        { { 'S', "10" } }, NULL
+    };
+    struct outcome out;
+    int failed;
+
+    if (check_merged(NULL))
+        return 1;
+
+    /* a source which runs over its timeout gives what it had found */
+    failed = run_pdsh(&r, &out) < 0
+        || expect_hosts("with a slow source", out.collected,
+                        CHECK_SOURCES_HOSTS)
+        || expect_int("gave up in time", out.collect_ms < 2500, 1)
+        || expect_output("warning", &out, "did not finish", 1);
+    if (failed)
+        show_outcome(&out);
+    return failed;
+}
+
+/* In a server, the sources and prefetches run on threads of their own, and
+ * what they register still goes back to the run they belong to. */
+int
+check_sources_server(void)
+{
+    struct run prefetch = {
+        "pdshpy_check_prefetch", { NULL }, { { 0 } }, NULL
+    };
+    char sock[PATH_MAX], env[PATH_MAX + 16];
+    struct outcome out;
+    pid_t pid;
+    int failed;
+
+    if (check_path(sock, sizeof(sock), "sock") < 0
+        || (pid = start_server(sock, CHECK_SOURCES_DRIVER, 0)) < 0)
+        return 1;
+    snprintf(env, sizeof(env), "PDSHPY_SERVER=%s", sock);
+    failed = check_merged(env);
+    stop_server(pid);
+    if (failed || (pid = start_server(sock, prefetch.driver, 0)) < 0)
+        return 1;
+
+    prefetch.env[0] = env;
+    failed = run_pdsh(&prefetch, &out) < 0
+        || expect_str("prefetched in the server", out.collected, "pf[1-2]")
+        || expect_int("collections", check_counter("collections"), 0);
+    if (failed)
+        show_outcome(&out);
+    stop_server(pid);
+    return failed;
+}
@@ -0,0 +1,70 @@
+# Helpers for the drivers bench/check.c runs (bench/pdshpy_check_*.py).
+#
+# Each check has a directory of its own, named by PDSHPY_CHECK_DIR, where
+# drivers leave what they saw for the check to look at: record() and bump()
+# write files there which check_counter() in bench/check.c reads back.
+
+import fcntl
+import os
+import sys
+import time
+
+# what expect() found wrong, for perform_postop() to return the number of
+failures = []
+
+
+def expect(what, got, want):
+    if got != want:
+        failures.append(what)
+        sys.stderr.write('%s: got %r, wanted %r\n' % (what, got, want))
+
+
+def path(name):
+    return os.path.join(os.environ['PDSHPY_CHECK_DIR'], name)
+
+
+def record(name, value):
+    with open(path(name), 'w') as f:
+        f.write('%s\n' % (value,))
+
+
+def bump(name):
+    """
+    Add one to the number in the file 'name', and return what it comes to:
+    how many times something has happened, across runs and processes.
+    """
+    with open(path(name), 'a+') as f:
+        fcntl.flock(f, fcntl.LOCK_EX)
+        f.seek(0)
+        n = int(f.read() or 0) + 1
+        f.seek(0)
+        f.truncate()
+        f.write('%d\n' % n)
+    return n
+
+
+
+def long_switch_interval():
+    """
+    Have this interpreter's threads take turns only when the one running
+    blocks, not every few milliseconds, so that hold_gil() keeps the others
+    from running.
+    """
+    if hasattr(sys, 'setswitchinterval'):
+        sys.setswitchinterval(5.0)
+    else:
+        sys.setcheckinterval(1 << 30)
+
+
+def hold_gil(seconds):
+    """
+    Spin for 'seconds', after a moment's sleep so that everything starting
+    alongside gets going. After long_switch_interval(), no other thread of
+    the interpreter runs meanwhile, as if a CPU-bound callback had the
+    machine to itself; those of interpreters with a GIL of their own still
+    do.
+    """
+    time.sleep(0.2)
+    end = time.time() + seconds
+    while time.time() < end:
+        pass
@@ -0,0 +1,94 @@
+#!/usr/bin/env python
+#
+# Sweep pdsh fanout, host count and per-host output volume against the
+# loopback rcmd module, with pdshpy supplying the working collective and the
+# rcmd default (see bench/pdshpy_fanout.py), and record wall time, CPU time
+# and peak RSS of each pdsh run as CSV.
+#
+# pdshpy.so and loopback.so need to be where pdsh will load them from, i.e.
+# installed, or in a directory given with --module-dir.
+#
+#   python bench/fanout.py --fanouts 32,256,4096 --hosts 1000,10000 \
+#       --output 0,65536 > fanout.csv
+
+import argparse
+import csv
+import os
+import subprocess
+import sys
+import time
+
+FIELDS = ('fanout', 'hosts', 'output_bytes', 'latency_ms', 'run',
+          'wall_s', 'user_s', 'sys_s', 'maxrss_kb', 'rc')
+
+
+def int_list(s):
+    return [int(x) for x in s.split(',') if x]
+
+
+def run_pdsh(args, fanout, nhosts, output, env):
+    env = dict(env, PDSHPY_BENCH_HOSTS=str(nhosts),
+               PDSHPY_LOOPBACK_OUTPUT=str(output))
+    cmd = [args.pdsh, '-f', str(fanout)] + args.pdsh_args + [args.command]
+    with open(os.devnull, 'w') as devnull:
+        start = time.time()
+        proc = subprocess.Popen(cmd, env=env, stdout=devnull, stderr=devnull)
+        # wait4 gives us pdsh's own resource usage (including the children
+        # it reaped), not that of everything this script has run so far
+        _, status, usage = os.wait4(proc.pid, 0)
+        wall = time.time() - start
+    # already reaped; don't let Popen try again
+    proc.returncode = status
+    rc = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+    return ('%.3f' % wall, '%.3f' % usage.ru_utime, '%.3f' % usage.ru_stime,
+            usage.ru_maxrss, rc)
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        description='Benchmark pdsh fanout using the loopback rcmd module')
+    parser.add_argument('--fanouts', type=int_list,
+                        default=[32, 64, 128, 256, 512, 1024, 2048, 4096])
+    parser.add_argument('--hosts', type=int_list, default=[1000, 10000])
+    parser.add_argument('--output', type=int_list, default=[0, 1024, 65536],
+                        help='bytes of output per host')
+    parser.add_argument('--latency', type=int, default=0,
+                        help='emulated connection latency, in ms')
+    parser.add_argument('--repeat', type=int, default=3)
+    parser.add_argument('--exec', dest='exec_commands', action='store_true',
+                        help='really run the command on this machine, '
+                             'instead of emulating its output')
+    parser.add_argument('--command', default='true',
+                        help='command to (pretend to) run on each host')
+    parser.add_argument('--pdsh', default='pdsh')
+    parser.add_argument('--module-dir',
+                        help='load pdsh modules from here (PDSH_MODULE_DIR)')
+    parser.add_argument('pdsh_args', nargs='*',
+                        help='extra arguments for pdsh (after --)')
+    args = parser.parse_args(argv)
+
+    here = os.path.dirname(os.path.abspath(__file__))
+    env = dict(os.environ)
+    env['PDSHPY_MODULE'] = 'pdshpy_fanout'
+    env['PYTHONPATH'] = os.pathsep.join(
+        [here, os.path.dirname(here)]
+        + [p for p in [env.get('PYTHONPATH')] if p])
+    env['PDSHPY_LOOPBACK_LATENCY'] = str(args.latency)
+    env['PDSHPY_LOOPBACK_EXEC'] = '1' if args.exec_commands else '0'
+    if args.module_dir:
+        env['PDSH_MODULE_DIR'] = args.module_dir
+
+    out = csv.writer(sys.stdout)
+    out.writerow(FIELDS)
+    for nhosts in args.hosts:
+        for output in args.output:
+            for fanout in args.fanouts:
+                for run in range(args.repeat):
+                    result = run_pdsh(args, fanout, nhosts, output, env)
+                    out.writerow((fanout, nhosts, output, args.latency, run)
+                                 + result)
+                    sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,708 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* A stand-in for pdsh's hostlist and hostset (src/common/hostlist.c), for
+ * the bench and the checks to link with when there's no pdsh source to
+ * build pdsh's own from (see PDSH_SRC in the Makefile). It follows the
+ * semantics documented in src/common/hostlist.h, simply: a hostlist is an
+ * array of strings, and a hostset a sorted one.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/common/hostlist.h"
+#include "src/common/xmalloc.h"
+
+/* ----[ hostlist ]---- */
+
+struct hostlist {
+    char **hosts;
+    int n;
+    int cap;
+};
+
+struct hostset {
+    struct hostlist hl;
+};
+
+struct hostlist_iterator {
+    hostlist_t hl;
+    int pos;
+};
+
+static void
+hl_append(hostlist_t hl, char *host)
+{
+    if (hl->n == hl->cap)
+    {
+        hl->cap = hl->cap ? hl->cap * 2 : 16;
+        Realloc((void **)&hl->hosts, hl->cap * sizeof(char *));
+    }
+    hl->hosts[hl->n++] = host;
+}
+
+static void
+hl_remove_at(hostlist_t hl, int i)
+{
+    free(hl->hosts[i]);
+    memmove(&hl->hosts[i], &hl->hosts[i + 1],
+            (hl->n - i - 1) * sizeof(char *));
+    hl->n--;
+}
+
+/* Split a hostname into prefix length, numeric suffix and zero-pad width.
+ * Returns 0 if there is no numeric suffix. */
+static int
+split_host(const char *host, size_t *prefixlen, unsigned long *num, int *width)
+{
+    size_t len = strlen(host);
+    size_t i = len;
+
+    while (i > 0 && isdigit((unsigned char)host[i - 1]))
+        i--;
+    if (i == len)
+        return 0;
+    *prefixlen = i;
+    *num = strtoul(host + i, NULL, 10);
+    *width = (len - i > 1 && host[i] == '0') ? (int)(len - i) : 0;
+    return 1;
+}
+
+/* Expand one comma-free host expression, like "foo[1-3,07]-ib" */
+static int
+expand_one(const char *expr, size_t len, void (*emit)(void *, char *),
+           void *arg)
+{
+    const char *open_at = memchr(expr, '[', len);
+    const char *close_at = NULL;
+    const char *p = NULL;
+    char *host = NULL;
+    int count = 0;
+
+    if (open_at == NULL)
+    {
+        host = Malloc(len + 1);
+        memcpy(host, expr, len);
+        emit(arg, host);
+        return 1;
+    }
+    close_at = memchr(open_at, ']', len - (open_at - expr));
+    if (close_at == NULL)
+        return -1;
+
+    p = open_at + 1;
+    while (p < close_at)
+    {
+        char *end = NULL;
+        unsigned long lo, hi, n;
+        int width = 0;
+
+        if (!isdigit((unsigned char)*p))
+            return -1;
+        if (*p == '0' && isdigit((unsigned char)p[1]))
+        {
+            const char *q = p;
+            while (isdigit((unsigned char)*q))
+                q++;
+            width = q - p;
+        }
+        lo = hi = strtoul(p, &end, 10);
+        p = end;
+        if (*p == '-')
+        {
+            hi = strtoul(p + 1, &end, 10);
+            p = end;
+        }
+        if (*p == ',')
+            p++;
+        for (n = lo; n <= hi; n++)
+        {
+            size_t hostlen = (open_at - expr) + 32 + (len - (close_at - expr));
+            host = Malloc(hostlen);
+            snprintf(host, hostlen, "%.*s%0*lu%.*s",
+                     (int)(open_at - expr), expr, width, n,
+                     (int)(len - (close_at - expr) - 1), close_at + 1);
+            emit(arg, host);
+            count++;
+        }
+    }
+    return count;
+}
+
+static int
+expand(const char *str, void (*emit)(void *, char *), void *arg)
+{
+    const char *start = str;
+    const char *p = str;
+    int depth = 0;
+    int count = 0;
+    int rc;
+
+    if (str == NULL)
+        return 0;
+    for (;; p++)
+    {
+        if (*p == '[')
+            depth++;
+        else if (*p == ']')
+            depth--;
+        else if (*p == '\0' || (depth == 0 && (*p == ',' || isspace(*p))))
+        {
+            if (p > start)
+            {
+                if ((rc = expand_one(start, p - start, emit, arg)) < 0)
+                    return -1;
+                count += rc;
+            }
+            if (*p == '\0')
+                break;
+            start = p + 1;
+        }
+    }
+    return count;
+}
+
+static void
+emit_append(void *arg, char *host)
+{
+    hl_append((hostlist_t)arg, host);
+}
+
+hostlist_t
+hostlist_create(const char *str)
+{
+    hostlist_t hl = Malloc(sizeof(*hl));
+
+    if (expand(str, emit_append, hl) < 0)
+    {
+        hostlist_destroy(hl);
+        return NULL;
+    }
+    return hl;
+}
+
+hostlist_t
+hostlist_copy(const hostlist_t hl)
+{
+    hostlist_t new = Malloc(sizeof(*new));
+    int i;
+
+    for (i = 0; i < hl->n; i++)
+        hl_append(new, Strdup(hl->hosts[i]));
+    return new;
+}
+
+void
+hostlist_destroy(hostlist_t hl)
+{
+    int i;
+
+    if (hl == NULL)
+        return;
+    for (i = 0; i < hl->n; i++)
+        free(hl->hosts[i]);
+    free(hl->hosts);
+    free(hl);
+}
+
+int
+hostlist_push(hostlist_t hl, const char *hosts)
+{
+    int rc = expand(hosts, emit_append, hl);
+    return rc < 0 ? 0 : rc;
+}
+
+int
+hostlist_push_host(hostlist_t hl, const char *host)
+{
+    hl_append(hl, Strdup(host));
+    return 1;
+}
+
+int
+hostlist_push_list(hostlist_t hl1, hostlist_t hl2)
+{
+    int i;
+
+    for (i = 0; i < hl2->n; i++)
+        hl_append(hl1, Strdup(hl2->hosts[i]));
+    return 1;
+}
+
+char *
+hostlist_pop(hostlist_t hl)
+{
+    if (hl->n == 0)
+        return NULL;
+    return hl->hosts[--hl->n];
+}
+
+char *
+hostlist_nth(hostlist_t hl, int n)
+{
+    if (n < 0 || n >= hl->n)
+        return NULL;
+    return Strdup(hl->hosts[n]);
+}
+
+char *
+hostlist_shift(hostlist_t hl)
+{
+    char *host = NULL;
+
+    if (hl->n == 0)
+        return NULL;
+    host = hl->hosts[0];
+    memmove(&hl->hosts[0], &hl->hosts[1], (hl->n - 1) * sizeof(char *));
+    hl->n--;
+    return host;
+}
+
+int
+hostlist_find(hostlist_t hl, const char *hostname)
+{
+    int i;
+
+    for (i = 0; i < hl->n; i++)
+        if (strcmp(hl->hosts[i], hostname) == 0)
+            return i;
+    return -1;
+}
+
+struct delete_arg {
+    hostlist_t hl;
+    int count;
+};
+
+static void
+emit_delete(void *arg, char *host)
+{
+    struct delete_arg *d = arg;
+    int i;
+
+    for (i = 0; i < d->hl->n; )
+    {
+        if (strcmp(d->hl->hosts[i], host) == 0)
+        {
+            hl_remove_at(d->hl, i);
+            d->count++;
+        }
+        else
+            i++;
+    }
+    free(host);
+}
+
+int
+hostlist_delete(hostlist_t hl, const char *hosts)
+{
+    struct delete_arg d = { hl, 0 };
+
+    expand(hosts, emit_delete, &d);
+    return d.count;
+}
+
+int
+hostlist_delete_host(hostlist_t hl, const char *hostname)
+{
+    int i = hostlist_find(hl, hostname);
+
+    if (i < 0)
+        return 0;
+    hl_remove_at(hl, i);
+    return 1;
+}
+
+int
+hostlist_delete_nth(hostlist_t hl, int n)
+{
+    if (n < 0 || n >= hl->n)
+        return 0;
+    hl_remove_at(hl, n);
+    return 1;
+}
+
+int
+hostlist_count(hostlist_t hl)
+{
+    return hl->n;
+}
+
+static int
+host_cmp(const char *a, const char *b)
+{
+    size_t alen = strlen(a), blen = strlen(b);
+    unsigned long anum = 0, bnum = 0;
+    int awidth, bwidth, rc;
+    int ahas = split_host(a, &alen, &anum, &awidth);
+    int bhas = split_host(b, &blen, &bnum, &bwidth);
+
+    /* by prefix (the whole name, if there's no number), then number, so
+     * that it's an order a binary search can go by */
+    if ((rc = strncmp(a, b, alen < blen ? alen : blen)) != 0)
+        return rc;
+    if (alen != blen)
+        return (alen > blen) - (alen < blen);
+    if (ahas != bhas)
+        return ahas - bhas;
+    if ((rc = (anum > bnum) - (anum < bnum)) != 0)
+        return rc;
+    return strcmp(a, b);
+}
+
+static int
+host_qsort_cmp(const void *a, const void *b)
+{
+    return host_cmp(*(char * const *)a, *(char * const *)b);
+}
+
+void
+hostlist_sort(hostlist_t hl)
+{
+    qsort(hl->hosts, hl->n, sizeof(char *), host_qsort_cmp);
+}
+
+void
+hostlist_uniq(hostlist_t hl)
+{
+    int i, j;
+
+    hostlist_sort(hl);
+    for (i = j = 0; i < hl->n; i++)
+    {
+        if (j > 0 && strcmp(hl->hosts[j - 1], hl->hosts[i]) == 0)
+            free(hl->hosts[i]);
+        else
+            hl->hosts[j++] = hl->hosts[i];
+    }
+    hl->n = j;
+}
+
+/* Write a ranged representation, collapsing runs of adjacent hosts with the
+ * same prefix. Returns the number of bytes written, or -1 on truncation.
+ * If nranges is not NULL, only counts the ranges. */
+static ssize_t
+ranged(hostlist_t hl, size_t n, char *buf, int *nranges)
+{
+    size_t len = 0;
+    int i = 0;
+    int truncated = 0;
+
+#define PUT(fmt, args...) ({                                            \
+    if (buf != NULL)                                                    \
+    {                                                                   \
+        int __w = snprintf(buf + len, len < n ? n - len : 0,            \
+                           fmt, ## args);                               \
+        if (__w < 0 || len + __w >= n)                                  \
+            truncated = 1;                                              \
+        else                                                            \
+            len += __w;                                                 \
+    }                                                                   \
+})
+
+    if (nranges != NULL)
+        *nranges = 0;
+    if (buf != NULL && n > 0)
+        buf[0] = '\0';
+
+    while (i < hl->n)
+    {
+        size_t plen, plen2;
+        unsigned long num, num2, lo, hi;
+        int width, width2, nspans = 0, j;
+
+        if (i > 0)
+            PUT(",");
+        if (nranges != NULL)
+            (*nranges)++;
+        if (!split_host(hl->hosts[i], &plen, &num, &width))
+        {
+            PUT("%s", hl->hosts[i]);
+            i++;
+            continue;
+        }
+
+        /* how far does this prefix group go? */
+        for (j = i + 1; j < hl->n; j++)
+        {
+            if (!split_host(hl->hosts[j], &plen2, &num2, &width2)
+                || plen2 != plen || width2 != width
+                || strncmp(hl->hosts[i], hl->hosts[j], plen) != 0)
+                break;
+        }
+        if (j == i + 1)
+        {
+            PUT("%s", hl->hosts[i]);
+            i++;
+            continue;
+        }
+
+        PUT("%.*s[", (int)plen, hl->hosts[i]);
+        while (i < j)
+        {
+            split_host(hl->hosts[i], &plen, &lo, &width);
+            hi = lo;
+            i++;
+            while (i < j)
+            {
+                split_host(hl->hosts[i], &plen2, &num2, &width2);
+                if (num2 != hi + 1)
+                    break;
+                hi = num2;
+                i++;
+            }
+            if (nspans++ > 0)
+                PUT(",");
+            if (lo == hi)
+                PUT("%0*lu", width, lo);
+            else
+                PUT("%0*lu-%0*lu", width, lo, width, hi);
+        }
+        PUT("]");
+    }
+#undef PUT
+    return truncated ? -1 : (ssize_t)len;
+}
+
+ssize_t
+hostlist_ranged_string(hostlist_t hl, size_t n, char *buf)
+{
+    return ranged(hl, n, buf, NULL);
+}
+
+ssize_t
+hostlist_deranged_string(hostlist_t hl, size_t n, char *buf)
+{
+    size_t len = 0;
+    int i, w;
+
+    if (n > 0)
+        buf[0] = '\0';
+    for (i = 0; i < hl->n; i++)
+    {
+        w = snprintf(buf + len, n - len, "%s%s", i ? "," : "", hl->hosts[i]);
+        if (w < 0 || len + w >= n)
+            return -1;
+        len += w;
+    }
+    return len;
+}
+
+int
+hostlist_nranges(hostlist_t hl)
+{
+    int count = 0;
+
+    ranged(hl, 0, NULL, &count);
+    return count;
+}
+
+hostlist_iterator_t
+hostlist_iterator_create(hostlist_t hl)
+{
+    hostlist_iterator_t i = Malloc(sizeof(*i));
+
+    i->hl = hl;
+    i->pos = 0;
+    return i;
+}
+
+hostlist_iterator_t
+hostset_iterator_create(hostset_t set)
+{
+    return hostlist_iterator_create(&set->hl);
+}
+
+void
+hostlist_iterator_destroy(hostlist_iterator_t i)
+{
+    free(i);
+}
+
+void
+hostlist_iterator_reset(hostlist_iterator_t i)
+{
+    i->pos = 0;
+}
+
+char *
+hostlist_next(hostlist_iterator_t i)
+{
+    if (i->pos >= i->hl->n)
+        return NULL;
+    return Strdup(i->hl->hosts[i->pos++]);
+}
+
+int
+hostlist_remove(hostlist_iterator_t i)
+{
+    if (i->pos == 0)
+        return 0;
+    hl_remove_at(i->hl, --i->pos);
+    return 1;
+}
+
+/* ----[ hostset ]---- */
+
+/* binary search; returns index of host, or -(insertion point + 1) */
+static int
+hs_search(hostset_t set, const char *host)
+{
+    int lo = 0, hi = set->hl.n - 1, mid, rc;
+
+    while (lo <= hi)
+    {
+        mid = (lo + hi) / 2;
+        rc = host_cmp(set->hl.hosts[mid], host);
+        if (rc == 0)
+            return mid;
+        if (rc < 0)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return -(lo + 1);
+}
+
+struct hs_arg {
+    hostset_t set;
+    int count;
+};
+
+static void
+emit_insert(void *arg, char *host)
+{
+    struct hs_arg *a = arg;
+    int i = hs_search(a->set, host);
+
+    if (i >= 0)
+    {
+        free(host);
+        return;
+    }
+    i = -i - 1;
+    hl_append(&a->set->hl, NULL);
+    memmove(&a->set->hl.hosts[i + 1], &a->set->hl.hosts[i],
+            (a->set->hl.n - i - 1) * sizeof(char *));
+    a->set->hl.hosts[i] = host;
+    a->count++;
+}
+
+static void
+emit_hs_delete(void *arg, char *host)
+{
+    struct hs_arg *a = arg;
+    int i = hs_search(a->set, host);
+
+    if (i >= 0)
+    {
+        hl_remove_at(&a->set->hl, i);
+        a->count++;
+    }
+    free(host);
+}
+
+static void
+emit_within(void *arg, char *host)
+{
+    struct hs_arg *a = arg;
+
+    if (hs_search(a->set, host) < 0)
+        a->count++;
+    free(host);
+}
+
+hostset_t
+hostset_create(const char *hostlist)
+{
+    hostset_t set = Malloc(sizeof(*set));
+
+    hostset_insert(set, hostlist);
+    return set;
+}
+
+hostset_t
+hostset_copy(hostset_t set)
+{
+    hostset_t new = Malloc(sizeof(*new));
+    int i;
+
+    for (i = 0; i < set->hl.n; i++)
+        hl_append(&new->hl, Strdup(set->hl.hosts[i]));
+    return new;
+}
+
+void
+hostset_destroy(hostset_t set)
+{
+    int i;
+
+    if (set == NULL)
+        return;
+    for (i = 0; i < set->hl.n; i++)
+        free(set->hl.hosts[i]);
+    free(set->hl.hosts);
+    free(set);
+}
+
+int
+hostset_insert(hostset_t set, const char *hosts)
+{
+    struct hs_arg a = { set, 0 };
+
+    expand(hosts, emit_insert, &a);
+    return a.count;
+}
+
+int
+hostset_delete(hostset_t set, const char *hosts)
+{
+    struct hs_arg a = { set, 0 };
+
+    expand(hosts, emit_hs_delete, &a);
+    return a.count;
+}
+
+int
+hostset_within(hostset_t set, const char *hosts)
+{
+    struct hs_arg a = { set, 0 };
+
+    expand(hosts, emit_within, &a);
+    return a.count == 0;
+}
+
+char *
+hostset_shift(hostset_t set)
+{
+    return hostlist_shift(&set->hl);
+}
+
+int
+hostset_count(hostset_t set)
+{
+    return set->hl.n;
+}
+
+ssize_t
+hostset_ranged_string(hostset_t set, size_t n, char *buf)
+{
+    return ranged(&set->hl, n, buf, NULL);
+}
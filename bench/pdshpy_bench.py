@@ -0,0 +1,24 @@
+# Driver module for bench/bench.c.
+#
+# Does as little as possible beyond making pdshpy move the options and the
+# working collective back and forth, so that what gets measured is pdshpy.
+
+from pdshpy import util
+
+
+def initialize(session):
+    util.register_option('B', 'n', 'DSH,PCP', set_fanout,
+                         'Set fanout to n (benchmark option)')
+
+
+def set_fanout(opt, arg, pdshopt, session):
+    pdshopt.fanout = int(arg)
+
+
+def collect_hosts(pdshopt, session):
+    # hand the whole working collective back, like a filtering driver would
+    return list(pdshopt.wcoll or ())
+
+
+def perform_postop(pdshopt, session):
+    return 0
@@ -0,0 +1,25 @@
+# Driver for the cache checks in bench/check_cache.c.
+#
+# -K names the cache key. Each call to collect_hosts() is counted, and the
+# host it returns says which call it was: gen1, gen2, and so on.
+
+from pdshpy import util
+
+import checkutil
+
+
+def initialize(session):
+    util.register_option('K', 'key', 'DSH,PCP', set_key,
+                         'Cache hosts under key (check option)')
+
+
+def set_key(opt, arg, pdshopt, session):
+    util.set_cache_key(arg)
+
+
+def collect_hosts(pdshopt, session):
+    return ['gen%d' % checkutil.bump('collections')]
+
+
+def perform_postop(pdshopt, session):
+    return 0
@@ -0,0 +1,12 @@
+# The first of two chained drivers for the checks in bench/check_hostlist.c:
+# it finds c2, c1 and b1, and its postop drops c2, and then c1 from a slice
+# of the wcoll, which mustn't change the wcoll itself.
+
+def collect_hosts(pdshopt, session):
+    return ['c2', 'c1', 'b1']
+
+
+def perform_postop(pdshopt, session):
+    pdshopt.wcoll.discard('c2')
+    pdshopt.wcoll[:].remove('c1')
+    return 0
@@ -0,0 +1,15 @@
+# The second of two chained drivers for the checks in bench/check_hostlist.c:
+# it finds c1 and c3, and its postop records the wcoll as
+# pdshpy_check_chain_a's left it in "seen_by_b", then drops c1 from it.
+
+import checkutil
+
+
+def collect_hosts(pdshopt, session):
+    return ['c1', 'c3']
+
+
+def perform_postop(pdshopt, session):
+    checkutil.record('seen_by_b', pdshopt.wcoll)
+    pdshopt.wcoll.remove('c1')
+    return 0
@@ -0,0 +1,58 @@
+# Driver for the coroutine checks in bench/check_coro.c; it needs 'async
+# def', so Python 3.5 or later.
+#
+# Every callback is a coroutine function. collect_hosts() has the number of
+# queries given with -Q in flight at once, each taking 0.3 seconds to find
+# one host, q1, q2 and so on, and host source "src" finds src1. Each
+# callback notes the event loop it ran on; perform_postop() records how
+# many different ones initialize(), the option callback, collect_hosts()
+# and itself saw, in "loops".
+
+import asyncio
+
+from pdshpy import util
+
+import checkutil
+
+
+def _note_loop(session):
+    # kept, not just their ids, which a new loop could be given again
+    loop = asyncio.get_event_loop()
+    if all(seen is not loop for seen in session.loops):
+        session.loops.append(loop)
+
+
+async def initialize(session):
+    session.loops = []
+    session.queries = 1
+    _note_loop(session)
+    util.register_option('Q', 'n', 'DSH,PCP', set_queries,
+                         'Have n queries in flight at once (check option)')
+    util.register_host_source('src', source)
+
+
+async def set_queries(opt, arg, pdshopt, session):
+    _note_loop(session)
+    session.queries = int(arg)
+
+
+async def _query(i):
+    await asyncio.sleep(0.3)
+    return 'q%d' % i
+
+
+async def source(pdshopt, session):
+    await asyncio.sleep(0.3)
+    return ['src1']
+
+
+async def collect_hosts(pdshopt, session):
+    _note_loop(session)
+    queries = [_query(i + 1) for i in range(session.queries)]
+    return await asyncio.gather(*queries)
+
+
+async def perform_postop(pdshopt, session):
+    _note_loop(session)
+    checkutil.record('loops', len(session.loops))
+    return 0
@@ -0,0 +1,26 @@
+# Driver for the checks of remembered unreachable hosts in
+# bench/check_deadhosts.c.
+#
+# perform_postop() records the hosts in the wcoll whose names start with
+# "dead" as unreachable or, with -R, every host in it as reachable.
+
+from pdshpy import util
+
+
+def initialize(session):
+    session.reachable = False
+    util.register_option('R', 'any', 'DSH,PCP', set_reachable,
+                         'Record every host as reachable (check option)')
+
+
+def set_reachable(opt, arg, pdshopt, session):
+    session.reachable = True
+
+
+def perform_postop(pdshopt, session):
+    if session.reachable:
+        util.record_reachable(pdshopt.wcoll)
+    else:
+        util.record_unreachable(h for h in pdshopt.wcoll
+                                if h.startswith('dead'))
+    return 0
@@ -0,0 +1,35 @@
+# Driver for the deadline checks in bench/check_deadline.c.
+#
+# collect_hosts() yields node1 and node2, then with -S takes that many
+# seconds before yielding node3; -K names a cache key.
+
+import time
+
+from pdshpy import util
+
+
+def initialize(session):
+    session.hang = 0
+    util.register_option('K', 'key', 'DSH,PCP', set_key,
+                         'Cache hosts under key (check option)')
+    util.register_option('S', 'seconds', 'DSH,PCP', set_hang,
+                         'Hang for seconds collecting hosts (check option)')
+
+
+def set_key(opt, arg, pdshopt, session):
+    util.set_cache_key(arg)
+
+
+def set_hang(opt, arg, pdshopt, session):
+    session.hang = float(arg)
+
+
+def collect_hosts(pdshopt, session):
+    yield 'node1'
+    yield 'node2'
+    time.sleep(session.hang)
+    yield 'node3'
+
+
+def perform_postop(pdshopt, session):
+    return 0
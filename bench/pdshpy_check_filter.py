@@ -0,0 +1,104 @@
+# Driver for the filter_hosts() checks in bench/check_filter.c.
+#
+# filter_hosts() keeps the hosts whose number is 1, 2, 9 or 500 past a
+# thousand, and says so with the kind of mask the hosts' prefix names (see
+# MASKS). It checks that each batch's buffer and offsets agree with its
+# names, and notes the batches' sizes. perform_postop() records those in
+# "batches", and returns how many things were wrong, including the wcoll
+# not being what the masks said it should be.
+
+import re
+
+import checkutil
+
+_numbered = re.compile(r'^([a-z]+?)(\d+)$')
+
+
+def _parse(host):
+    prefix, number = _numbered.match(host).groups()
+    return prefix, int(number)
+
+
+def keep(host):
+    return _parse(host)[1] % 1000 in (1, 2, 9, 500)
+
+
+def _bits(keeps):
+    packed = bytearray((len(keeps) + 7) // 8)
+    for i, k in enumerate(keeps):
+        if k:
+            packed[i // 8] |= 1 << (i % 8)
+    return bytes(packed)
+
+
+def _late(keeps, session):
+    # a good mask for the first batch, a bad one after that
+    if session.batches[1:]:
+        return b'\1' * (len(keeps) + 1)
+    return bytes(bytearray(keeps))
+
+
+def _fail(keeps, session):
+    raise RuntimeError('filter_hosts() went wrong on purpose')
+
+
+# what filter_hosts() returns for hosts with each prefix, given whether to
+# keep each of them
+MASKS = {
+    'bytes': lambda keeps, session: bytes(bytearray(keeps)),
+    'ff': lambda keeps, session: bytearray(0xff * k for k in keeps),
+    'bits': lambda keeps, session: _bits(keeps),
+    'list': lambda keeps, session: list(keeps),
+    'none': lambda keeps, session: None,
+    # a byte for one host is a byte per host, not a bit: 0xfe keeps it
+    'one': lambda keeps, session: b'\xfe',
+    'short': lambda keeps, session: bytes(bytearray(keeps))[:-1],
+    'text': lambda keeps, session: u'\1' * len(keeps),
+    'late': _late,
+    'fail': _fail,
+}
+
+# the ones whose masks are refused, so the wcoll should be left as it was
+REFUSED = ['short', 'text', 'late', 'fail']
+
+
+def check_batch(hosts):
+    names = list(hosts)
+    data = hosts.data.tobytes()
+    offsets = list(hosts.offsets)
+    checkutil.expect('batch size', 0 < len(names) <= 4096, True)
+    checkutil.expect('offsets', len(offsets), len(names) + 1)
+    checkutil.expect('end of the data', offsets[-1], len(data))
+    checkutil.expect('indexed', [hosts[i] for i in range(len(names))],
+                     names)
+    from_data = [data[offsets[i]:offsets[i + 1] - 1].decode('utf-8')
+                 for i in range(len(names))]
+    checkutil.expect('names in the data', from_data, names)
+    checkutil.expect('NULs in the data',
+                     [data[offsets[i + 1] - 1:offsets[i + 1]]
+                      for i in range(len(names))],
+                     [b'\0'] * len(names))
+
+
+def initialize(session):
+    session.batches = []
+    session.seen = []
+
+
+def filter_hosts(hosts, session):
+    check_batch(hosts)
+    session.batches.append(len(hosts))
+    session.seen.extend(hosts)
+    keeps = [keep(h) for h in hosts]
+    return MASKS[_parse(hosts[0])[0]](keeps, session)
+
+
+def perform_postop(pdshopt, session):
+    checkutil.record('batches', ','.join(str(n) for n in session.batches))
+    prefix = _parse(session.seen[0])[0]
+    if prefix in REFUSED or prefix in ('none', 'one'):
+        want = session.seen
+    else:
+        want = [h for h in session.seen if keep(h)]
+    checkutil.expect('wcoll', list(pdshopt.wcoll), want)
+    return len(checkutil.failures)
@@ -0,0 +1,99 @@
+# Driver for the host database checks in bench/check_hostdb.c, with the
+# database it compiles as "inventory.db" in the check's directory.
+#
+# collect_hosts() finds the GPU hosts which aren't down. perform_postop()
+# asks every HostDB there is the same questions, and expects the same
+# answers: the native one (in-process) and pdshpy.hostdb's (always). It
+# records which it asked in "checked", and returns how many answers
+# differed from pdshpy.hostdb's or from what the inventory says.
+
+import sys
+
+from pdshpy import hostdb
+from pdshpy import util
+
+import checkutil
+
+
+def _outcome(func):
+    try:
+        return func()
+    except Exception:
+        return sys.exc_info()[0]
+
+
+def answers(cls):
+    """
+    What a HostDB of cls makes of the database: a list of (question,
+    answer) pairs, with HostLists as ranged strings.
+    """
+    db = cls(checkutil.path('inventory.db'))
+    gpu = db.bitmap('gpu')
+    down = db.bitmap('down')
+    every = db.bitmap()
+    questions = [
+        ('len', lambda: len(db)),
+        ('node05 in', lambda: 'node05' in db),
+        ('node5 in', lambda: 'node5' in db),
+        ('node21 in', lambda: 'node21' in db),
+        ('storage in', lambda: 'storage' in db),
+        ('hosts', lambda: str(db.hosts())),
+        ('attributes', lambda: db.attributes()),
+        ('attributes_of node03', lambda: db.attributes_of('node03')),
+        ('attributes_of storage', lambda: db.attributes_of('storage')),
+        ('attributes_of node21', lambda: db.attributes_of('node21')),
+        ('with_attribute nothing', lambda: db.with_attribute('nothing')),
+        ('bitmap nothing', lambda: db.bitmap('nothing')),
+        ('len every', lambda: len(every)),
+        ('gpu & !down', lambda: str((gpu - down).hosts())),
+        ('len gpu & !down', lambda: len(gpu - down)),
+        ('gpu | down', lambda: str((gpu | down).hosts())),
+        ('gpu & down', lambda: str((gpu & down).hosts())),
+        ('node03 in gpu & !down', lambda: 'node03' in gpu - down),
+        ('node04 in gpu & !down', lambda: 'node04' in gpu - down),
+    ]
+    for attr in db.attributes():
+        questions.append(('with_attribute %s' % attr,
+                          lambda attr=attr: str(db.with_attribute(attr))))
+    return [(what, _outcome(func)) for what, func in questions]
+
+
+# what the inventory written by bench/check_hostdb.c says
+EXPECTED = {
+    'len': 25,
+    'node05 in': True,
+    'node5 in': False,
+    'node21 in': False,
+    # in ID order, where node10 (unpadded) comes before node01
+    'hosts': 'gpu[8-10],login1,node[10-20],node[01-09],storage',
+    'attributes': ['compute', 'down', 'gpu', 'login', 'rack=1', 'rack=2'],
+    'attributes_of node03': ['compute', 'down', 'gpu', 'rack=1'],
+    'attributes_of storage': [],
+    'attributes_of node21': KeyError,
+    'with_attribute nothing': KeyError,
+    'bitmap nothing': KeyError,
+    'gpu & !down': 'gpu[8-10],node[01-02,04]',
+    'len gpu & !down': 6,
+    'with_attribute gpu': 'gpu[8-10],node[01-04]',
+    'with_attribute rack=2': 'gpu[8-10]',
+}
+
+
+def collect_hosts(pdshopt, session):
+    db = util.HostDB(checkutil.path('inventory.db'))
+    return (db.bitmap('gpu') - db.bitmap('down')).hosts()
+
+
+def perform_postop(pdshopt, session):
+    classes = [('python', hostdb.HostDB)]
+    if util.HostDB is not hostdb.HostDB:
+        classes.insert(0, ('native', util.HostDB))
+    want = dict(answers(hostdb.HostDB))
+    for what, answer in want.items():
+        if what in EXPECTED:
+            checkutil.expect('python: %s' % what, answer, EXPECTED[what])
+    for label, cls in classes[:-1]:
+        for what, answer in answers(cls):
+            checkutil.expect('%s: %s' % (label, what), answer, want[what])
+    checkutil.record('checked', ','.join(label for label, cls in classes))
+    return len(checkutil.failures)
@@ -0,0 +1,122 @@
+# Driver for the host expression checks in bench/check_hostexpr.c.
+#
+# initialize() compiles INVENTORY into "hosts.db" in the check's directory,
+# and registers -g through util.HostExprOption, counting in "compiled" how
+# many expressions it compiles. collect_hosts() selects from the database
+# the hosts every -g matches. perform_postop() compiles the same
+# expressions with every HostExpr there is, the native one (in-process) and
+# pdshpy.hostexpr's (always), and evaluates them on the same hosts; it
+# records which it checked in "checked", and returns how many answers
+# differed from pdshpy.hostexpr's or from what's expected.
+
+import sys
+
+from pdshpy import hostdb
+from pdshpy import hostexpr
+from pdshpy import util
+
+import checkutil
+
+INVENTORY = [
+    'node[01-20]     compute rack=1\n',
+    'node[01-04]     gpu\n',
+    'node03          down\n',
+    'login1          login\n',
+    'gpu[8-10]       gpu rack=2\n',
+]
+
+HOSTS = 'node[1-12],login1'
+
+# expressions, and what they come to: simplified, selected from HOSTS, and
+# selected from the database
+EXPRESSIONS = [
+    ('node[1-10] & !(node[3-4] | node9)', 'node[1-10] & !node[3-4,9]',
+     'node[1-2,5-8,10]', 'node10'),
+    ('a & !a', '!*', '', ''),
+    ('a | !a', '*', HOSTS, 'gpu[8-10],login1,node[10-20],node[01-09]'),
+    ('!!login1', 'login1', 'login1', 'login1'),
+    ('node[1-3] | node[4-6] | login1', 'login1,node[1-6]',
+     'node[1-6],login1', 'login1'),
+    ('gpu & !down', 'gpu & !down', '', 'gpu[8-10],node[01-02,04]'),
+    ('gpu & !down & !node04', 'gpu & !down,node04', '',
+     'gpu[8-10],node[01-02]'),
+    ('rack=2 | node03', 'node03,rack=2', '', 'gpu[8-10],node03'),
+    ('compute & !rack=1', 'compute & !rack=1', '', ''),
+]
+
+BAD = ['node[1-', 'a &', '(a', 'a b', ')', '']
+
+HostExpr = util.HostExpr
+select = util.HostExprOption()
+
+
+def _counted(text):
+    checkutil.bump('compiled')
+    return HostExpr(text)
+
+
+def _outcome(func):
+    try:
+        return func()
+    except Exception:
+        e = sys.exc_info()[1]
+        return (type(e), str(e))
+
+
+def answers(cls, dbcls):
+    """
+    What HostExprs of cls make of EXPRESSIONS and BAD, given HostDBs of
+    dbcls: a list of (question, answer) pairs, with HostLists as ranged
+    strings.
+    """
+    db = dbcls(checkutil.path('hosts.db'))
+    questions = []
+    for text, _, _, _ in EXPRESSIONS:
+        e = cls(text)
+        questions.extend([
+            ('str(%s)' % text, lambda e=e: str(e)),
+            ('%s from a HostList' % text,
+             lambda e=e: str(e.select(util.HostList(HOSTS)))),
+            ('%s from a string' % text, lambda e=e: str(e.select(HOSTS))),
+            ('%s from a list' % text,
+             lambda e=e: str(e.select(list(util.HostList(HOSTS))))),
+            ('%s from the database' % text,
+             lambda e=e: str(e.select(db).hosts())),
+        ])
+    for text in BAD:
+        questions.append(('compiling %r' % text,
+                          lambda text=text: str(cls(text))))
+    return [(what, _outcome(func)) for what, func in questions]
+
+
+def expected():
+    want = {}
+    for text, simplified, from_hosts, from_db in EXPRESSIONS:
+        want['str(%s)' % text] = simplified
+        want['%s from a string' % text] = from_hosts
+        want['%s from the database' % text] = from_db
+    return want
+
+
+def initialize(data):
+    hostdb.compile_inventory(INVENTORY, checkutil.path('hosts.db'))
+    util.HostExpr = _counted
+    util.register_option('g', 'expr', 'DSH', select, 'select hosts')
+
+
+def collect_hosts(pdshopt, session):
+    return select.select(util.HostDB(checkutil.path('hosts.db'))).hosts()
+
+
+def perform_postop(pdshopt, session):
+    classes = [('python', hostexpr.HostExpr, hostdb.HostDB)]
+    if HostExpr is not hostexpr.HostExpr:
+        classes.insert(0, ('native', HostExpr, util.HostDB))
+    want = dict(answers(hostexpr.HostExpr, hostdb.HostDB))
+    for what, answer in sorted(expected().items()):
+        checkutil.expect('python: %s' % what, want[what], answer)
+    for label, cls, dbcls in classes[:-1]:
+        for what, answer in answers(cls, dbcls):
+            checkutil.expect('%s: %s' % (label, what), answer, want[what])
+    checkutil.record('checked', ','.join(c[0] for c in classes))
+    return len(checkutil.failures)
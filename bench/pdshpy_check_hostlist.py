@@ -0,0 +1,162 @@
+# Driver for the HostList checks in bench/check_hostlist.c.
+#
+# perform_postop() puts every HostList there is through the same list
+# operations, side by side with a plain list: the native one pdsh's wcoll
+# is (in-process), and pdshpy.hostlist's (always). It records which it
+# checked in "checked", and returns how many operations went wrong. Then
+# it changes the wcoll in place, given as -w 'w[1-5]': w1 is deleted and
+# w2 and w3 become x1 and x2.
+
+import sys
+
+from pdshpy import hostlist
+
+import checkutil
+
+HOSTS = ['n1', 'n2', 'n3', 'n10', 'n4', 'a1']
+
+
+def _outcome(func):
+    """
+    What func() came to: what it returned, or the type of exception it
+    raised.
+    """
+    try:
+        return func()
+    except Exception:
+        return sys.exc_info()[0]
+
+
+def _check(label, cls, what, func, hosts=HOSTS):
+    """
+    Run func on a HostList of cls and on a list of the same hosts; the two
+    should return the same, and be left with the same hosts.
+    """
+    mine = cls(hosts)
+    model = list(hosts)
+    got = _outcome(lambda: func(mine))
+    want = _outcome(lambda: func(model))
+    if isinstance(got, cls):
+        got = list(got)
+    checkutil.expect('%s: %s' % (label, what), got, want)
+    checkutil.expect('%s: hosts after %s' % (label, what), list(mine), model)
+
+
+def _set(hl, key, value):
+    hl[key] = value
+
+
+def _delete(hl, key):
+    del hl[key]
+
+
+def _iadd(hl, other):
+    hl += other
+    return hl
+
+
+def check_sequence(label, cls):
+    # indexing and slicing, which gives a HostList
+    for key in (0, 5, -1, -6, 6, -7):
+        _check(label, cls, 'hl[%d]' % key, lambda hl: hl[key])
+    for key in (slice(1, 3), slice(None, None, 2), slice(None, None, -1),
+                slice(4, 1, -2), slice(10, None), slice(-2, None),
+                slice(3, 3)):
+        _check(label, cls, 'hl[%r]' % key, lambda hl: hl[key])
+    checkutil.expect('%s: type of a slice' % label, type(cls(HOSTS)[1:3]),
+                     cls)
+
+    # changing it through an index or a slice
+    _check(label, cls, 'hl[0] = m1', lambda hl: _set(hl, 0, 'm1'))
+    _check(label, cls, 'hl[-1] = m1', lambda hl: _set(hl, -1, 'm1'))
+    _check(label, cls, 'hl[6] = m1', lambda hl: _set(hl, 6, 'm1'))
+    _check(label, cls, 'hl[1:3] = [x1, x2, x3]',
+           lambda hl: _set(hl, slice(1, 3), ['x1', 'x2', 'x3']))
+    _check(label, cls, 'hl[::2] = [x1, x2, x3]',
+           lambda hl: _set(hl, slice(None, None, 2), ['x1', 'x2', 'x3']))
+    _check(label, cls, 'hl[::2] = [x1]',
+           lambda hl: _set(hl, slice(None, None, 2), ['x1']))
+    for key in (0, -1, 6, slice(1, 3), slice(None, None, 2),
+                slice(None, None, -3)):
+        _check(label, cls, 'del hl[%r]' % key, lambda hl: _delete(hl, key))
+    # a ranged string, as extend() takes
+    mine = cls(HOSTS)
+    mine[1:3] = 'x[1-2]'
+    checkutil.expect('%s: hl[1:3] = x[1-2]' % label, list(mine),
+                     ['n1', 'x1', 'x2', 'n10', 'n4', 'a1'])
+
+    # comparisons, with each other and with lists
+    checkutil.expect('%s: == list' % label, cls(HOSTS) == HOSTS, True)
+    checkutil.expect('%s: list ==' % label, HOSTS == cls(HOSTS), True)
+    checkutil.expect('%s: == HostList' % label, cls(HOSTS) == cls(HOSTS),
+                     True)
+    checkutil.expect('%s: != reversed' % label,
+                     cls(HOSTS) != cls(HOSTS[::-1]), True)
+    checkutil.expect('%s: == reversed' % label,
+                     cls(HOSTS) == HOSTS[::-1], False)
+    checkutil.expect('%s: == string' % label, cls(HOSTS) == str(HOSTS),
+                     False)
+    checkutil.expect('%s: <' % label, cls(HOSTS) < cls(HOSTS + ['z1']),
+                     True)
+
+    # concatenation, which gives a new HostList, and +=, which doesn't
+    _check(label, cls, 'hl + list', lambda hl: hl + ['z1', 'z2'])
+    _check(label, cls, 'hl + HostList', lambda hl: hl + cls(['z1']))
+    _check(label, cls, 'list + hl', lambda hl: ['z1'] + hl)
+    checkutil.expect('%s: hl + ranged string' % label,
+                     list(cls(HOSTS) + 'z[1-2]'), HOSTS + ['z1', 'z2'])
+    checkutil.expect('%s: type of hl + list' % label,
+                     type(cls(HOSTS) + ['z1']), cls)
+    checkutil.expect('%s: type of list + hl' % label,
+                     type(['z1'] + cls(HOSTS)), cls)
+    _check(label, cls, 'hl += list', lambda hl: _iadd(hl, ['z1']) is hl)
+    mine = cls(HOSTS)
+    checkutil.expect('%s: hl += ranged string' % label,
+                     list(_iadd(mine, 'z[1-2]')), HOSTS + ['z1', 'z2'])
+
+    # the rest of a list's methods
+    for args in ((), (0,), (-2,), (5,), (6,), (-7,)):
+        _check(label, cls, 'pop%r' % (args,), lambda hl: hl.pop(*args))
+    _check(label, cls, 'pop() when empty', lambda hl: hl.pop(), [])
+    for i in (1, -1, 100, -100):
+        _check(label, cls, 'insert(%d)' % i, lambda hl: hl.insert(i, 'i1'))
+    for args in (('n3',), ('n3', 3), ('n1', 0, 1), ('zz',)):
+        _check(label, cls, 'index%r' % (args,), lambda hl: hl.index(*args))
+    for host in ('n1', 'zz'):
+        _check(label, cls, 'count(%s)' % host, lambda hl: hl.count(host),
+               HOSTS + ['n1', 'n1'])
+    _check(label, cls, 'reverse()', lambda hl: hl.reverse())
+    _check(label, cls, 'reversed()', lambda hl: list(reversed(hl)))
+    # not a list method until Python 3
+    mine = cls(HOSTS)
+    mine.clear()
+    checkutil.expect('%s: clear()' % label, list(mine), [])
+
+    # sorting: by prefix and then number, unless there's a key
+    mine = cls(['n10', 'n9', 'a2', 'n1'])
+    mine.sort()
+    checkutil.expect('%s: sort()' % label, list(mine),
+                     ['a2', 'n1', 'n9', 'n10'])
+    mine.sort(reverse=True)
+    checkutil.expect('%s: sort(reverse=True)' % label, list(mine),
+                     ['n10', 'n9', 'n1', 'a2'])
+    _check(label, cls, 'sort(key=len)', lambda hl: hl.sort(key=len))
+    _check(label, cls, 'sort(key=len, reverse=True)',
+           lambda hl: hl.sort(key=len, reverse=True))
+    mine = cls(['n10', 'n9', 'n10', 'n1'])
+    mine.uniq()
+    checkutil.expect('%s: uniq()' % label, list(mine), ['n1', 'n9', 'n10'])
+
+
+def perform_postop(pdshopt, session):
+    classes = [('python', hostlist.HostList)]
+    if type(pdshopt.wcoll) is not hostlist.HostList:
+        classes.insert(0, ('native', type(pdshopt.wcoll)))
+    for label, cls in classes:
+        check_sequence(label, cls)
+    checkutil.record('checked', ','.join(label for label, cls in classes))
+
+    wcoll = pdshopt.wcoll
+    wcoll[1:3] = 'x[1-2]'
+    del wcoll[0]
+    return len(checkutil.failures)
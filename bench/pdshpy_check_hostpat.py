@@ -0,0 +1,140 @@
+# Driver for the host pattern checks in bench/check_hostpat.c.
+#
+# perform_postop() puts every HostPatterns there is through the same
+# pattern sets and names: the native one (in-process), whose globs and
+# regular expressions are one DFA, and pdshpy.hostpat's (always), which
+# tries them one at a time with fnmatch and re. It records which it checked
+# in "checked". Then it takes MAINTENANCE out of the wcoll, and returns how
+# many answers differed from pdshpy.hostpat's or from what's expected.
+
+import random
+import sys
+
+from pdshpy import hostlist
+from pdshpy import hostpat
+from pdshpy import util
+
+import checkutil
+
+MAINTENANCE = '# comment\nnode[1-10],login1\nrack1*\nre:^gpu\\d+$\n'
+
+# sets of patterns, and the names to try them on
+SETS = [
+    MAINTENANCE,
+    'n?-ib\n  rack[12]*  \n\nglob:node[12]\n*[!a-z0-9]\nglob:x[!0-9]y',
+    # an unterminated [ is just a [
+    'glob:[a\nx[*',
+    're:^(ab|ba)+$\nre:\\d{3}\nre:[^a-z0-9-]\nre:^n.?.?-ib$\nre:b{2,3}a*$',
+    're:node0*1$\nre:^(r|rack)1[0-9]?(-ib)?$\nnode[01-04]\nr[8-12]',
+    # more DFA states than are kept, so it has to start again as it goes
+    're:a[ab]{13}$',
+]
+
+# a list to select from, and what MAINTENANCE selects from it
+FEW = 'node[9-12],rack1a,gpu3,other'
+FEW_SELECTED = ['node9', 'node10', 'rack1a', 'gpu3']
+
+# names which aren't hostlists, only for matches()
+BRACKETS = ['[a', 'x[', 'x[1', 'a']
+
+BAD = ['re:(a', 're:a{2,1}', 'node[1-', 'good\nre:)']
+
+# what the native type turns down, as a DFA can't do it
+NATIVE_ONLY_BAD = ['re:(a)\\1', 're:(?=a)', 're:\\bnode']
+
+WORDS = ['n', 'node', 'rack', 'r', 'login', 'gpu', 'x', 'y', 'ab', 'ba', '-ib',
+         '1', '01', '2', '10', '12', '007', '-', '_', '.', 'A']
+
+
+def names():
+    """
+    The names each set is tried on: made up from WORDS and from a and b,
+    the same every run.
+    """
+    rand = random.Random(1)
+    made = ['node1', 'node10', 'node11', 'node01', 'login1', 'login', 'gpu12',
+            'gpu12x', 'rack12', 'rack1-ib', 'r1-ib', 'n1-ib', 'n12-ib',
+            'node2', 'x_y', 'xay', 'x1y', 'abab', 'bba', 'bbbb', 'r8', 'r08']
+    for i in range(400):
+        made.append(''.join(rand.choice(WORDS)
+                            for _ in range(rand.randint(1, 4))))
+    for i in range(400):
+        made.append(''.join(rand.choice('ab')
+                            for _ in range(rand.randint(10, 40))))
+    return made
+
+
+def _outcome(func):
+    try:
+        return func()
+    except Exception:
+        return sys.exc_info()[0]
+
+
+def answers(cls, hlcls):
+    """
+    What HostPatterns of cls make of SETS and BAD, given HostLists of hlcls
+    to remove from: a list of (question, answer) pairs, with HostLists as
+    lists.
+    """
+    hosts = names()
+    got = []
+    for i, text in enumerate(SETS):
+        p = cls(text)
+        got.append(('len(set %d)' % i, len(p)))
+        got.append(('str(set %d)' % i, str(p)))
+        got.append(('set %d matches' % i,
+                    [h for h in hosts if p.matches(h)]))
+        got.append(('in set %d' % i, [h for h in hosts if h in p]))
+        got.append(('set %d selects' % i, list(p.select(hosts))))
+        got.append(('set %d matches %s' % (i, BRACKETS),
+                    [p.matches(h) for h in BRACKETS]))
+        got.append(('set %d selects from %s' % (i, FEW),
+                    list(p.select(FEW))))
+        got.append(('set %d excludes' % i,
+                    list(p.exclude(','.join(hosts[:50])))))
+        wcoll = hlcls(hosts)
+        removed = p.remove_from(wcoll)
+        got.append(('set %d removes' % i, (removed, list(wcoll))))
+        got.append(('set %d removes from a list' % i,
+                    _outcome(lambda: p.remove_from(list(hosts)))))
+    for text in BAD:
+        got.append(('compiling %r' % text, _outcome(lambda: cls(text))))
+    return got
+
+
+def expected():
+    want = {
+        'len(set 0)': 3,
+        'len(set 1)': 5,
+        'set 0 selects from %s' % FEW: FEW_SELECTED,
+        'set 2 matches %s' % BRACKETS: [True, True, True, False],
+        'set 0 removes from a list': TypeError,
+    }
+    for text in BAD:
+        want['compiling %r' % text] = ValueError
+    return want
+
+
+def collect_hosts(pdshopt, session):
+    return hostlist.expand('node[9-12],rack1a,gpu3,other,login1')
+
+
+def perform_postop(pdshopt, session):
+    classes = [('python', hostpat.HostPatterns, hostlist.HostList)]
+    if util.HostPatterns is not hostpat.HostPatterns:
+        classes.insert(0, ('native', util.HostPatterns, util.HostList))
+    want = dict(answers(hostpat.HostPatterns, hostlist.HostList))
+    for what, answer in sorted(expected().items()):
+        checkutil.expect('python: %s' % what, want[what], answer)
+    for label, cls, hlcls in classes[:-1]:
+        for what, answer in answers(cls, hlcls):
+            checkutil.expect('%s: %s' % (label, what), answer, want[what])
+        for text in NATIVE_ONLY_BAD:
+            checkutil.expect('%s: compiling %r' % (label, text),
+                             _outcome(lambda: cls(text)), ValueError)
+    checkutil.record('checked', ','.join(c[0] for c in classes))
+
+    removed = util.HostPatterns(MAINTENANCE).remove_from(pdshopt.wcoll)
+    checkutil.expect('removed from the wcoll', removed, 5)
+    return len(checkutil.failures)
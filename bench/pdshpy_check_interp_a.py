@@ -0,0 +1,23 @@
+# The first of two chained drivers for the subinterpreter checks in
+# bench/check_interp.c: it marks pdshpy.util in its interpreter, finds byt1
+# and byt2, given as bytes, and has host source "hold_a" hold its GIL for
+# half a second (see checkutil.hold_gil()).
+
+from pdshpy import util
+
+import checkutil
+
+
+def initialize(session):
+    checkutil.long_switch_interval()
+    util._check_marked_by = 'pdshpy_check_interp_a'
+    util.register_host_source('hold_a', hold)
+
+
+def hold(pdshopt, session):
+    checkutil.hold_gil(0.5)
+    return ['hold_a']
+
+
+def collect_hosts(pdshopt, session):
+    return [b'byt1', b'byt2']
@@ -0,0 +1,24 @@
+# The second of two chained drivers for the subinterpreter checks in
+# bench/check_interp.c: it records in "shared_util" whether it sees the mark
+# pdshpy_check_interp_a left on pdshpy.util, which it wouldn't in an
+# interpreter of its own, finds str1, and has host source "hold_b" hold its
+# GIL for half a second.
+
+from pdshpy import util
+
+import checkutil
+
+
+def initialize(session):
+    checkutil.long_switch_interval()
+    checkutil.record('shared_util', int(hasattr(util, '_check_marked_by')))
+    util.register_host_source('hold_b', hold)
+
+
+def hold(pdshopt, session):
+    checkutil.hold_gil(0.5)
+    return ['hold_b']
+
+
+def collect_hosts(pdshopt, session):
+    return ['str1']
@@ -0,0 +1,148 @@
+# Driver for the partitioning checks in bench/check_hostlist.c.
+#
+# perform_postop() cuts the same lists into chunks, batches and interleaved
+# parts, and samples them, with every HostList there is: the native one
+# pdsh's wcoll is (in-process), and pdshpy.hostlist's (always). Parts
+# should be what slicing a plain list gives, and both should sample the
+# same hosts. It records which it checked in "partitioned", and returns how
+# many answers went wrong.
+
+import sys
+
+from pdshpy import hostlist
+
+import checkutil
+
+LISTS = [
+    'n[1-10]',
+    'node[01-20],login1,node[8-12]',
+    'a1,b2,a1,b2,a1',
+    'r[98-102],r[099-101],host-[1-3],login',
+    'big12345678901234567890,big1',
+    '',
+]
+
+PARTS = [1, 2, 3, 7, 40]
+
+PERCENTS = [0, 0.5, 10, 33.3, 50, 99.9, 100]
+
+SEEDS = [0, 1, 12345, 2 ** 63 + 5]
+
+
+def _outcome(func):
+    try:
+        return func()
+    except Exception:
+        return sys.exc_info()[0]
+
+
+def _lists(parts):
+    return [list(p) for p in parts]
+
+
+def model_chunks(hosts, n):
+    size, extra = divmod(len(hosts), n)
+    parts = []
+    for k in range(n):
+        start = k * size + min(k, extra)
+        parts.append(hosts[start:start + size + (k < extra)])
+    return parts
+
+
+def model_batches(hosts, n):
+    return [hosts[i:i + n] for i in range(0, len(hosts), n)]
+
+
+def model_interleave(hosts, n):
+    return [hosts[k::n] for k in range(n)]
+
+
+def check_partitions(label, cls):
+    for ranged in LISTS:
+        hl = cls(ranged)
+        hosts = list(hostlist.expand(ranged))
+        for n in PARTS:
+            for how, model in (('chunks', model_chunks),
+                               ('batches', model_batches),
+                               ('interleave', model_interleave)):
+                parts = getattr(hl, how)(n)
+                checkutil.expect('%s: %s(%d) of %s' % (label, how, n, ranged),
+                                 _lists(parts), model(hosts, n))
+                checkutil.expect('%s: type of %s' % (label, how),
+                                 set(type(p) for p in parts) - set([cls]),
+                                 set())
+        checkutil.expect('%s: hosts after partitioning %s' % (label, ranged),
+                         list(hl), hosts)
+        for how in ('chunks', 'batches', 'interleave'):
+            checkutil.expect('%s: %s(0)' % (label, how),
+                             _outcome(lambda: getattr(hl, how)(0)),
+                             ValueError)
+    for percent in (-1, 100.5):
+        checkutil.expect('%s: sample(%r)' % (label, percent),
+                         _outcome(lambda: cls('n1').sample(percent)),
+                         ValueError)
+
+
+def samples(cls):
+    """
+    What HostLists of cls sample from LISTS and a list of 10000 hosts, for
+    each of PERCENTS and SEEDS, as lists.
+    """
+    got = {}
+    for ranged in LISTS + ['r[1-10000]']:
+        hl = cls(ranged)
+        for percent in PERCENTS:
+            for seed in SEEDS:
+                got[ranged, percent, seed] = list(hl.sample(percent, seed))
+    return got
+
+
+def check_sampling(got):
+    """
+    What's expected of a sample, given pdshpy.hostlist's samples.
+    """
+    every = hostlist.expand('r[1-10000]')
+    for seed in SEEDS:
+        last = []
+        for percent in PERCENTS:
+            picked = got['r[1-10000]', percent, seed]
+            chosen = set(picked)
+            what = 'python: sample(%r, %r)' % (percent, seed)
+            checkutil.expect('%s in order' % what,
+                             picked, [h for h in every if h in chosen])
+            checkutil.expect('%s picks what smaller ones did' % what,
+                             set(last) - chosen, set())
+            checkutil.expect('%s picks about that many' % what,
+                             abs(len(picked) - percent * 100) <= 200, True)
+            last = picked
+        # the same hosts, whatever list they're in
+        part = hostlist.HostList('r[500-600]').sample(33.3, seed)
+        within = set(hostlist.expand('r[500-600]'))
+        checkutil.expect('python: sample(33.3, %r) of part' % seed,
+                         list(part),
+                         [h for h in got['r[1-10000]', 33.3, seed]
+                          if h in within])
+    checkutil.expect('python: sample(0)', got['n[1-10]', 0, 0], [])
+    checkutil.expect('python: sample(100)', got['n[1-10]', 100, 0],
+                     hostlist.expand('n[1-10]'))
+    checkutil.expect('python: seeds differ',
+                     got['r[1-10000]', 50, 0] != got['r[1-10000]', 50, 1],
+                     True)
+
+
+def perform_postop(pdshopt, session):
+    classes = [('python', hostlist.HostList)]
+    if type(pdshopt.wcoll) is not hostlist.HostList:
+        classes.insert(0, ('native', type(pdshopt.wcoll)))
+    for label, cls in classes:
+        check_partitions(label, cls)
+    want = samples(hostlist.HostList)
+    check_sampling(want)
+    for label, cls in classes[:-1]:
+        got = samples(cls)
+        for key in sorted(want):
+            checkutil.expect('%s: sample%r' % (label, key), got[key],
+                             want[key])
+    checkutil.record('partitioned',
+                     ','.join(label for label, cls in classes))
+    return len(checkutil.failures)
@@ -0,0 +1,39 @@
+# Driver for the prefetch checks in bench/check_prefetch.c.
+#
+# prefetch_hosts() finds pf1 and pf2, or fails with PDSHPY_CHECK_FAIL set;
+# collect_hosts() finds col1. Both count their calls, and -X cancels the
+# prefetch.
+
+import os
+
+from pdshpy import util
+
+import checkutil
+
+
+def initialize(session):
+    util.register_option('X', None, 'DSH,PCP', cancel,
+                         'Cancel the prefetch (check option)')
+
+
+def cancel(opt, arg, pdshopt, session):
+    util.cancel_prefetch(session)
+
+
+def prefetch_hosts(session):
+    checkutil.bump('prefetches')
+    if os.environ.get('PDSHPY_CHECK_FAIL'):
+        raise RuntimeError('prefetch failed, as asked')
+    # from the prefetch's own thread, which in a server has to know which
+    # connection this goes back on
+    util.record_reachable(['pf1'])
+    return ['pf1', 'pf2']
+
+
+def collect_hosts(pdshopt, session):
+    checkutil.bump('collections')
+    return ['col1']
+
+
+def perform_postop(pdshopt, session):
+    return 0
@@ -0,0 +1,57 @@
+# Driver for the server checks in bench/check_server.c.
+#
+# -P names the hosts' prefix and sets the fanout, -S makes collect_hosts()
+# take that many seconds; collect_hosts() records the pid it ran in and the
+# most runs it has seen inside it at once, and perform_postop() leaves out
+# the first host.
+
+import os
+import threading
+import time
+
+from pdshpy import util
+
+import checkutil
+
+# from outside, to let runs into collect_hosts() side by side
+threadsafe = os.environ.get('PDSHPY_CHECK_THREADSAFE') == '1'
+
+_lock = threading.Lock()
+_inside = [0, 0]
+
+
+def initialize(session):
+    session.prefix = 'node'
+    session.sleep = 0
+    util.register_option('P', 'prefix', 'DSH,PCP', set_prefix,
+                         'Name hosts with prefix (check option)')
+    util.register_option('S', 'seconds', 'DSH,PCP', set_sleep,
+                         'Take seconds to collect hosts (check option)')
+
+
+def set_prefix(opt, arg, pdshopt, session):
+    session.prefix = arg
+    pdshopt.fanout = 7
+
+
+def set_sleep(opt, arg, pdshopt, session):
+    session.sleep = float(arg)
+
+
+def collect_hosts(pdshopt, session):
+    checkutil.record('collect_pid', os.getpid())
+    with _lock:
+        _inside[0] += 1
+        _inside[1] = max(_inside)
+    time.sleep(session.sleep)
+    with _lock:
+        _inside[0] -= 1
+        checkutil.record('most_inside', _inside[1])
+    if session.prefix != 'node':
+        checkutil.expect('fanout from -P', pdshopt.fanout, 7)
+    return ['%s%d' % (session.prefix, i) for i in range(1, 4)]
+
+
+def perform_postop(pdshopt, session):
+    del pdshopt.wcoll[0]
+    return len(checkutil.failures)
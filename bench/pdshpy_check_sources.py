@@ -0,0 +1,49 @@
+# Driver for the host source checks in bench/check_sources.c.
+#
+# Alongside collect_hosts(), which finds c1, host source "a" sets the cache
+# key and finds a1 and a2, and "b" finds b1 and c1 again, each taking half a
+# second. Source "slow" finds s1, and then with -S takes that many seconds
+# to finish, with a timeout of one second.
+
+import time
+
+from pdshpy import util
+
+
+def initialize(session):
+    session.slow = 0
+    util.register_option('S', 'seconds', 'DSH,PCP', set_slow,
+                         'Make a host source take seconds (check option)')
+    util.register_host_source('a', source_a)
+    util.register_host_source('b', source_b)
+    util.register_host_source('slow', source_slow, timeout=1.0)
+
+
+def set_slow(opt, arg, pdshopt, session):
+    session.slow = float(arg)
+
+
+def source_a(pdshopt, session):
+    # from the source's own thread, which in a server has to know which
+    # connection this goes back on
+    util.set_cache_key('sources')
+    time.sleep(0.5)
+    return ['a1', 'a2']
+
+
+def source_b(pdshopt, session):
+    time.sleep(0.5)
+    return ['b1', 'c1']
+
+
+def source_slow(pdshopt, session):
+    yield 's1'
+    time.sleep(session.slow)
+
+
+def collect_hosts(pdshopt, session):
+    return ['c1']
+
+
+def perform_postop(pdshopt, session):
+    return 0
@@ -0,0 +1,16 @@
+# Driver for the coroutine checks in bench/check_coro.c which has none:
+# collect_hosts() finds sync1, and perform_postop() records in
+# "asyncio_loaded" whether anything loaded asyncio on its account.
+
+import sys
+
+import checkutil
+
+
+def collect_hosts(pdshopt, session):
+    return ['sync1']
+
+
+def perform_postop(pdshopt, session):
+    checkutil.record('asyncio_loaded', int('asyncio' in sys.modules))
+    return 0
@@ -0,0 +1,18 @@
+# Driver module for bench/fanout.py.
+#
+# Supplies a working collective of PDSHPY_BENCH_HOSTS made-up hosts, and
+# makes the loopback rcmd module the default for them.
+
+import os
+
+from pdshpy import util
+
+
+def collect_hosts(pdshopt, session):
+    nhosts = int(os.environ.get('PDSHPY_BENCH_HOSTS', '16'))
+    util.rcmd_register_defaults(None, 'loopback')
+    return ['lnode%d' % i for i in range(1, nhosts + 1)]
+
+
+def perform_postop(pdshopt, session):
+    return 0
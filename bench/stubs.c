@@ -0,0 +1,293 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* Stand-ins for the pdsh functions pdshpy.so expects to find in the pdsh
+ * executable, so that the module can be driven without pdsh. These are
+ * simple rather than fast but they follow the semantics documented in the
+ * pdsh headers, including who owns returned memory. The hostlist is in
+ * bench/hostlist_stub.c, so that pdsh's own can take its place.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "src/common/fd.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xpoll.h"
+#include "src/pdsh/opt.h"
+#include "src/pdsh/rcmd.h"
+
+#include "stubs.h"
+
+/* ----[ xmalloc ]---- */
+
+void *
+Malloc(size_t size)
+{
+    void *p = calloc(1, size ? size : 1);
+
+    if (p == NULL)
+    {
+        fprintf(stderr, "stubs: out of memory\n");
+        abort();
+    }
+    return p;
+}
+
+void
+Realloc(void **p, size_t size)
+{
+    if ((*p = realloc(*p, size)) == NULL)
+    {
+        fprintf(stderr, "stubs: out of memory\n");
+        abort();
+    }
+}
+
+void
+Free(void **p)
+{
+    free(*p);
+    *p = NULL;
+}
+
+char *
+Strdup(const char *str)
+{
+    char *dup = NULL;
+
+    if (str == NULL)
+        return NULL;
+    dup = Malloc(strlen(str) + 1);
+    strcpy(dup, str);
+    return dup;
+}
+
+/* ----[ opt / rcmd ]---- */
+
+struct pdsh_module_option stub_options[STUB_MAX_OPTIONS];
+int stub_noptions = 0;
+int stub_verbose = 0;
+
+/* pdsh only checks for conflicts here and looks options up in the module's
+ * own table later (which pdshpy reallocates as it goes), so keep a copy */
+bool
+opt_register(struct pdsh_module_option *popt)
+{
+    int i;
+
+    for (i = 0; i < stub_noptions; i++)
+        if (stub_options[i].opt == popt->opt)
+            return false;
+    if (stub_noptions == STUB_MAX_OPTIONS)
+        return false;
+    stub_options[stub_noptions++] = *popt;
+    return true;
+}
+
+pers_t
+pdsh_personality(void)
+{
+    return DSH;
+}
+
+int
+rcmd_register_defaults(char *hosts, char *rcmd_type, char *user)
+{
+    if (stub_verbose)
+        fprintf(stderr, "stubs: rcmd_register_defaults(%s, %s, %s)\n",
+                hosts ? hosts : "(null)", rcmd_type ? rcmd_type : "(null)",
+                user ? user : "(null)");
+    return 0;
+}
+
+char *
+rcmd_get_default_module(void)
+{
+    return "ssh";
+}
+
+/* ----[ err ]---- */
+
+void
+err(char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+void
+out(char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stdout, fmt, ap);
+    va_end(ap);
+}
+
+void
+errx(char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    exit(1);
+}
+
+/* ----[ fd ]---- */
+
+static int
+fd_lock(int fd, int cmd, int type)
+{
+    struct flock lock;
+
+    lock.l_type = type;
+    lock.l_start = 0;
+    lock.l_whence = SEEK_SET;
+    lock.l_len = 0;
+    return fcntl(fd, cmd, &lock);
+}
+
+int
+fd_set_close_on_exec(int fd)
+{
+    return fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+int
+fd_set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+
+    if (flags < 0)
+        return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+int
+fd_get_read_lock(int fd)
+{
+    return fd_lock(fd, F_SETLK, F_RDLCK);
+}
+
+int
+fd_get_readw_lock(int fd)
+{
+    return fd_lock(fd, F_SETLKW, F_RDLCK);
+}
+
+int
+fd_get_write_lock(int fd)
+{
+    return fd_lock(fd, F_SETLK, F_WRLCK);
+}
+
+int
+fd_get_writew_lock(int fd)
+{
+    return fd_lock(fd, F_SETLKW, F_WRLCK);
+}
+
+int
+fd_release_lock(int fd)
+{
+    return fd_lock(fd, F_SETLK, F_UNLCK);
+}
+
+ssize_t
+fd_read_n(int fd, void *buf, size_t n)
+{
+    size_t done = 0;
+    ssize_t r;
+
+    while (done < n)
+    {
+        if ((r = read(fd, (char *)buf + done, n - done)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (r == 0)
+            break;
+        done += r;
+    }
+    return done;
+}
+
+ssize_t
+fd_write_n(int fd, void *buf, size_t n)
+{
+    size_t done = 0;
+    ssize_t w;
+
+    while (done < n)
+    {
+        if ((w = write(fd, (char *)buf + done, n - done)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        done += w;
+    }
+    return done;
+}
+
+/* ----[ xpoll ]---- */
+
+int
+xpoll(struct xpollfd *xfds, int nfds, int timeout)
+{
+    struct pollfd *pfds = Malloc(nfds * sizeof(struct pollfd));
+    int i, rc;
+
+    for (i = 0; i < nfds; i++)
+    {
+        pfds[i].fd = xfds[i].fd;
+        pfds[i].events = ((xfds[i].events & XPOLLREAD) ? POLLIN : 0)
+                       | ((xfds[i].events & XPOLLWRITE) ? POLLOUT : 0);
+        pfds[i].revents = 0;
+    }
+    rc = poll(pfds, nfds, timeout < 0 ? -1 : timeout * 1000);
+    for (i = 0; i < nfds; i++)
+    {
+        xfds[i].revents = 0;
+        if (pfds[i].revents & POLLIN)
+            xfds[i].revents |= XPOLLREAD;
+        if (pfds[i].revents & POLLOUT)
+            xfds[i].revents |= XPOLLWRITE;
+        if (pfds[i].revents & POLLNVAL)
+            xfds[i].revents |= XPOLLINVAL;
+        if (pfds[i].revents & (POLLERR | POLLHUP))
+            xfds[i].revents |= XPOLLERR;
+    }
+    free(pfds);
+    return rc;
+}
@@ -0,0 +1,32 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#ifndef _PDSHPY_BENCH_STUBS_H
+#define _PDSHPY_BENCH_STUBS_H
+
+#include "src/pdsh/opt.h"
+
+#define STUB_MAX_OPTIONS 64
+
+/* copies of every option table entry handed to opt_register(), in order */
+extern struct pdsh_module_option stub_options[STUB_MAX_OPTIONS];
+extern int stub_noptions;
+
+/* nonzero to log calls like rcmd_register_defaults() */
+extern int stub_verbose;
+
+#endif /* !_PDSHPY_BENCH_STUBS_H */
@@ -0,0 +1,699 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap.h"
+
+/* in memory, run containers are turned into one of the other two */
+struct container {
+    uint16_t key;
+    uint8_t type;           /* BITMAP_ARRAY or BITMAP_BITMAP */
+    uint8_t owned;          /* free data along with the bitmap */
+    uint32_t card;
+    union {
+        const uint16_t *array;
+        const uint64_t *words;
+        void *data;
+    } u;
+};
+
+struct bitmap {
+    struct container *c;
+    uint32_t n;
+    uint32_t cap;
+};
+
+enum op { OP_AND, OP_OR, OP_ANDNOT };
+
+struct bitmap *
+bitmap_new(void)
+{
+    return calloc(1, sizeof(struct bitmap));
+}
+
+void
+bitmap_free(struct bitmap *bm)
+{
+    uint32_t i;
+
+    if (bm == NULL)
+        return;
+    for (i = 0; i < bm->n; i++)
+        if (bm->c[i].owned)
+            free(bm->c[i].u.data);
+    free(bm->c);
+    free(bm);
+}
+
+/* a new container on the end, or NULL */
+static struct container *
+push(struct bitmap *bm, uint16_t key)
+{
+    struct container *c = NULL;
+    uint32_t cap;
+
+    if (bm->n == bm->cap)
+    {
+        cap = bm->cap ? bm->cap * 2 : 4;
+        if ((c = realloc(bm->c, cap * sizeof(*c))) == NULL)
+            return NULL;
+        bm->c = c;
+        bm->cap = cap;
+    }
+    c = &bm->c[bm->n++];
+    memset(c, 0, sizeof(*c));
+    c->key = key;
+    return c;
+}
+
+static uint32_t
+count_words(const uint64_t *words)
+{
+    uint32_t card = 0;
+    int i;
+
+    for (i = 0; i < BITMAP_WORDS; i++)
+        card += __builtin_popcountll(words[i]);
+    return card;
+}
+
+/* Add 'words' (which the bitmap takes over) as the container for 'key', as
+ * an array if they're sparse enough, or not at all if they're empty. */
+static int
+push_words(struct bitmap *bm, uint16_t key, uint64_t *words)
+{
+    struct container *c = NULL;
+    uint16_t *array = NULL;
+    uint32_t card = count_words(words);
+    uint32_t i, n = 0;
+    uint64_t w;
+
+    if (card == 0)
+    {
+        free(words);
+        return 0;
+    }
+    if (card <= BITMAP_ARRAY_MAX)
+    {
+        if ((array = malloc(card * sizeof(*array))) == NULL)
+            goto nomem;
+        for (i = 0; i < BITMAP_WORDS; i++)
+            for (w = words[i]; w != 0; w &= w - 1)
+                array[n++] = i * 64 + __builtin_ctzll(w);
+        free(words);
+        words = NULL;
+    }
+    if ((c = push(bm, key)) == NULL)
+        goto nomem;
+    c->owned = 1;
+    c->card = card;
+    if (array != NULL)
+    {
+        c->type = BITMAP_ARRAY;
+        c->u.array = array;
+    }
+    else
+    {
+        c->type = BITMAP_BITMAP;
+        c->u.words = words;
+    }
+    return 0;
+
+nomem:
+    free(array);
+    free(words);
+    errno = ENOMEM;
+    return -1;
+}
+
+/* Add 'n' array values (which the bitmap takes over) as the container for
+ * 'key', as a bitmap if there are too many for an array. */
+static int
+push_array(struct bitmap *bm, uint16_t key, uint16_t *array, uint32_t n)
+{
+    struct container *c = NULL;
+    uint64_t *words = NULL;
+    uint32_t i;
+
+    if (n == 0)
+    {
+        free(array);
+        return 0;
+    }
+    if (n > BITMAP_ARRAY_MAX)
+    {
+        if ((words = calloc(BITMAP_WORDS, sizeof(*words))) == NULL)
+        {
+            free(array);
+            errno = ENOMEM;
+            return -1;
+        }
+        for (i = 0; i < n; i++)
+            words[array[i] / 64] |= 1ULL << (array[i] % 64);
+        free(array);
+        return push_words(bm, key, words);
+    }
+    if ((c = push(bm, key)) == NULL)
+    {
+        free(array);
+        errno = ENOMEM;
+        return -1;
+    }
+    c->type = BITMAP_ARRAY;
+    c->owned = 1;
+    c->card = n;
+    c->u.array = array;
+    return 0;
+}
+
+/* set bits 'first' to 'last' (inclusive) */
+static void
+set_bits(uint64_t *words, uint32_t first, uint32_t last)
+{
+    uint32_t i;
+
+    for (i = first; i <= last && i % 64 != 0; i++)
+        words[i / 64] |= 1ULL << (i % 64);
+    for (; i + 63 <= last; i += 64)
+        words[i / 64] = ~0ULL;
+    for (; i <= last; i++)
+        words[i / 64] |= 1ULL << (i % 64);
+}
+
+/* the highest value in 'c', which isn't empty */
+static uint32_t
+last_value(const struct container *c)
+{
+    int i;
+
+    if (c->type == BITMAP_ARRAY)
+        return c->u.array[c->card - 1];
+    for (i = BITMAP_WORDS - 1; c->u.words[i] == 0; i--)
+        ;
+    return i * 64 + 63 - __builtin_clzll(c->u.words[i]);
+}
+
+/* Turn 'c' into an owned bitmap container, so that more can be set in it. */
+static int
+to_words(struct container *c)
+{
+    uint64_t *words = NULL;
+    uint32_t i;
+
+    if (c->type == BITMAP_BITMAP && c->owned)
+        return 0;
+    if ((words = calloc(BITMAP_WORDS, sizeof(*words))) == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (c->type == BITMAP_BITMAP)
+        memcpy(words, c->u.words, BITMAP_WORDS * sizeof(*words));
+    else
+        for (i = 0; i < c->card; i++)
+            words[c->u.array[i] / 64] |= 1ULL << (c->u.array[i] % 64);
+    if (c->owned)
+        free(c->u.data);
+    c->type = BITMAP_BITMAP;
+    c->owned = 1;
+    c->u.words = words;
+    return 0;
+}
+
+/* Add 'lo' to 'hi' (inclusive) to 'c', all above what's in it already. */
+static int
+add_range(struct container *c, uint32_t lo, uint32_t hi)
+{
+    uint16_t *array = NULL;
+    uint32_t n = hi - lo + 1;
+
+    if (c->type == BITMAP_ARRAY && c->owned && c->card + n <= BITMAP_ARRAY_MAX)
+    {
+        if ((array = realloc(c->u.data, (c->card + n) * sizeof(*array)))
+            == NULL)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        for (; lo <= hi; lo++)
+            array[c->card++] = lo;
+        c->u.array = array;
+        return 0;
+    }
+    if (to_words(c) < 0)
+        return -1;
+    set_bits(c->u.data, lo, hi);
+    c->card += n;
+    return 0;
+}
+
+int
+bitmap_append_range(struct bitmap *bm, uint32_t first, uint32_t last)
+{
+    struct container *c = NULL;
+    uint32_t lo, hi;
+    uint16_t key;
+
+    while (first < last)
+    {
+        key = first >> 16;
+        lo = first & 0xffff;
+        hi = (last - first > 0xffff - lo) ? 0xffff : lo + (last - first) - 1;
+        c = bm->n > 0 ? &bm->c[bm->n - 1] : NULL;
+        if (c != NULL && (c->key > key
+                          || (c->key == key && last_value(c) >= lo)))
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        if (c == NULL || c->key != key)
+        {
+            /* an empty array, to be added to */
+            if ((c = push(bm, key)) == NULL)
+            {
+                errno = ENOMEM;
+                return -1;
+            }
+            c->type = BITMAP_ARRAY;
+            c->owned = 1;
+        }
+        if (add_range(c, lo, hi) < 0)
+        {
+            if (c->card == 0)
+                bm->n--;
+            return -1;
+        }
+        first += hi - lo + 1;
+    }
+    return 0;
+}
+
+int
+bitmap_append_container(struct bitmap *bm, uint16_t key, int type,
+                        const void *data, uint32_t count)
+{
+    const uint16_t *values = data;
+    struct container *c = NULL;
+    uint64_t *words = NULL;
+    uint32_t i;
+
+    if (bm->n > 0 && bm->c[bm->n - 1].key >= key)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    switch (type)
+    {
+    case BITMAP_ARRAY:
+        if (count == 0 || count > BITMAP_ARRAY_MAX)
+            break;
+        for (i = 1; i < count; i++)
+            if (values[i - 1] >= values[i])
+                break;
+        if (i < count)
+            break;
+        if ((c = push(bm, key)) == NULL)
+            goto nomem;
+        c->type = BITMAP_ARRAY;
+        c->card = count;
+        c->u.array = data;
+        return 0;
+    case BITMAP_BITMAP:
+        if (count != BITMAP_WORDS)
+            break;
+        if ((c = push(bm, key)) == NULL)
+            goto nomem;
+        c->type = BITMAP_BITMAP;
+        c->card = count_words(data);
+        c->u.words = data;
+        return 0;
+    case BITMAP_RUN:
+        /* no more than every other value can start a run */
+        if (count == 0 || count > 0x8000)
+            break;
+        if ((words = calloc(BITMAP_WORDS, sizeof(*words))) == NULL)
+            goto nomem;
+        for (i = 0; i < count; i++)
+        {
+            if (values[i * 2] > values[i * 2 + 1])
+            {
+                free(words);
+                errno = EINVAL;
+                return -1;
+            }
+            set_bits(words, values[i * 2], values[i * 2 + 1]);
+        }
+        return push_words(bm, key, words);
+    }
+    errno = EINVAL;
+    return -1;
+
+nomem:
+    errno = ENOMEM;
+    return -1;
+}
+
+uint64_t
+bitmap_count(const struct bitmap *bm)
+{
+    uint64_t count = 0;
+    uint32_t i;
+
+    for (i = 0; i < bm->n; i++)
+        count += bm->c[i].card;
+    return count;
+}
+
+static const struct container *
+find(const struct bitmap *bm, uint16_t key)
+{
+    uint32_t lo = 0, hi = bm->n, mid;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (bm->c[mid].key == key)
+            return &bm->c[mid];
+        if (bm->c[mid].key < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+int
+bitmap_contains(const struct bitmap *bm, uint32_t id)
+{
+    const struct container *c = find(bm, id >> 16);
+    uint16_t low = id & 0xffff;
+    uint32_t lo, hi, mid;
+
+    if (c == NULL)
+        return 0;
+    if (c->type == BITMAP_BITMAP)
+        return (c->u.words[low / 64] >> (low % 64)) & 1;
+    for (lo = 0, hi = c->card; lo < hi;)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (c->u.array[mid] == low)
+            return 1;
+        if (c->u.array[mid] < low)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return 0;
+}
+
+/* add a container the same as 'c' to 'bm', sharing its data if that
+ * belongs to someone else, or copying it if it belongs to another bitmap */
+static int
+push_copy(struct bitmap *bm, const struct container *c)
+{
+    struct container *copy = NULL;
+    size_t size;
+    void *data = NULL;
+
+    if (c->owned)
+    {
+        size = (c->type == BITMAP_BITMAP) ? BITMAP_WORDS * sizeof(uint64_t)
+                                          : c->card * sizeof(uint16_t);
+        if ((data = malloc(size)) == NULL)
+            goto nomem;
+        memcpy(data, c->u.data, size);
+    }
+    if ((copy = push(bm, c->key)) == NULL)
+        goto nomem;
+    *copy = *c;
+    if (data != NULL)
+        copy->u.data = data;
+    return 0;
+
+nomem:
+    free(data);
+    errno = ENOMEM;
+    return -1;
+}
+
+/* the container's IDs, as bitmap words */
+static void
+load_words(uint64_t *words, const struct container *c)
+{
+    uint32_t i;
+
+    if (c->type == BITMAP_BITMAP)
+    {
+        memcpy(words, c->u.words, BITMAP_WORDS * sizeof(*words));
+        return;
+    }
+    memset(words, 0, BITMAP_WORDS * sizeof(*words));
+    for (i = 0; i < c->card; i++)
+        words[c->u.array[i] / 64] |= 1ULL << (c->u.array[i] % 64);
+}
+
+static int
+merge_arrays(struct bitmap *out, enum op op, const struct container *a,
+             const struct container *b)
+{
+    const uint16_t *x = a->u.array, *y = b->u.array;
+    uint16_t *result = NULL;
+    uint32_t i = 0, j = 0, n = 0;
+
+    if ((result = malloc((a->card + b->card) * sizeof(*result))) == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    while (i < a->card && j < b->card)
+    {
+        if (x[i] < y[j])
+        {
+            if (op != OP_AND)
+                result[n++] = x[i];
+            i++;
+        }
+        else if (x[i] > y[j])
+        {
+            if (op == OP_OR)
+                result[n++] = y[j];
+            j++;
+        }
+        else
+        {
+            if (op != OP_ANDNOT)
+                result[n++] = x[i];
+            i++;
+            j++;
+        }
+    }
+    if (op != OP_AND)
+        for (; i < a->card; i++)
+            result[n++] = x[i];
+    if (op == OP_OR)
+        for (; j < b->card; j++)
+            result[n++] = y[j];
+    return push_array(out, a->key, result, n);
+}
+
+static int
+combine(struct bitmap *out, enum op op, const struct container *a,
+        const struct container *b)
+{
+    uint64_t other[BITMAP_WORDS];
+    uint64_t *words = NULL;
+    const uint64_t *y = NULL;
+    int i;
+
+    if (a->type == BITMAP_ARRAY && b->type == BITMAP_ARRAY)
+        return merge_arrays(out, op, a, b);
+
+    if ((words = malloc(BITMAP_WORDS * sizeof(*words))) == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    load_words(words, a);
+    if (b->type == BITMAP_BITMAP)
+        y = b->u.words;
+    else
+    {
+        load_words(other, b);
+        y = other;
+    }
+
+    switch (op)
+    {
+    case OP_AND:
+        for (i = 0; i < BITMAP_WORDS; i++)
+            words[i] &= y[i];
+        break;
+    case OP_OR:
+        for (i = 0; i < BITMAP_WORDS; i++)
+            words[i] |= y[i];
+        break;
+    case OP_ANDNOT:
+        for (i = 0; i < BITMAP_WORDS; i++)
+            words[i] &= ~y[i];
+        break;
+    }
+    return push_words(out, a->key, words);
+}
+
+static struct bitmap *
+operate(enum op op, const struct bitmap *a, const struct bitmap *b)
+{
+    struct bitmap *out = NULL;
+    uint32_t i = 0, j = 0;
+    int rc = 0;
+
+    if ((out = bitmap_new()) == NULL)
+        return NULL;
+    while (rc == 0 && (i < a->n || j < b->n))
+    {
+        if (j == b->n || (i < a->n && a->c[i].key < b->c[j].key))
+        {
+            /* only in a */
+            if (op != OP_AND)
+                rc = push_copy(out, &a->c[i]);
+            i++;
+        }
+        else if (i == a->n || b->c[j].key < a->c[i].key)
+        {
+            /* only in b */
+            if (op == OP_OR)
+                rc = push_copy(out, &b->c[j]);
+            j++;
+        }
+        else
+            rc = combine(out, op, &a->c[i++], &b->c[j++]);
+    }
+    if (rc < 0)
+    {
+        bitmap_free(out);
+        return NULL;
+    }
+    return out;
+}
+
+struct bitmap *
+bitmap_copy(const struct bitmap *bm)
+{
+    struct bitmap *copy = NULL;
+    uint32_t i;
+
+    if ((copy = bitmap_new()) == NULL)
+        return NULL;
+    for (i = 0; i < bm->n; i++)
+    {
+        if (push_copy(copy, &bm->c[i]) < 0)
+        {
+            bitmap_free(copy);
+            return NULL;
+        }
+    }
+    return copy;
+}
+
+struct bitmap *
+bitmap_and(const struct bitmap *a, const struct bitmap *b)
+{
+    return operate(OP_AND, a, b);
+}
+
+struct bitmap *
+bitmap_or(const struct bitmap *a, const struct bitmap *b)
+{
+    return operate(OP_OR, a, b);
+}
+
+struct bitmap *
+bitmap_andnot(const struct bitmap *a, const struct bitmap *b)
+{
+    return operate(OP_ANDNOT, a, b);
+}
+
+/* runs are put together here, so they can carry on across words and
+ * containers */
+struct run_state {
+    int (*fn)(void *, uint32_t, uint32_t);
+    void *arg;
+    uint64_t first, last;       /* the run so far; last is one past it */
+};
+
+static int
+extend_run(struct run_state *st, uint64_t first, uint64_t last)
+{
+    if (st->last == first && st->last > st->first)
+    {
+        st->last = last;
+        return 0;
+    }
+    if (st->last > st->first && st->fn(st->arg, st->first, st->last) < 0)
+        return -1;
+    st->first = first;
+    st->last = last;
+    return 0;
+}
+
+int
+bitmap_each_run(const struct bitmap *bm,
+                int (*fn)(void *arg, uint32_t first, uint32_t last),
+                void *arg)
+{
+    struct run_state st = { fn, arg, 0, 0 };
+    const struct container *c = NULL;
+    uint64_t base, w, rest;
+    uint32_t i, j;
+    int start, len;
+
+    for (i = 0; i < bm->n; i++)
+    {
+        c = &bm->c[i];
+        base = (uint64_t)c->key << 16;
+        if (c->type == BITMAP_ARRAY)
+        {
+            for (j = 0; j < c->card; j++)
+                if (extend_run(&st, base + c->u.array[j],
+                               base + c->u.array[j] + 1) < 0)
+                    return -1;
+            continue;
+        }
+        for (j = 0; j < BITMAP_WORDS; j++)
+        {
+            for (w = c->u.words[j]; w != 0;)
+            {
+                start = __builtin_ctzll(w);
+                rest = ~(w >> start);
+                len = rest ? __builtin_ctzll(rest) : 64 - start;
+                if (extend_run(&st, base + j * 64 + start,
+                               base + j * 64 + start + len) < 0)
+                    return -1;
+                if (start + len == 64)
+                    break;
+                w &= ~(((1ULL << len) - 1) << start);
+            }
+        }
+    }
+    if (st.last > st.first)
+        return fn(arg, st.first, st.last);
+    return 0;
+}
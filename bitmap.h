@@ -0,0 +1,89 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* Compressed bitmaps of 32-bit IDs (host IDs, in a host database), in the
+ * style of Roaring bitmaps: IDs are grouped by their high 16 bits into
+ * containers, each of which is either a sorted array of the low 16 bits
+ * (when there are few of them) or a plain 65536-bit bitmap. Set operations
+ * go container by container; bitmap containers are combined a 64-bit word
+ * at a time, in loops simple enough for the compiler to vectorize.
+ *
+ * Containers can point at data which lives elsewhere (in a mapped host
+ * database, say) rather than owning a copy of it; that data has to outlive
+ * any bitmap made from it, including the results of operations on it.
+ */
+
+#ifndef _PDSHPY_BITMAP_H
+#define _PDSHPY_BITMAP_H
+
+#include <stdint.h>
+
+/* 64-bit words in a bitmap container */
+#define BITMAP_WORDS 1024
+
+/* the most values kept in an array container */
+#define BITMAP_ARRAY_MAX 4096
+
+/* container types, as also stored in host databases */
+enum bitmap_container_type {
+    BITMAP_ARRAY = 1,       /* sorted uint16_t values */
+    BITMAP_BITMAP = 2,      /* BITMAP_WORDS uint64_t words */
+    BITMAP_RUN = 3,         /* uint16_t (first, last) pairs, sorted */
+};
+
+struct bitmap;
+
+/* a new, empty bitmap, or NULL if there's no memory */
+struct bitmap *bitmap_new(void);
+
+void bitmap_free(struct bitmap *bm);
+
+/* Add the IDs from 'first' up to (not including) 'last', which have to be
+ * above any already there. Returns 0, or -1 with errno set to EINVAL if
+ * they aren't, or ENOMEM. */
+int bitmap_append_range(struct bitmap *bm, uint32_t first, uint32_t last);
+
+/* Add a container, given in its stored form: 'count' array values, words
+ * or runs of type 'type', for the IDs whose high 16 bits are 'key'. Keys
+ * have to be added in increasing order. Array and bitmap data is used where
+ * it lies; runs are expanded. Returns 0, or -1 with errno set to EINVAL if
+ * the container makes no sense, or ENOMEM.
+ */
+int bitmap_append_container(struct bitmap *bm, uint16_t key, int type,
+                            const void *data, uint32_t count);
+
+uint64_t bitmap_count(const struct bitmap *bm);
+
+int bitmap_contains(const struct bitmap *bm, uint32_t id);
+
+/* a new bitmap with the same IDs as 'bm' (sharing its data), or NULL */
+struct bitmap *bitmap_copy(const struct bitmap *bm);
+
+/* New bitmaps of the IDs in both, either, or 'a' but not 'b'; NULL if
+ * there's no memory. They may share data with 'a' and 'b'. */
+struct bitmap *bitmap_and(const struct bitmap *a, const struct bitmap *b);
+struct bitmap *bitmap_or(const struct bitmap *a, const struct bitmap *b);
+struct bitmap *bitmap_andnot(const struct bitmap *a, const struct bitmap *b);
+
+/* Call fn(arg, first, last) for each run of consecutive IDs in 'bm', in
+ * order, with 'last' one past the end of the run. Stops, and returns -1,
+ * if 'fn' does; 0 otherwise. */
+int bitmap_each_run(const struct bitmap *bm,
+                    int (*fn)(void *arg, uint32_t first, uint32_t last),
+                    void *arg);
+
+#endif /* !_PDSHPY_BITMAP_H */
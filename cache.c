@@ -0,0 +1,370 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "src/common/fd.h"
+
+#include "pdshpy.h"
+#include "cache.h"
+
+/* An entry is a header line, then the key, then the ranged hosts:
+ *
+ *     pdshpy-cache 1\n
+ *     <time created> <key length> <hosts length>\n
+ *     <key><hosts>
+ *
+ * A file whose size doesn't add up (a writer died partway) is a miss.
+ */
+#define CACHE_MAGIC "pdshpy-cache 1\n"
+
+/* anything bigger than this isn't something we wrote */
+#define CACHE_MAX_ENTRY (64 * 1024 * 1024)
+
+static int
+resolve_ttl(int ttl)
+{
+    const char *ttlenv = getenv(PDSHPY_ENVIRON_CACHE_TTL);
+
+    /* PDSHPY_CACHE_TTL=0 turns the cache off whatever the driver says */
+    if (ttlenv != NULL && ttlenv[0] != '\0' && atoi(ttlenv) <= 0)
+        return 0;
+    if (ttl >= 0)
+        return ttl;
+    if (ttlenv != NULL && ttlenv[0] != '\0')
+        return atoi(ttlenv);
+    return PDSHPY_CACHE_DEFAULT_TTL;
+}
+
+/* FNV-1a. The key is stored in the entry and checked on lookup, so a
+ * collision just costs a miss. */
+static uint64_t
+hash_key(const char *key)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (; *key != '\0'; key++)
+    {
+        hash ^= (unsigned char)*key;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int
+make_dirs(const char *path)
+{
+    char buf[PATH_MAX];
+    char *p = NULL;
+
+    if (snprintf(buf, sizeof(buf), "%s", path) >= (int)sizeof(buf))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    for (p = buf + 1; *p != '\0'; p++)
+    {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        if (mkdir(buf, 0700) < 0 && errno != EEXIST)
+            return -1;
+        *p = '/';
+    }
+    if (mkdir(buf, 0700) < 0 && errno != EEXIST)
+        return -1;
+    return 0;
+}
+
+int
+cache_path(char *path, size_t n, const char *name, int create)
+{
+    char dirbuf[PATH_MAX];
+    const char *dir = getenv(PDSHPY_ENVIRON_CACHE_DIR);
+    const char *base = NULL;
+
+    if (dir == NULL || dir[0] == '\0')
+    {
+        if ((base = getenv("XDG_CACHE_HOME")) != NULL && base[0] != '\0')
+            snprintf(dirbuf, sizeof(dirbuf), "%s/pdshpy", base);
+        else if ((base = getenv("HOME")) != NULL && base[0] != '\0')
+            snprintf(dirbuf, sizeof(dirbuf), "%s/.cache/pdshpy", base);
+        else
+        {
+            errno = ENOENT;
+            return -1;
+        }
+        dir = dirbuf;
+    }
+
+    if (create && make_dirs(dir) < 0)
+        return -1;
+    if (snprintf(path, n, "%s/%s", dir, name) >= (int)n)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+/* Put the name of the file for this entry in 'path'. With 'create', make
+ * sure the directory it goes in exists. */
+static int
+entry_path(char *path, size_t n, const char *module, const char *key,
+           int create)
+{
+    char name[PATH_MAX];
+
+    if (snprintf(name, sizeof(name), "%s.%016llx", module,
+                 (unsigned long long)hash_key(key)) >= (int)sizeof(name))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return cache_path(path, n, name, create);
+}
+
+static int
+max_staleness(void)
+{
+    const char *staleenv = getenv(PDSHPY_ENVIRON_CACHE_MAX_STALE);
+
+    if (staleenv == NULL || atoi(staleenv) <= 0)
+        return 0;
+    return atoi(staleenv);
+}
+
+/* Read the entry at 'path', returning what it holds (use free()), with its
+ * size in *len and when it was made in *created; or NULL if it's missing,
+ * damaged, or for some other key. */
+static char *
+read_entry(const char *path, const char *key, long *created, size_t *len)
+{
+    struct stat st;
+    char *buf = NULL;
+    size_t keylen = 0;
+    int hdrlen = 0;
+    int fd = -1;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+    {
+        if (errno != ENOENT)
+            DBG("Could not open cache entry %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    /* wait out anyone writing it */
+    if (fd_get_readw_lock(fd) < 0 || fstat(fd, &st) < 0)
+        goto fail;
+    if (st.st_size <= (off_t)strlen(CACHE_MAGIC)
+        || st.st_size > CACHE_MAX_ENTRY)
+        goto fail;
+    if ((buf = malloc(st.st_size + 1)) == NULL)
+        goto fail;
+    if (fd_read_n(fd, buf, st.st_size) != st.st_size)
+        goto fail;
+    buf[st.st_size] = '\0';
+
+    if (strncmp(buf, CACHE_MAGIC, strlen(CACHE_MAGIC)) != 0
+        || sscanf(buf + strlen(CACHE_MAGIC), "%ld %zu %zu%n",
+                  created, &keylen, len, &hdrlen) != 3)
+        goto fail;
+    hdrlen += strlen(CACHE_MAGIC);
+    if (buf[hdrlen++] != '\n'
+        || hdrlen + keylen + *len != (size_t)st.st_size)
+        goto fail;
+    if (keylen != strlen(key) || memcmp(buf + hdrlen, key, keylen) != 0)
+        goto fail;
+
+    memmove(buf, buf + hdrlen + keylen, *len + 1);
+    close(fd);
+    return buf;
+
+fail:
+    free(buf);
+    close(fd);
+    return NULL;
+}
+
+/* Write an entry holding the 'len' bytes at 'data' to 'path'. */
+static int
+write_entry(const char *path, const char *key, const void *data, size_t len)
+{
+    char header[128];
+    int fd = -1;
+    int saved_errno = 0;
+    int rc = -1;
+
+    snprintf(header, sizeof(header), CACHE_MAGIC "%ld %zu %zu\n",
+             (long)time(NULL), strlen(key), len);
+
+    /* not O_TRUNC: readers hold read locks, and we can't truncate until
+     * they're done */
+    if ((fd = open(path, O_WRONLY | O_CREAT, 0600)) < 0)
+        return -1;
+    if (fd_get_writew_lock(fd) < 0 || ftruncate(fd, 0) < 0)
+        goto out;
+    if (fd_write_n(fd, header, strlen(header)) < 0
+        || fd_write_n(fd, (void *)key, strlen(key)) < 0
+        || fd_write_n(fd, (void *)data, len) < 0)
+        goto out;
+    rc = 0;
+
+out:
+    saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return rc;
+}
+
+/* the hosts in the entry at 'path', as read_entry() */
+static hostlist_t
+read_hosts(const char *path, const char *key, long *created)
+{
+    hostlist_t hl = NULL;
+    char *hosts = NULL;
+    size_t len = 0;
+
+    if ((hosts = read_entry(path, key, created, &len)) == NULL)
+        return NULL;
+    hl = hostlist_create(hosts);
+    free(hosts);
+    return hl;
+}
+
+hostlist_t
+cache_lookup(const char *module, const char *key, int ttl, int *stale)
+{
+    char path[PATH_MAX];
+    long created = 0;
+    time_t now = time(NULL);
+    hostlist_t hl = NULL;
+
+    *stale = 0;
+    if ((ttl = resolve_ttl(ttl)) == 0)
+        return NULL;
+    if (entry_path(path, sizeof(path), module, key, 0) < 0)
+        return NULL;
+    if ((hl = read_hosts(path, key, &created)) == NULL)
+        return NULL;
+    if (created > now || now - created >= ttl + max_staleness())
+    {
+        DBG("Cache entry %s has expired", path);
+        hostlist_destroy(hl);
+        return NULL;
+    }
+    *stale = (now - created >= ttl);
+    return hl;
+}
+
+hostlist_t
+cache_lookup_last(const char *module, const char *key, long *age)
+{
+    char path[PATH_MAX];
+    long created = 0;
+    hostlist_t hl = NULL;
+
+    if (resolve_ttl(-1) == 0)
+        return NULL;
+    if (entry_path(path, sizeof(path), module, key, 0) < 0)
+        return NULL;
+    if ((hl = read_hosts(path, key, &created)) != NULL)
+        *age = (long)time(NULL) - created;
+    return hl;
+}
+
+int
+cache_store(const char *module, const char *key, int ttl, hostlist_t hl)
+{
+    char path[PATH_MAX];
+    char *hosts = NULL;
+    int saved_errno = 0;
+    int rc = -1;
+
+    if (resolve_ttl(ttl) == 0)
+        return 0;
+    if (entry_path(path, sizeof(path), module, key, 1) < 0)
+        return -1;
+    if ((hosts = pdshpy_hostlist_ranged(hl)) == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    rc = write_entry(path, key, hosts, strlen(hosts));
+    saved_errno = errno;
+    free(hosts);
+    errno = saved_errno;
+    return rc;
+}
+
+void *
+cache_get(const char *module, const char *key, size_t *len)
+{
+    char path[PATH_MAX];
+    long created = 0;
+
+    if (resolve_ttl(-1) == 0)
+        return NULL;
+    if (entry_path(path, sizeof(path), module, key, 0) < 0)
+        return NULL;
+    return read_entry(path, key, &created, len);
+}
+
+int
+cache_put(const char *module, const char *key, const void *data, size_t len)
+{
+    char path[PATH_MAX];
+
+    if (resolve_ttl(-1) == 0)
+        return 0;
+    if (entry_path(path, sizeof(path), module, key, 1) < 0)
+        return -1;
+    return write_entry(path, key, data, len);
+}
+
+int
+cache_refresh_lock(const char *module, const char *key)
+{
+    char path[PATH_MAX];
+    size_t len = 0;
+    int fd = -1;
+
+    if (entry_path(path, sizeof(path), module, key, 1) < 0)
+        return -1;
+    len = strlen(path);
+    if (snprintf(path + len, sizeof(path) - len, ".refresh")
+        >= (int)(sizeof(path) - len))
+        return -1;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT, 0600)) < 0)
+        return -1;
+    if (fd_get_write_lock(fd) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
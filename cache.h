@@ -0,0 +1,92 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* On-disk cache of what the driver's collect_hosts() returned, so that a
+ * slow inventory lookup doesn't have to be repeated by every pdsh run. The
+ * driver opts in by giving a key with util.set_cache_key(), derived from
+ * whichever options determine its answer; runs with the same key within the
+ * TTL get the cached hosts without the driver being called at all.
+ *
+ * Entries live in PDSHPY_CACHE_DIR (default $XDG_CACHE_HOME/pdshpy, or
+ * ~/.cache/pdshpy), one file per driver and key, holding the hosts in ranged
+ * form. Concurrent pdsh processes share them under fcntl locks.
+ */
+
+#ifndef _PDSHPY_CACHE_H
+#define _PDSHPY_CACHE_H
+
+#include "src/common/hostlist.h"
+
+/* set the environment variable with this name to the directory to keep the
+ * cache in */
+#define PDSHPY_ENVIRON_CACHE_DIR "PDSHPY_CACHE_DIR"
+
+/* set the environment variable with this name to the number of seconds
+ * cached hosts stay good for, unless the driver says otherwise. 0 turns the
+ * cache off, even for drivers which give their own TTL. */
+#define PDSHPY_ENVIRON_CACHE_TTL "PDSHPY_CACHE_TTL"
+
+#define PDSHPY_CACHE_DEFAULT_TTL 60
+
+/* set the environment variable with this name to a number of seconds to
+ * keep serving entries for after they expire, while they're refreshed in
+ * the background (stale-while-revalidate). Past that, an expired entry is
+ * a miss like any other. */
+#define PDSHPY_ENVIRON_CACHE_MAX_STALE "PDSHPY_CACHE_MAX_STALE"
+
+/* Return a new hostlist with the hosts cached for 'module' under 'key', or
+ * NULL if there aren't any younger than 'ttl' seconds (-1 for the default).
+ * Expired entries still within PDSHPY_CACHE_MAX_STALE are returned too, with
+ * *stale set to 1; the caller should arrange for them to be refreshed.
+ */
+hostlist_t cache_lookup(const char *module, const char *key, int ttl,
+                        int *stale);
+
+/* Return a new hostlist with whatever hosts were last cached for 'module'
+ * under 'key', however long ago, and set *age to how many seconds ago that
+ * was. For when collecting them again has failed; NULL if there are none.
+ */
+hostlist_t cache_lookup_last(const char *module, const char *key, long *age);
+
+/* Take the lock which says an entry is being refreshed, so that only one
+ * process at a time does it. Returns a file descriptor to close when done,
+ * or -1 if someone else is already refreshing the entry (or the lock can't
+ * be had at all).
+ */
+int cache_refresh_lock(const char *module, const char *key);
+
+/* Cache the hosts in 'hl' for 'module' under 'key'. Returns 0 on success, or
+ * -1 (with errno set) if they couldn't be written. */
+int cache_store(const char *module, const char *key, int ttl, hostlist_t hl);
+
+/* Return a copy of what was last stored for 'module' under 'key' with
+ * cache_put() (use free()), setting *len to its size; or NULL if nothing
+ * was, or the cache is off. These entries don't expire, so they're for
+ * things which are found from their key, like compiled patterns. */
+void *cache_get(const char *module, const char *key, size_t *len);
+
+/* Store the 'len' bytes at 'data' for 'module' under 'key'. Returns 0 on
+ * success (or if the cache is off), or -1 with errno set. */
+int cache_put(const char *module, const char *key, const void *data,
+              size_t len);
+
+/* Put the name of the file called 'name' in the cache directory in 'path',
+ * for other things pdshpy keeps between runs. With 'create', make sure the
+ * directory exists. Returns 0, or -1 with errno set. */
+int cache_path(char *path, size_t n, const char *name, int create);
+
+#endif /* !_PDSHPY_CACHE_H */
@@ -0,0 +1,532 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* Server mode. Instead of starting up an interpreter and importing the
+ * driver module in every pdsh process, talk to a long-running pdshpy server
+ * (pdshpy/server.py) which already has the driver loaded. Everything the
+ * driver would see or change in the opt_t goes over the socket; hostlists
+ * travel in ranged form.
+ */
+
+/* for struct ucred */
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "src/common/xmalloc.h"
+#include "src/pdsh/rcmd.h"
+
+#include "pdshpy.h"
+#include "metrics.h"
+#include "probes.h"
+#include "wire.h"
+
+#define CLIENT_PROTOCOL_VERSION 1
+
+static int server_fd = -1;
+
+/* what we last sent as the wcoll, so we can tell whether it came back
+ * changed without having to rebuild the hostlist */
+static char *sent_wcoll = NULL;
+
+/* the server didn't answer in time, and the connection has been dropped */
+static int timed_out = 0;
+
+/* The server only takes connections from its own user; likewise, only take
+ * options, rcmd defaults and hosts from a server run by our own user, not
+ * from whoever managed to listen on the socket first. Returns -1 with errno
+ * set to EPERM if it's someone else's. */
+static int
+check_server_uid(int fd, const char *path)
+{
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+        return -1;
+    if (cred.uid != getuid())
+    {
+        ERR("warning: ignoring pdshpy server at %s, which is run by uid %d",
+            path, (int)cred.uid);
+        errno = EPERM;
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+int
+client_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+        || check_server_uid(fd, path) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    server_fd = fd;
+    return fd;
+}
+
+/* Give up on any request the server takes longer than 'seconds' to answer,
+ * for PDSHPY_CALLBACK_TIMEOUT. The server can't be interrupted from here,
+ * so the connection is dropped and it finishes on its own.
+ */
+void
+client_set_timeout(double seconds)
+{
+    struct timeval tv;
+
+    tv.tv_sec = (time_t)seconds;
+    tv.tv_usec = (suseconds_t)((seconds - tv.tv_sec) * 1e6);
+    if (setsockopt(server_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0
+        || setsockopt(server_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0)
+        ERR("Could not set a timeout on the pdshpy server connection: %s",
+            strerror(errno));
+}
+
+/* Close every file descriptor above stderr, going by those /proc lists
+ * where it can, else up to the open file limit. */
+static void
+close_inherited_fds(void)
+{
+    struct dirent *d = NULL;
+    struct rlimit rl;
+    DIR *dir = NULL;
+    int fd, max = 1024;
+
+    if ((dir = opendir("/proc/self/fd")) != NULL)
+    {
+        while ((d = readdir(dir)) != NULL)
+        {
+            fd = atoi(d->d_name);
+            if (fd > STDERR_FILENO && fd != dirfd(dir))
+                close(fd);
+        }
+        closedir(dir);
+        return;
+    }
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+        max = (int)rl.rlim_cur;
+    for (fd = STDERR_FILENO + 1; fd < max; fd++)
+        close(fd);
+}
+
+/* Start a forking pdshpy server in the background, detached from this
+ * process, so that later pdsh runs can use it. It keeps none of pdsh's
+ * file descriptors, so it can't hold on to pdsh's pipes, sockets and
+ * terminal after pdsh is done.
+ */
+int
+client_spawn_server(const char *python, const char *path,
+                    const char *modulename)
+{
+    pid_t pid;
+    int devnull;
+
+    if ((pid = fork()) < 0)
+        return -1;
+    if (pid == 0)
+    {
+        if (setsid() < 0 || fork() != 0)
+            _exit(0);
+        if ((devnull = open("/dev/null", O_RDWR)) >= 0)
+        {
+            dup2(devnull, STDIN_FILENO);
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        close_inherited_fds();
+        execlp(python, python, "-m", "pdshpy.server", "--fork",
+               "--socket", path, "--module", modulename, (char *)NULL);
+        _exit(127);
+    }
+    while (waitpid(pid, NULL, 0) < 0 && errno == EINTR)
+        ;
+    return 0;
+}
+
+static const struct pdshpy_opt_field *
+find_opt_field(const char *name)
+{
+    const struct pdshpy_opt_field *f;
+
+    for (f = pdshpy_opt_fields; f->name != NULL; f++)
+        if (strcmp(f->name, name) == 0)
+            return f;
+    return NULL;
+}
+
+static int
+add_opts(struct wire_msg *msg, opt_t *opts)
+{
+    const struct pdshpy_opt_field *f;
+    char *field = NULL;
+
+    for (f = pdshpy_opt_fields; f->name != NULL; f++)
+    {
+        field = (char *)opts + f->offset;
+        switch (f->type)
+        {
+        case PDSHPY_OPT_STR:
+            if (wire_add(msg, f->name, *(char **)field) < 0)
+                return -1;
+            break;
+        case PDSHPY_OPT_BOOL:
+            if (wire_add_int(msg, f->name, *(bool *)field) < 0)
+                return -1;
+            break;
+        case PDSHPY_OPT_INT:
+            if (wire_add_int(msg, f->name, *(int *)field) < 0)
+                return -1;
+            break;
+        case PDSHPY_OPT_UID:
+            if (wire_add_int(msg, f->name, *(uid_t *)field) < 0)
+                return -1;
+            break;
+        }
+    }
+
+    free(sent_wcoll);
+    sent_wcoll = NULL;
+    if (opts->wcoll != NULL
+        && (sent_wcoll = pdshpy_hostlist_ranged(opts->wcoll)) == NULL)
+        return -1;
+    return wire_add(msg, "wcoll", sent_wcoll);
+}
+
+static void
+set_opt(opt_t *opts, const struct pdshpy_opt_field *f, const char *value)
+{
+    char *field = (char *)opts + f->offset;
+
+    switch (f->type)
+    {
+    case PDSHPY_OPT_STR:
+        if (*(char **)field != NULL)
+        {
+            if (value != NULL && strcmp(*(char **)field, value) == 0)
+                break;
+            Free((void **)field);
+        }
+        *(char **)field = Strdup(value);
+        break;
+    case PDSHPY_OPT_BOOL:
+        *(bool *)field = (value != NULL && atoi(value) != 0);
+        break;
+    case PDSHPY_OPT_INT:
+        *(int *)field = value ? atoi(value) : 0;
+        break;
+    case PDSHPY_OPT_UID:
+        *(uid_t *)field = value ? strtoul(value, NULL, 10) : 0;
+        break;
+    }
+}
+
+static void
+set_wcoll(opt_t *opts, const char *value)
+{
+    if (value != NULL && sent_wcoll != NULL && strcmp(value, sent_wcoll) == 0)
+        return;
+    if (opts->wcoll != NULL)
+        hostlist_destroy(opts->wcoll);
+    opts->wcoll = value ? hostlist_create(value) : NULL;
+}
+
+/* Send a request and act on everything in the reply: option registrations,
+ * rcmd defaults, and changed opt_t values. Returns 0 and sets *status to the
+ * reply status, or returns -1 if the exchange failed altogether.
+ */
+static int
+exchange(struct wire_msg *req, opt_t *opts, long *status,
+         struct wire_msg *reply)
+{
+    const char *name, *value;
+    const char *argmeta, *desc, *personality;
+    const char *module, *user;
+    const struct pdshpy_opt_field *f;
+    struct metrics_mark mark;
+    int rc;
+
+    /* already reported */
+    if (timed_out)
+        return -1;
+
+    metrics_begin(&mark);
+    if (wire_send(server_fd, req) < 0 || wire_recv(server_fd, reply) < 0)
+    {
+        metrics_end(PHASE_SERVER_REQUEST, &mark);
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            /* whatever the server says later would be out of step */
+            ERR("warning: pdshpy server did not answer in time");
+            timed_out = 1;
+            close(server_fd);
+            server_fd = -1;
+            return -1;
+        }
+        ERR("Lost connection to pdshpy server: %s", strerror(errno));
+        return -1;
+    }
+    metrics_end(PHASE_SERVER_REQUEST, &mark);
+    metrics_count(COUNT_SERVER_BYTES_SENT, req->len);
+    metrics_count(COUNT_SERVER_BYTES_RECEIVED, reply->len);
+
+    *status = 0;
+    while ((rc = wire_next(reply, &name, &value)) > 0)
+    {
+        if (strcmp(name, "status") == 0)
+            *status = value ? strtol(value, NULL, 10) : 0;
+        else if (strcmp(name, "error") == 0)
+        {
+            ERR("Driver module failed in pdshpy server:\n%s",
+                value ? value : "(no details)");
+            return -1;
+        }
+        else if (strcmp(name, "option") == 0)
+        {
+            /* followed by its arginfo, personality and descr */
+            if (value == NULL
+                || wire_next(reply, &name, &argmeta) <= 0
+                || wire_next(reply, &name, &personality) <= 0
+                || wire_next(reply, &name, &desc) <= 0)
+                break;
+            if (pdshpy_add_option(value[0], argmeta,
+                                  personality ? atoi(personality) : 0,
+                                  desc) < 0)
+                ERR("Pdsh refused to allow option '%c' to be registered",
+                    value[0]);
+        }
+        else if (strcmp(name, "rcmd_hosts") == 0)
+        {
+            /* followed by the rcmd module and the username */
+            char *hosts = Strdup(value);
+            char *mod = NULL, *usr = NULL;
+            int result = 0;
+
+            if (wire_next(reply, &name, &module) <= 0
+                || wire_next(reply, &name, &user) <= 0)
+            {
+                Free((void **)&hosts);
+                break;
+            }
+            mod = Strdup(module);
+            usr = Strdup(user);
+            result = rcmd_register_defaults(hosts, mod, usr);
+            PDSHPY_PROBE4(rcmd_register, value, module, user, result);
+            if (result < 0)
+                ERR("Failed to register rcmd defaults for '%s', '%s', '%s'",
+                    value ? value : "(null)", module ? module : "(null)",
+                    user ? user : "(null)");
+            Free((void **)&hosts);
+            Free((void **)&mod);
+            Free((void **)&usr);
+        }
+        else if (strcmp(name, "cache_key") == 0)
+        {
+            /* followed by the TTL */
+            const char *key = value;
+
+            if (wire_next(reply, &name, &value) <= 0)
+                break;
+            pdshpy_set_cache_key(key, value ? atoi(value) : -1);
+        }
+        else if (strcmp(name, "unreachable") == 0
+                 || strcmp(name, "reachable") == 0)
+        {
+            if (value != NULL
+                && pdshpy_record_hosts(value, name[0] == 'u') < 0)
+                ERR("Couldn't record which hosts are unreachable: %s",
+                    strerror(errno));
+        }
+        else if (opts != NULL && strcmp(name, "wcoll") == 0)
+            set_wcoll(opts, value);
+        else if (opts != NULL && (f = find_opt_field(name)) != NULL)
+            set_opt(opts, f, value);
+    }
+    if (rc != 0)
+    {
+        ERR("Malformed reply from pdshpy server");
+        return -1;
+    }
+    return 0;
+}
+
+int
+client_init(void)
+{
+    struct wire_msg req, reply;
+    long status = 0;
+    int rc = 0;
+
+    wire_init(&req);
+    wire_init(&reply);
+
+    if (wire_add(&req, "op", "init") < 0
+        || wire_add_int(&req, "version", CLIENT_PROTOCOL_VERSION) < 0)
+        rc = -1;
+    else if (exchange(&req, NULL, &status, &reply) < 0)
+        rc = -1;
+    else
+        rc = status < 0 ? -1 : 0;
+
+    wire_free(&req);
+    wire_free(&reply);
+    return rc;
+}
+
+int
+client_process_opt(opt_t *opts, int opt, char *arg)
+{
+    struct wire_msg req, reply;
+    char optstr[2] = { (char)opt, '\0' };
+    long status = 0;
+
+    DBG("Sending option %c (%s) to pdshpy server.", opt, arg);
+
+    wire_init(&req);
+    wire_init(&reply);
+    if (wire_add(&req, "op", "option") < 0
+        || wire_add(&req, "opt", optstr) < 0
+        || wire_add(&req, "arg", arg) < 0
+        || add_opts(&req, opts) < 0
+        || exchange(&req, opts, &status, &reply) < 0)
+        status = -1;
+
+    wire_free(&req);
+    wire_free(&reply);
+    return (int)status;
+}
+
+/* Sets *complete to 0 if the server didn't answer in time. */
+hostlist_t
+client_wcoll(opt_t *opts, int *complete)
+{
+    struct wire_msg req, reply;
+    const char *hosts = NULL;
+    hostlist_t hl = NULL;
+    long status = 0;
+
+    DBG("Requesting hosts from pdshpy server.");
+
+    *complete = 1;
+    wire_init(&req);
+    wire_init(&reply);
+    if (wire_add(&req, "op", "wcoll") < 0
+        || add_opts(&req, opts) < 0
+        || exchange(&req, opts, &status, &reply) < 0)
+    {
+        if (timed_out)
+            *complete = 0;
+        goto out;
+    }
+
+    hosts = wire_get(&reply, "hosts", NULL);
+    hl = hostlist_create(hosts);
+
+    /* some of the driver's host sources didn't come through */
+    if (wire_get(&reply, "partial", NULL) != NULL)
+        *complete = 0;
+
+out:
+    wire_free(&req);
+    wire_free(&reply);
+    return hl;
+}
+
+int
+client_postop(opt_t *opts)
+{
+    struct wire_msg req, reply;
+    long status = 0;
+
+    /* The connection went with the timeout, and the session with it, so
+     * the driver can't have its say on the hosts any more: it might have
+     * taken out some of them, so don't let pdsh near any of them. */
+    if (timed_out)
+    {
+        ERR("pdshpy server timed out earlier in this run, so the driver "
+            "module's perform_postop() can't be run; refusing to go on "
+            "with hosts it hasn't seen");
+        return 1;
+    }
+
+    DBG("Requesting postop from pdshpy server.");
+
+    wire_init(&req);
+    wire_init(&reply);
+    if (wire_add(&req, "op", "postop") < 0
+        || add_opts(&req, opts) < 0
+        || exchange(&req, opts, &status, &reply) < 0)
+        status = 1;
+    else if (status < 0)
+    {
+        ERR("Value returned from driver module perform_postop() is negative "
+            "(should be the number of errors)");
+        status = 1;
+    }
+
+    wire_free(&req);
+    wire_free(&reply);
+    return (int)status;
+}
+
+void
+client_fini(void)
+{
+    struct wire_msg req;
+
+    timed_out = 0;
+    if (server_fd < 0)
+        return;
+
+    wire_init(&req);
+    if (wire_add(&req, "op", "fini") == 0)
+        wire_send(server_fd, &req);
+    wire_free(&req);
+
+    close(server_fd);
+    server_fd = -1;
+    free(sent_wcoll);
+    sent_wcoll = NULL;
+}
@@ -0,0 +1,303 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "src/common/fd.h"
+
+#include "pdshpy.h"
+#include "cache.h"
+#include "deadhosts.h"
+
+/* the file's name in the cache directory */
+#define DEADHOSTS_FILE "deadhosts"
+
+#define DEADHOSTS_MAGIC "pdshpy-dead 1\n"
+
+struct dead_header {
+    char magic[16];
+    uint32_t nbuckets;
+    uint32_t slot_size;
+    char reserved[40];
+};
+
+/* a slot is free when its hash is 0 */
+struct dead_slot {
+    uint64_t hash;
+    int64_t until;              /* down until then, in seconds since 1970 */
+    uint32_t failures;          /* times found unreachable running */
+    char name[DEADHOSTS_NAME_MAX + 1];
+};
+
+#define DEADHOSTS_SIZE (sizeof(struct dead_header) \
+                        + (size_t)DEADHOSTS_NBUCKETS * DEADHOSTS_BUCKET \
+                          * sizeof(struct dead_slot))
+
+/* fcntl locks don't keep this process's own threads apart */
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* FNV-1a, never 0 */
+static uint64_t
+hash_name(const char *name)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (; *name != '\0'; name++)
+    {
+        hash ^= (unsigned char)*name;
+        hash *= 1099511628211ULL;
+    }
+    return hash ? hash : 1;
+}
+
+static int
+base_ttl(void)
+{
+    const char *ttlenv = getenv(PDSHPY_ENVIRON_DEADHOSTS_TTL);
+
+    if (ttlenv == NULL || atoi(ttlenv) <= 0)
+        return DEADHOSTS_DEFAULT_TTL;
+    return atoi(ttlenv) < DEADHOSTS_MAX_TTL ? atoi(ttlenv) : DEADHOSTS_MAX_TTL;
+}
+
+static int
+table_ok(const struct dead_header *hdr)
+{
+    return memcmp(hdr->magic, DEADHOSTS_MAGIC, sizeof(DEADHOSTS_MAGIC)) == 0
+        && hdr->nbuckets == DEADHOSTS_NBUCKETS
+        && hdr->slot_size == sizeof(struct dead_slot);
+}
+
+/* Open and lock the file and map it in, with 'writable' for updates. One
+ * which is missing (when not writable) or isn't ours gives NULL with errno
+ * set to ENOENT; for updates, it's started over instead. Undo with
+ * unmap_table(). */
+static struct dead_header *
+map_table(int writable, int *fdp)
+{
+    char path[PATH_MAX];
+    struct dead_header *hdr = NULL;
+    struct stat st;
+    int saved_errno = 0;
+    int fd = -1;
+
+    if (cache_path(path, sizeof(path), DEADHOSTS_FILE, writable) < 0)
+        return NULL;
+    if ((fd = open(path, (writable ? O_RDWR | O_CREAT : O_RDONLY) | O_CLOEXEC,
+                   0600)) < 0)
+        return NULL;
+    if ((writable ? fd_get_writew_lock(fd) : fd_get_readw_lock(fd)) < 0
+        || fstat(fd, &st) < 0)
+        goto fail;
+
+    if (st.st_size == (off_t)DEADHOSTS_SIZE)
+    {
+        hdr = mmap(NULL, DEADHOSTS_SIZE,
+                   writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+                   fd, 0);
+        if (hdr == MAP_FAILED)
+        {
+            hdr = NULL;
+            goto fail;
+        }
+        if (table_ok(hdr))
+        {
+            *fdp = fd;
+            return hdr;
+        }
+        munmap(hdr, DEADHOSTS_SIZE);
+        hdr = NULL;
+    }
+    if (!writable)
+    {
+        errno = ENOENT;
+        goto fail;
+    }
+
+    /* new, or not something we can read: start over (a sparse file, so
+     * empty buckets take no space) */
+    DBG("Starting a new table of unreachable hosts in %s", path);
+    if (ftruncate(fd, 0) < 0 || ftruncate(fd, DEADHOSTS_SIZE) < 0)
+        goto fail;
+    hdr = mmap(NULL, DEADHOSTS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+               0);
+    if (hdr == MAP_FAILED)
+    {
+        hdr = NULL;
+        goto fail;
+    }
+    memcpy(hdr->magic, DEADHOSTS_MAGIC, sizeof(DEADHOSTS_MAGIC));
+    hdr->nbuckets = DEADHOSTS_NBUCKETS;
+    hdr->slot_size = sizeof(struct dead_slot);
+    *fdp = fd;
+    return hdr;
+
+fail:
+    saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return NULL;
+}
+
+static void
+unmap_table(struct dead_header *hdr, int fd)
+{
+    munmap(hdr, DEADHOSTS_SIZE);
+    close(fd);
+}
+
+static struct dead_slot *
+bucket_of(struct dead_header *hdr, uint64_t hash)
+{
+    struct dead_slot *slots = (struct dead_slot *)(hdr + 1);
+
+    return slots + (hash % DEADHOSTS_NBUCKETS) * DEADHOSTS_BUCKET;
+}
+
+/* the slot in 'bucket' for 'name', or NULL if it has none */
+static struct dead_slot *
+find_slot(struct dead_slot *bucket, uint64_t hash, const char *name)
+{
+    int i;
+
+    for (i = 0; i < DEADHOSTS_BUCKET; i++)
+        if (bucket[i].hash == hash
+            && strncmp(bucket[i].name, name, sizeof(bucket[i].name)) == 0)
+            return &bucket[i];
+    return NULL;
+}
+
+/* the slot in 'bucket' to put a new host in: a free one, or else the one
+ * whose time is up soonest */
+static struct dead_slot *
+victim_slot(struct dead_slot *bucket)
+{
+    struct dead_slot *victim = &bucket[0];
+    int i;
+
+    for (i = 0; i < DEADHOSTS_BUCKET; i++)
+    {
+        if (bucket[i].hash == 0)
+            return &bucket[i];
+        if (bucket[i].until < victim->until)
+            victim = &bucket[i];
+    }
+    return victim;
+}
+
+int
+deadhosts_lookup(char *const *hosts, size_t n, unsigned char *dead)
+{
+    struct dead_header *hdr = NULL;
+    struct dead_slot *slot = NULL;
+    int64_t now = time(NULL);
+    uint64_t hash;
+    size_t i;
+    int fd = -1;
+    int ndead = 0;
+
+    memset(dead, 0, n);
+    pthread_mutex_lock(&table_lock);
+    if ((hdr = map_table(0, &fd)) == NULL)
+    {
+        pthread_mutex_unlock(&table_lock);
+        /* nothing's been recorded yet */
+        return errno == ENOENT ? 0 : -1;
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (strlen(hosts[i]) > DEADHOSTS_NAME_MAX)
+            continue;
+        hash = hash_name(hosts[i]);
+        slot = find_slot(bucket_of(hdr, hash), hash, hosts[i]);
+        if (slot != NULL && slot->until > now)
+        {
+            dead[i] = 1;
+            ndead++;
+        }
+    }
+    unmap_table(hdr, fd);
+    pthread_mutex_unlock(&table_lock);
+    return ndead;
+}
+
+int
+deadhosts_update(char *const *hosts, size_t n, const unsigned char *down)
+{
+    struct dead_header *hdr = NULL;
+    struct dead_slot *bucket = NULL;
+    struct dead_slot *slot = NULL;
+    int64_t now = time(NULL);
+    int64_t ttl;
+    uint64_t hash;
+    size_t i;
+    int base = base_ttl();
+    int fd = -1;
+
+    pthread_mutex_lock(&table_lock);
+    if ((hdr = map_table(1, &fd)) == NULL)
+    {
+        pthread_mutex_unlock(&table_lock);
+        return -1;
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (strlen(hosts[i]) > DEADHOSTS_NAME_MAX)
+            continue;
+        hash = hash_name(hosts[i]);
+        bucket = bucket_of(hdr, hash);
+        slot = find_slot(bucket, hash, hosts[i]);
+        if (!down[i])
+        {
+            if (slot != NULL)
+                memset(slot, 0, sizeof(*slot));
+            continue;
+        }
+
+        /* already taken to be down: it hasn't been tried again since */
+        if (slot != NULL && slot->until > now)
+            continue;
+        /* long enough since it was last down that it starts over */
+        if (slot != NULL && slot->until + DEADHOSTS_MAX_TTL <= now)
+            slot->failures = 0;
+        if (slot == NULL)
+        {
+            slot = victim_slot(bucket);
+            memset(slot, 0, sizeof(*slot));
+            slot->hash = hash;
+            strcpy(slot->name, hosts[i]);
+        }
+        ttl = (int64_t)base << (slot->failures < 20 ? slot->failures : 20);
+        if (ttl > DEADHOSTS_MAX_TTL)
+            ttl = DEADHOSTS_MAX_TTL;
+        slot->until = now + ttl;
+        slot->failures++;
+    }
+    unmap_table(hdr, fd);
+    pthread_mutex_unlock(&table_lock);
+    return 0;
+}
@@ -0,0 +1,71 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* Remembers, between pdsh runs, which hosts couldn't be connected to
+ * lately, so that a run straight after one which waited out connect_timeout
+ * on a dead host needn't wait for it all over again. Hosts are recorded as
+ * unreachable by the liveness check (see liveness.h) or by the driver, with
+ * util.record_unreachable(); each stays in for PDSHPY_DEADHOSTS_TTL seconds,
+ * twice that if it's still unreachable when it's next tried, and so on up to
+ * DEADHOSTS_MAX_TTL. A host recorded as reachable is forgotten.
+ *
+ * The hosts are kept in a file of fixed size in the cache directory (see
+ * cache.h), mapped in and shared by concurrent pdsh processes under fcntl
+ * locks: a hash table in buckets of DEADHOSTS_BUCKET slots, each a host's
+ * name, how many times running it has been found unreachable, and until
+ * when it's taken to be down. When a bucket is full, the host whose time is
+ * up soonest makes way.
+ */
+
+#ifndef _PDSHPY_DEADHOSTS_H
+#define _PDSHPY_DEADHOSTS_H
+
+#include <stddef.h>
+
+/* set the environment variable with this name to "skip" to have hosts
+ * recently found unreachable left out of the working set, or to "last" to
+ * have them tried after all the others; either way they're reported once,
+ * together. Unset, nothing is remembered. */
+#define PDSHPY_ENVIRON_DEADHOSTS "PDSHPY_DEADHOSTS"
+
+/* set the environment variable with this name to how many seconds a host
+ * is first taken to be down for */
+#define PDSHPY_ENVIRON_DEADHOSTS_TTL "PDSHPY_DEADHOSTS_TTL"
+
+#define DEADHOSTS_DEFAULT_TTL 30
+
+/* the longest a host is taken to be down for; a host not found unreachable
+ * again for this long after that is forgotten altogether */
+#define DEADHOSTS_MAX_TTL 3600
+
+#define DEADHOSTS_NBUCKETS 2048
+#define DEADHOSTS_BUCKET 8
+
+/* longer names than this aren't remembered */
+#define DEADHOSTS_NAME_MAX 107
+
+/* Set dead[i] to 1 if hosts[i] is taken to be down, or 0 if not, for each
+ * of the 'n' hosts. Returns how many are down, or -1 with errno set. */
+int deadhosts_lookup(char *const *hosts, size_t n, unsigned char *dead);
+
+/* Record each of the 'n' hosts as unreachable if down[i] is nonzero (as
+ * with liveness_check()'s states), or as reachable if it's zero. Returns 0,
+ * or -1 with errno set. */
+int deadhosts_update(char *const *hosts, size_t n,
+                     const unsigned char *down);
+
+#endif /* !_PDSHPY_DEADHOSTS_H */
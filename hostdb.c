@@ -0,0 +1,730 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pdshpy.h"
+#include "hostdb.h"
+
+/* longest hostname the compiler accepts, plus room for a range */
+#define HOSTDB_NAME_MAX 256
+
+struct hostdb {
+    void *base;
+    size_t size;
+    uint32_t nhosts;
+    int refs;
+
+    const char *strings;
+    uint64_t strings_size;
+    const struct hostdb_prefix *prefixes;
+    uint32_t nprefixes;
+    const struct hostdb_range *ranges;
+    uint32_t nranges;
+    const uint32_t *attrs;
+    uint32_t nattrs;
+    const uint64_t *host_attrs;
+    uint32_t attr_words;        /* per host */
+
+    /* the attribute index, if there is one */
+    const struct hostdb_posting *postings;
+    uint64_t npostings;
+    const struct hostdb_container *containers;
+    uint64_t ncontainers;
+    const char *index_data;
+    uint64_t index_data_size;
+};
+
+static int
+map_section(struct hostdb *db, const struct hostdb_section *sec)
+{
+    const char *start = (const char *)db->base + sec->offset;
+
+    if (sec->offset > db->size || sec->size > db->size - sec->offset
+        || sec->offset % 8 != 0)
+        return -1;
+
+    switch (sec->id)
+    {
+    case HOSTDB_SECTION_STRINGS:
+        /* so that any offset into it is a terminated string */
+        if (sec->size > 0 && start[sec->size - 1] != '\0')
+            return -1;
+        db->strings = start;
+        db->strings_size = sec->size;
+        break;
+    case HOSTDB_SECTION_PREFIXES:
+        if (sec->size % sizeof(struct hostdb_prefix) != 0
+            || sec->size / sizeof(struct hostdb_prefix) > UINT32_MAX)
+            return -1;
+        db->prefixes = (const struct hostdb_prefix *)start;
+        db->nprefixes = sec->size / sizeof(struct hostdb_prefix);
+        break;
+    case HOSTDB_SECTION_RANGES:
+        if (sec->size % sizeof(struct hostdb_range) != 0
+            || sec->size / sizeof(struct hostdb_range) > UINT32_MAX)
+            return -1;
+        db->ranges = (const struct hostdb_range *)start;
+        db->nranges = sec->size / sizeof(struct hostdb_range);
+        break;
+    case HOSTDB_SECTION_ATTRS:
+        if (sec->size % sizeof(uint32_t) != 0)
+            return -1;
+        db->attrs = (const uint32_t *)start;
+        db->nattrs = sec->size / sizeof(uint32_t);
+        break;
+    case HOSTDB_SECTION_HOST_ATTRS:
+        db->host_attrs = (const uint64_t *)start;
+        break;
+    case HOSTDB_SECTION_INDEX:
+        if (sec->size % sizeof(struct hostdb_posting) != 0)
+            return -1;
+        db->postings = (const struct hostdb_posting *)start;
+        db->npostings = sec->size / sizeof(struct hostdb_posting);
+        break;
+    case HOSTDB_SECTION_CONTAINERS:
+        if (sec->size % sizeof(struct hostdb_container) != 0)
+            return -1;
+        db->containers = (const struct hostdb_container *)start;
+        db->ncontainers = sec->size / sizeof(struct hostdb_container);
+        break;
+    case HOSTDB_SECTION_INDEX_DATA:
+        db->index_data = start;
+        db->index_data_size = sec->size;
+        break;
+    default:
+        /* something newer; not for us */
+        break;
+    }
+    return 0;
+}
+
+struct hostdb *
+hostdb_open(const char *path)
+{
+    struct hostdb *db = NULL;
+    const struct hostdb_header *hdr = NULL;
+    const struct hostdb_section *secs = NULL;
+    const struct hostdb_section *attrsec = NULL;
+    struct stat st;
+    int saved_errno = 0;
+    int fd = -1;
+    uint32_t i;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0)
+        goto fail;
+    if (st.st_size < (off_t)sizeof(*hdr))
+    {
+        errno = EINVAL;
+        goto fail;
+    }
+    if ((db = calloc(1, sizeof(*db))) == NULL)
+        goto fail;
+    db->size = st.st_size;
+    db->refs = 1;
+    db->base = mmap(NULL, db->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (db->base == MAP_FAILED)
+    {
+        db->base = NULL;
+        goto fail;
+    }
+    close(fd);
+    fd = -1;
+
+    errno = EINVAL;
+    hdr = db->base;
+    if (memcmp(hdr->magic, HOSTDB_MAGIC, sizeof(hdr->magic)) != 0
+        || hdr->version != HOSTDB_VERSION
+        || hdr->byte_order != HOSTDB_BYTE_ORDER
+        || hdr->size != db->size)
+        goto fail;
+    if (hdr->nsections > (db->size - sizeof(*hdr)) / sizeof(*secs))
+        goto fail;
+    db->nhosts = hdr->nhosts;
+
+    secs = (const struct hostdb_section *)(hdr + 1);
+    for (i = 0; i < hdr->nsections; i++)
+    {
+        if (map_section(db, &secs[i]) < 0)
+            goto fail;
+        if (secs[i].id == HOSTDB_SECTION_HOST_ATTRS)
+            attrsec = &secs[i];
+    }
+    if (db->strings == NULL || db->prefixes == NULL || db->ranges == NULL)
+        goto fail;
+
+    db->attr_words = (db->nattrs + 63) / 64;
+    if (db->attr_words > 0
+        && (attrsec == NULL
+            || attrsec->size != (uint64_t)db->nhosts * db->attr_words * 8))
+        goto fail;
+    if (db->postings != NULL
+        && (db->npostings != db->nattrs || db->containers == NULL
+            || db->index_data == NULL))
+        goto fail;
+    return db;
+
+fail:
+    saved_errno = errno;
+    if (fd >= 0)
+        close(fd);
+    hostdb_close(db);
+    errno = saved_errno;
+    return NULL;
+}
+
+struct hostdb *
+hostdb_ref(struct hostdb *db)
+{
+    __atomic_add_fetch(&db->refs, 1, __ATOMIC_RELAXED);
+    return db;
+}
+
+void
+hostdb_close(struct hostdb *db)
+{
+    if (db == NULL || __atomic_sub_fetch(&db->refs, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+    if (db->base != NULL)
+        munmap(db->base, db->size);
+    free(db);
+}
+
+uint32_t
+hostdb_nhosts(const struct hostdb *db)
+{
+    return db->nhosts;
+}
+
+uint32_t
+hostdb_nattrs(const struct hostdb *db)
+{
+    return db->nattrs;
+}
+
+static const char *
+string_at(const struct hostdb *db, uint32_t offset)
+{
+    if (offset >= db->strings_size)
+        return NULL;
+    return db->strings + offset;
+}
+
+const char *
+hostdb_attr_name(const struct hostdb *db, uint32_t attr)
+{
+    if (attr >= db->nattrs)
+        return NULL;
+    return string_at(db, db->attrs[attr]);
+}
+
+int64_t
+hostdb_attr_id(const struct hostdb *db, const char *name)
+{
+    uint32_t i = hostdb_attr_lower_bound(db, name);
+    const char *other = hostdb_attr_name(db, i);
+
+    if (other == NULL || strcmp(other, name) != 0)
+        return -1;
+    return i;
+}
+
+uint32_t
+hostdb_attr_lower_bound(const struct hostdb *db, const char *name)
+{
+    const char *other = NULL;
+    uint32_t lo = 0, hi = db->nattrs, mid;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        /* a damaged name sorts first, so it's never matched */
+        other = string_at(db, db->attrs[mid]);
+        if (other == NULL || strcmp(other, name) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* the range, or NULL if it's out of bounds or doesn't make sense */
+static const struct hostdb_range *
+range_at(const struct hostdb *db, uint32_t i)
+{
+    const struct hostdb_range *r = NULL;
+
+    if (i >= db->nranges)
+        return NULL;
+    r = &db->ranges[i];
+    if (r->prefix >= db->nprefixes || r->lo > r->hi
+        || (uint64_t)r->first_host + (r->hi - r->lo) >= db->nhosts)
+        return NULL;
+    return r;
+}
+
+/* how 'name' compares with the 'keylen' characters at 'key' */
+static int
+compare_prefix(const char *name, const char *key, size_t keylen)
+{
+    int cmp = strncmp(name, key, keylen);
+
+    if (cmp != 0)
+        return cmp;
+    return name[keylen] != '\0';
+}
+
+/* ranges within a prefix are ordered by bare-ness, width, then number */
+static int
+compare_range(const struct hostdb_range *r, int bare, uint32_t width,
+              uint32_t num)
+{
+    int rbare = (r->flags & HOSTDB_RANGE_BARE) != 0;
+
+    if (rbare != bare)
+        return rbare ? -1 : 1;
+    if (r->width != width)
+        return r->width < width ? -1 : 1;
+    if (r->lo != num)
+        return r->lo < num ? -1 : 1;
+    return 0;
+}
+
+/* the prefix called 'len' characters of 'name', or NULL */
+static const struct hostdb_prefix *
+find_prefix(const struct hostdb *db, const char *name, size_t len)
+{
+    const struct hostdb_prefix *p = NULL;
+    const char *other = NULL;
+    uint32_t lo, hi, mid;
+    int cmp;
+
+    for (lo = 0, hi = db->nprefixes; lo < hi && p == NULL;)
+    {
+        mid = lo + (hi - lo) / 2;
+        if ((other = string_at(db, db->prefixes[mid].name)) == NULL)
+            return NULL;
+        if ((cmp = compare_prefix(other, name, len)) == 0)
+            p = &db->prefixes[mid];
+        else if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (p == NULL || p->first_range > db->nranges
+        || p->nranges > db->nranges - p->first_range)
+        return NULL;
+    return p;
+}
+
+/* the last range of 'p' starting at or before the host given, or -1 */
+static int64_t
+find_range_of(const struct hostdb *db, const struct hostdb_prefix *p,
+              int bare, uint32_t width, uint32_t num)
+{
+    uint32_t lo, hi, mid;
+    int64_t found = -1;
+
+    for (lo = p->first_range, hi = p->first_range + p->nranges; lo < hi;)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (compare_range(&db->ranges[mid], bare, width, num) <= 0)
+        {
+            found = mid;
+            lo = mid + 1;
+        }
+        else
+            hi = mid;
+    }
+    return found;
+}
+
+int64_t
+hostdb_host_id(const struct hostdb *db, const char *host)
+{
+    const struct hostdb_prefix *p = NULL;
+    const struct hostdb_range *r = NULL;
+    size_t len = strlen(host);
+    size_t plen = len;
+    uint32_t num = 0, width = 0;
+    int64_t found;
+    int bare = 1;
+
+    /* split it the way the compiler does */
+    while (plen > 0 && host[plen - 1] >= '0' && host[plen - 1] <= '9')
+        plen--;
+    if (plen < len && len - plen <= HOSTDB_MAX_DIGITS)
+    {
+        bare = 0;
+        num = strtoul(host + plen, NULL, 10);
+        if (len - plen > 1 && host[plen] == '0')
+            width = len - plen;
+    }
+    else
+        plen = len;
+
+    if ((p = find_prefix(db, host, plen)) == NULL)
+        return -1;
+    found = find_range_of(db, p, bare, width, num);
+    if (found < 0 || (r = range_at(db, found)) == NULL)
+        return -1;
+    if (((r->flags & HOSTDB_RANGE_BARE) != 0) != bare || r->width != width
+        || num > r->hi)
+        return -1;
+    return r->first_host + (num - r->lo);
+}
+
+/* Call 'fn' for the runs of IDs of hosts numbered 'lo' to 'hi' in the
+ * ranges of 'p' with the given width. */
+static int
+width_range_ids(const struct hostdb *db, const struct hostdb_prefix *p,
+                uint32_t width, uint32_t lo, uint32_t hi,
+                int (*fn)(void *arg, uint32_t first, uint32_t last),
+                void *arg)
+{
+    const struct hostdb_range *r = NULL;
+    uint32_t end = p->first_range + p->nranges;
+    uint32_t from, to;
+    int64_t i;
+
+    if ((i = find_range_of(db, p, 0, width, lo)) < 0)
+        i = p->first_range;
+    for (; i < end; i++)
+    {
+        if ((r = range_at(db, i)) == NULL)
+            return -1;
+        if ((r->flags & HOSTDB_RANGE_BARE) || r->width < width)
+            continue;
+        if (r->width > width || r->lo > hi)
+            break;
+        if (r->hi < lo)
+            continue;
+        from = r->lo > lo ? r->lo : lo;
+        to = r->hi < hi ? r->hi : hi;
+        if (fn(arg, r->first_host + (from - r->lo),
+               r->first_host + (to - r->lo) + 1) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int
+hostdb_range_ids(const struct hostdb *db, const char *prefix, uint32_t lo,
+                 uint32_t hi, uint32_t width,
+                 int (*fn)(void *arg, uint32_t first, uint32_t last),
+                 void *arg)
+{
+    const struct hostdb_prefix *p = NULL;
+    uint32_t padded = 0;
+    uint32_t i;
+
+    if (lo > hi || width > HOSTDB_MAX_DIGITS)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((p = find_prefix(db, prefix, strlen(prefix))) == NULL)
+        return 0;
+
+    /* numbers with fewer digits than 'width' have leading zeroes, and are
+     * kept in ranges of that width; the rest are kept unpadded */
+    for (i = 1; i < width; i++)
+        padded = padded ? padded * 10 : 10;
+    if (hi >= padded && width_range_ids(db, p, 0, lo > padded ? lo : padded,
+                                        hi, fn, arg) < 0)
+        return -1;
+    if (lo < padded && width_range_ids(db, p, width, lo,
+                                       hi < padded ? hi : padded - 1, fn,
+                                       arg) < 0)
+        return -1;
+    return 0;
+}
+
+/* the index of the range holding host 'id', or -1 */
+static int64_t
+find_range(const struct hostdb *db, uint32_t id)
+{
+    uint32_t lo = 0, hi = db->nranges, mid;
+    int64_t found = -1;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (db->ranges[mid].first_host <= id)
+        {
+            found = mid;
+            lo = mid + 1;
+        }
+        else
+            hi = mid;
+    }
+    return found;
+}
+
+int
+hostdb_host_name(const struct hostdb *db, uint32_t id, char *buf, size_t n)
+{
+    const struct hostdb_range *r = NULL;
+    const char *prefix = NULL;
+    int64_t i;
+    int len;
+
+    if ((i = find_range(db, id)) < 0 || (r = range_at(db, i)) == NULL)
+        return -1;
+    if (id - r->first_host > r->hi - r->lo)
+        return -1;
+    if ((prefix = string_at(db, db->prefixes[r->prefix].name)) == NULL)
+        return -1;
+    if (r->flags & HOSTDB_RANGE_BARE)
+        len = snprintf(buf, n, "%s", prefix);
+    else
+        len = snprintf(buf, n, "%s%0*u", prefix, (int)r->width,
+                       r->lo + (id - r->first_host));
+    if (len < 0 || (size_t)len >= n)
+        return -1;
+    return len;
+}
+
+int
+hostdb_host_has_attr(const struct hostdb *db, uint32_t id, uint32_t attr)
+{
+    if (id >= db->nhosts || attr >= db->nattrs)
+        return 0;
+    return (db->host_attrs[(uint64_t)id * db->attr_words + attr / 64]
+            >> (attr % 64)) & 1;
+}
+
+/* push numbers 'lo' to 'hi' of range 'r' */
+static int
+push_range(const struct hostdb *db, hostlist_t hl,
+           const struct hostdb_range *r, uint32_t lo, uint32_t hi)
+{
+    char buf[HOSTDB_NAME_MAX * 2];
+    const char *prefix = NULL;
+    int width = r->width;
+    int len;
+
+    if ((prefix = string_at(db, db->prefixes[r->prefix].name)) == NULL)
+        return -1;
+    if (r->flags & HOSTDB_RANGE_BARE)
+        return hostlist_push_host(hl, prefix) > 0 ? 0 : -1;
+
+    if (lo == hi)
+        len = snprintf(buf, sizeof(buf), "%s%0*u", prefix, width, lo);
+    else
+        len = snprintf(buf, sizeof(buf), "%s[%0*u-%0*u]", prefix,
+                       width, lo, width, hi);
+    if (len < 0 || (size_t)len >= sizeof(buf))
+        return -1;
+    return hostlist_push(hl, buf) > 0 ? 0 : -1;
+}
+
+int
+hostdb_push_ids(const struct hostdb *db, hostlist_t hl, uint32_t first,
+                uint32_t last)
+{
+    const struct hostdb_range *r = NULL;
+    uint32_t offset, count;
+    int64_t i;
+
+    if (first > last || last > db->nhosts)
+        return -1;
+    if (first == last)
+        return 0;
+    if ((i = find_range(db, first)) < 0)
+        return -1;
+
+    /* IDs are given out in range order, so the rest follow on */
+    for (; first < last; i++)
+    {
+        if ((r = range_at(db, i)) == NULL || r->first_host > first)
+            return -1;
+        offset = first - r->first_host;
+        if (offset > r->hi - r->lo)
+            return -1;
+        count = r->hi - r->lo - offset + 1;
+        if (count > last - first)
+            count = last - first;
+        if (push_range(db, hl, r, r->lo + offset, r->lo + offset + count - 1)
+            < 0)
+            return -1;
+        first += count;
+    }
+    return 0;
+}
+
+hostlist_t
+hostdb_hostlist(const struct hostdb *db)
+{
+    hostlist_t hl = NULL;
+
+    if ((hl = hostlist_create(NULL)) == NULL)
+        return NULL;
+    if (hostdb_push_ids(db, hl, 0, db->nhosts) < 0)
+    {
+        hostlist_destroy(hl);
+        return NULL;
+    }
+    return hl;
+}
+
+hostlist_t
+hostdb_with_attr(const struct hostdb *db, uint32_t attr)
+{
+    struct bitmap *bm = NULL;
+    hostlist_t hl = NULL;
+
+    if ((bm = hostdb_attr_bitmap(db, attr)) == NULL)
+        return NULL;
+    if ((hl = hostlist_create(NULL)) != NULL
+        && hostdb_push_bitmap(db, hl, bm) < 0)
+    {
+        hostlist_destroy(hl);
+        hl = NULL;
+    }
+    bitmap_free(bm);
+    return hl;
+}
+
+/* the bitmap for 'attr' from the index */
+static struct bitmap *
+read_posting(const struct hostdb *db, uint32_t attr)
+{
+    const struct hostdb_posting *p = &db->postings[attr];
+    const struct hostdb_container *c = NULL;
+    struct bitmap *bm = NULL;
+    uint64_t size;
+    uint32_t i;
+
+    if (p->first_container > db->ncontainers
+        || p->ncontainers > db->ncontainers - p->first_container)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((bm = bitmap_new()) == NULL)
+        return NULL;
+    for (i = 0; i < p->ncontainers; i++)
+    {
+        c = &db->containers[p->first_container + i];
+        switch (c->type)
+        {
+        case BITMAP_ARRAY:
+            size = (uint64_t)c->count * sizeof(uint16_t);
+            break;
+        case BITMAP_BITMAP:
+            size = (uint64_t)c->count * sizeof(uint64_t);
+            break;
+        default:
+            size = (uint64_t)c->count * 2 * sizeof(uint16_t);
+            break;
+        }
+        if (c->offset % 8 != 0 || c->offset > db->index_data_size
+            || size > db->index_data_size - c->offset)
+            goto damaged;
+        if (bitmap_append_container(bm, c->key, c->type,
+                                    db->index_data + c->offset, c->count)
+            < 0)
+            goto fail;
+    }
+    return bm;
+
+damaged:
+    errno = EINVAL;
+fail:
+    bitmap_free(bm);
+    return NULL;
+}
+
+struct bitmap *
+hostdb_attr_bitmap(const struct hostdb *db, uint32_t attr)
+{
+    struct bitmap *bm = NULL;
+    uint32_t id, start;
+
+    if (attr >= db->nattrs)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (db->postings != NULL)
+        return read_posting(db, attr);
+
+    /* no index: go through the hosts */
+    if ((bm = bitmap_new()) == NULL)
+        return NULL;
+    for (id = 0; id < db->nhosts; id++)
+    {
+        if (!hostdb_host_has_attr(db, id, attr))
+            continue;
+        for (start = id; id < db->nhosts; id++)
+            if (!hostdb_host_has_attr(db, id, attr))
+                break;
+        if (bitmap_append_range(bm, start, id) < 0)
+        {
+            bitmap_free(bm);
+            return NULL;
+        }
+    }
+    return bm;
+}
+
+struct bitmap *
+hostdb_all_bitmap(const struct hostdb *db)
+{
+    struct bitmap *bm = NULL;
+
+    if ((bm = bitmap_new()) == NULL)
+        return NULL;
+    if (bitmap_append_range(bm, 0, db->nhosts) < 0)
+    {
+        bitmap_free(bm);
+        return NULL;
+    }
+    return bm;
+}
+
+struct push_state {
+    const struct hostdb *db;
+    hostlist_t hl;
+};
+
+static int
+push_run(void *arg, uint32_t first, uint32_t last)
+{
+    struct push_state *st = arg;
+
+    return hostdb_push_ids(st->db, st->hl, first, last);
+}
+
+int
+hostdb_push_bitmap(const struct hostdb *db, hostlist_t hl,
+                   const struct bitmap *bm)
+{
+    struct push_state st = { db, hl };
+
+    return bitmap_each_run(bm, push_run, &st);
+}
@@ -0,0 +1,203 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* Host databases: a compact binary form of a host inventory, compiled ahead
+ * of time from text (see pdshpy/hostdb.py) and read with mmap(), so opening
+ * one costs the same however many hosts it holds, and only the pages a
+ * query touches are ever read.
+ *
+ * Hosts are kept the way pdsh's hostlists keep them: a table of interned
+ * prefixes, each with sorted ranges of numeric suffixes. Every host gets a
+ * dense ID, in sorted order, so a run of consecutive IDs within one range is
+ * a run of consecutive hostnames. Each host also has a bitmap of the
+ * attributes (arbitrary strings, like "gpu" or "rack=12") it was given.
+ *
+ * The file is a header, a table of sections, and the sections themselves,
+ * all little-endian and 8-byte aligned:
+ *
+ *     header          struct hostdb_header
+ *     sections        struct hostdb_section, one per section
+ *     STRINGS         NUL-terminated names, referred to by offset
+ *     PREFIXES        struct hostdb_prefix, sorted by name (strcmp order)
+ *     RANGES          struct hostdb_range, by prefix, then bare (no number)
+ *                     first, then by width and lo; i.e. by host ID
+ *     ATTRS           uint32_t string offsets, sorted by name
+ *     HOST_ATTRS      for each host, (nattrs + 63) / 64 uint64_t words;
+ *                     bit n of word n / 64 set if it has attribute n
+ *     INDEX           struct hostdb_posting for each attribute: which of
+ *                     the CONTAINERS make up its bitmap (see bitmap.h)
+ *     CONTAINERS      struct hostdb_container, by attribute, then key
+ *     INDEX_DATA      the containers' contents
+ *
+ * Readers skip sections they don't know about, so later versions can add
+ * sections without breaking older readers.
+ */
+
+#ifndef _PDSHPY_HOSTDB_H
+#define _PDSHPY_HOSTDB_H
+
+#include <stdint.h>
+
+#include "src/common/hostlist.h"
+
+#include "bitmap.h"
+
+#define HOSTDB_MAGIC "PDSHPYDB"
+#define HOSTDB_VERSION 1
+#define HOSTDB_BYTE_ORDER 0x01020304
+
+/* suffixes with more digits than this are left in the prefix */
+#define HOSTDB_MAX_DIGITS 9
+
+enum hostdb_section_id {
+    HOSTDB_SECTION_STRINGS = 1,
+    HOSTDB_SECTION_PREFIXES = 2,
+    HOSTDB_SECTION_RANGES = 3,
+    HOSTDB_SECTION_ATTRS = 4,
+    HOSTDB_SECTION_HOST_ATTRS = 5,
+    HOSTDB_SECTION_INDEX = 6,
+    HOSTDB_SECTION_CONTAINERS = 7,
+    HOSTDB_SECTION_INDEX_DATA = 8,
+};
+
+struct hostdb_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t nhosts;
+    uint32_t nsections;
+    uint64_t size;              /* of the whole file */
+};
+
+struct hostdb_section {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct hostdb_prefix {
+    uint32_t name;              /* offset into STRINGS */
+    uint32_t first_range;
+    uint32_t nranges;
+    uint32_t reserved;
+};
+
+/* the range's host is the prefix itself, without a number */
+#define HOSTDB_RANGE_BARE 0x1
+
+struct hostdb_range {
+    uint32_t prefix;
+    uint32_t lo;
+    uint32_t hi;                /* inclusive */
+    uint16_t width;             /* zero-padded to this many digits, or 0 */
+    uint16_t flags;
+    uint32_t first_host;        /* ID of the host numbered lo */
+    uint32_t reserved;
+};
+
+/* the hosts with an attribute, as a bitmap of host IDs */
+struct hostdb_posting {
+    uint32_t first_container;
+    uint32_t ncontainers;
+};
+
+struct hostdb_container {
+    uint16_t key;               /* high 16 bits of the IDs in it */
+    uint16_t type;              /* enum bitmap_container_type */
+    uint32_t count;             /* array values, words, or runs */
+    uint64_t offset;            /* into INDEX_DATA; 8-byte aligned */
+};
+
+struct hostdb;
+
+/* Map the host database at 'path'. Returns NULL with errno set if it can't
+ * be opened, or to EINVAL if it isn't a host database this code can read.
+ * Only the header is looked at here; the rest is checked as it's used.
+ */
+struct hostdb *hostdb_open(const char *path);
+
+/* Another reference to 'db', for something which needs it to stay mapped
+ * (a bitmap made from it, say). hostdb_close() drops a reference, and the
+ * database is unmapped when the last one goes. */
+struct hostdb *hostdb_ref(struct hostdb *db);
+
+void hostdb_close(struct hostdb *db);
+
+uint32_t hostdb_nhosts(const struct hostdb *db);
+
+uint32_t hostdb_nattrs(const struct hostdb *db);
+
+/* the name of attribute 'attr', or NULL if there's no such attribute */
+const char *hostdb_attr_name(const struct hostdb *db, uint32_t attr);
+
+/* the number of the attribute called 'name', or -1 if there's none */
+int64_t hostdb_attr_id(const struct hostdb *db, const char *name);
+
+/* the first attribute whose name sorts at or after 'name', or nattrs if
+ * there's none; so the ones starting with some prefix can be walked */
+uint32_t hostdb_attr_lower_bound(const struct hostdb *db, const char *name);
+
+/* the ID of 'host', or -1 if it isn't in the database */
+int64_t hostdb_host_id(const struct hostdb *db, const char *host);
+
+/* Put the name of host 'id' in 'buf'. Returns its length, or -1 if there is
+ * no such host or it doesn't fit. */
+int hostdb_host_name(const struct hostdb *db, uint32_t id, char *buf,
+                     size_t n);
+
+/* Call fn(arg, first, last) for each run of IDs of the hosts named 'prefix'
+ * followed by a number from 'lo' to 'hi' zero-padded to 'width' digits (as
+ * in a hostlist range, like "node[01-10]"), with 'last' one past the end.
+ * Returns 0, or -1 if 'fn' does or the database is damaged. */
+int hostdb_range_ids(const struct hostdb *db, const char *prefix, uint32_t lo,
+                     uint32_t hi, uint32_t width,
+                     int (*fn)(void *arg, uint32_t first, uint32_t last),
+                     void *arg);
+
+/* nonzero if host 'id' has attribute 'attr' */
+int hostdb_host_has_attr(const struct hostdb *db, uint32_t id,
+                         uint32_t attr);
+
+/* Add hosts 'first' up to (not including) 'last' to 'hl', in ranged form:
+ * one hostlist_push() per range they span, however many hosts that is.
+ * Returns 0, or -1 if the IDs are out of range or the database is damaged.
+ */
+int hostdb_push_ids(const struct hostdb *db, hostlist_t hl, uint32_t first,
+                    uint32_t last);
+
+/* a new hostlist of every host in the database, or NULL on failure */
+hostlist_t hostdb_hostlist(const struct hostdb *db);
+
+/* a new hostlist of the hosts with attribute 'attr', or NULL on failure */
+hostlist_t hostdb_with_attr(const struct hostdb *db, uint32_t attr);
+
+/* A new bitmap of the IDs of the hosts with attribute 'attr', or NULL with
+ * errno set. It's read straight from the database's index where there is
+ * one, and may point into the database, which has to stay mapped for as
+ * long as it's around. */
+struct bitmap *hostdb_attr_bitmap(const struct hostdb *db, uint32_t attr);
+
+/* a new bitmap of every host ID, or NULL */
+struct bitmap *hostdb_all_bitmap(const struct hostdb *db);
+
+/* Add the hosts in 'bm' to 'hl', in ranged form. Returns 0, or -1 if 'bm'
+ * has IDs which aren't in the database. */
+int hostdb_push_bitmap(const struct hostdb *db, hostlist_t hl,
+                       const struct bitmap *bm);
+
+#endif /* !_PDSHPY_HOSTDB_H */
@@ -0,0 +1,1712 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hostexpr.h"
+
+/* characters which can't be part of a name */
+#define OPERATORS "&|!()*"
+
+/* how deeply '!' and '(' can nest */
+#define MAX_DEPTH 256
+
+struct range {
+    uint32_t lo;
+    uint32_t hi;                /* inclusive */
+    uint32_t width;             /* zero-padded to exactly this many digits,
+                                 * or 0 if not padded at all */
+};
+
+/* one comma-free piece of a hostlist: a prefix and the numbers which can
+ * follow it, or just a name */
+struct term {
+    char *prefix;
+    struct range *ranges;
+    uint32_t nranges;           /* 0 if it's just a name */
+};
+
+enum node_type {
+    NODE_NONE,                  /* no hosts */
+    NODE_ALL,                   /* every host */
+    NODE_NAMES,
+    NODE_NOT,
+    NODE_AND,
+    NODE_OR,
+};
+
+struct node {
+    enum node_type type;
+    char *text;                 /* canonical form, once simplified */
+    struct term *terms;         /* NODE_NAMES */
+    uint32_t nterms;
+    uint32_t leaf;              /* NODE_NAMES: its number, for evaluation */
+    struct node **kids;         /* NODE_NOT has one */
+    uint32_t nkids;
+};
+
+struct hostexpr {
+    int refs;
+    char *source;               /* what it was compiled from */
+    struct node *root;
+    uint32_t nleaves;
+};
+
+static void
+free_node(struct node *n)
+{
+    uint32_t i;
+
+    if (n == NULL)
+        return;
+    for (i = 0; i < n->nterms; i++)
+    {
+        free(n->terms[i].prefix);
+        free(n->terms[i].ranges);
+    }
+    free(n->terms);
+    for (i = 0; i < n->nkids; i++)
+        free_node(n->kids[i]);
+    free(n->kids);
+    free(n->text);
+    free(n);
+}
+
+static struct node *
+new_node(enum node_type type)
+{
+    struct node *n = calloc(1, sizeof(*n));
+
+    if (n != NULL)
+        n->type = type;
+    return n;
+}
+
+/* Add 'kid' to 'n'. On failure, 'kid' is freed. */
+static int
+add_kid(struct node *n, struct node *kid)
+{
+    struct node **kids = NULL;
+
+    if ((kids = realloc(n->kids, (n->nkids + 1) * sizeof(*kids))) == NULL)
+    {
+        free_node(kid);
+        return -1;
+    }
+    n->kids = kids;
+    n->kids[n->nkids++] = kid;
+    return 0;
+}
+
+/* Move the children of 'from' to the end of 'n', and free 'from' (even on
+ * failure). */
+static int
+take_kids(struct node *n, struct node *from)
+{
+    struct node **kids = NULL;
+
+    kids = realloc(n->kids, (n->nkids + from->nkids + 1) * sizeof(*kids));
+    if (kids == NULL)
+    {
+        free_node(from);
+        return -1;
+    }
+    memcpy(kids + n->nkids, from->kids, from->nkids * sizeof(*kids));
+    n->kids = kids;
+    n->nkids += from->nkids;
+    from->nkids = 0;
+    free_node(from);
+    return 0;
+}
+
+/* Move the terms of 'from' to the end of 'n', and free 'from' (even on
+ * failure). */
+static int
+take_terms(struct node *n, struct node *from)
+{
+    struct term *terms = NULL;
+
+    terms = realloc(n->terms,
+                    (n->nterms + from->nterms + 1) * sizeof(*terms));
+    if (terms == NULL)
+    {
+        free_node(from);
+        return -1;
+    }
+    memcpy(terms + n->nterms, from->terms, from->nterms * sizeof(*terms));
+    n->terms = terms;
+    n->nterms += from->nterms;
+    from->nterms = 0;
+    free_node(from);
+    return 0;
+}
+
+/* ----[ parsing ]---- */
+
+struct parser {
+    const char *text;
+    const char *p;
+    char *err;
+    size_t n;
+    int depth;
+    int failed;                 /* errno to fail with, once it has */
+};
+
+static void
+syntax_error(struct parser *ps, const char *fmt, ...)
+{
+    va_list ap;
+    int len = 0;
+
+    if (ps->failed)
+        return;
+    ps->failed = EINVAL;
+    if (ps->n == 0)
+        return;
+    va_start(ap, fmt);
+    len = vsnprintf(ps->err, ps->n, fmt, ap);
+    va_end(ap);
+    if (len >= 0 && (size_t)len < ps->n)
+        snprintf(ps->err + len, ps->n - len, " at column %d",
+                 (int)(ps->p - ps->text) + 1);
+}
+
+static void
+no_memory(struct parser *ps)
+{
+    if (ps->failed)
+        return;
+    ps->failed = ENOMEM;
+    if (ps->n > 0)
+        snprintf(ps->err, ps->n, "out of memory");
+}
+
+static void
+skip_space(struct parser *ps)
+{
+    while (isspace((unsigned char)*ps->p))
+        ps->p++;
+}
+
+static int
+add_range(struct term *t, uint32_t lo, uint32_t hi, uint32_t width)
+{
+    struct range *ranges = NULL;
+
+    ranges = realloc(t->ranges, (t->nranges + 1) * sizeof(*ranges));
+    if (ranges == NULL)
+        return -1;
+    t->ranges = ranges;
+    t->ranges[t->nranges].lo = lo;
+    t->ranges[t->nranges].hi = hi;
+    t->ranges[t->nranges].width = width;
+    t->nranges++;
+    return 0;
+}
+
+/* Add numbers 'lo' to 'hi', written with at least 'width' digits (as in a
+ * hostlist), split into the ones that are zero-padded and the ones that
+ * aren't; that's how host databases keep them, and it means ranges which
+ * give the same names the same way can always be merged. */
+static int
+add_numbers(struct term *t, uint32_t lo, uint32_t hi, uint32_t width)
+{
+    uint32_t padded = 0;
+    uint32_t i;
+
+    for (i = 1; i < width; i++)
+        padded = padded ? padded * 10 : 10;
+    if (lo < padded
+        && add_range(t, lo, hi < padded ? hi : padded - 1, width) < 0)
+        return -1;
+    if (hi >= padded && add_range(t, lo > padded ? lo : padded, hi, 0) < 0)
+        return -1;
+    return 0;
+}
+
+/* Read a number of at most HOSTDB_MAX_DIGITS digits at 's', setting *width
+ * to how many there are if they have a leading zero. Returns how many
+ * characters it took, or 0 if there's no such number. */
+static size_t
+read_number(const char *s, size_t len, uint32_t *num, uint32_t *width)
+{
+    size_t n = 0;
+
+    *num = 0;
+    while (n < len && isdigit((unsigned char)s[n]))
+    {
+        if (n == HOSTDB_MAX_DIGITS)
+            return 0;
+        *num = *num * 10 + (s[n++] - '0');
+    }
+    *width = (n > 1 && s[0] == '0') ? n : 0;
+    return n;
+}
+
+/* Parse the 'len' characters at 's', a piece of a hostlist, into 't'. */
+static int
+parse_term(struct parser *ps, const char *s, size_t len, struct term *t)
+{
+    const char *open = memchr(s, '[', len);
+    const char *p = NULL;
+    const char *end = s + len;
+    uint32_t lo, hi, width, ignored;
+    size_t plen, n;
+
+    plen = (open != NULL) ? (size_t)(open - s) : len;
+    ps->p = s;
+    if (open == NULL && memchr(s, ']', len) != NULL)
+    {
+        syntax_error(ps, "unmatched ']'");
+        return -1;
+    }
+    if (open != NULL && memchr(open, ']', end - open) == NULL)
+    {
+        syntax_error(ps, "unmatched '['");
+        return -1;
+    }
+    if (open != NULL && (memchr(s, ']', plen) != NULL || end[-1] != ']'
+                         || memchr(open + 1, '[', end - open - 1) != NULL))
+    {
+        syntax_error(ps, "only one range, at the end, is allowed in a name");
+        return -1;
+    }
+
+    if (open == NULL)
+    {
+        /* a plain name: any number on the end is made into a range */
+        while (plen > 0 && isdigit((unsigned char)s[plen - 1]))
+            plen--;
+        if (plen == len || len - plen > HOSTDB_MAX_DIGITS)
+            plen = len;
+    }
+    if ((t->prefix = malloc(plen + 1)) == NULL)
+        goto nomem;
+    memcpy(t->prefix, s, plen);
+    t->prefix[plen] = '\0';
+
+    if (open == NULL)
+    {
+        if (plen < len && (read_number(s + plen, len - plen, &lo, &width) == 0
+                           || add_numbers(t, lo, lo, width) < 0))
+            goto nomem;
+        return 0;
+    }
+
+    for (p = open + 1; p < end - 1;)
+    {
+        ps->p = p;
+        if ((n = read_number(p, end - 1 - p, &lo, &width)) == 0)
+        {
+            syntax_error(ps, "expected a number of at most %d digits",
+                         HOSTDB_MAX_DIGITS);
+            return -1;
+        }
+        p += n;
+        hi = lo;
+        if (*p == '-')
+        {
+            ps->p = ++p;
+            if ((n = read_number(p, end - 1 - p, &hi, &ignored)) == 0)
+            {
+                syntax_error(ps, "expected a number of at most %d digits",
+                             HOSTDB_MAX_DIGITS);
+                return -1;
+            }
+            p += n;
+            if (hi < lo)
+            {
+                syntax_error(ps, "range goes backwards");
+                return -1;
+            }
+        }
+        if (add_numbers(t, lo, hi, width) < 0)
+            goto nomem;
+        if (*p == ',' && p + 1 < end - 1)
+            p++;
+        else if (p != end - 1)
+        {
+            ps->p = p;
+            syntax_error(ps, "unexpected '%c' in range", *p);
+            return -1;
+        }
+    }
+    if (t->nranges == 0)
+    {
+        ps->p = open;
+        syntax_error(ps, "empty range");
+        return -1;
+    }
+    return 0;
+
+nomem:
+    no_memory(ps);
+    return -1;
+}
+
+/* a hostlist: names and ranges of names, separated by commas */
+static struct node *
+parse_names(struct parser *ps)
+{
+    struct node *n = NULL;
+    struct term *terms = NULL;
+    const char *start = ps->p;
+    const char *end = NULL;
+    const char *piece = NULL;
+    const char *comma = NULL;
+    int depth = 0;
+
+    for (end = start; *end != '\0'; end++)
+        if (isspace((unsigned char)*end) || strchr(OPERATORS, *end) != NULL)
+            break;
+    if (end == start)
+    {
+        if (*start == '\0')
+            syntax_error(ps, "expression ends too soon");
+        else
+            syntax_error(ps, "unexpected '%c'", *start);
+        return NULL;
+    }
+
+    if ((n = new_node(NODE_NAMES)) == NULL)
+    {
+        no_memory(ps);
+        return NULL;
+    }
+    for (piece = start; piece <= end; piece = comma + 1)
+    {
+        /* the next comma outside a range */
+        for (comma = piece, depth = 0; comma < end; comma++)
+        {
+            if (*comma == '[')
+                depth++;
+            else if (*comma == ']')
+                depth--;
+            else if (*comma == ',' && depth == 0)
+                break;
+        }
+        if (comma == piece)
+        {
+            ps->p = piece;
+            syntax_error(ps, "empty name");
+            goto fail;
+        }
+        terms = realloc(n->terms, (n->nterms + 1) * sizeof(*terms));
+        if (terms == NULL)
+        {
+            no_memory(ps);
+            goto fail;
+        }
+        n->terms = terms;
+        memset(&n->terms[n->nterms], 0, sizeof(*terms));
+        n->nterms++;
+        if (parse_term(ps, piece, comma - piece, &n->terms[n->nterms - 1])
+            < 0)
+            goto fail;
+    }
+    ps->p = end;
+    return n;
+
+fail:
+    free_node(n);
+    return NULL;
+}
+
+static struct node *parse_or(struct parser *ps);
+
+static struct node *
+parse_not(struct parser *ps)
+{
+    struct node *n = NULL;
+    struct node *kid = NULL;
+
+    skip_space(ps);
+    if (++ps->depth > MAX_DEPTH)
+    {
+        syntax_error(ps, "expression nested too deeply");
+        return NULL;
+    }
+    switch (*ps->p)
+    {
+    case '!':
+        ps->p++;
+        if ((kid = parse_not(ps)) == NULL)
+            break;
+        if ((n = new_node(NODE_NOT)) == NULL)
+        {
+            free_node(kid);
+            no_memory(ps);
+        }
+        else if (add_kid(n, kid) < 0)
+        {
+            free_node(n);
+            n = NULL;
+            no_memory(ps);
+        }
+        break;
+    case '(':
+        ps->p++;
+        if ((n = parse_or(ps)) == NULL)
+            break;
+        skip_space(ps);
+        if (*ps->p != ')')
+        {
+            syntax_error(ps, "missing ')'");
+            free_node(n);
+            n = NULL;
+            break;
+        }
+        ps->p++;
+        break;
+    case '*':
+        ps->p++;
+        if ((n = new_node(NODE_ALL)) == NULL)
+            no_memory(ps);
+        break;
+    default:
+        n = parse_names(ps);
+        break;
+    }
+    ps->depth--;
+    return n;
+}
+
+/* what 'parse' parses, separated by 'op' */
+static struct node *
+parse_list(struct parser *ps, char op, enum node_type type,
+           struct node *(*parse)(struct parser *))
+{
+    struct node *n = NULL;
+    struct node *kid = NULL;
+
+    if ((kid = parse(ps)) == NULL)
+        return NULL;
+    skip_space(ps);
+    if (*ps->p != op)
+        return kid;
+    if ((n = new_node(type)) == NULL)
+    {
+        free_node(kid);
+        no_memory(ps);
+        return NULL;
+    }
+    for (;;)
+    {
+        if (add_kid(n, kid) < 0)
+        {
+            free_node(n);
+            no_memory(ps);
+            return NULL;
+        }
+        skip_space(ps);
+        if (*ps->p != op)
+            return n;
+        ps->p++;
+        if ((kid = parse(ps)) == NULL)
+        {
+            free_node(n);
+            return NULL;
+        }
+    }
+}
+
+static struct node *
+parse_and(struct parser *ps)
+{
+    return parse_list(ps, '&', NODE_AND, parse_not);
+}
+
+static struct node *
+parse_or(struct parser *ps)
+{
+    return parse_list(ps, '|', NODE_OR, parse_and);
+}
+
+/* ----[ simplifying ]---- */
+
+struct buf {
+    char *s;
+    size_t len;
+    size_t cap;
+    int failed;
+};
+
+static void
+buf_add(struct buf *b, const char *s, size_t len)
+{
+    char *bigger = NULL;
+    size_t cap;
+
+    if (b->failed)
+        return;
+    if (b->len + len + 1 > b->cap)
+    {
+        for (cap = b->cap ? b->cap : 32; cap < b->len + len + 1; cap *= 2)
+            ;
+        if ((bigger = realloc(b->s, cap)) == NULL)
+        {
+            b->failed = 1;
+            return;
+        }
+        b->s = bigger;
+        b->cap = cap;
+    }
+    memcpy(b->s + b->len, s, len);
+    b->len += len;
+    b->s[b->len] = '\0';
+}
+
+static void
+buf_str(struct buf *b, const char *s)
+{
+    buf_add(b, s, strlen(s));
+}
+
+static void
+buf_number(struct buf *b, uint32_t num, uint32_t width)
+{
+    char digits[32];
+    int len = snprintf(digits, sizeof(digits), "%0*u", (int)width, num);
+
+    buf_add(b, digits, len);
+}
+
+static void
+buf_term(struct buf *b, const struct term *t)
+{
+    const struct range *r = NULL;
+    uint32_t i;
+
+    buf_str(b, t->prefix);
+    if (t->nranges == 1 && t->ranges[0].lo == t->ranges[0].hi)
+    {
+        buf_number(b, t->ranges[0].lo, t->ranges[0].width);
+        return;
+    }
+    if (t->nranges == 0)
+        return;
+    buf_str(b, "[");
+    for (i = 0; i < t->nranges; i++)
+    {
+        r = &t->ranges[i];
+        if (i > 0)
+            buf_str(b, ",");
+        buf_number(b, r->lo, r->width);
+        if (r->hi > r->lo)
+        {
+            buf_str(b, "-");
+            buf_number(b, r->hi, r->width);
+        }
+    }
+    buf_str(b, "]");
+}
+
+/* the kid's text, in parentheses if it binds more loosely than 'type' */
+static void
+buf_kid(struct buf *b, const struct node *kid, enum node_type type)
+{
+    int parens = (kid->type == NODE_OR && type != NODE_OR)
+                 || (kid->type == NODE_AND && type == NODE_NOT);
+
+    if (parens)
+        buf_str(b, "(");
+    buf_str(b, kid->text);
+    if (parens)
+        buf_str(b, ")");
+}
+
+/* set n->text, from its terms or its children's text */
+static int
+set_text(struct node *n)
+{
+    struct buf b = { NULL, 0, 0, 0 };
+    uint32_t i;
+
+    switch (n->type)
+    {
+    case NODE_NONE:
+        buf_str(&b, "!*");
+        break;
+    case NODE_ALL:
+        buf_str(&b, "*");
+        break;
+    case NODE_NAMES:
+        for (i = 0; i < n->nterms; i++)
+        {
+            if (i > 0)
+                buf_str(&b, ",");
+            buf_term(&b, &n->terms[i]);
+        }
+        break;
+    case NODE_NOT:
+        buf_str(&b, "!");
+        buf_kid(&b, n->kids[0], NODE_NOT);
+        break;
+    case NODE_AND:
+    case NODE_OR:
+        for (i = 0; i < n->nkids; i++)
+        {
+            if (i > 0)
+                buf_str(&b, n->type == NODE_AND ? " & " : " | ");
+            buf_kid(&b, n->kids[i], n->type);
+        }
+        break;
+    }
+    if (b.failed || b.s == NULL)
+    {
+        free(b.s);
+        return -1;
+    }
+    free(n->text);
+    n->text = b.s;
+    return 0;
+}
+
+static int
+compare_ranges(const void *a, const void *b)
+{
+    const struct range *x = a, *y = b;
+
+    if (x->width != y->width)
+        return x->width < y->width ? -1 : 1;
+    if (x->lo != y->lo)
+        return x->lo < y->lo ? -1 : 1;
+    return 0;
+}
+
+/* plain names before ranges, then by prefix */
+static int
+compare_terms(const void *a, const void *b)
+{
+    const struct term *x = a, *y = b;
+
+    if ((x->nranges == 0) != (y->nranges == 0))
+        return x->nranges == 0 ? -1 : 1;
+    return strcmp(x->prefix, y->prefix);
+}
+
+/* Sort and merge the ranges of each prefix, and drop repeated names. */
+static int
+merge_names(struct node *n)
+{
+    struct term *t = NULL;
+    struct term *prev = NULL;
+    struct range *ranges = NULL;
+    uint32_t i, j, out = 0;
+
+    qsort(n->terms, n->nterms, sizeof(*n->terms), compare_terms);
+    for (i = 0; i < n->nterms; i++)
+    {
+        t = &n->terms[i];
+        prev = (out > 0) ? &n->terms[out - 1] : NULL;
+        if (prev != NULL && (prev->nranges == 0) == (t->nranges == 0)
+            && strcmp(prev->prefix, t->prefix) == 0)
+        {
+            if (t->nranges > 0)
+            {
+                ranges = realloc(prev->ranges, (prev->nranges + t->nranges)
+                                               * sizeof(*ranges));
+                if (ranges == NULL)
+                {
+                    /* keep the rest, so they're freed along with 'n' */
+                    memmove(&n->terms[out], t,
+                            (n->nterms - i) * sizeof(*t));
+                    n->nterms = out + (n->nterms - i);
+                    return -1;
+                }
+                memcpy(ranges + prev->nranges, t->ranges,
+                       t->nranges * sizeof(*ranges));
+                prev->ranges = ranges;
+                prev->nranges += t->nranges;
+            }
+            free(t->prefix);
+            free(t->ranges);
+            continue;
+        }
+        n->terms[out++] = *t;
+    }
+    n->nterms = out;
+
+    for (i = 0; i < n->nterms; i++)
+    {
+        t = &n->terms[i];
+        if (t->nranges < 2)
+            continue;
+        qsort(t->ranges, t->nranges, sizeof(*t->ranges), compare_ranges);
+        for (j = 1, out = 1; j < t->nranges; j++)
+        {
+            if (t->ranges[j].width == t->ranges[out - 1].width
+                && t->ranges[j].lo <= t->ranges[out - 1].hi + 1)
+            {
+                if (t->ranges[j].hi > t->ranges[out - 1].hi)
+                    t->ranges[out - 1].hi = t->ranges[j].hi;
+            }
+            else
+                t->ranges[out++] = t->ranges[j];
+        }
+        t->nranges = out;
+    }
+    return 0;
+}
+
+/* NOT parts last, then by text */
+static int
+compare_kids(const void *a, const void *b)
+{
+    const struct node *x = *(struct node *const *)a;
+    const struct node *y = *(struct node *const *)b;
+
+    if ((x->type == NODE_NOT) != (y->type == NODE_NOT))
+        return x->type == NODE_NOT ? 1 : -1;
+    return strcmp(x->text, y->text);
+}
+
+static struct node *simplify(struct node *n);
+
+static struct node *
+simplify_not(struct node *n)
+{
+    struct node *kid = NULL;
+    struct node *result = NULL;
+
+    kid = n->kids[0] = simplify(n->kids[0]);
+    if (kid == NULL)
+    {
+        free_node(n);
+        return NULL;
+    }
+    if (kid->type == NODE_NOT)
+    {
+        result = kid->kids[0];
+        kid->kids[0] = NULL;
+        free_node(n);
+        return result;
+    }
+    if (kid->type == NODE_ALL || kid->type == NODE_NONE)
+    {
+        result = new_node(kid->type == NODE_ALL ? NODE_NONE : NODE_ALL);
+        free_node(n);
+        return result != NULL ? simplify(result) : NULL;
+    }
+    if (set_text(n) < 0)
+    {
+        free_node(n);
+        return NULL;
+    }
+    return n;
+}
+
+/* Replace the NOT children of AND node 'n', if there are several, with
+ * one NOT of them all ORed together: !a & !b is !(a | b), and then a and b
+ * can be merged, and taken away in one go. */
+static int
+gather_nots(struct node *n)
+{
+    struct node *any = NULL;
+    struct node *not = NULL;
+    uint32_t i, out, count = 0;
+
+    for (i = 0; i < n->nkids; i++)
+        count += n->kids[i]->type == NODE_NOT;
+    if (count < 2)
+        return 0;
+    if ((any = new_node(NODE_OR)) == NULL)
+        return -1;
+    for (i = 0, out = 0; i < n->nkids; i++)
+    {
+        if (n->kids[i]->type != NODE_NOT)
+        {
+            n->kids[out++] = n->kids[i];
+            continue;
+        }
+        if (take_kids(any, n->kids[i]) < 0)
+        {
+            /* the rest are freed along with 'n' */
+            memmove(&n->kids[out], &n->kids[i + 1],
+                    (n->nkids - i - 1) * sizeof(*n->kids));
+            n->nkids = out + (n->nkids - i - 1);
+            free_node(any);
+            return -1;
+        }
+    }
+    n->nkids = out;
+    if ((not = new_node(NODE_NOT)) == NULL)
+    {
+        free_node(any);
+        return -1;
+    }
+    if (add_kid(not, any) < 0)
+    {
+        free_node(not);
+        return -1;
+    }
+    if ((not = simplify(not)) == NULL)
+        return -1;
+    return add_kid(n, not);
+}
+
+static struct node *
+simplify_list(struct node *n)
+{
+    enum node_type identity = (n->type == NODE_AND) ? NODE_ALL : NODE_NONE;
+    enum node_type absorbing = (n->type == NODE_AND) ? NODE_NONE : NODE_ALL;
+    struct node **old = n->kids;
+    struct node *kid = NULL;
+    struct node *names = NULL;
+    uint32_t nold = n->nkids;
+    uint32_t i, j, out;
+
+    n->kids = NULL;
+    n->nkids = 0;
+    for (i = 0; i < nold; i++)
+    {
+        kid = simplify(old[i]);
+        old[i] = NULL;
+        if (kid == NULL)
+            goto fail;
+        if (kid->type == n->type)
+        {
+            if (take_kids(n, kid) < 0)
+                goto fail;
+        }
+        else if (kid->type == identity)
+            free_node(kid);
+        else if (kid->type == absorbing)
+            goto absorbed;
+        else if (add_kid(n, kid) < 0)
+            goto fail;
+    }
+    free(old);
+    old = NULL;
+
+    /* names ORed together are just more names */
+    for (i = 0, out = 0; n->type == NODE_OR && i < n->nkids; i++)
+    {
+        kid = n->kids[i];
+        if (kid->type != NODE_NAMES || names == NULL)
+        {
+            n->kids[out++] = kid;
+            if (kid->type == NODE_NAMES)
+                names = kid;
+        }
+        else if (take_terms(names, kid) < 0)
+        {
+            memmove(&n->kids[out], &n->kids[i + 1],
+                    (n->nkids - i - 1) * sizeof(*n->kids));
+            n->nkids = out + (n->nkids - i - 1);
+            goto fail;
+        }
+    }
+    if (n->type == NODE_OR)
+        n->nkids = out;
+    if (names != NULL && (merge_names(names) < 0 || set_text(names) < 0))
+        goto fail;
+    if (n->type == NODE_AND && gather_nots(n) < 0)
+        goto fail;
+    for (i = 0; i < n->nkids; i++)
+    {
+        if (n->kids[i]->type == absorbing)
+        {
+            kid = n->kids[i];
+            n->kids[i] = n->kids[--n->nkids];
+            goto absorbed;
+        }
+        if (n->kids[i]->type == identity)
+        {
+            free_node(n->kids[i]);
+            n->kids[i--] = n->kids[--n->nkids];
+        }
+    }
+
+    /* drop repeats; and x with !x is nothing (or everything) */
+    qsort(n->kids, n->nkids, sizeof(*n->kids), compare_kids);
+    for (i = 1, out = n->nkids ? 1 : 0; i < n->nkids; i++)
+    {
+        if (strcmp(n->kids[i]->text, n->kids[out - 1]->text) == 0)
+            free_node(n->kids[i]);
+        else
+            n->kids[out++] = n->kids[i];
+    }
+    n->nkids = out;
+    for (i = 0; i < n->nkids; i++)
+    {
+        if (n->kids[i]->type != NODE_NOT)
+            continue;
+        for (j = 0; j < n->nkids; j++)
+        {
+            if (strcmp(n->kids[j]->text, n->kids[i]->kids[0]->text) == 0)
+            {
+                free_node(n);
+                return simplify(new_node(absorbing));
+            }
+        }
+    }
+
+    if (n->nkids == 0)
+    {
+        free_node(n);
+        return simplify(new_node(identity));
+    }
+    if (n->nkids == 1)
+    {
+        kid = n->kids[0];
+        n->nkids = 0;
+        free_node(n);
+        return kid;
+    }
+    if (set_text(n) < 0)
+        goto fail;
+    return n;
+
+absorbed:
+    for (i++; old != NULL && i < nold; i++)
+        free_node(old[i]);
+    free(old);
+    free_node(n);
+    return kid;
+
+fail:
+    for (i++; old != NULL && i < nold; i++)
+        free_node(old[i]);
+    free(old);
+    free_node(n);
+    return NULL;
+}
+
+/* Simplify 'n', and set the text of it and everything under it. Returns
+ * what it's become (maybe not 'n' itself), or NULL if there's no memory,
+ * in which case 'n' is gone. */
+static struct node *
+simplify(struct node *n)
+{
+    if (n == NULL)
+        return NULL;
+    switch (n->type)
+    {
+    case NODE_NOT:
+        return simplify_not(n);
+    case NODE_AND:
+    case NODE_OR:
+        return simplify_list(n);
+    case NODE_NAMES:
+        if (merge_names(n) < 0)
+            break;
+        /* fall through */
+    case NODE_NONE:
+    case NODE_ALL:
+        if (set_text(n) < 0)
+            break;
+        return n;
+    }
+    free_node(n);
+    return NULL;
+}
+
+static void
+number_leaves(struct node *n, uint32_t *count)
+{
+    uint32_t i;
+
+    if (n->type == NODE_NAMES)
+        n->leaf = (*count)++;
+    for (i = 0; i < n->nkids; i++)
+        number_leaves(n->kids[i], count);
+}
+
+/* ----[ the plan cache ]---- */
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+    struct hostexpr *e;
+    unsigned long used;
+} cache[HOSTEXPR_CACHE_SIZE];
+
+static unsigned long cache_clock;
+
+static struct hostexpr *
+hostexpr_ref(struct hostexpr *e)
+{
+    __atomic_add_fetch(&e->refs, 1, __ATOMIC_RELAXED);
+    return e;
+}
+
+void
+hostexpr_release(struct hostexpr *e)
+{
+    if (e == NULL || __atomic_sub_fetch(&e->refs, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+    free_node(e->root);
+    free(e->source);
+    free(e);
+}
+
+/* the cached plan for 'text', or NULL */
+static struct hostexpr *
+cache_find(const char *text)
+{
+    struct hostexpr *e = NULL;
+    int i;
+
+    pthread_mutex_lock(&cache_lock);
+    for (i = 0; i < HOSTEXPR_CACHE_SIZE && e == NULL; i++)
+    {
+        if (cache[i].e != NULL && strcmp(cache[i].e->source, text) == 0)
+        {
+            e = hostexpr_ref(cache[i].e);
+            cache[i].used = ++cache_clock;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return e;
+}
+
+/* Put 'e' in the cache, in place of the least recently used plan, unless
+ * another thread has just done the same; returns the one that's cached. */
+static struct hostexpr *
+cache_add(struct hostexpr *e)
+{
+    struct hostexpr *evicted = NULL;
+    int i, slot = 0;
+
+    pthread_mutex_lock(&cache_lock);
+    for (i = 0; i < HOSTEXPR_CACHE_SIZE; i++)
+    {
+        if (cache[i].e != NULL && strcmp(cache[i].e->source, e->source) == 0)
+        {
+            evicted = e;
+            e = hostexpr_ref(cache[i].e);
+            cache[i].used = ++cache_clock;
+            goto out;
+        }
+        if (cache[i].used < cache[slot].used)
+            slot = i;
+    }
+    evicted = cache[slot].e;
+    cache[slot].e = hostexpr_ref(e);
+    cache[slot].used = ++cache_clock;
+out:
+    pthread_mutex_unlock(&cache_lock);
+    hostexpr_release(evicted);
+    return e;
+}
+
+struct hostexpr *
+hostexpr_compile(const char *text, char *err, size_t n)
+{
+    struct parser ps = { text, text, err, n, 0, 0 };
+    struct hostexpr *e = NULL;
+    struct node *root = NULL;
+
+    if ((e = cache_find(text)) != NULL)
+        return e;
+
+    root = parse_or(&ps);
+    skip_space(&ps);
+    if (root != NULL && *ps.p != '\0')
+    {
+        syntax_error(&ps, "unexpected '%c'", *ps.p);
+        free_node(root);
+        root = NULL;
+    }
+    if (root == NULL)
+    {
+        errno = ps.failed ? ps.failed : ENOMEM;
+        return NULL;
+    }
+    if ((root = simplify(root)) == NULL)
+    {
+        no_memory(&ps);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if ((e = calloc(1, sizeof(*e))) == NULL
+        || (e->source = strdup(text)) == NULL)
+    {
+        free(e);
+        free_node(root);
+        no_memory(&ps);
+        errno = ENOMEM;
+        return NULL;
+    }
+    e->refs = 1;
+    e->root = root;
+    number_leaves(root, &e->nleaves);
+    return cache_add(e);
+}
+
+const char *
+hostexpr_text(const struct hostexpr *e)
+{
+    return e->root->text;
+}
+
+/* ----[ evaluation ]---- */
+
+struct eval {
+    const struct hostexpr *e;
+    const struct hostdb *db;    /* when picking from a database */
+    char **names;               /* or the hosts of a hostlist, by index */
+    hostset_t *sets;            /* each leaf's names, for a hostlist */
+    struct bitmap **leaves;     /* each leaf's hosts, from a database */
+    int64_t *counts;            /* each leaf's size, or -1 if not known */
+    uint32_t total;             /* hosts to pick from */
+};
+
+struct id_run {
+    uint32_t first;
+    uint32_t last;              /* one past the end */
+};
+
+struct run_list {
+    struct id_run *runs;
+    size_t n;
+    size_t cap;
+};
+
+static int
+add_run(void *arg, uint32_t first, uint32_t last)
+{
+    struct run_list *rl = arg;
+    struct id_run *bigger = NULL;
+    size_t cap;
+
+    if (rl->n == rl->cap)
+    {
+        cap = rl->cap ? rl->cap * 2 : 16;
+        if ((bigger = realloc(rl->runs, cap * sizeof(*rl->runs))) == NULL)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        rl->runs = bigger;
+        rl->cap = cap;
+    }
+    rl->runs[rl->n].first = first;
+    rl->runs[rl->n].last = last;
+    rl->n++;
+    return 0;
+}
+
+static int
+compare_runs(const void *a, const void *b)
+{
+    const struct id_run *x = a, *y = b;
+
+    return (x->first > y->first) - (x->first < y->first);
+}
+
+/* 'bm' with the hosts in 'rl' added */
+static struct bitmap *
+or_runs(struct bitmap *bm, struct run_list *rl)
+{
+    struct bitmap *runs = NULL;
+    struct bitmap *result = NULL;
+    uint32_t first, last;
+    size_t i;
+
+    if ((runs = bitmap_new()) == NULL)
+        return NULL;
+    qsort(rl->runs, rl->n, sizeof(*rl->runs), compare_runs);
+    i = 0;
+    while (i < rl->n)
+    {
+        first = rl->runs[i].first;
+        last = rl->runs[i].last;
+        for (i++; i < rl->n && rl->runs[i].first <= last; i++)
+            if (rl->runs[i].last > last)
+                last = rl->runs[i].last;
+        if (bitmap_append_range(runs, first, last) < 0)
+        {
+            bitmap_free(runs);
+            return NULL;
+        }
+    }
+    result = bitmap_or(bm, runs);
+    bitmap_free(runs);
+    if (result == NULL)
+        errno = ENOMEM;
+    return result;
+}
+
+/* add attribute 'attr' to *bm */
+static int
+or_attr(struct bitmap **bm, const struct hostdb *db, uint32_t attr)
+{
+    struct bitmap *hosts = NULL;
+    struct bitmap *result = NULL;
+
+    if ((hosts = hostdb_attr_bitmap(db, attr)) == NULL)
+        return -1;
+    result = bitmap_or(*bm, hosts);
+    bitmap_free(hosts);
+    if (result == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    bitmap_free(*bm);
+    *bm = result;
+    return 0;
+}
+
+/* whether 't' names "prefix" followed by 'rest' */
+static int
+term_matches(const struct term *t, const char *rest)
+{
+    size_t len = strlen(rest);
+    uint32_t num, width, i;
+
+    if (len == 0 || read_number(rest, len, &num, &width) != len)
+        return 0;
+    for (i = 0; i < t->nranges; i++)
+        if (t->ranges[i].width == width && t->ranges[i].lo <= num
+            && num <= t->ranges[i].hi)
+            return 1;
+    return 0;
+}
+
+/* the hosts in the database which leaf 'n' names, as attributes or as
+ * hostnames */
+static struct bitmap *
+load_leaf(const struct hostdb *db, const struct node *n)
+{
+    struct run_list rl = { NULL, 0, 0 };
+    struct bitmap *bm = NULL;
+    struct bitmap *result = NULL;
+    const struct term *t = NULL;
+    const char *name = NULL;
+    size_t plen;
+    int64_t id;
+    uint32_t i, j;
+
+    if ((bm = bitmap_new()) == NULL)
+        return NULL;
+    for (i = 0; i < n->nterms; i++)
+    {
+        t = &n->terms[i];
+        if (t->nranges == 0)
+        {
+            if ((id = hostdb_attr_id(db, t->prefix)) >= 0
+                && or_attr(&bm, db, id) < 0)
+                goto fail;
+            if ((id = hostdb_host_id(db, t->prefix)) >= 0
+                && add_run(&rl, id, id + 1) < 0)
+                goto fail;
+            continue;
+        }
+
+        /* attributes are sorted, so the ones with the prefix are together */
+        plen = strlen(t->prefix);
+        for (j = hostdb_attr_lower_bound(db, t->prefix);
+             (name = hostdb_attr_name(db, j)) != NULL
+             && strncmp(name, t->prefix, plen) == 0; j++)
+            if (term_matches(t, name + plen) && or_attr(&bm, db, j) < 0)
+                goto fail;
+        for (j = 0; j < t->nranges; j++)
+        {
+            errno = 0;
+            if (hostdb_range_ids(db, t->prefix, t->ranges[j].lo,
+                                 t->ranges[j].hi, t->ranges[j].width,
+                                 add_run, &rl) < 0)
+            {
+                if (errno != ENOMEM)
+                    errno = EINVAL;
+                goto fail;
+            }
+        }
+    }
+    result = or_runs(bm, &rl);
+    bitmap_free(bm);
+    free(rl.runs);
+    return result;
+
+fail:
+    bitmap_free(bm);
+    free(rl.runs);
+    return NULL;
+}
+
+/* how many hosts leaf 'n' names, or -1 */
+static int64_t
+leaf_count(struct eval *ev, const struct node *n)
+{
+    int64_t count;
+
+    if (ev->counts[n->leaf] >= 0)
+        return ev->counts[n->leaf];
+    if (ev->db != NULL)
+    {
+        if ((ev->leaves[n->leaf] = load_leaf(ev->db, n)) == NULL)
+            return -1;
+        count = bitmap_count(ev->leaves[n->leaf]);
+    }
+    else
+    {
+        if ((ev->sets[n->leaf] = hostset_create(n->text)) == NULL)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        count = hostset_count(ev->sets[n->leaf]);
+    }
+    if (count > ev->total)
+        count = ev->total;
+    return ev->counts[n->leaf] = count;
+}
+
+/* a guess at how many hosts 'n' selects, or -1 */
+static int64_t
+estimate(struct eval *ev, const struct node *n)
+{
+    int64_t est = 0, kid;
+    uint32_t i;
+
+    switch (n->type)
+    {
+    case NODE_NONE:
+        return 0;
+    case NODE_ALL:
+        return ev->total;
+    case NODE_NAMES:
+        return leaf_count(ev, n);
+    case NODE_NOT:
+        if ((est = estimate(ev, n->kids[0])) < 0)
+            return -1;
+        return ev->total - est;
+    case NODE_AND:
+    case NODE_OR:
+        est = (n->type == NODE_AND) ? ev->total : 0;
+        for (i = 0; i < n->nkids; i++)
+        {
+            if ((kid = estimate(ev, n->kids[i])) < 0)
+                return -1;
+            if (n->type == NODE_AND && kid < est)
+                est = kid;
+            else if (n->type == NODE_OR)
+                est += kid;
+        }
+        return est < ev->total ? est : ev->total;
+    }
+    return 0;
+}
+
+static struct bitmap *select_hosts(struct eval *ev, const struct node *n,
+                                   const struct bitmap *cand);
+
+struct within {
+    struct eval *ev;
+    hostset_t set;
+    struct bitmap *out;
+};
+
+static int
+add_within(void *arg, uint32_t first, uint32_t last)
+{
+    struct within *w = arg;
+
+    for (; first < last; first++)
+        if (hostset_within(w->set, w->ev->names[first])
+            && bitmap_append_range(w->out, first, first + 1) < 0)
+            return -1;
+    return 0;
+}
+
+static struct bitmap *
+select_names(struct eval *ev, const struct node *n,
+             const struct bitmap *cand)
+{
+    struct within w = { ev, NULL, NULL };
+    struct bitmap *result = NULL;
+
+    if (leaf_count(ev, n) < 0)
+        return NULL;
+    if (ev->db != NULL)
+    {
+        if ((result = bitmap_and(ev->leaves[n->leaf], cand)) == NULL)
+            errno = ENOMEM;
+        return result;
+    }
+    if ((w.out = bitmap_new()) == NULL)
+        return NULL;
+    w.set = ev->sets[n->leaf];
+    if (ev->counts[n->leaf] > 0 && bitmap_each_run(cand, add_within, &w) < 0)
+    {
+        bitmap_free(w.out);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return w.out;
+}
+
+/* Put the children of 'n' in order of their estimates, smallest first
+ * (or largest first, with 'reverse'). Returns a new array, or NULL. */
+static uint32_t *
+order_kids(struct eval *ev, const struct node *n, int reverse)
+{
+    uint32_t *order = NULL;
+    int64_t *est = NULL;
+    uint32_t i, j, kid;
+
+    order = malloc(n->nkids * sizeof(*order));
+    est = malloc(n->nkids * sizeof(*est));
+    if (order == NULL || est == NULL)
+    {
+        errno = ENOMEM;
+        goto fail;
+    }
+    for (i = 0; i < n->nkids; i++)
+    {
+        if ((est[i] = estimate(ev, n->kids[i])) < 0)
+            goto fail;
+        if (reverse)
+            est[i] = -est[i];
+        for (j = i, kid = i; j > 0 && est[order[j - 1]] > est[kid]; j--)
+            order[j] = order[j - 1];
+        order[j] = kid;
+    }
+    free(est);
+    return order;
+
+fail:
+    free(order);
+    free(est);
+    return NULL;
+}
+
+/* each operand tested against what the ones before it left */
+static struct bitmap *
+select_and(struct eval *ev, const struct node *n, const struct bitmap *cand)
+{
+    struct bitmap *cur = NULL;
+    struct bitmap *next = NULL;
+    uint32_t *order = NULL;
+    uint32_t i;
+
+    if ((order = order_kids(ev, n, 0)) == NULL)
+        return NULL;
+    if ((cur = bitmap_copy(cand)) == NULL)
+        errno = ENOMEM;
+    for (i = 0; cur != NULL && i < n->nkids && bitmap_count(cur) > 0; i++)
+    {
+        next = select_hosts(ev, n->kids[order[i]], cur);
+        bitmap_free(cur);
+        cur = next;
+    }
+    free(order);
+    return cur;
+}
+
+/* each operand tested against what the ones before it didn't select */
+static struct bitmap *
+select_or(struct eval *ev, const struct node *n, const struct bitmap *cand)
+{
+    struct bitmap *out = NULL;
+    struct bitmap *rest = NULL;
+    struct bitmap *got = NULL;
+    struct bitmap *tmp = NULL;
+    uint32_t *order = NULL;
+    uint32_t i;
+
+    if ((order = order_kids(ev, n, 1)) == NULL)
+        return NULL;
+    if ((out = bitmap_new()) == NULL || (rest = bitmap_copy(cand)) == NULL)
+        goto nomem;
+    for (i = 0; i < n->nkids && bitmap_count(rest) > 0; i++)
+    {
+        if ((got = select_hosts(ev, n->kids[order[i]], rest)) == NULL)
+            goto fail;
+        if ((tmp = bitmap_or(out, got)) == NULL)
+            goto nomem;
+        bitmap_free(out);
+        out = tmp;
+        if ((tmp = bitmap_andnot(rest, got)) == NULL)
+            goto nomem;
+        bitmap_free(rest);
+        rest = tmp;
+        bitmap_free(got);
+        got = NULL;
+    }
+    bitmap_free(rest);
+    free(order);
+    return out;
+
+nomem:
+    errno = ENOMEM;
+fail:
+    bitmap_free(got);
+    bitmap_free(rest);
+    bitmap_free(out);
+    free(order);
+    return NULL;
+}
+
+/* the hosts in 'cand' which 'n' selects, or NULL with errno set */
+static struct bitmap *
+select_hosts(struct eval *ev, const struct node *n, const struct bitmap *cand)
+{
+    struct bitmap *kid = NULL;
+    struct bitmap *result = NULL;
+
+    switch (n->type)
+    {
+    case NODE_NONE:
+        result = bitmap_new();
+        break;
+    case NODE_ALL:
+        result = bitmap_copy(cand);
+        break;
+    case NODE_NAMES:
+        return select_names(ev, n, cand);
+    case NODE_NOT:
+        if ((kid = select_hosts(ev, n->kids[0], cand)) == NULL)
+            return NULL;
+        result = bitmap_andnot(cand, kid);
+        bitmap_free(kid);
+        break;
+    case NODE_AND:
+        return select_and(ev, n, cand);
+    case NODE_OR:
+        return select_or(ev, n, cand);
+    }
+    if (result == NULL)
+        errno = ENOMEM;
+    return result;
+}
+
+/* set up 'ev' for 'e'; the caller fills in the rest */
+static int
+eval_init(struct eval *ev, const struct hostexpr *e)
+{
+    uint32_t i;
+
+    memset(ev, 0, sizeof(*ev));
+    ev->e = e;
+    ev->leaves = calloc(e->nleaves + 1, sizeof(*ev->leaves));
+    ev->sets = calloc(e->nleaves + 1, sizeof(*ev->sets));
+    ev->counts = malloc((e->nleaves + 1) * sizeof(*ev->counts));
+    if (ev->leaves == NULL || ev->sets == NULL || ev->counts == NULL)
+    {
+        free(ev->leaves);
+        free(ev->sets);
+        free(ev->counts);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = 0; i < e->nleaves; i++)
+        ev->counts[i] = -1;
+    return 0;
+}
+
+static void
+eval_done(struct eval *ev)
+{
+    uint32_t i;
+
+    for (i = 0; i < ev->e->nleaves; i++)
+    {
+        bitmap_free(ev->leaves[i]);
+        if (ev->sets[i] != NULL)
+            hostset_destroy(ev->sets[i]);
+    }
+    free(ev->leaves);
+    free(ev->sets);
+    free(ev->counts);
+}
+
+struct bitmap *
+hostexpr_select_db(const struct hostexpr *e, const struct hostdb *db)
+{
+    struct bitmap *all = NULL;
+    struct bitmap *result = NULL;
+    struct eval ev;
+
+    if (eval_init(&ev, e) < 0)
+        return NULL;
+    ev.db = db;
+    ev.total = hostdb_nhosts(db);
+    if ((all = hostdb_all_bitmap(db)) != NULL)
+        result = select_hosts(&ev, e->root, all);
+    bitmap_free(all);
+    eval_done(&ev);
+    return result;
+}
+
+struct push_names {
+    char **names;
+    hostlist_t hl;
+};
+
+static int
+push_names(void *arg, uint32_t first, uint32_t last)
+{
+    struct push_names *pn = arg;
+
+    for (; first < last; first++)
+        if (hostlist_push_host(pn->hl, pn->names[first]) <= 0)
+            return -1;
+    return 0;
+}
+
+hostlist_t
+hostexpr_select_hostlist(const struct hostexpr *e, hostlist_t hl)
+{
+    struct push_names pn = { NULL, NULL };
+    hostlist_iterator_t it = NULL;
+    struct bitmap *all = NULL;
+    struct bitmap *bm = NULL;
+    struct eval ev;
+    char *name = NULL;
+    uint32_t i, n = 0;
+
+    if (eval_init(&ev, e) < 0)
+        return NULL;
+    if ((pn.names = malloc((hostlist_count(hl) + 1) * sizeof(char *)))
+        == NULL || (it = hostlist_iterator_create(hl)) == NULL)
+        goto out;
+    while (n < (uint32_t)hostlist_count(hl) && (name = hostlist_next(it)))
+        pn.names[n++] = name;
+    hostlist_iterator_destroy(it);
+
+    ev.names = pn.names;
+    ev.total = n;
+    if ((all = bitmap_new()) == NULL || bitmap_append_range(all, 0, n) < 0
+        || (bm = select_hosts(&ev, e->root, all)) == NULL)
+        goto out;
+    if ((pn.hl = hostlist_create(NULL)) != NULL
+        && bitmap_each_run(bm, push_names, &pn) < 0)
+    {
+        hostlist_destroy(pn.hl);
+        pn.hl = NULL;
+    }
+
+out:
+    bitmap_free(all);
+    bitmap_free(bm);
+    for (i = 0; i < n; i++)
+        free(pn.names[i]);
+    free(pn.names);
+    eval_done(&ev);
+    return pn.hl;
+}
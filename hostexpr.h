@@ -0,0 +1,78 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* Host-selection expressions, like "gpu & !down & rack[10-20]", compiled
+ * once into a plan which can then pick hosts out of a host database (by
+ * way of its attribute index) or out of a plain hostlist. The grammar,
+ * loosest-binding first:
+ *
+ *     expr    := and ('|' and)*
+ *     and     := not ('&' not)*
+ *     not     := '!' not | '(' expr ')' | '*' | names
+ *     names   := a hostlist, like "node[1-10,20],login1"
+ *
+ * A name selects the hosts with the attribute of that name, along with the
+ * host of that name itself; ranges of names select all of them. '*' is
+ * every host. Against a plain hostlist, names are only hostnames.
+ *
+ * Compiling also simplifies: constants are folded (x & !x is nothing, !!x
+ * is x), repeated operands dropped, names ORed together merged into one set
+ * of ranges, and the negated operands of an AND gathered up to be taken
+ * away together. When it's evaluated, each AND starts from its operand
+ * likely to match the fewest hosts, and each operand after that is only
+ * tested against the hosts still in the running; it stops as soon as none
+ * are left.
+ *
+ * Compiled plans are cached by the text they were compiled from, so giving
+ * the same expression again costs a lookup.
+ */
+
+#ifndef _PDSHPY_HOSTEXPR_H
+#define _PDSHPY_HOSTEXPR_H
+
+#include <stddef.h>
+
+#include "src/common/hostlist.h"
+
+#include "bitmap.h"
+#include "hostdb.h"
+
+/* how many compiled plans are kept */
+#define HOSTEXPR_CACHE_SIZE 64
+
+struct hostexpr;
+
+/* Compile 'text', or find it in the cache. Returns NULL with errno set to
+ * EINVAL, and what's wrong with it in 'err', if it doesn't parse; or to
+ * ENOMEM. */
+struct hostexpr *hostexpr_compile(const char *text, char *err, size_t n);
+
+void hostexpr_release(struct hostexpr *e);
+
+/* the simplified expression, as text that compiles to the same thing */
+const char *hostexpr_text(const struct hostexpr *e);
+
+/* A new bitmap of the IDs of the hosts in 'db' which 'e' selects, or NULL
+ * with errno set (to EINVAL if the database is damaged). */
+struct bitmap *hostexpr_select_db(const struct hostexpr *e,
+                                  const struct hostdb *db);
+
+/* a new hostlist of the hosts in 'hl' which 'e' selects, in the same order,
+ * or NULL if there's no memory */
+hostlist_t hostexpr_select_hostlist(const struct hostexpr *e, hostlist_t hl);
+
+#endif /* !_PDSHPY_HOSTEXPR_H */
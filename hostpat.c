@@ -0,0 +1,1726 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "hostpat.h"
+#include "rangeset.h"
+
+/* what saved DFAs are kept under in the cache directory */
+#define CACHE_MODULE "hostpat"
+
+/* how high {m,n} can count */
+#define MAX_REPEAT 1000
+
+/* how many instructions the NFA can have */
+#define MAX_PROGRAM (1 << 20)
+
+/* how deeply groups can nest */
+#define MAX_DEPTH 256
+
+/* a transition which hasn't been made yet, or no state at all */
+#define NO_STATE UINT32_MAX
+
+/* add_state() has run out of room */
+#define FULL (UINT32_MAX - 1)
+
+/* The NFA is a program in the style of Thompson's construction: a thread
+ * at an instruction either takes a byte, or splits, jumps or checks where
+ * it is without taking one. */
+enum op {
+    OP_BYTE,                    /* a byte in sets[set], then on to x */
+    OP_SPLIT,                   /* on to both x and y */
+    OP_JMP,                     /* on to x */
+    OP_BEGIN,                   /* on to x, at the start of the name */
+    OP_END,                     /* on to x, at the end of the name */
+    OP_MATCH,
+};
+
+struct inst {
+    uint32_t op;
+    uint32_t x;
+    uint32_t y;
+    uint32_t set;
+};
+
+struct byteset {
+    uint8_t bits[32];
+};
+
+/* A DFA state: the instructions which threads are waiting at, sorted; all
+ * of them take a byte, or are a match, or wait for the end of the name. */
+struct dstate {
+    uint32_t off;               /* in pool */
+    uint32_t n;
+    uint32_t accepts;           /* whether a name ending here matches */
+};
+
+struct hostpat {
+    int refs;
+    char *source;               /* what it was compiled from */
+    int persist;                /* keep the DFA in the cache directory */
+    uint32_t npatterns;
+
+    struct rangeset *names;     /* the hostlists, or NULL */
+
+    struct inst *prog;
+    uint32_t nprog;
+    uint32_t cap_prog;
+    uint32_t start;
+    struct byteset *sets;
+    uint32_t nsets;
+    uint32_t cap_sets;
+    uint8_t classes[256];       /* bytes no set tells apart share a class */
+    uint8_t reps[256];          /* a byte of each class */
+    uint32_t nclasses;
+    uint64_t hash;              /* of all that, to check saved DFAs by */
+
+    /* the DFA, which matching adds to */
+    pthread_mutex_t lock;
+    struct dstate *states;      /* the first is where names start */
+    uint32_t nstates;
+    uint32_t cap_states;
+    uint32_t *pool;
+    uint32_t npool;
+    uint32_t cap_pool;
+    uint32_t *next;             /* by state, then class */
+    uint32_t *table;            /* states by their instructions: index + 1 */
+    uint32_t table_size;
+    uint32_t saved;             /* states when last saved or loaded */
+    int flushed;                /* since then */
+
+    /* scratch, for making states */
+    uint32_t *marks;
+    uint32_t mark;
+    uint32_t *stack;
+    uint32_t *work;
+    uint32_t *work2;
+};
+
+/* ----[ parsing ]---- */
+
+enum re_type {
+    RE_EMPTY,
+    RE_BYTE,
+    RE_BEGIN,
+    RE_END,
+    RE_CAT,
+    RE_ALT,
+    RE_REPEAT,
+};
+
+struct re {
+    enum re_type type;
+    uint32_t set;               /* RE_BYTE */
+    struct re *a;               /* RE_CAT, RE_ALT, RE_REPEAT */
+    struct re *b;               /* RE_CAT, RE_ALT */
+    int min;                    /* RE_REPEAT */
+    int max;                    /* RE_REPEAT; -1 for no limit */
+    struct re *made;            /* the one made before, for freeing */
+};
+
+struct compiler {
+    struct hostpat *p;
+    const char *line;           /* the pattern, as given */
+    size_t len;
+    const char *s;              /* what's being parsed, and where */
+    const char *at;
+    const char *end;
+    unsigned lineno;
+    int depth;
+    struct re *made;
+    uint32_t any;               /* sets of every byte, and all but '\n' */
+    uint32_t dot;
+    char *err;
+    size_t n;
+    int failed;                 /* errno to fail with, once it has */
+};
+
+static void pattern_error(struct compiler *c, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void
+pattern_error(struct compiler *c, const char *fmt, ...)
+{
+    va_list ap;
+    int len = 0;
+
+    if (c->failed)
+        return;
+    c->failed = EINVAL;
+    if (c->n == 0)
+        return;
+    len = snprintf(c->err, c->n, "line %u ('%.*s'): ", c->lineno,
+                   (int)c->len, c->line);
+    if (len < 0 || (size_t)len >= c->n)
+        return;
+    va_start(ap, fmt);
+    vsnprintf(c->err + len, c->n - len, fmt, ap);
+    va_end(ap);
+}
+
+static void
+no_memory(struct compiler *c)
+{
+    if (c->failed)
+        return;
+    c->failed = ENOMEM;
+    if (c->n > 0)
+        snprintf(c->err, c->n, "out of memory");
+}
+
+static struct re *
+new_re(struct compiler *c, enum re_type type, struct re *a, struct re *b)
+{
+    struct re *re = NULL;
+
+    if (c->failed)
+        return NULL;
+    if ((re = calloc(1, sizeof(*re))) == NULL)
+    {
+        no_memory(c);
+        return NULL;
+    }
+    re->type = type;
+    re->a = a;
+    re->b = b;
+    re->made = c->made;
+    c->made = re;
+    return re;
+}
+
+/* a new set, empty or full, or NO_STATE */
+static uint32_t
+new_set(struct compiler *c, int full)
+{
+    struct hostpat *p = c->p;
+    struct byteset *sets = NULL;
+    uint32_t cap;
+
+    if (c->failed)
+        return NO_STATE;
+    if (p->nsets == p->cap_sets)
+    {
+        cap = p->cap_sets ? p->cap_sets * 2 : 16;
+        if ((sets = realloc(p->sets, cap * sizeof(*sets))) == NULL)
+        {
+            no_memory(c);
+            return NO_STATE;
+        }
+        p->sets = sets;
+        p->cap_sets = cap;
+    }
+    memset(&p->sets[p->nsets], full ? 0xff : 0, sizeof(*p->sets));
+    return p->nsets++;
+}
+
+static void
+set_add(struct byteset *set, unsigned lo, unsigned hi)
+{
+    for (; lo <= hi; lo++)
+        set->bits[lo / 8] |= 1 << (lo % 8);
+}
+
+static int
+set_has(const struct byteset *set, unsigned byte)
+{
+    return (set->bits[byte / 8] >> (byte % 8)) & 1;
+}
+
+static void
+set_invert(struct byteset *set)
+{
+    int i;
+
+    for (i = 0; i < 32; i++)
+        set->bits[i] = ~set->bits[i];
+}
+
+static struct re *
+byte_re(struct compiler *c, uint32_t set)
+{
+    struct re *re = NULL;
+
+    if (set == NO_STATE || (re = new_re(c, RE_BYTE, NULL, NULL)) == NULL)
+        return NULL;
+    re->set = set;
+    return re;
+}
+
+static struct re *
+literal(struct compiler *c, unsigned byte)
+{
+    uint32_t set = new_set(c, 0);
+
+    if (set != NO_STATE)
+        set_add(&c->p->sets[set], byte, byte);
+    return byte_re(c, set);
+}
+
+static struct re *
+repeat(struct compiler *c, struct re *a, int min, int max)
+{
+    struct re *re = NULL;
+
+    if (a == NULL || (re = new_re(c, RE_REPEAT, a, NULL)) == NULL)
+        return NULL;
+    re->min = min;
+    re->max = max;
+    return re;
+}
+
+/* 'a' then 'b', where either may be NULL for nothing */
+static struct re *
+concat(struct compiler *c, struct re *a, struct re *b)
+{
+    if (a == NULL)
+        return b;
+    if (b == NULL)
+        return a;
+    return new_re(c, RE_CAT, a, b);
+}
+
+/* Add \d, \s or \w (or their opposites, in capitals) to 'set'. Returns 0
+ * if 'esc' isn't one of them. */
+static int
+add_category(struct byteset *set, char esc)
+{
+    struct byteset cat;
+
+    memset(&cat, 0, sizeof(cat));
+    switch (tolower((unsigned char)esc))
+    {
+    case 'd':
+        set_add(&cat, '0', '9');
+        break;
+    case 's':
+        set_add(&cat, '\t', '\r');
+        set_add(&cat, ' ', ' ');
+        break;
+    case 'w':
+        set_add(&cat, '0', '9');
+        set_add(&cat, 'A', 'Z');
+        set_add(&cat, 'a', 'z');
+        set_add(&cat, '_', '_');
+        break;
+    default:
+        return 0;
+    }
+    if (isupper((unsigned char)esc))
+        set_invert(&cat);
+    for (esc = 0; esc < 32; esc++)
+        set->bits[(int)esc] |= cat.bits[(int)esc];
+    return 1;
+}
+
+static int
+hex_value(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+/* The byte escaped by the '\' before c->at, which is moved past it; or -1
+ * (with an error) if it isn't one. */
+static int
+escaped_byte(struct compiler *c, int in_set)
+{
+    static const char controls[] = "a\af\fn\nr\rt\tv\v";
+    const char *ctl = NULL;
+    char ch;
+
+    if (c->at == c->end)
+    {
+        pattern_error(c, "bad escape (end of pattern)");
+        return -1;
+    }
+    ch = *c->at++;
+    if (ch == 'b' && in_set)
+        return '\b';
+    if (ch == 'x')
+    {
+        if (c->end - c->at < 2 || hex_value(c->at[0]) < 0
+            || hex_value(c->at[1]) < 0)
+        {
+            pattern_error(c, "bad escape \\x");
+            return -1;
+        }
+        c->at += 2;
+        return hex_value(c->at[-2]) * 16 + hex_value(c->at[-1]);
+    }
+    if (isdigit((unsigned char)ch))
+    {
+        pattern_error(c, "group references and octal escapes aren't "
+                      "supported");
+        return -1;
+    }
+    if (!isalpha((unsigned char)ch))
+        return (unsigned char)ch;
+    for (ctl = controls; *ctl != '\0'; ctl += 2)
+        if (*ctl == ch)
+            return (unsigned char)ctl[1];
+    if (ch == 'b' || ch == 'B')
+        pattern_error(c, "\\b and \\B aren't supported");
+    else
+        pattern_error(c, "bad escape \\%c", ch);
+    return -1;
+}
+
+/* [...] in a regular expression, from just after the '[' */
+static struct re *
+parse_set(struct compiler *c)
+{
+    uint32_t set = new_set(c, 0);
+    struct byteset *bs = NULL;
+    const char *first = NULL;
+    int negate = 0, lo, hi;
+
+    if (set == NO_STATE)
+        return NULL;
+    if (c->at < c->end && *c->at == '^')
+    {
+        negate = 1;
+        c->at++;
+    }
+    first = c->at;
+    for (;;)
+    {
+        bs = &c->p->sets[set];
+        if (c->at == c->end)
+        {
+            pattern_error(c, "unterminated character set");
+            return NULL;
+        }
+        if (*c->at == ']' && c->at != first)
+        {
+            c->at++;
+            break;
+        }
+        lo = (unsigned char)*c->at++;
+        if (lo == '\\')
+        {
+            if (c->at < c->end && add_category(bs, *c->at))
+            {
+                c->at++;
+                lo = -1;
+            }
+            else if ((lo = escaped_byte(c, 1)) < 0)
+                return NULL;
+        }
+        if (c->end - c->at >= 2 && c->at[0] == '-' && c->at[1] != ']')
+        {
+            c->at++;
+            hi = (unsigned char)*c->at++;
+            if (hi == '\\')
+            {
+                if (c->at < c->end && strchr("dDsSwW", *c->at) != NULL)
+                    hi = -1;
+                else if ((hi = escaped_byte(c, 1)) < 0)
+                    return NULL;
+            }
+            if (lo < 0 || hi < 0 || hi < lo)
+            {
+                pattern_error(c, "bad character range");
+                return NULL;
+            }
+            set_add(bs, lo, hi);
+        }
+        else if (lo >= 0)
+            set_add(bs, lo, lo);
+    }
+    if (negate)
+        set_invert(&c->p->sets[set]);
+    return byte_re(c, set);
+}
+
+/* Read a {m,n} repeat at c->at, moving past it; returns 0 (leaving c->at
+ * alone) if there isn't one there, so the '{' is just a '{'. */
+static int
+parse_braces(struct compiler *c, int *min, int *max)
+{
+    const char *p = c->at + 1;
+    long lo = -1, hi = -1;
+
+    if (p < c->end && *p == '}')
+        return 0;
+    if (p < c->end && isdigit((unsigned char)*p))
+        for (lo = 0; p < c->end && isdigit((unsigned char)*p); p++)
+            lo = lo > MAX_REPEAT ? lo : lo * 10 + (*p - '0');
+    if (p < c->end && *p == ',')
+    {
+        p++;
+        if (p < c->end && isdigit((unsigned char)*p))
+            for (hi = 0; p < c->end && isdigit((unsigned char)*p); p++)
+                hi = hi > MAX_REPEAT ? hi : hi * 10 + (*p - '0');
+    }
+    else
+        hi = lo;
+    if (p == c->end || *p != '}')
+        return 0;
+    c->at = p + 1;
+    *min = lo < 0 ? 0 : lo;
+    *max = hi < 0 ? -1 : hi;
+    if (*min > MAX_REPEAT || *max > MAX_REPEAT)
+        pattern_error(c, "repeats can't count past %d", MAX_REPEAT);
+    else if (*max >= 0 && *max < *min)
+        pattern_error(c, "min repeat greater than max repeat");
+    return 1;
+}
+
+/* whether there's a repeat at c->at */
+static int
+at_repeat(struct compiler *c)
+{
+    const char *at = c->at;
+    int min, max, failed = c->failed, found;
+
+    if (at == c->end)
+        return 0;
+    if (strchr("*+?", *at) != NULL)
+        return 1;
+    if (*at != '{')
+        return 0;
+    /* just looking */
+    c->failed = EINVAL;
+    found = parse_braces(c, &min, &max);
+    c->failed = failed;
+    c->at = at;
+    return found;
+}
+
+static struct re *parse_alt(struct compiler *c);
+
+static struct re *
+parse_atom(struct compiler *c)
+{
+    struct re *re = NULL;
+    uint32_t set;
+    int byte;
+    char ch;
+
+    if (at_repeat(c))
+    {
+        pattern_error(c, "nothing to repeat");
+        return NULL;
+    }
+    ch = *c->at++;
+    switch (ch)
+    {
+    case '(':
+        if (c->at < c->end && *c->at == '?')
+        {
+            if (c->end - c->at >= 2 && c->at[1] == ':')
+                c->at += 2;
+            else if (c->end - c->at >= 3 && c->at[1] == 'P'
+                     && c->at[2] == '<')
+            {
+                for (c->at += 3; c->at < c->end && *c->at != '>'; c->at++)
+                    if (!isalnum((unsigned char)*c->at) && *c->at != '_')
+                        break;
+                if (c->at == c->end || *c->at != '>')
+                {
+                    pattern_error(c, "bad group name");
+                    return NULL;
+                }
+                c->at++;
+            }
+            else
+            {
+                pattern_error(c, "only (?:...) and (?P<name>...) groups "
+                              "are supported");
+                return NULL;
+            }
+        }
+        if (++c->depth > MAX_DEPTH)
+        {
+            pattern_error(c, "groups nested too deeply");
+            return NULL;
+        }
+        re = parse_alt(c);
+        c->depth--;
+        if (c->failed)
+            return NULL;
+        if (c->at == c->end || *c->at != ')')
+        {
+            pattern_error(c, "missing ), unterminated subpattern");
+            return NULL;
+        }
+        c->at++;
+        /* a group can be repeated, even when it's empty */
+        return re != NULL ? re : new_re(c, RE_EMPTY, NULL, NULL);
+    case '[':
+        return parse_set(c);
+    case '.':
+        return byte_re(c, c->dot);
+    case '^':
+        return new_re(c, RE_BEGIN, NULL, NULL);
+    case '$':
+        return new_re(c, RE_END, NULL, NULL);
+    case '\\':
+        if (c->at < c->end && (*c->at == 'A' || *c->at == 'Z'))
+            return new_re(c, *c->at++ == 'A' ? RE_BEGIN : RE_END, NULL,
+                          NULL);
+        if (c->at < c->end && strchr("dDsSwW", *c->at) != NULL)
+        {
+            if ((set = new_set(c, 0)) == NO_STATE)
+                return NULL;
+            add_category(&c->p->sets[set], *c->at++);
+            return byte_re(c, set);
+        }
+        if ((byte = escaped_byte(c, 0)) < 0)
+            return NULL;
+        return literal(c, byte);
+    default:
+        return literal(c, (unsigned char)ch);
+    }
+}
+
+static struct re *
+parse_repeat(struct compiler *c)
+{
+    struct re *re = parse_atom(c);
+    int min, max;
+
+    if (re == NULL || !at_repeat(c))
+        return re;
+    if (re->type == RE_BEGIN || re->type == RE_END)
+    {
+        pattern_error(c, "nothing to repeat");
+        return NULL;
+    }
+    switch (*c->at)
+    {
+    case '*':
+        min = 0;
+        max = -1;
+        c->at++;
+        break;
+    case '+':
+        min = 1;
+        max = -1;
+        c->at++;
+        break;
+    case '?':
+        min = 0;
+        max = 1;
+        c->at++;
+        break;
+    default:
+        parse_braces(c, &min, &max);
+        if (c->failed)
+            return NULL;
+        break;
+    }
+    /* lazy or greedy doesn't matter to whether it matches */
+    if (c->at < c->end && *c->at == '?')
+        c->at++;
+    else if (c->at < c->end && *c->at == '+')
+    {
+        pattern_error(c, "possessive repeats aren't supported");
+        return NULL;
+    }
+    if (at_repeat(c))
+    {
+        pattern_error(c, "multiple repeat");
+        return NULL;
+    }
+    return repeat(c, re, min, max);
+}
+
+/* a run of atoms, or NULL (without an error) for nothing at all */
+static struct re *
+parse_cat(struct compiler *c)
+{
+    struct re *re = NULL;
+    struct re *atom = NULL;
+
+    while (!c->failed && c->at < c->end && *c->at != '|' && *c->at != ')')
+    {
+        if ((atom = parse_repeat(c)) != NULL)
+            re = concat(c, re, atom);
+    }
+    return c->failed ? NULL : re;
+}
+
+static struct re *
+parse_alt(struct compiler *c)
+{
+    struct re *re = parse_cat(c);
+
+    while (!c->failed && c->at < c->end && *c->at == '|')
+    {
+        c->at++;
+        re = new_re(c, RE_ALT, re != NULL ? re : new_re(c, RE_EMPTY, NULL,
+                                                         NULL),
+                    NULL);
+        if (re != NULL && (re->b = parse_cat(c)) == NULL)
+            re->b = new_re(c, RE_EMPTY, NULL, NULL);
+    }
+    return c->failed ? NULL : re;
+}
+
+static struct re *
+parse_regex(struct compiler *c)
+{
+    struct re *re = parse_alt(c);
+
+    if (!c->failed && c->at < c->end)
+        pattern_error(c, "unbalanced parenthesis");
+    if (c->failed)
+        return NULL;
+    return re != NULL ? re : new_re(c, RE_EMPTY, NULL, NULL);
+}
+
+/* a glob, the way Python's fnmatch.translate() reads them */
+static struct re *
+parse_glob(struct compiler *c)
+{
+    struct re *re = NULL;
+    struct byteset *bs = NULL;
+    const char *close = NULL;
+    uint32_t set;
+    int negate, star = 0;
+
+    while (!c->failed && c->at < c->end)
+    {
+        if (*c->at == '*')
+        {
+            /* one will do for a run of them */
+            if (!star)
+                re = concat(c, re, repeat(c, byte_re(c, c->any), 0, -1));
+            star = 1;
+            c->at++;
+            continue;
+        }
+        star = 0;
+        if (*c->at == '?')
+        {
+            re = concat(c, re, byte_re(c, c->any));
+            c->at++;
+            continue;
+        }
+        if (*c->at == '[')
+        {
+            close = c->at + 1;
+            if (close < c->end && *close == '!')
+                close++;
+            if (close < c->end && *close == ']')
+                close++;
+            while (close < c->end && *close != ']')
+                close++;
+        }
+        /* an unterminated '[' is just a '[' */
+        if (*c->at != '[' || close == c->end)
+        {
+            re = concat(c, re, literal(c, (unsigned char)*c->at++));
+            continue;
+        }
+
+        if ((set = new_set(c, 0)) == NO_STATE)
+            return NULL;
+        bs = &c->p->sets[set];
+        c->at++;
+        if ((negate = (*c->at == '!')))
+            c->at++;
+        while (c->at < close)
+        {
+            /* backwards ranges are dropped */
+            if (close - c->at >= 3 && c->at[1] == '-')
+            {
+                if ((unsigned char)c->at[2] >= (unsigned char)c->at[0])
+                    set_add(bs, (unsigned char)c->at[0],
+                            (unsigned char)c->at[2]);
+                c->at += 3;
+            }
+            else
+            {
+                set_add(bs, (unsigned char)*c->at, (unsigned char)*c->at);
+                c->at++;
+            }
+        }
+        if (negate)
+            set_invert(bs);
+        c->at = close + 1;
+        re = concat(c, re, byte_re(c, set));
+    }
+    if (c->failed)
+        return NULL;
+    return re != NULL ? re : new_re(c, RE_EMPTY, NULL, NULL);
+}
+
+/* ----[ making the NFA ]---- */
+
+/* a new instruction, or NO_STATE */
+static uint32_t
+emit(struct compiler *c, enum op op, uint32_t x, uint32_t y, uint32_t set)
+{
+    struct hostpat *p = c->p;
+    struct inst *prog = NULL;
+    uint32_t cap;
+
+    if (c->failed)
+        return NO_STATE;
+    if (p->nprog == MAX_PROGRAM)
+    {
+        pattern_error(c, "too big: more than %d instructions", MAX_PROGRAM);
+        return NO_STATE;
+    }
+    if (p->nprog == p->cap_prog)
+    {
+        cap = p->cap_prog ? p->cap_prog * 2 : 64;
+        if ((prog = realloc(p->prog, cap * sizeof(*prog))) == NULL)
+        {
+            no_memory(c);
+            return NO_STATE;
+        }
+        p->prog = prog;
+        p->cap_prog = cap;
+    }
+    p->prog[p->nprog].op = op;
+    p->prog[p->nprog].x = x;
+    p->prog[p->nprog].y = y;
+    p->prog[p->nprog].set = set;
+    return p->nprog++;
+}
+
+/* Compile 're' to go on to 'next' once it has matched, returning where it
+ * starts. Building from the end backwards means nothing needs patching up
+ * afterwards, except the jumps back of loops. */
+static uint32_t
+emit_re(struct compiler *c, const struct re *re, uint32_t next)
+{
+    uint32_t loop, body, entry;
+    int i;
+
+    if (c->failed)
+        return NO_STATE;
+    switch (re->type)
+    {
+    case RE_EMPTY:
+        return next;
+    case RE_BYTE:
+        return emit(c, OP_BYTE, next, 0, re->set);
+    case RE_BEGIN:
+        return emit(c, OP_BEGIN, next, 0, 0);
+    case RE_END:
+        return emit(c, OP_END, next, 0, 0);
+    case RE_CAT:
+        return emit_re(c, re->a, emit_re(c, re->b, next));
+    case RE_ALT:
+        entry = emit_re(c, re->a, next);
+        return emit(c, OP_SPLIT, entry, emit_re(c, re->b, next), 0);
+    case RE_REPEAT:
+        if (re->max < 0)
+        {
+            if ((loop = emit(c, OP_SPLIT, 0, next, 0)) == NO_STATE
+                || (body = emit_re(c, re->a, loop)) == NO_STATE)
+                return NO_STATE;
+            c->p->prog[loop].x = body;
+            entry = loop;
+        }
+        else
+        {
+            /* each optional copy can skip the rest */
+            entry = next;
+            for (i = re->min; i < re->max; i++)
+                entry = emit(c, OP_SPLIT, emit_re(c, re->a, entry), next, 0);
+        }
+        for (i = 0; i < re->min; i++)
+            entry = emit_re(c, re->a, entry);
+        return entry;
+    }
+    return NO_STATE;
+}
+
+/* Split bytes into classes, putting two in the same one only if every set
+ * has both or neither. */
+static void
+make_classes(struct hostpat *p)
+{
+    uint8_t split[2][256];
+    uint32_t i, b, n;
+    int in;
+
+    memset(p->classes, 0, sizeof(p->classes));
+    p->nclasses = 1;
+    for (i = 0; i < p->nsets; i++)
+    {
+        memset(split, 0xff, sizeof(split));
+        n = 0;
+        for (b = 0; b < 256; b++)
+        {
+            in = set_has(&p->sets[i], b);
+            if (split[in][p->classes[b]] == 0xff)
+                split[in][p->classes[b]] = n++;
+            p->classes[b] = split[in][p->classes[b]];
+        }
+        p->nclasses = n;
+    }
+    for (b = 256; b-- > 0;)
+        p->reps[p->classes[b]] = b;
+}
+
+static uint64_t
+fnv1a(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *s = data;
+
+    while (len-- > 0)
+    {
+        hash ^= *s++;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* ----[ the DFA ]---- */
+
+static uint32_t
+new_mark(struct hostpat *p)
+{
+    if (++p->mark == 0)
+    {
+        memset(p->marks, 0, p->nprog * sizeof(*p->marks));
+        p->mark = 1;
+    }
+    return p->mark;
+}
+
+/* flags for follow() */
+#define AT_BEGIN 1
+#define AT_END 2
+
+/* Add the instructions a thread at 'pc' can get to without taking a byte
+ * to set[*n], skipping any already marked. */
+static void
+follow(struct hostpat *p, uint32_t pc, int flags, uint32_t *set,
+       uint32_t *n)
+{
+    const struct inst *in = NULL;
+    size_t top = 0;
+
+    p->stack[top++] = pc;
+    while (top > 0)
+    {
+        pc = p->stack[--top];
+        if (p->marks[pc] == p->mark)
+            continue;
+        p->marks[pc] = p->mark;
+        in = &p->prog[pc];
+        switch (in->op)
+        {
+        case OP_SPLIT:
+            p->stack[top++] = in->y;
+            p->stack[top++] = in->x;
+            break;
+        case OP_JMP:
+            p->stack[top++] = in->x;
+            break;
+        case OP_BEGIN:
+            if (flags & AT_BEGIN)
+                p->stack[top++] = in->x;
+            break;
+        case OP_END:
+            if (flags & AT_END)
+                p->stack[top++] = in->x;
+            else
+                set[(*n)++] = pc;
+            break;
+        default:
+            set[(*n)++] = pc;
+            break;
+        }
+    }
+}
+
+/* whether a name ending with threads at the 'n' instructions in 'set'
+ * matches */
+static int
+accepts(struct hostpat *p, const uint32_t *set, uint32_t n, int flags)
+{
+    uint32_t i, j, m;
+
+    for (i = 0; i < n; i++)
+    {
+        if (p->prog[set[i]].op == OP_MATCH)
+            return 1;
+        if (p->prog[set[i]].op != OP_END)
+            continue;
+        m = 0;
+        new_mark(p);
+        follow(p, p->prog[set[i]].x, flags | AT_END, p->work2, &m);
+        for (j = 0; j < m; j++)
+            if (p->prog[p->work2[j]].op == OP_MATCH)
+                return 1;
+    }
+    return 0;
+}
+
+static int
+compare_pcs(const void *x, const void *y)
+{
+    uint32_t a = *(const uint32_t *)x, b = *(const uint32_t *)y;
+
+    return (a > b) - (a < b);
+}
+
+static uint32_t
+hash_set(const uint32_t *set, uint32_t n)
+{
+    return (uint32_t)fnv1a(14695981039346656037ULL, set, n * sizeof(*set));
+}
+
+/* Put state 's' in the table, making it bigger if it's getting full. */
+static int
+table_add(struct hostpat *p, uint32_t s)
+{
+    uint32_t *table = NULL;
+    uint32_t size, i, h;
+
+    if ((p->nstates + 1) * 2 > p->table_size)
+    {
+        size = p->table_size ? p->table_size * 2 : 64;
+        if ((table = calloc(size, sizeof(*table))) == NULL)
+            return -1;
+        free(p->table);
+        p->table = table;
+        p->table_size = size;
+        /* the start state stays out of it, since at the start '^' holds */
+        for (i = 1; i < p->nstates; i++)
+            if (i != s && table_add(p, i) < 0)
+                return -1;
+    }
+    h = hash_set(p->pool + p->states[s].off, p->states[s].n);
+    for (i = h & (p->table_size - 1); p->table[i] != 0;
+         i = (i + 1) & (p->table_size - 1))
+        ;
+    p->table[i] = s + 1;
+    return 0;
+}
+
+/* The state made of the 'n' instructions in 'set' (which it sorts), made
+ * if need be; NO_STATE if there's no memory, or FULL if there are already
+ * HOSTPAT_MAX_STATES. */
+static uint32_t
+add_state(struct hostpat *p, uint32_t *set, uint32_t n, int flags)
+{
+    struct dstate *states = NULL;
+    uint32_t *pool = NULL;
+    uint32_t *next = NULL;
+    uint32_t i, h, s, cap;
+
+    qsort(set, n, sizeof(*set), compare_pcs);
+    if (!(flags & AT_BEGIN) && p->table_size > 0)
+    {
+        h = hash_set(set, n);
+        for (i = h & (p->table_size - 1); p->table[i] != 0;
+             i = (i + 1) & (p->table_size - 1))
+        {
+            s = p->table[i] - 1;
+            if (p->states[s].n == n
+                && memcmp(p->pool + p->states[s].off, set,
+                          n * sizeof(*set)) == 0)
+                return s;
+        }
+    }
+
+    if (p->nstates == HOSTPAT_MAX_STATES)
+        return FULL;
+    if (p->nstates == p->cap_states)
+    {
+        cap = p->cap_states ? p->cap_states * 2 : 16;
+        if ((states = realloc(p->states, cap * sizeof(*states))) == NULL)
+            return NO_STATE;
+        p->states = states;
+        if ((next = realloc(p->next, (size_t)cap * p->nclasses
+                            * sizeof(*next))) == NULL)
+            return NO_STATE;
+        p->next = next;
+        p->cap_states = cap;
+    }
+    if (p->npool + n > p->cap_pool)
+    {
+        for (cap = p->cap_pool ? p->cap_pool : 256; cap < p->npool + n;)
+            cap *= 2;
+        if ((pool = realloc(p->pool, cap * sizeof(*pool))) == NULL)
+            return NO_STATE;
+        p->pool = pool;
+        p->cap_pool = cap;
+    }
+
+    s = p->nstates;
+    p->states[s].off = p->npool;
+    p->states[s].n = n;
+    p->states[s].accepts = accepts(p, set, n, flags);
+    memcpy(p->pool + p->npool, set, n * sizeof(*set));
+    p->npool += n;
+    for (i = 0; i < p->nclasses; i++)
+        p->next[(size_t)s * p->nclasses + i] = NO_STATE;
+    p->nstates++;
+    if (s > 0 && table_add(p, s) < 0)
+    {
+        p->nstates--;
+        p->npool -= n;
+        return NO_STATE;
+    }
+    return s;
+}
+
+/* Throw away every state, and make the start state again. */
+static int
+reset_dfa(struct hostpat *p)
+{
+    uint32_t n = 0;
+
+    p->nstates = 0;
+    p->npool = 0;
+    if (p->table != NULL)
+        memset(p->table, 0, p->table_size * sizeof(*p->table));
+    new_mark(p);
+    follow(p, p->start, AT_BEGIN, p->work, &n);
+    return add_state(p, p->work, n, AT_BEGIN) == 0 ? 0 : -1;
+}
+
+/* where state 's' goes on a byte of class 'cls', made if need be; or
+ * NO_STATE if there's no memory */
+static uint32_t
+step(struct hostpat *p, uint32_t s, uint32_t cls)
+{
+    const struct dstate *st = &p->states[s];
+    const struct inst *in = NULL;
+    uint32_t i, n = 0, t;
+
+    new_mark(p);
+    for (i = 0; i < st->n; i++)
+    {
+        in = &p->prog[p->pool[st->off + i]];
+        if (in->op == OP_BYTE && set_has(&p->sets[in->set], p->reps[cls]))
+            follow(p, in->x, 0, p->work, &n);
+    }
+    if ((t = add_state(p, p->work, n, 0)) == FULL)
+    {
+        /* start again; 's' goes, and with it the need to remember this */
+        if (reset_dfa(p) < 0)
+            return NO_STATE;
+        p->flushed = 1;
+        t = add_state(p, p->work, n, 0);
+        return t == FULL ? NO_STATE : t;
+    }
+    if (t != NO_STATE)
+        p->next[(size_t)s * p->nclasses + cls] = t;
+    return t;
+}
+
+/* whether the globs and regular expressions match 'name', or -1; with
+ * p->lock held */
+static int
+run_dfa(struct hostpat *p, const char *name)
+{
+    const unsigned char *ch = NULL;
+    uint32_t s = 0, t, cls;
+
+    if (p->nprog == 0)
+        return 0;
+    for (ch = (const unsigned char *)name; *ch != '\0'; ch++)
+    {
+        cls = p->classes[*ch];
+        t = p->next[(size_t)s * p->nclasses + cls];
+        if (t == NO_STATE && (t = step(p, s, cls)) == NO_STATE)
+            return -1;
+        s = t;
+        /* no threads left */
+        if (p->states[s].n == 0)
+            return 0;
+    }
+    return p->states[s].accepts;
+}
+
+/* ----[ saving the DFA ]---- */
+
+/* A saved DFA is this, then its states, their instructions, and their
+ * transitions, as they are in memory. */
+struct saved_dfa {
+    uint64_t hash;              /* of the NFA it was made from */
+    uint32_t nclasses;
+    uint32_t nstates;
+    uint32_t npool;
+    uint32_t unused;
+};
+
+/* Save the DFA, if there's anything new in it since it was loaded or last
+ * saved. */
+static void
+save_dfa(struct hostpat *p)
+{
+    struct saved_dfa hdr;
+    size_t len;
+    char *buf = NULL;
+    char *at = NULL;
+
+    pthread_mutex_lock(&p->lock);
+    if (!p->persist || p->nprog == 0
+        || (p->nstates <= p->saved && !p->flushed))
+    {
+        pthread_mutex_unlock(&p->lock);
+        return;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.hash = p->hash;
+    hdr.nclasses = p->nclasses;
+    hdr.nstates = p->nstates;
+    hdr.npool = p->npool;
+    len = sizeof(hdr) + p->nstates * sizeof(*p->states)
+        + p->npool * sizeof(*p->pool)
+        + (size_t)p->nstates * p->nclasses * sizeof(*p->next);
+    if ((at = buf = malloc(len)) != NULL)
+    {
+        memcpy(at, &hdr, sizeof(hdr));
+        at += sizeof(hdr);
+        memcpy(at, p->states, p->nstates * sizeof(*p->states));
+        at += p->nstates * sizeof(*p->states);
+        memcpy(at, p->pool, p->npool * sizeof(*p->pool));
+        at += p->npool * sizeof(*p->pool);
+        memcpy(at, p->next,
+               (size_t)p->nstates * p->nclasses * sizeof(*p->next));
+        p->saved = p->nstates;
+        p->flushed = 0;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    /* it's only a cache */
+    if (buf != NULL)
+        cache_put(CACHE_MODULE, p->source, buf, len);
+    free(buf);
+}
+
+/* Take up a saved DFA for 'p', if there's one which checks out, in place
+ * of the start state it has. */
+static void
+load_dfa(struct hostpat *p)
+{
+    struct saved_dfa hdr;
+    const struct dstate *states = NULL;
+    const uint32_t *pool = NULL;
+    const uint32_t *next = NULL;
+    char *buf = NULL;
+    size_t len = 0, i, ntrans;
+    int ok = 0;
+
+    if ((buf = cache_get(CACHE_MODULE, p->source, &len)) == NULL)
+        return;
+    if (len < sizeof(hdr))
+        goto out;
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.hash != p->hash || hdr.nclasses != p->nclasses
+        || hdr.nstates == 0 || hdr.nstates > HOSTPAT_MAX_STATES
+        || hdr.npool > (uint32_t)HOSTPAT_MAX_STATES * p->nprog)
+        goto out;
+    ntrans = (size_t)hdr.nstates * hdr.nclasses;
+    if (len != sizeof(hdr) + hdr.nstates * sizeof(*states)
+        + hdr.npool * sizeof(*pool) + ntrans * sizeof(*next))
+        goto out;
+    states = (const struct dstate *)(buf + sizeof(hdr));
+    pool = (const uint32_t *)(states + hdr.nstates);
+    next = pool + hdr.npool;
+
+    /* it has to be the same start, and make sense all through */
+    if (states[0].off != 0 || states[0].n != p->states[0].n
+        || memcmp(pool, p->pool, p->states[0].n * sizeof(*pool)) != 0)
+        goto out;
+    for (i = 0; i < hdr.nstates; i++)
+        if (states[i].off > hdr.npool || states[i].n > hdr.npool
+            - states[i].off || states[i].accepts > 1)
+            goto out;
+    for (i = 0; i < hdr.npool; i++)
+        if (pool[i] >= p->nprog)
+            goto out;
+    for (i = 0; i < ntrans; i++)
+        if (next[i] >= hdr.nstates && next[i] != NO_STATE)
+            goto out;
+
+    /* copy it in, making room as add_state() would */
+    p->nstates = 1;
+    p->npool = p->states[0].n;
+    for (i = 1; i < hdr.nstates; i++)
+    {
+        memcpy(p->work, pool + states[i].off, states[i].n * sizeof(*pool));
+        if (add_state(p, p->work, states[i].n, AT_BEGIN) != i)
+            goto out;
+    }
+    memcpy(p->states, states, hdr.nstates * sizeof(*states));
+    memcpy(p->pool, pool, hdr.npool * sizeof(*pool));
+    memcpy(p->next, next, ntrans * sizeof(*next));
+    p->npool = hdr.npool;
+    if (p->table != NULL)
+        memset(p->table, 0, p->table_size * sizeof(*p->table));
+    for (i = 1; i < hdr.nstates; i++)
+        if (table_add(p, i) < 0)
+            goto out;
+    p->saved = hdr.nstates;
+    ok = 1;
+
+out:
+    if (!ok && p->nstates > 1)
+        reset_dfa(p);
+    free(buf);
+}
+
+/* ----[ compiling ]---- */
+
+static void
+free_hostpat(struct hostpat *p)
+{
+    if (p == NULL)
+        return;
+    rangeset_free(p->names);
+    free(p->prog);
+    free(p->sets);
+    free(p->states);
+    free(p->pool);
+    free(p->next);
+    free(p->table);
+    free(p->marks);
+    free(p->stack);
+    free(p->work);
+    free(p->work2);
+    pthread_mutex_destroy(&p->lock);
+    free(p->source);
+    free(p);
+}
+
+/* Add a hostlist pattern to p->names. */
+static void
+add_hostlist(struct compiler *c, const char *s, size_t len)
+{
+    struct rangeset *rs = NULL;
+    struct rangeset *both = NULL;
+    char *copy = NULL;
+
+    if ((copy = strndup(s, len)) == NULL)
+    {
+        no_memory(c);
+        return;
+    }
+    rs = rangeset_parse(copy, 0);
+    free(copy);
+    if (rs == NULL)
+    {
+        if (errno == EINVAL)
+            pattern_error(c, "bad hostlist");
+        else
+            no_memory(c);
+        return;
+    }
+    if (c->p->names == NULL)
+    {
+        c->p->names = rs;
+        return;
+    }
+    both = rangeset_union(c->p->names, rs);
+    rangeset_free(rs);
+    if (both == NULL)
+    {
+        no_memory(c);
+        return;
+    }
+    rangeset_free(c->p->names);
+    c->p->names = both;
+}
+
+/* Add 'pc' to the 'n' at *starts. */
+static void
+add_start(struct compiler *c, uint32_t **starts, uint32_t *n, uint32_t pc)
+{
+    uint32_t *more = NULL;
+
+    if ((*n & (*n - 1)) == 0)
+    {
+        if ((more = realloc(*starts, (*n ? *n * 2 : 1) * sizeof(*more)))
+            == NULL)
+        {
+            no_memory(c);
+            return;
+        }
+        *starts = more;
+    }
+    (*starts)[(*n)++] = pc;
+}
+
+/* Parse each line of 'text', compiling the globs to go on to 'match' and
+ * the regular expressions to 'found' (which matches whatever comes after),
+ * and adding where they start to 'globs' and 'regexes'. */
+static void
+compile_lines(struct compiler *c, const char *text, uint32_t match,
+              uint32_t found, uint32_t **globs, uint32_t *nglobs,
+              uint32_t **regexes, uint32_t *nregexes)
+{
+    const char *line = text, *eol = NULL, *s = NULL, *e = NULL;
+    struct re *re = NULL;
+    uint32_t pc;
+    int is_regex;
+
+    for (c->lineno = 1; !c->failed && *line != '\0'; c->lineno++)
+    {
+        if ((eol = strchr(line, '\n')) == NULL)
+            eol = line + strlen(line);
+        for (s = line; s < eol && isspace((unsigned char)*s); s++)
+            ;
+        for (e = eol; e > s && isspace((unsigned char)e[-1]); e--)
+            ;
+        line = *eol != '\0' ? eol + 1 : eol;
+        if (s == e || *s == '#')
+            continue;
+        c->line = s;
+        c->len = e - s;
+        c->p->npatterns++;
+
+        is_regex = (e - s >= 3 && strncmp(s, "re:", 3) == 0);
+        if (is_regex)
+            s += 3;
+        else if (e - s >= 5 && strncmp(s, "glob:", 5) == 0)
+            s += 5;
+        else if (memchr(s, '*', e - s) == NULL
+                 && memchr(s, '?', e - s) == NULL)
+        {
+            add_hostlist(c, s, e - s);
+            continue;
+        }
+        c->s = c->at = s;
+        c->end = e;
+        c->depth = 0;
+        if ((re = is_regex ? parse_regex(c) : parse_glob(c)) == NULL)
+            break;
+        if ((pc = emit_re(c, re, is_regex ? found : match)) == NO_STATE)
+            break;
+        if (is_regex)
+            add_start(c, regexes, nregexes, pc);
+        else
+            add_start(c, globs, nglobs, pc);
+    }
+}
+
+/* a split between each of the 'n' at 'starts', or NO_STATE */
+static uint32_t
+emit_either(struct compiler *c, const uint32_t *starts, uint32_t n)
+{
+    uint32_t entry;
+
+    if (n == 0)
+        return NO_STATE;
+    for (entry = starts[--n]; n-- > 0;)
+        entry = emit(c, OP_SPLIT, starts[n], entry, 0);
+    return entry;
+}
+
+/* compile 'text' into 'p', returning 0 or -1 */
+static int
+compile(struct compiler *c, const char *text)
+{
+    struct hostpat *p = c->p;
+    uint32_t *globs = NULL;
+    uint32_t *regexes = NULL;
+    uint32_t nglobs = 0, nregexes = 0;
+    uint32_t match, found, any, loop, entries[2];
+    struct re *re = NULL;
+
+    c->any = new_set(c, 1);
+    if ((c->dot = new_set(c, 1)) != NO_STATE)
+        p->sets[c->dot].bits['\n' / 8] &= ~(1 << ('\n' % 8));
+
+    /* regexes go on to anything at all, then the match globs go to */
+    match = emit(c, OP_MATCH, 0, 0, 0);
+    if ((found = emit(c, OP_SPLIT, 0, match, 0)) != NO_STATE
+        && (any = emit(c, OP_BYTE, found, 0, c->any)) != NO_STATE)
+        p->prog[found].x = any;
+
+    compile_lines(c, text, match, found, &globs, &nglobs, &regexes,
+                  &nregexes);
+
+    /* and come after anything at all, unless they're anchored */
+    p->start = NO_STATE;
+    if (!c->failed && nglobs + nregexes > 0)
+    {
+        entries[0] = emit_either(c, globs, nglobs);
+        entries[1] = emit_either(c, regexes, nregexes);
+        if (nregexes > 0 && (loop = emit(c, OP_SPLIT, 0, entries[1], 0))
+            != NO_STATE && (any = emit(c, OP_BYTE, loop, 0, c->any))
+            != NO_STATE)
+        {
+            p->prog[loop].x = any;
+            entries[1] = loop;
+        }
+        p->start = emit_either(c, entries + (nglobs == 0),
+                               1 + (nglobs > 0 && nregexes > 0));
+    }
+    free(globs);
+    free(regexes);
+    while ((re = c->made) != NULL)
+    {
+        c->made = re->made;
+        free(re);
+    }
+    if (c->failed)
+        return -1;
+
+    /* nothing to run the DFA for */
+    if (p->start == NO_STATE)
+    {
+        p->nprog = 0;
+        return 0;
+    }
+
+    make_classes(p);
+    p->hash = fnv1a(14695981039346656037ULL, p->prog,
+                    p->nprog * sizeof(*p->prog));
+    p->hash = fnv1a(p->hash, p->sets, p->nsets * sizeof(*p->sets));
+    p->hash = fnv1a(p->hash, p->classes, sizeof(p->classes));
+    p->hash = fnv1a(p->hash, &p->start, sizeof(p->start));
+    if ((p->marks = calloc(p->nprog, sizeof(*p->marks))) == NULL
+        || (p->stack = malloc((2 * p->nprog + 1) * sizeof(*p->stack)))
+        == NULL || (p->work = malloc(p->nprog * sizeof(*p->work))) == NULL
+        || (p->work2 = malloc(p->nprog * sizeof(*p->work2))) == NULL
+        || reset_dfa(p) < 0)
+    {
+        no_memory(c);
+        return -1;
+    }
+    return 0;
+}
+
+/* ----[ the cache ]---- */
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+    struct hostpat *p;
+    unsigned long used;
+} cache[HOSTPAT_CACHE_SIZE];
+
+static unsigned long cache_clock;
+
+static struct hostpat *
+hostpat_ref(struct hostpat *p)
+{
+    __atomic_add_fetch(&p->refs, 1, __ATOMIC_RELAXED);
+    return p;
+}
+
+void
+hostpat_release(struct hostpat *p)
+{
+    if (p == NULL || __atomic_sub_fetch(&p->refs, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+    free_hostpat(p);
+}
+
+/* the cached set for 'text', or NULL */
+static struct hostpat *
+cache_find(const char *text)
+{
+    struct hostpat *p = NULL;
+    int i;
+
+    pthread_mutex_lock(&cache_lock);
+    for (i = 0; i < HOSTPAT_CACHE_SIZE && p == NULL; i++)
+    {
+        if (cache[i].p != NULL && strcmp(cache[i].p->source, text) == 0)
+        {
+            p = hostpat_ref(cache[i].p);
+            cache[i].used = ++cache_clock;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return p;
+}
+
+/* Put 'p' in the cache, in place of the least recently used set, unless
+ * another thread has just done the same; returns the one that's cached. */
+static struct hostpat *
+cache_add(struct hostpat *p)
+{
+    struct hostpat *evicted = NULL;
+    int i, slot = 0;
+
+    pthread_mutex_lock(&cache_lock);
+    for (i = 0; i < HOSTPAT_CACHE_SIZE; i++)
+    {
+        if (cache[i].p != NULL && strcmp(cache[i].p->source, p->source) == 0)
+        {
+            evicted = p;
+            p = hostpat_ref(cache[i].p);
+            cache[i].used = ++cache_clock;
+            goto out;
+        }
+        if (cache[i].used < cache[slot].used)
+            slot = i;
+    }
+    evicted = cache[slot].p;
+    cache[slot].p = hostpat_ref(p);
+    cache[slot].used = ++cache_clock;
+out:
+    pthread_mutex_unlock(&cache_lock);
+    hostpat_release(evicted);
+    return p;
+}
+
+struct hostpat *
+hostpat_compile(const char *text, int persist, char *err, size_t n)
+{
+    struct compiler c;
+    struct hostpat *p = NULL;
+
+    if ((p = cache_find(text)) != NULL)
+    {
+        if (persist && !p->persist)
+        {
+            pthread_mutex_lock(&p->lock);
+            p->persist = 1;
+            pthread_mutex_unlock(&p->lock);
+        }
+        return p;
+    }
+
+    memset(&c, 0, sizeof(c));
+    c.err = err;
+    c.n = n;
+    if ((c.p = p = calloc(1, sizeof(*p))) == NULL
+        || (p->source = strdup(text)) == NULL)
+    {
+        free(p);
+        no_memory(&c);
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    p->refs = 1;
+    p->persist = persist;
+    if (compile(&c, text) < 0)
+    {
+        free_hostpat(p);
+        errno = c.failed;
+        return NULL;
+    }
+    if (persist && p->nprog > 0)
+        load_dfa(p);
+    return cache_add(p);
+}
+
+const char *
+hostpat_text(const struct hostpat *p)
+{
+    return p->source;
+}
+
+size_t
+hostpat_count(const struct hostpat *p)
+{
+    return p->npatterns;
+}
+
+/* with p->lock held */
+static int
+match_locked(struct hostpat *p, const char *host)
+{
+    if (p->names != NULL && rangeset_contains(p->names, host))
+        return 1;
+    return run_dfa(p, host);
+}
+
+int
+hostpat_match(struct hostpat *p, const char *host)
+{
+    int rc;
+
+    pthread_mutex_lock(&p->lock);
+    rc = match_locked(p, host);
+    pthread_mutex_unlock(&p->lock);
+    return rc;
+}
+
+hostlist_t
+hostpat_select(struct hostpat *p, hostlist_t hl, int invert)
+{
+    hostlist_iterator_t it = NULL;
+    hostlist_t out = NULL;
+    char *name = NULL;
+    int m = 0;
+
+    if ((it = hostlist_iterator_create(hl)) == NULL)
+        return NULL;
+    if ((out = hostlist_create(NULL)) == NULL)
+    {
+        hostlist_iterator_destroy(it);
+        return NULL;
+    }
+    pthread_mutex_lock(&p->lock);
+    while (m >= 0 && (name = hostlist_next(it)) != NULL)
+    {
+        if ((m = match_locked(p, name)) >= 0 && m != invert
+            && hostlist_push_host(out, name) <= 0)
+            m = -1;
+        free(name);
+    }
+    pthread_mutex_unlock(&p->lock);
+    hostlist_iterator_destroy(it);
+    if (m < 0)
+    {
+        hostlist_destroy(out);
+        return NULL;
+    }
+    save_dfa(p);
+    return out;
+}
+
+int
+hostpat_remove(struct hostpat *p, hostlist_t hl)
+{
+    hostlist_iterator_t it = NULL;
+    char *name = NULL;
+    int m = 0, removed = 0;
+
+    if ((it = hostlist_iterator_create(hl)) == NULL)
+        return -1;
+    pthread_mutex_lock(&p->lock);
+    while (m >= 0 && (name = hostlist_next(it)) != NULL)
+    {
+        if ((m = match_locked(p, name)) > 0)
+        {
+            hostlist_remove(it);
+            removed++;
+        }
+        free(name);
+    }
+    pthread_mutex_unlock(&p->lock);
+    hostlist_iterator_destroy(it);
+    if (m < 0)
+        return -1;
+    save_dfa(p);
+    return removed;
+}
@@ -0,0 +1,93 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* Sets of host patterns, like maintenance lists and exclusions, compiled
+ * once so that testing a host against all of them costs about the same as
+ * testing it against one. A pattern set is text with one pattern per line
+ * (blank lines and lines starting with '#' are skipped), each one of:
+ *
+ *     node[1-10],login1    a hostlist: exactly those hosts
+ *     rack1*, n?-ib        a glob, for any pattern with '*' or '?': matches
+ *                          whole names as Python's fnmatchcase() does, with
+ *                          * any run of characters, ? any one, and [seq]
+ *                          and [!seq] any one in (or not in) seq
+ *     glob:node[12]        a glob, for ones with no '*' or '?'
+ *     re:^gpu\d+$          a Python regular expression, which matches if
+ *                          it matches anywhere in the name (as re.search())
+ *
+ * The hostlists are merged into one rangeset (see rangeset.h), which names
+ * are looked up in by binary search. The globs and regular expressions are
+ * all compiled into one NFA, and that is made into a DFA a state at a time,
+ * as names need them; once the states a name goes through have been made,
+ * matching it is one table lookup per character, however many patterns
+ * there are. Bytes which no pattern tells apart share a column of the
+ * tables, so they stay small.
+ *
+ * Compiled sets are cached by their text, so compiling the same set again
+ * costs a lookup, and can be kept in pdshpy's cache directory too (see
+ * cache.h): the DFA states one run makes are saved, and later runs with the
+ * same patterns start from them rather than from nothing.
+ *
+ * Regular expressions can use anything in Python's syntax which a DFA can
+ * do: not backreferences, lookaround, \b, \B, inline flags or possessive
+ * repeats. Names are matched byte by byte, so . and ? are one byte.
+ */
+
+#ifndef _PDSHPY_HOSTPAT_H
+#define _PDSHPY_HOSTPAT_H
+
+#include <stddef.h>
+
+#include "src/common/hostlist.h"
+
+/* how many compiled sets are kept */
+#define HOSTPAT_CACHE_SIZE 16
+
+/* how many DFA states a set keeps before throwing them away and starting
+ * again */
+#define HOSTPAT_MAX_STATES 8192
+
+struct hostpat;
+
+/* Compile 'text', or find it in the cache. With 'persist', the DFA is kept
+ * in the cache directory as well, and picked up from there if it's already
+ * been saved. Returns NULL with errno set to EINVAL, and what's wrong in
+ * 'err', if a pattern is bad; or to ENOMEM. */
+struct hostpat *hostpat_compile(const char *text, int persist, char *err,
+                                size_t n);
+
+void hostpat_release(struct hostpat *p);
+
+/* the text it was compiled from */
+const char *hostpat_text(const struct hostpat *p);
+
+/* how many patterns there are */
+size_t hostpat_count(const struct hostpat *p);
+
+/* 1 if some pattern matches 'host', 0 if none do, or -1 if there's no
+ * memory */
+int hostpat_match(struct hostpat *p, const char *host);
+
+/* A new hostlist of the hosts in 'hl' which some pattern matches or, with
+ * 'invert', which none do, in the same order; NULL if there's no memory. */
+hostlist_t hostpat_select(struct hostpat *p, hostlist_t hl, int invert);
+
+/* Remove the hosts some pattern matches from 'hl', returning how many
+ * there were, or -1 if there's no memory. */
+int hostpat_remove(struct hostpat *p, hostlist_t hl);
+
+#endif /* !_PDSHPY_HOSTPAT_H */
@@ -0,0 +1,693 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#include "liveness.h"
+#include "metrics.h"
+
+/* not a state: still waiting to hear */
+#define PENDING 0xff
+
+static const char *state_names[LIVENESS_NSTATES] = {
+    "up",
+    "refusing connections",
+    "timed out",
+    "unreachable",
+    "unresolved",
+};
+
+const char *
+liveness_describe(enum liveness_state state)
+{
+    return state < LIVENESS_NSTATES ? state_names[state] : "unknown";
+}
+
+/* the rcmd modules pdsh comes with which connect to a port of their own */
+static const struct {
+    const char *rcmd;
+    int port;
+} rcmd_ports[] = {
+    { "ssh", 22 },
+    { "rsh", 514 },
+    { "krb4", 544 },
+    { "mrsh", 21212 },
+    { NULL, 0 }
+};
+
+int
+liveness_port(const char *rcmd)
+{
+    int i;
+
+    for (i = 0; rcmd != NULL && rcmd_ports[i].rcmd != NULL; i++)
+        if (strcmp(rcmd, rcmd_ports[i].rcmd) == 0)
+            return rcmd_ports[i].port;
+    return -1;
+}
+
+/* a connection attempt in flight */
+struct attempt {
+    int fd;                     /* -1 if the slot is free */
+    size_t host;
+    struct addrinfo *addrs;     /* all of the host's addresses */
+    struct addrinfo *addr;      /* the one being tried */
+};
+
+/* Waits for attempts to finish: epoll where there is one, so each wait
+ * costs the same however many are in flight; otherwise poll(), over a
+ * pollfd for each slot. */
+struct waiter {
+#ifdef HAVE_SYS_EPOLL_H
+    int epfd;
+    struct epoll_event *events;
+#else
+    struct pollfd *fds;
+#endif
+    int nslots;
+};
+
+static int
+waiter_init(struct waiter *w, int nslots)
+{
+    w->nslots = nslots;
+#ifdef HAVE_SYS_EPOLL_H
+    if ((w->events = malloc(nslots * sizeof(*w->events))) == NULL)
+        return -1;
+    if ((w->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    {
+        free(w->events);
+        return -1;
+    }
+#else
+    int i;
+
+    if ((w->fds = malloc(nslots * sizeof(*w->fds))) == NULL)
+        return -1;
+    for (i = 0; i < nslots; i++)
+    {
+        w->fds[i].fd = -1;
+        w->fds[i].events = POLLOUT;
+    }
+#endif
+    return 0;
+}
+
+static void
+waiter_free(struct waiter *w)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    close(w->epfd);
+    free(w->events);
+#else
+    free(w->fds);
+#endif
+}
+
+/* wait for 'fd', in 'slot', to be connected or fail */
+static int
+waiter_add(struct waiter *w, int slot, int fd)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLOUT;
+    ev.data.u32 = slot;
+    return epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev);
+#else
+    w->fds[slot].fd = fd;
+    return 0;
+#endif
+}
+
+/* stop waiting on 'slot' (before its fd is closed) */
+static void
+waiter_remove(struct waiter *w, int slot)
+{
+#ifndef HAVE_SYS_EPOLL_H
+    w->fds[slot].fd = -1;
+#endif
+    /* closing the fd takes it out of an epoll set */
+}
+
+/* Wait up to 'timeout_ms' for attempts to finish, and put the slots of
+ * those which have in 'ready'. Returns how many there are, or -1. */
+static int
+waiter_wait(struct waiter *w, int timeout_ms, int *ready)
+{
+    int n, i;
+
+#ifdef HAVE_SYS_EPOLL_H
+    if ((n = epoll_wait(w->epfd, w->events, w->nslots, timeout_ms)) < 0)
+        return errno == EINTR ? 0 : -1;
+    for (i = 0; i < n; i++)
+        ready[i] = w->events[i].data.u32;
+    return n;
+#else
+    int k = 0;
+
+    if ((n = poll(w->fds, w->nslots, timeout_ms)) < 0)
+        return errno == EINTR ? 0 : -1;
+    for (i = 0; i < w->nslots && k < n; i++)
+        if (w->fds[i].fd >= 0 && w->fds[i].revents != 0)
+            ready[k++] = i;
+    return k;
+#endif
+}
+
+/* how many attempts to have in flight, leaving file descriptors for
+ * everything else */
+static int
+inflight_limit(size_t n)
+{
+    struct rlimit rl;
+    rlim_t limit = LIVENESS_MAX_INFLIGHT;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY
+        && rl.rlim_cur / 2 < limit)
+        limit = rl.rlim_cur / 2;
+    if (limit < 1)
+        limit = 1;
+    return n < limit ? (int)n : (int)limit;
+}
+
+/* what a failed connect()'s errno says about the host */
+static int
+failure_state(int err)
+{
+    return err == ECONNREFUSED ? LIVENESS_REFUSED
+        : err == ETIMEDOUT ? LIVENESS_TIMEOUT
+        : LIVENESS_UNREACHABLE;
+}
+
+/* Start connecting to a->addr, or the addresses after it, until one is in
+ * progress. Returns PENDING with a->fd set if one is, or the host's state
+ * if it's already known; -1 if a socket couldn't be had at all. */
+static int
+try_connect(struct attempt *a)
+{
+    struct linger linger = { 1, 0 };
+    int state = LIVENESS_UNREACHABLE;
+    int fd;
+
+    for (; a->addr != NULL; a->addr = a->addr->ai_next)
+    {
+        fd = socket(a->addr->ai_family, a->addr->ai_socktype,
+                    a->addr->ai_protocol);
+        if (fd < 0)
+        {
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS
+                || errno == ENOMEM)
+                return -1;
+            continue;
+        }
+        /* reset rather than linger in TIME_WAIT: there may be thousands */
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+        if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0
+            || fcntl(fd, F_SETFD, FD_CLOEXEC) < 0)
+        {
+            close(fd);
+            return -1;
+        }
+        if (connect(fd, a->addr->ai_addr, a->addr->ai_addrlen) == 0)
+        {
+            close(fd);
+            return LIVENESS_UP;
+        }
+        if (errno == EINPROGRESS)
+        {
+            a->fd = fd;
+            return PENDING;
+        }
+        state = failure_state(errno);
+        close(fd);
+    }
+    return state;
+}
+
+/* what a name which couldn't be looked up in time comes to in the table
+ * filled in by lookup_names() */
+static struct addrinfo unresolved;
+
+static void
+lookup_hints(struct addrinfo *hints, int flags)
+{
+    memset(hints, 0, sizeof(*hints));
+    hints->ai_family = AF_UNSPEC;
+    hints->ai_socktype = SOCK_STREAM;
+    hints->ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG | flags;
+}
+
+/* nonzero if 'name' is an address, which needs no lookup */
+static int
+is_address(const char *name)
+{
+    unsigned char buf[sizeof(struct in6_addr)];
+
+    return inet_pton(AF_INET, name, buf) == 1
+        || inet_pton(AF_INET6, name, buf) == 1;
+}
+
+/* Names are looked up by a pool of threads, side by side, and the caller
+ * waits no longer than the timeout for them altogether; the threads left
+ * looking then finish in their own time, and the last to go frees what
+ * they share. */
+struct lookup {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    char **names;               /* copies, to outlive the caller's */
+    struct addrinfo **addrs;    /* what each came to, or &unresolved */
+    size_t n, next, left;
+    int refs;                   /* the caller and each running thread */
+    int abandoned;              /* the caller has stopped waiting */
+    char port[16];
+};
+
+static void
+lookup_free(struct lookup *l)
+{
+    size_t k;
+
+    for (k = 0; k < l->n; k++)
+    {
+        free(l->names[k]);
+        if (l->addrs[k] != NULL && l->addrs[k] != &unresolved)
+            freeaddrinfo(l->addrs[k]);
+    }
+    free(l->names);
+    free(l->addrs);
+    pthread_cond_destroy(&l->done);
+    pthread_mutex_destroy(&l->lock);
+    free(l);
+}
+
+static void *
+lookup_thread(void *arg)
+{
+    struct lookup *l = arg;
+    struct addrinfo hints;
+    struct addrinfo *addrs = NULL;
+    size_t k;
+    int last;
+
+    lookup_hints(&hints, 0);
+    pthread_mutex_lock(&l->lock);
+    while (!l->abandoned && l->next < l->n)
+    {
+        k = l->next++;
+        pthread_mutex_unlock(&l->lock);
+        if (getaddrinfo(l->names[k], l->port, &hints, &addrs) != 0)
+            addrs = &unresolved;
+        pthread_mutex_lock(&l->lock);
+        if (l->abandoned && addrs != &unresolved)
+            freeaddrinfo(addrs);
+        else
+            l->addrs[k] = addrs;
+        if (--l->left == 0)
+            pthread_cond_signal(&l->done);
+    }
+    last = --l->refs == 0;
+    pthread_mutex_unlock(&l->lock);
+    if (last)
+        lookup_free(l);
+    return NULL;
+}
+
+static struct lookup *
+lookup_create(size_t n, const char *port)
+{
+    struct lookup *l = calloc(1, sizeof(*l));
+    pthread_condattr_t attr;
+
+    if (l == NULL)
+        return NULL;
+    l->names = calloc(n, sizeof(*l->names));
+    l->addrs = calloc(n, sizeof(*l->addrs));
+    if (l->names == NULL || l->addrs == NULL)
+    {
+        free(l->names);
+        free(l->addrs);
+        free(l);
+        return NULL;
+    }
+    pthread_mutex_init(&l->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&l->done, &attr);
+    pthread_condattr_destroy(&attr);
+    snprintf(l->port, sizeof(l->port), "%s", port);
+    l->refs = 1;
+    return l;
+}
+
+/* Look up the names of those hosts which aren't addresses, taking no more
+ * than 'timeout_ms' in all, and set addrs[i] to what hosts[i] came to:
+ * &unresolved if it couldn't be looked up in that time, NULL if it's an
+ * address and was left alone. Returns -1 if it couldn't get going. */
+static int
+lookup_names(char *const *hosts, size_t n, const char *port, int timeout_ms,
+             struct addrinfo **addrs)
+{
+    struct lookup *l = NULL;
+    struct timespec until;
+    pthread_attr_t attr;
+    pthread_t thread;
+    sigset_t all, saved;
+    size_t i, k, nthreads;
+    int last;
+
+    memset(addrs, 0, n * sizeof(*addrs));
+    for (i = 0, k = 0; i < n; i++)
+        k += !is_address(hosts[i]);
+    if (k == 0)
+        return 0;
+    if ((l = lookup_create(k, port)) == NULL)
+        return -1;
+    for (i = 0, k = 0; i < n; i++)
+    {
+        if (is_address(hosts[i]))
+            continue;
+        if ((l->names[k++] = strdup(hosts[i])) == NULL)
+        {
+            lookup_free(l);
+            return -1;
+        }
+    }
+    l->n = l->left = k;
+
+    /* the threads take no signals: those are for the caller */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    nthreads = k < LIVENESS_MAX_LOOKUPS ? k : LIVENESS_MAX_LOOKUPS;
+    for (i = 0; i < nthreads; i++)
+    {
+        pthread_mutex_lock(&l->lock);
+        l->refs++;
+        pthread_mutex_unlock(&l->lock);
+        if (pthread_create(&thread, &attr, lookup_thread, l) == 0)
+            continue;
+        pthread_mutex_lock(&l->lock);
+        l->refs--;
+        pthread_mutex_unlock(&l->lock);
+        break;
+    }
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+    /* with no threads to be had, look them up here, as best we can */
+    if (i == 0)
+    {
+        l->refs++;
+        lookup_thread(l);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &until);
+    until.tv_sec += timeout_ms / 1000;
+    until.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (until.tv_nsec >= 1000000000)
+    {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&l->lock);
+    while (l->left > 0
+           && pthread_cond_timedwait(&l->done, &l->lock, &until) != ETIMEDOUT)
+        ;
+    l->abandoned = 1;
+    for (i = 0, k = 0; i < n; i++)
+    {
+        if (is_address(hosts[i]))
+            continue;
+        addrs[i] = l->addrs[k] != NULL ? l->addrs[k] : &unresolved;
+        l->addrs[k++] = NULL;
+    }
+    last = --l->refs == 0;
+    pthread_mutex_unlock(&l->lock);
+    if (last)
+        lookup_free(l);
+    return 0;
+}
+
+static void
+free_addrs(struct addrinfo *addrs)
+{
+    if (addrs != NULL && addrs != &unresolved)
+        freeaddrinfo(addrs);
+}
+
+/* Start on host 'i', whose addresses lookup_names() found, or which is an
+ * address itself if addrs[i] is NULL. Returns as try_connect(), with
+ * a->addrs set (to free once done) if it's PENDING. */
+static int
+start_attempt(struct attempt *a, char *const *hosts, size_t i,
+              const char *port, struct addrinfo **addrs)
+{
+    struct addrinfo *found = addrs[i];
+    struct addrinfo hints;
+    int state;
+
+    a->host = i;
+    a->fd = -1;
+    a->addrs = found;
+    lookup_hints(&hints, AI_NUMERICHOST);
+    if (found == &unresolved || (found == NULL
+        && getaddrinfo(hosts[i], port, &hints, &a->addrs) != 0))
+        return LIVENESS_UNRESOLVED;
+    a->addr = a->addrs;
+    state = try_connect(a);
+
+    /* out of sockets: keep what was found for the next try */
+    if (state < 0 && found != NULL)
+        return state;
+    addrs[i] = NULL;
+    if (state != PENDING)
+        freeaddrinfo(a->addrs);
+    return state;
+}
+
+/* Hear how attempt 'a', whose socket is ready, went; moving on to the
+ * host's next address if that one failed. Returns as try_connect(). */
+static int
+finish_attempt(struct attempt *a)
+{
+    socklen_t len = sizeof(int);
+    int err = 0;
+    int state;
+
+    if (getsockopt(a->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+        err = errno;
+    close(a->fd);
+    a->fd = -1;
+    if (err == 0)
+        return LIVENESS_UP;
+    state = failure_state(err);
+    a->addr = a->addr->ai_next;
+    if (a->addr != NULL && (state = try_connect(a)) < 0)
+        state = LIVENESS_UNREACHABLE;
+    return state;
+}
+
+int
+liveness_check(char *const *hosts, size_t n, int port, int timeout_ms,
+               unsigned char *state)
+{
+    struct attempt *attempts = NULL;
+    struct addrinfo **addrs = NULL;
+    struct waiter waiter;
+    uint64_t *deadline = NULL;
+    uint64_t now;
+    int *slot_of = NULL;
+    char portstr[16];
+    int *free_slots = NULL;
+    int *ready = NULL;
+    int nslots, nfree, nready, slot, rc, k, wait_ms;
+    size_t next = 0, oldest = 0, h;
+    int up = 0, saved_errno;
+
+    if (n == 0)
+        return 0;
+    nslots = inflight_limit(n);
+    attempts = malloc(nslots * sizeof(*attempts));
+    free_slots = malloc(nslots * sizeof(*free_slots));
+    ready = malloc(nslots * sizeof(*ready));
+    deadline = malloc(n * sizeof(*deadline));
+    slot_of = malloc(n * sizeof(*slot_of));
+    addrs = malloc(n * sizeof(*addrs));
+    snprintf(portstr, sizeof(portstr), "%d", port);
+    if (attempts == NULL || free_slots == NULL || ready == NULL
+        || deadline == NULL || slot_of == NULL || addrs == NULL
+        || lookup_names(hosts, n, portstr, timeout_ms, addrs) < 0
+        || waiter_init(&waiter, nslots) < 0)
+    {
+        saved_errno = errno;
+        if (addrs != NULL)
+            for (h = 0; h < n; h++)
+                free_addrs(addrs[h]);
+        free(addrs);
+        free(attempts);
+        free(free_slots);
+        free(ready);
+        free(deadline);
+        free(slot_of);
+        errno = saved_errno;
+        return -1;
+    }
+    for (nfree = 0; nfree < nslots; nfree++)
+    {
+        attempts[nfree].fd = -1;
+        free_slots[nfree] = nslots - 1 - nfree;
+    }
+    memset(state, PENDING, n);
+
+    while (oldest < n)
+    {
+        /* start as many as there's room for */
+        now = metrics_now();
+        while (next < n && nfree > 0)
+        {
+            slot = free_slots[nfree - 1];
+            slot_of[next] = slot;
+            deadline[next] = now + (uint64_t)timeout_ms * 1000000;
+            rc = start_attempt(&attempts[slot], hosts, next, portstr, addrs);
+            if (rc < 0)
+            {
+                /* out of sockets: make do with those in flight */
+                if (nfree == nslots)
+                    goto fail;
+                break;
+            }
+            if (rc == PENDING
+                && waiter_add(&waiter, slot, attempts[slot].fd) < 0)
+            {
+                close(attempts[slot].fd);
+                attempts[slot].fd = -1;
+                freeaddrinfo(attempts[slot].addrs);
+                rc = LIVENESS_UNREACHABLE;
+            }
+            if (rc == PENDING)
+                nfree--;
+            else
+                up += (state[next] = rc) == LIVENESS_UP;
+            next++;
+        }
+
+        /* hosts are started in order, each with the same time to answer,
+         * so the oldest still waiting is the next to run out */
+        while (oldest < next && state[oldest] != PENDING)
+            oldest++;
+        if (oldest == n)
+            break;
+        if (oldest == next)
+            continue;
+
+        now = metrics_now();
+        wait_ms = deadline[oldest] > now
+            ? (int)((deadline[oldest] - now + 999999) / 1000000) : 0;
+        if ((nready = waiter_wait(&waiter, wait_ms, ready)) < 0)
+            goto fail;
+        for (k = 0; k < nready; k++)
+        {
+            struct attempt *a = &attempts[ready[k]];
+
+            if (a->fd < 0)
+                continue;
+            waiter_remove(&waiter, ready[k]);
+            rc = finish_attempt(a);
+            if (rc == PENDING
+                && waiter_add(&waiter, ready[k], a->fd) == 0)
+                continue;
+            if (a->fd >= 0)
+            {
+                close(a->fd);
+                a->fd = -1;
+            }
+            freeaddrinfo(a->addrs);
+            if (rc == PENDING)
+                rc = LIVENESS_UNREACHABLE;
+            up += (state[a->host] = rc) == LIVENESS_UP;
+            free_slots[nfree++] = ready[k];
+        }
+
+        /* and give up on any which have had long enough */
+        now = metrics_now();
+        for (h = oldest; h < next && deadline[h] <= now; h++)
+        {
+            struct attempt *a = &attempts[slot_of[h]];
+
+            if (state[h] != PENDING)
+                continue;
+            slot = slot_of[h];
+            waiter_remove(&waiter, slot);
+            close(a->fd);
+            a->fd = -1;
+            freeaddrinfo(a->addrs);
+            state[a->host] = LIVENESS_TIMEOUT;
+            free_slots[nfree++] = slot;
+        }
+    }
+
+    waiter_free(&waiter);
+    free(addrs);
+    free(attempts);
+    free(free_slots);
+    free(ready);
+    free(deadline);
+    free(slot_of);
+    return up;
+
+fail:
+    saved_errno = errno;
+    for (slot = 0; slot < nslots; slot++)
+    {
+        if (attempts[slot].fd < 0)
+            continue;
+        close(attempts[slot].fd);
+        freeaddrinfo(attempts[slot].addrs);
+    }
+    for (h = next; h < n; h++)
+        free_addrs(addrs[h]);
+    waiter_free(&waiter);
+    free(addrs);
+    free(attempts);
+    free(free_slots);
+    free(ready);
+    free(deadline);
+    free(slot_of);
+    errno = saved_errno;
+    return -1;
+}
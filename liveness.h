@@ -0,0 +1,88 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* Checks that hosts are up before pdsh fans out to them. A dead host holds
+ * one of pdsh's fanout slots until connect_timeout runs out, so a few dead
+ * hosts in a big working set can take most of a run's time; instead, every
+ * host is sent a TCP connection attempt on the rcmd port at once (well, up
+ * to LIVENESS_MAX_INFLIGHT at a time), non-blocking, all waited on together
+ * with epoll (or poll() where there's no epoll), and any that haven't
+ * answered within a short timeout are taken to be down. Connections which
+ * succeed are closed straight away, without sending anything.
+ *
+ * Turned on with PDSHPY_LIVENESS, it runs after the drivers' perform_postop()
+ * on whatever working set they leave, and reports the hosts which are down;
+ * drivers can also check hosts themselves with util.probe_hosts().
+ */
+
+#ifndef _PDSHPY_LIVENESS_H
+#define _PDSHPY_LIVENESS_H
+
+#include <stddef.h>
+
+/* set the environment variable with this name to "remove" to have hosts
+ * which are down reported and taken out of the working set, or to "report"
+ * to only report them */
+#define PDSHPY_ENVIRON_LIVENESS "PDSHPY_LIVENESS"
+
+/* set the environment variable with this name to the port to try, if it
+ * can't be told from the rcmd module (see liveness_port()) */
+#define PDSHPY_ENVIRON_LIVENESS_PORT "PDSHPY_LIVENESS_PORT"
+
+/* set the environment variable with this name to how many milliseconds a
+ * host has to answer in */
+#define PDSHPY_ENVIRON_LIVENESS_TIMEOUT "PDSHPY_LIVENESS_TIMEOUT"
+
+#define LIVENESS_DEFAULT_TIMEOUT 1000
+
+/* the most connection attempts in flight at once (fewer if the open file
+ * limit is low) */
+#define LIVENESS_MAX_INFLIGHT 4096
+
+/* the most threads looking up names at once */
+#define LIVENESS_MAX_LOOKUPS 32
+
+/* what became of each host */
+enum liveness_state {
+    LIVENESS_UP,            /* it accepted the connection */
+    LIVENESS_REFUSED,       /* it's there, but nothing's listening */
+    LIVENESS_TIMEOUT,       /* no answer in time */
+    LIVENESS_UNREACHABLE,   /* the network said it couldn't get there */
+    LIVENESS_UNRESOLVED,    /* its name couldn't be looked up */
+    LIVENESS_NSTATES
+};
+
+/* how a state reads in a report, like "timed out" */
+const char *liveness_describe(enum liveness_state state);
+
+/* the port the rcmd module named 'rcmd' (as in pdsh -R) connects to, or -1
+ * if that isn't known */
+int liveness_port(const char *rcmd);
+
+/* Try connecting to each of the 'n' hosts on 'port', giving each up to
+ * 'timeout_ms' milliseconds from when its attempt starts, and set state[i]
+ * to what became of hosts[i]. Names which aren't addresses are looked up
+ * first, with getaddrinfo() on up to LIVENESS_MAX_LOOKUPS threads, and all
+ * within 'timeout_ms': those not found by then are LIVENESS_UNRESOLVED.
+ * A host's addresses are tried in turn until one answers. Returns how many
+ * hosts are up, or -1 with errno set if it couldn't get going (out of
+ * memory or file descriptors).
+ */
+int liveness_check(char *const *hosts, size_t n, int port, int timeout_ms,
+                   unsigned char *state);
+
+#endif /* !_PDSHPY_LIVENESS_H */
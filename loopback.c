@@ -0,0 +1,169 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ * Based on code from pdsh, Copyright (C) 2001-2006 The Regents of the
+ * University of California.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+
+/* "loopback" rcmd module: instead of connecting to the remote host, runs the
+ * command (or a stand-in for it) on the local machine. It's for measuring
+ * how pdsh itself behaves at large fanouts and host counts, without putting
+ * any load on real hosts. Select it with "-R loopback", or have a pdshpy
+ * driver make it the default with util.rcmd_register_defaults().
+ *
+ * By default the command isn't run at all; each "host" just writes
+ * PDSHPY_LOOPBACK_OUTPUT bytes of output (64 if unset). Set
+ * PDSHPY_LOOPBACK_EXEC=1 to really run the command with /bin/sh. Set
+ * PDSHPY_LOOPBACK_LATENCY to a number of milliseconds to have each
+ * connection take that long to set up, like a real remote connection.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "src/common/err.h"
+#include "src/common/pipecmd.h"
+#include "src/pdsh/mod.h"
+
+#define LOOPBACK_ENVIRON_EXEC "PDSHPY_LOOPBACK_EXEC"
+#define LOOPBACK_ENVIRON_OUTPUT "PDSHPY_LOOPBACK_OUTPUT"
+#define LOOPBACK_ENVIRON_LATENCY "PDSHPY_LOOPBACK_LATENCY"
+
+#define LOOPBACK_DEFAULT_OUTPUT 64
+
+int pdsh_module_priority = DEFAULT_MODULE_PRIORITY;
+
+static int loopback_init(opt_t *);
+static int loopback_signal(int, void *, int);
+static int loopback_rcmd(char *, char *, char *, char *, char *, int, int *,
+                         void **);
+static int loopback_destroy(pipecmd_t);
+
+static int exec_commands = 0;
+static long output_bytes = LOOPBACK_DEFAULT_OUTPUT;
+static long latency_ms = 0;
+
+struct pdsh_module_operations loopback_module_ops = {
+    (ModInitF)       NULL,
+    (ModExitF)       NULL,
+    (ModReadWcollF)  NULL,
+    (ModPostOpF)     NULL,
+};
+
+struct pdsh_rcmd_operations loopback_rcmd_ops = {
+    (RcmdInitF)     loopback_init,
+    (RcmdSigF)      loopback_signal,
+    (RcmdF)         loopback_rcmd,
+    (RcmdDestroyF)  loopback_destroy,
+};
+
+struct pdsh_module_option loopback_module_options[] = {
+    PDSH_OPT_TABLE_END
+};
+
+struct pdsh_module pdsh_module_info = {
+    "rcmd",
+    "loopback",
+    "paul cannon <paul@spacemonkey.com>",
+    "Run commands locally instead of on remote hosts, for benchmarking",
+    DSH,
+
+    &loopback_module_ops,
+    &loopback_rcmd_ops,
+    &loopback_module_options[0],
+};
+
+static long
+env_long(const char *name, long dflt)
+{
+    const char *val = getenv(name);
+
+    if (val == NULL || val[0] == '\0')
+        return dflt;
+    return atol(val);
+}
+
+static int
+loopback_init(opt_t *opt)
+{
+    exec_commands = env_long(LOOPBACK_ENVIRON_EXEC, 0) > 0;
+    output_bytes = env_long(LOOPBACK_ENVIRON_OUTPUT, LOOPBACK_DEFAULT_OUTPUT);
+    latency_ms = env_long(LOOPBACK_ENVIRON_LATENCY, 0);
+    if (output_bytes < 0)
+        output_bytes = 0;
+    return 0;
+}
+
+static int
+loopback_signal(int fd, void *arg, int signum)
+{
+    return pipecmd_signal((pipecmd_t)arg, signum);
+}
+
+static int
+loopback_rcmd(char *ahost, char *addr, char *luser, char *ruser, char *cmd,
+              int rank, int *fd2p, void **arg)
+{
+    /* pipecmd supplies argv[0] */
+    const char *args[3] = { "-c", NULL, NULL };
+    char fake[128];
+    struct timespec delay;
+    pipecmd_t p = NULL;
+
+    if (latency_ms > 0)
+    {
+        /* each connection is made by its own thread, so this overlaps up
+         * to the fanout, just like real connection setup */
+        delay.tv_sec = latency_ms / 1000;
+        delay.tv_nsec = (latency_ms % 1000) * 1000000L;
+        while (nanosleep(&delay, &delay) < 0)
+            ;
+    }
+
+    if (exec_commands)
+        args[1] = cmd;
+    else
+    {
+        /* pipecmd substitutes the host name for %h */
+        snprintf(fake, sizeof(fake),
+                 "yes 'loopback output from %%h' | head -c %ld", output_bytes);
+        args[1] = fake;
+    }
+
+    if ((p = pipecmd("/bin/sh", args, ahost, ruser, rank)) == NULL)
+        return -1;
+
+    if (fd2p != NULL)
+        *fd2p = pipecmd_stderrfd(p);
+    *arg = (void *)p;
+    return pipecmd_stdoutfd(p);
+}
+
+/* returns the command's exit status, for pdsh -S */
+static int
+loopback_destroy(pipecmd_t p)
+{
+    int status = 0;
+
+    if (pipecmd_wait(p, &status) < 0)
+        err("%p: %S: loopback: wait: %m\n", pipecmd_target(p));
+    pipecmd_destroy(p);
+    return WEXITSTATUS(status);
+}
@@ -0,0 +1,345 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pdshpy.h"
+#include "metrics.h"
+
+static const char *phase_names[METRICS_NPHASES] = {
+    "py_initialize",
+    "import_util",
+    "import_driver",
+    "driver_initialize",
+    "process_option",
+    "collect_hosts",
+    "perform_postop",
+    "filter_hosts",
+    "liveness",
+    "opts_to_python",
+    "opts_from_python",
+    "hosts_to_python",
+    "hosts_from_python",
+    "server_connect",
+    "server_request",
+    "cache",
+    "prefetch_wait",
+    "host_sources",
+    "finalize",
+};
+
+static const char *counter_names[METRICS_NCOUNTERS] = {
+    "nhosts_to_python",
+    "nbytes_to_python",
+    "nhosts_from_python",
+    "nbytes_from_python",
+    "server_bytes_sent",
+    "server_bytes_received",
+    "python_hostlist_bytes",
+    "hostlist_bytes",
+    "cache_hits",
+    "cache_stale_hits",
+    "cache_misses",
+    "deadlines_exceeded",
+    "nhosts_filtered",
+    "nhosts_down",
+    "nhosts_known_down",
+};
+
+static struct {
+    uint64_t ns;
+    uint64_t calls;
+    int64_t rss_delta_kb;       /* summed over calls */
+    long rss_max_kb;            /* largest RSS seen at the end of a call */
+    int64_t python_delta;       /* summed over calls, in bytes */
+} phases[METRICS_NPHASES];
+
+static uint64_t counters[METRICS_NCOUNTERS];
+
+static uint64_t run_start = 0;
+static const char *metrics_path = NULL;
+
+/* /proc/self/statm, kept open when tracking memory; -1 otherwise */
+static int statm_fd = -1;
+static long page_kb = 4;
+static int python_tracked = 0;
+static int64_t (*python_memory)(void) = NULL;
+
+uint64_t
+metrics_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+metrics_init(void)
+{
+    memset(phases, 0, sizeof(phases));
+    memset(counters, 0, sizeof(counters));
+    run_start = metrics_now();
+    metrics_path = getenv(PDSHPY_ENVIRON_METRICS);
+    if (metrics_path != NULL && metrics_path[0] == '\0')
+        metrics_path = NULL;
+
+    if (statm_fd >= 0)
+        close(statm_fd);
+    statm_fd = -1;
+    python_tracked = 0;
+
+    /* a read per phase is cheap, but don't pay it for nothing */
+    if (pdshpy_debuglevel > 0 || metrics_path != NULL)
+    {
+        statm_fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+        page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    }
+}
+
+void
+metrics_set_python_memory(int64_t (*fn)(void))
+{
+    python_memory = fn;
+    if (fn != NULL && statm_fd >= 0)
+        python_tracked = 1;
+}
+
+static long
+rss_kb(void)
+{
+    char buf[128];
+    ssize_t n;
+    long size = 0, resident = 0;
+
+    if (statm_fd < 0)
+        return -1;
+    if ((n = pread(statm_fd, buf, sizeof(buf) - 1, 0)) <= 0)
+        return -1;
+    buf[n] = '\0';
+    if (sscanf(buf, "%ld %ld", &size, &resident) != 2)
+        return -1;
+    return resident * page_kb;
+}
+
+static long
+maxrss_kb(void)
+{
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) < 0)
+        return -1;
+    return ru.ru_maxrss;
+}
+
+void
+metrics_begin(struct metrics_mark *mark)
+{
+    mark->rss_kb = rss_kb();
+    mark->python_bytes = -1;
+    if (python_memory != NULL && statm_fd >= 0)
+        mark->python_bytes = python_memory();
+    mark->ns = metrics_now();
+}
+
+void
+metrics_end(enum metrics_phase phase, const struct metrics_mark *mark)
+{
+    long rss = 0;
+    int64_t py = 0;
+
+    phases[phase].ns += metrics_now() - mark->ns;
+    phases[phase].calls++;
+
+    if (mark->rss_kb >= 0 && (rss = rss_kb()) >= 0)
+    {
+        phases[phase].rss_delta_kb += rss - mark->rss_kb;
+        if (rss > phases[phase].rss_max_kb)
+            phases[phase].rss_max_kb = rss;
+    }
+    if (mark->python_bytes >= 0 && python_memory != NULL
+        && (py = python_memory()) >= 0)
+        phases[phase].python_delta += py - mark->python_bytes;
+}
+
+void
+metrics_count(enum metrics_counter counter, uint64_t n)
+{
+    counters[counter] += n;
+}
+
+#define MS(ns) ((double)(ns) / 1e6)
+
+static void
+report_summary(uint64_t total)
+{
+    char line[2048];
+    size_t len = 0;
+    int i;
+
+#define APPEND(fmt, args...) ({                                         \
+    if (len < sizeof(line))                                             \
+        len += snprintf(line + len, sizeof(line) - len, fmt, ## args);  \
+})
+
+    APPEND("total=%.3fms", MS(total));
+    for (i = 0; i < METRICS_NPHASES; i++)
+    {
+        if (phases[i].calls == 0)
+            continue;
+        APPEND(" %s=%.3fms", phase_names[i], MS(phases[i].ns));
+        if (phases[i].calls > 1)
+            APPEND("/%llu", (unsigned long long)phases[i].calls);
+    }
+    for (i = 0; i < METRICS_NCOUNTERS; i++)
+    {
+        if (counters[i] == 0)
+            continue;
+        APPEND(" %s=%llu", counter_names[i], (unsigned long long)counters[i]);
+    }
+#undef APPEND
+
+    ERR("timing: %s", line);
+}
+
+static void
+report_memory_summary(void)
+{
+    char line[2048];
+    size_t len = 0;
+    int i;
+
+#define APPEND(fmt, args...) ({                                         \
+    if (len < sizeof(line))                                             \
+        len += snprintf(line + len, sizeof(line) - len, fmt, ## args);  \
+})
+
+    APPEND("maxrss=%ldKB", maxrss_kb());
+    for (i = 0; i < METRICS_NPHASES; i++)
+    {
+        if (phases[i].calls == 0 || phases[i].rss_max_kb == 0)
+            continue;
+        APPEND(" %s=%+lldKB", phase_names[i],
+               (long long)phases[i].rss_delta_kb);
+        if (python_tracked)
+            APPEND("/py%+lldKB", (long long)phases[i].python_delta / 1024);
+    }
+#undef APPEND
+
+    ERR("memory: %s", line);
+}
+
+/* module names are the only strings that go in; be safe anyway */
+static void
+json_string(char *buf, size_t n, const char *str)
+{
+    size_t len = 0;
+
+    if (n < 3)
+        return;
+    buf[len++] = '"';
+    for (; str != NULL && *str != '\0' && len + 3 < n; str++)
+    {
+        if (*str == '"' || *str == '\\')
+            buf[len++] = '\\';
+        buf[len++] = ((unsigned char)*str < 0x20) ? '?' : *str;
+    }
+    buf[len++] = '"';
+    buf[len] = '\0';
+}
+
+static void
+report_json(uint64_t total, const char *module, const char *mode)
+{
+    char line[8192];
+    char modstr[256];
+    size_t len = 0;
+    struct timeval now;
+    int i, fd, sep = 0;
+
+#define APPEND(fmt, args...) ({                                         \
+    if (len < sizeof(line))                                             \
+        len += snprintf(line + len, sizeof(line) - len, fmt, ## args);  \
+})
+
+    gettimeofday(&now, NULL);
+    json_string(modstr, sizeof(modstr), module);
+
+    APPEND("{\"time\": %ld.%06ld, \"pid\": %ld, \"module\": %s, "
+           "\"mode\": \"%s\", \"total_ms\": %.3f, \"maxrss_kb\": %ld, "
+           "\"phases\": {",
+           (long)now.tv_sec, (long)now.tv_usec, (long)getpid(), modstr,
+           mode, MS(total), maxrss_kb());
+    for (i = 0; i < METRICS_NPHASES; i++)
+    {
+        if (phases[i].calls == 0)
+            continue;
+        APPEND("%s\"%s\": {\"ms\": %.3f, \"calls\": %llu",
+               sep++ ? ", " : "", phase_names[i], MS(phases[i].ns),
+               (unsigned long long)phases[i].calls);
+        if (phases[i].rss_max_kb > 0)
+            APPEND(", \"rss_delta_kb\": %lld, \"rss_kb\": %ld",
+                   (long long)phases[i].rss_delta_kb, phases[i].rss_max_kb);
+        if (python_tracked)
+            APPEND(", \"python_delta_bytes\": %lld",
+                   (long long)phases[i].python_delta);
+        APPEND("}");
+    }
+    APPEND("}, \"counters\": {");
+    for (i = 0; i < METRICS_NCOUNTERS; i++)
+        APPEND("%s\"%s\": %llu", i ? ", " : "", counter_names[i],
+               (unsigned long long)counters[i]);
+    APPEND("}}\n");
+#undef APPEND
+
+    if (len >= sizeof(line))
+    {
+        ERR("metrics record too long; not written");
+        return;
+    }
+
+    /* one write() with O_APPEND, so concurrent runs don't interleave */
+    if ((fd = open(metrics_path, O_WRONLY | O_APPEND | O_CREAT, 0644)) < 0)
+    {
+        ERR("Could not open %s: %s", metrics_path, strerror(errno));
+        return;
+    }
+    if (write(fd, line, len) < 0)
+        ERR("Could not write to %s: %s", metrics_path, strerror(errno));
+    close(fd);
+}
+
+void
+metrics_report(const char *module, const char *mode)
+{
+    uint64_t total = metrics_now() - run_start;
+
+    if (pdshpy_debuglevel > 0)
+    {
+        report_summary(total);
+        report_memory_summary();
+    }
+    if (metrics_path != NULL)
+        report_json(total, module, mode);
+}
@@ -0,0 +1,110 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* Per-phase timing, memory use and counters, so it's possible to tell where
+ * the time (or the memory) in a slow pdsh run went. Reported at unload time
+ * as a summary when PDSHPY_DEBUG is on, and/or appended as a line of JSON to
+ * the file named by PDSHPY_METRICS. Memory is only tracked when one of those
+ * reports is going to be made.
+ */
+
+#ifndef _PDSHPY_METRICS_H
+#define _PDSHPY_METRICS_H
+
+#include <stdint.h>
+
+/* set the environment variable with this name to a file path to have
+ * metrics for each run appended to it as JSON, one line per run */
+#define PDSHPY_ENVIRON_METRICS "PDSHPY_METRICS"
+
+/* keep in sync with phase_names in metrics.c */
+enum metrics_phase {
+    PHASE_PY_INITIALIZE,        /* Py_Initialize() */
+    PHASE_IMPORT_UTIL,          /* importing pdshpy.util */
+    PHASE_IMPORT_DRIVER,        /* importing the driver module */
+    PHASE_DRIVER_INITIALIZE,    /* the driver's initialize() */
+    PHASE_PROCESS_OPTION,       /* option callbacks */
+    PHASE_COLLECT_HOSTS,        /* the driver's collect_hosts() */
+    PHASE_PERFORM_POSTOP,       /* the driver's perform_postop() */
+    PHASE_FILTER_HOSTS,         /* the driver's filter_hosts(), in batches */
+    PHASE_LIVENESS,             /* checking hosts are up (liveness.h) */
+    PHASE_OPTS_TO_PYTHON,       /* building PdshOpts objects */
+    PHASE_OPTS_FROM_PYTHON,     /* copying PdshOpts back into opt_t */
+    PHASE_HOSTS_TO_PYTHON,      /* hostlist -> Python */
+    PHASE_HOSTS_FROM_PYTHON,    /* Python -> hostlist */
+    PHASE_SERVER_CONNECT,       /* connecting to a pdshpy server */
+    PHASE_SERVER_REQUEST,       /* round trips to a pdshpy server */
+    PHASE_CACHE,                /* reading and writing the hosts cache */
+    PHASE_PREFETCH_WAIT,        /* waiting for prefetch_hosts() to finish */
+    PHASE_HOST_SOURCES,         /* waiting for host sources to finish */
+    PHASE_FINALIZE,             /* Py_Finalize() */
+    METRICS_NPHASES
+};
+
+/* keep in sync with counter_names in metrics.c */
+enum metrics_counter {
+    COUNT_HOSTS_TO_PYTHON,
+    COUNT_BYTES_TO_PYTHON,
+    COUNT_HOSTS_FROM_PYTHON,
+    COUNT_BYTES_FROM_PYTHON,
+    COUNT_SERVER_BYTES_SENT,
+    COUNT_SERVER_BYTES_RECEIVED,
+    COUNT_PYTHON_HOSTLIST_BYTES,    /* estimated size of Python host lists */
+    COUNT_HOSTLIST_BYTES,           /* estimated size of hostlists built */
+    COUNT_CACHE_HITS,
+    COUNT_CACHE_STALE_HITS,
+    COUNT_CACHE_MISSES,
+    COUNT_DEADLINES_EXCEEDED,       /* collect_hosts() ran out of time */
+    COUNT_HOSTS_FILTERED,           /* removed by filter_hosts() */
+    COUNT_HOSTS_DOWN,               /* found down by the liveness check */
+    COUNT_HOSTS_KNOWN_DOWN,         /* unreachable lately (deadhosts.h) */
+    METRICS_NCOUNTERS
+};
+
+/* where things stood at the start of a phase */
+struct metrics_mark {
+    uint64_t ns;
+    long rss_kb;            /* -1 if memory isn't being tracked */
+    int64_t python_bytes;   /* -1 if Python memory isn't being tracked */
+};
+
+/* monotonic clock, in nanoseconds */
+uint64_t metrics_now(void);
+
+/* start the clock on the whole run; reads PDSHPY_METRICS. Call after
+ * pdshpy_debuglevel is set. */
+void metrics_init(void);
+
+/* Have memory accounting include the embedded interpreter's own idea of
+ * how much it has allocated: 'fn' returns a byte count (or -1 if it can't
+ * tell). Pass NULL before the interpreter goes away.
+ */
+void metrics_set_python_memory(int64_t (*fn)(void));
+
+/* start a phase */
+void metrics_begin(struct metrics_mark *mark);
+
+/* charge the time and memory since metrics_begin() to a phase */
+void metrics_end(enum metrics_phase phase, const struct metrics_mark *mark);
+
+void metrics_count(enum metrics_counter counter, uint64_t n);
+
+/* emit whatever reports are enabled. 'module' and 'mode' are included in the
+ * JSON record to help tell runs apart */
+void metrics_report(const char *module, const char *mode);
+
+#endif /* !_PDSHPY_METRICS_H */
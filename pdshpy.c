@@ -19,12 +19,31 @@
  */
 
 #include <Python.h>
+#include "pycompat.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "src/common/hostlist.h"
 #include "src/common/err.h"
 #include "src/common/xmalloc.h"
 #include "src/pdsh/mod.h"
 #include "src/pdsh/rcmd.h"
 
+#include "pdshpy.h"
+#include "cache.h"
+#include "deadhosts.h"
+#include "liveness.h"
+#include "metrics.h"
+#include "probes.h"
+#include "pyhostbatch.h"
+#include "pyhostdb.h"
+#include "pyhostexpr.h"
+#include "pyhostlist.h"
+#include "pyhostpat.h"
+
 int pdsh_module_priority = 110;
 
 static int pdshpy_init(void);
@@ -34,6 +53,9 @@ static int pdshpy_postop(opt_t *);
 static int pdshpy_fini(void);
 static PyObject *register_option(PyObject *self, PyObject *args);
 static PyObject *pdshpy_rcmd_register_defaults(PyObject *self, PyObject *args);
+static PyObject *set_cache_key(PyObject *self, PyObject *args);
+static PyObject *probe_hosts(PyObject *self, PyObject *args);
+static PyObject *record_hosts(PyObject *self, PyObject *args);
 
 /* the default name of the Python module to use for the pdsh functionality */
 #define PDSHPY_PYTHON_MODULE "pdshpy_module"
@@ -53,26 +75,118 @@ static PyObject *pdshpy_rcmd_register_defaults(PyObject *self, PyObject *args);
  * debug statements */
 #define PDSHPY_ENVIRON_DEBUG "PDSHPY_DEBUG"
 
-/* this will be output in front of output lines */
-#define PDSHPY_LOG_PREFIX "pdshpy"
-
-static int debuglevel = 0;
+/* set the environment variable with this name to the path of a pdshpy
+ * server's socket to have the driver module run there instead of in an
+ * interpreter inside this process. See pdshpy/server.py. */
+#define PDSHPY_ENVIRON_SERVER "PDSHPY_SERVER"
+
+/* set the environment variable with this name to a positive number to have
+ * pdshpy start a forking pdshpy server on the PDSHPY_SERVER socket when
+ * there isn't one running yet. PDSHPY_PYTHON names the interpreter to use. */
+#define PDSHPY_ENVIRON_SERVER_AUTOSTART "PDSHPY_SERVER_AUTOSTART"
+#define PDSHPY_ENVIRON_PYTHON "PDSHPY_PYTHON"
+
+/* set the environment variable with this name to a directory to have each
+ * driver callback run under a profiler, with the results written there when
+ * pdsh is done. PDSHPY_PROFILE_MODE picks "cprofile" (the default) or
+ * "sample", and PDSHPY_PROFILE_INTERVAL the sampling interval in
+ * milliseconds. See pdshpy/profiling.py. */
+#define PDSHPY_ENVIRON_PROFILE "PDSHPY_PROFILE"
+#define PDSHPY_ENVIRON_PROFILE_MODE "PDSHPY_PROFILE_MODE"
+#define PDSHPY_ENVIRON_PROFILE_INTERVAL "PDSHPY_PROFILE_INTERVAL"
+
+/* the Python module which does the profiling */
+#define PDSHPY_PROFILING_MODULE "pdshpy.profiling"
+
+/* default sampling interval for PDSHPY_PROFILE_MODE=sample, in ms */
+#define PDSHPY_PROFILE_DEFAULT_INTERVAL 5
+
+/* set the environment variable with this name to a positive number to have
+ * pdshpy trace the interpreter's allocations with tracemalloc (where the
+ * Python has it), so the memory report says how much of each phase's growth
+ * was Python objects. Slows everything down considerably. */
+#define PDSHPY_ENVIRON_TRACEMALLOC "PDSHPY_TRACEMALLOC"
+
+/* set the environment variable with this name to a number of seconds (which
+ * may be fractional) to bound each driver callback by. A collect_hosts()
+ * which runs over gives way to the hosts last cached for its key, or to
+ * whatever hosts it had produced by then; other callbacks which run over
+ * fail. */
+#define PDSHPY_ENVIRON_CALLBACK_TIMEOUT "PDSHPY_CALLBACK_TIMEOUT"
+
+/* set the environment variable with this name to a positive number to have
+ * each chained driver after the first loaded into a subinterpreter of its
+ * own, with its own GIL, so that their host sources and prefetches can run
+ * in parallel. Needs Python 3.12 or later; ignored otherwise. */
+#define PDSHPY_ENVIRON_SUBINTERPRETERS "PDSHPY_SUBINTERPRETERS"
+
+int pdshpy_debuglevel = 0;
 static int options_registered = 0;
 
-#define DBG(tmpl, args...) \
-    ({ if (debuglevel > 0) \
-            fprintf(stderr, PDSHPY_LOG_PREFIX ": " tmpl "\n", ## args); })
+/* nonzero when the driver is being run by a pdshpy server */
+static int server_mode = 0;
+
+/* name of the driver module, for reporting */
+static const char *driver_name = NULL;
+
+/* what the driver said to cache collect_hosts() results under, if anything,
+ * and for how long (-1 for the default). See cache.h. */
+static char *cache_key = NULL;
+static int cache_ttl = -1;
 
-#define ERR(tmpl, args...) \
-    ({ fprintf(stderr, PDSHPY_LOG_PREFIX ": " tmpl "\n", ## args); })
+/* PDSHPY_CALLBACK_TIMEOUT, in seconds; 0 for no limit */
+static double callback_budget = 0;
 
 #define PYERR(tmpl, args...) \
     ({ ERR(tmpl, ## args); PyErr_Print(); })
 
-static PyObject *pymodule = NULL;
-static PyObject *pymodule_util = NULL;
-static PyObject *pymodule_internal = NULL;
-static PyObject *pymodule_data = NULL;
+/* An interpreter drivers run in, with the pdshpy modules and the session
+ * object as seen from inside it. Normally there's only the main one. */
+struct interp {
+    /* a subinterpreter's thread state, while pdsh isn't running in it; NULL
+     * for the main interpreter */
+    PyThreadState *tstate;
+    PyObject *util;
+    PyObject *internal;
+    PyObject *data;
+    /* the HostList wrapping opt->wcoll in the PdshOpts object last made */
+    PyObject *wcoll_wrapper;
+    /* the host sources being collected from, during collection */
+    PyObject *collectors;
+};
+
+struct driver {
+    PyObject *module;
+    struct interp *interp;
+};
+
+static struct interp main_interp;
+
+/* the driver modules, in the order they were named */
+static struct driver *drivers = NULL;
+static int ndrivers = 0;
+
+/* nonzero when drivers after the first get subinterpreters of their own */
+static int subinterpreters = 0;
+
+/* the interpreter each option letter was registered from */
+static struct interp *option_interp[256];
+
+/* with subinterpreters, driver code can call back into pdsh from several
+ * threads at once */
+static pthread_mutex_t pdsh_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* a pdshpy.profiling.Profiler, when PDSHPY_PROFILE is set */
+static PyObject *profiler = NULL;
+
+/* tracemalloc.get_traced_memory, when PDSHPY_TRACEMALLOC is set */
+static PyObject *traced_memory = NULL;
+
+/* nonzero while the driver's prefetch_hosts() may be running on its own
+ * thread. Until it's been joined, the GIL is let go whenever control goes
+ * back to pdsh, so that the thread can get on with it. */
+static int prefetching = 0;
+static PyThreadState *released_thread = NULL;
 
 struct pdsh_module_operations pdshpy_module_ops = {
     (ModInitF)       pdshpy_init,
@@ -106,34 +220,97 @@ static PyMethodDef pdshpy_methods[] = {
      "Register a pdsh option to be recognized by this module."},
     {"_rcmd_register_defaults", pdshpy_rcmd_register_defaults, METH_VARARGS,
      "Register default rcmd parameters for given hosts"},
+    {"_set_cache_key", set_cache_key, METH_VARARGS,
+     "Set the key to cache collect_hosts() results under"},
+    {"_probe_hosts", probe_hosts, METH_VARARGS,
+     "A HostList of the hosts which don't accept a connection on a port"},
+    {"_record_hosts", record_hosts, METH_VARARGS,
+     "Record hosts as unreachable, or as reachable again"},
     {NULL, NULL, 0, NULL}
 };
 
+#if PY_MAJOR_VERSION >= 3
+
+/* Python 3's _pdshpy_internal uses multi-phase initialization, so that each
+ * interpreter gets a module (and a HostList type) of its own. Its state is
+ * the struct interp it belongs to, filled in by setup_interp(). */
+static int
+internal_exec(PyObject *module)
+{
+    if (pyhostlist_init(module) < 0 || pyhostdb_init(module) < 0
+        || pyhostexpr_init(module) < 0 || pyhostpat_init(module) < 0)
+        return -1;
+    return pyhostbatch_init(module);
+}
+
+static PyModuleDef_Slot internal_slots[] = {
+    {Py_mod_exec, (void *)internal_exec},
+#if PDSHPY_HAVE_SUBINTERPRETERS
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+    {0, NULL}
+};
+
+static struct PyModuleDef internal_def = {
+    PyModuleDef_HEAD_INIT,
+    PDSHPY_PYTHON_INTERNAL,
+    NULL,
+    sizeof(struct interp *),
+    pdshpy_methods,
+    internal_slots,
+    NULL,
+    NULL,
+    NULL,
+};
+
 static PyObject *
-register_option(PyObject *self, PyObject *args)
+internal_init(void)
 {
-    const char *opt_letter_str = NULL;
-    const char *argmeta = NULL;
-    const char *desc = NULL;
-    int personality = 0;
-    struct pdsh_module_option *new_opt_table = NULL;
+    return PyModuleDef_Init(&internal_def);
+}
 
-    if (!PyArg_ParseTuple(args, "sziz",
-                          &opt_letter_str, &argmeta, &personality, &desc))
-        return NULL;
+static struct interp *
+interp_of(PyObject *module)
+{
+    struct interp **state = PyModule_GetState(module);
 
-    if (opt_letter_str[0] == '\0')
-    {
-        PyErr_SetString(PyExc_ValueError,
-                        "Option letter must not be the empty string");
-        return NULL;
-    }
-    if (opt_letter_str[1] != '\0')
-    {
-        PyErr_SetString(PyExc_ValueError,
-                        "Option letter string must be exactly one character");
+    return (state != NULL && *state != NULL) ? *state : &main_interp;
+}
+
+#else
+
+#define interp_of(module) (&main_interp)
+
+#endif
+
+/* Switch from the main interpreter to 'in', if it's a subinterpreter.
+ * Returns what to pass to leave_interp() to switch back. */
+static PyThreadState *
+enter_interp(struct interp *in)
+{
+    PyThreadState *prev = NULL;
+
+    if (in->tstate == NULL)
         return NULL;
-    }
+    prev = PyEval_SaveThread();
+    PyEval_RestoreThread(in->tstate);
+    return prev;
+}
+
+static void
+leave_interp(struct interp *in, PyThreadState *prev)
+{
+    if (prev == NULL)
+        return;
+    in->tstate = PyEval_SaveThread();
+    PyEval_RestoreThread(prev);
+}
+
+int
+pdshpy_add_option(char opt, const char *argmeta, int personality,
+                  const char *desc)
+{
+    struct pdsh_module_option *new_opt_table = NULL;
 
     /* It looks pretty safe to mess with this module option table after
      * module initialization with the current pdsh code, but I don't think
@@ -152,7 +329,7 @@ register_option(PyObject *self, PyObject *args)
     pdsh_module_info.opt_table = new_opt_table;
     new_opt_table = &new_opt_table[options_registered - 1];
 
-    new_opt_table->opt = opt_letter_str[0];
+    new_opt_table->opt = opt;
     new_opt_table->arginfo = Strdup(argmeta);
     new_opt_table->descr = Strdup(desc);
     new_opt_table->personality = personality;
@@ -161,11 +338,46 @@ register_option(PyObject *self, PyObject *args)
     bzero(&new_opt_table[1], sizeof(struct pdsh_module_option));
 
     if (!opt_register(new_opt_table))
+        return -1;
+    return 0;
+}
+
+static PyObject *
+register_option(PyObject *self, PyObject *args)
+{
+    const char *opt_letter_str = NULL;
+    const char *argmeta = NULL;
+    const char *desc = NULL;
+    int personality = 0;
+    int rc = 0;
+
+    if (!PyArg_ParseTuple(args, "sziz",
+                          &opt_letter_str, &argmeta, &personality, &desc))
+        return NULL;
+
+    if (opt_letter_str[0] == '\0')
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "Option letter must not be the empty string");
+        return NULL;
+    }
+    if (opt_letter_str[1] != '\0')
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "Option letter string must be exactly one character");
+        return NULL;
+    }
+
+    pthread_mutex_lock(&pdsh_lock);
+    rc = pdshpy_add_option(opt_letter_str[0], argmeta, personality, desc);
+    pthread_mutex_unlock(&pdsh_lock);
+    if (rc < 0)
     {
         PyErr_SetString(PyExc_ValueError,
                         "Pdsh refused to allow option to be registered");
         return NULL;
     }
+    option_interp[(unsigned char)opt_letter_str[0]] = interp_of(self);
 
     Py_RETURN_NONE;
 }
@@ -191,9 +403,13 @@ pdshpy_rcmd_register_defaults(PyObject *self, PyObject *args)
     nonconst_rcmd_module_name = Strdup(rcmd_module_name);
     nonconst_username = Strdup(username);
 
+    pthread_mutex_lock(&pdsh_lock);
     result = rcmd_register_defaults(nonconst_hostliststr,
                                     nonconst_rcmd_module_name,
                                     nonconst_username);
+    pthread_mutex_unlock(&pdsh_lock);
+    PDSHPY_PROBE4(rcmd_register, hostliststr, rcmd_module_name, username,
+                  result);
 
     Free((void **)(&nonconst_hostliststr));
     Free((void **)(&nonconst_rcmd_module_name));
@@ -214,50 +430,266 @@ pdshpy_rcmd_register_defaults(PyObject *self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+void
+pdshpy_set_cache_key(const char *key, int ttl)
+{
+    Free((void **)&cache_key);
+    cache_key = Strdup(key);
+    cache_ttl = ttl;
+}
+
 static PyObject *
-make_pyobject_from_hostlist(hostlist_t hl)
+set_cache_key(PyObject *self, PyObject *args)
 {
-    PyObject *pylist = NULL;
-    PyObject *listitem = NULL;
-    const char *item = NULL;
-    hostlist_iterator_t hli = NULL;
+    const char *key = NULL;
+    PyObject *pyttl = NULL;
+    int ttl = -1;
 
-    if (hl == NULL)
-        Py_RETURN_NONE;
+    if (!PyArg_ParseTuple(args, "zO", &key, &pyttl))
+        return NULL;
+    if (pyttl != Py_None)
+    {
+        ttl = PyInt_AsLong(pyttl);
+        if (ttl < 0)
+        {
+            if (!PyErr_Occurred())
+                PyErr_SetString(PyExc_ValueError,
+                                "Cache TTL must not be negative");
+            return NULL;
+        }
+    }
+
+    pthread_mutex_lock(&pdsh_lock);
+    pdshpy_set_cache_key(key, ttl);
+    pthread_mutex_unlock(&pdsh_lock);
+    Py_RETURN_NONE;
+}
 
-    if ((hli = hostlist_iterator_create(hl)) == NULL)
+/* the hosts in 'hl', as an array of 'n' malloc'd names; NULL if there's no
+ * memory */
+static char **
+hostlist_names(hostlist_t hl, size_t *n)
+{
+    hostlist_iterator_t it = NULL;
+    char **names = NULL;
+    char *host = NULL;
+    size_t count = hostlist_count(hl);
+
+    *n = 0;
+    if ((names = malloc((count + 1) * sizeof(*names))) == NULL)
+        return NULL;
+    if ((it = hostlist_iterator_create(hl)) == NULL)
     {
-        PyErr_SetString(PyExc_RuntimeError,
-                        "Could not allocate hostlist iterator");
+        free(names);
         return NULL;
     }
+    while (*n < count && (host = hostlist_next(it)) != NULL)
+        names[(*n)++] = host;
+    hostlist_iterator_destroy(it);
+    return names;
+}
+
+static void
+free_names(char **names, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        free(names[i]);
+    free(names);
+}
 
-    if ((pylist = PyList_New(0)) == NULL)
+static PyObject *
+probe_hosts(PyObject *self, PyObject *args)
+{
+    PyObject *hosts = NULL;
+    PyObject *result = NULL;
+    hostlist_t hl = NULL;
+    hostlist_t down = NULL;
+    unsigned char *state = NULL;
+    char **names = NULL;
+    double timeout = LIVENESS_DEFAULT_TIMEOUT / 1000.0;
+    size_t n = 0, i;
+    int port, up;
+
+    if (!PyArg_ParseTuple(args, "Oi|d", &hosts, &port, &timeout))
+        return NULL;
+    if (port <= 0 || port > 65535 || timeout <= 0)
     {
-        hostlist_iterator_destroy(hli);
+        PyErr_SetString(PyExc_ValueError,
+                        "Port must be from 1 to 65535, and timeout positive");
         return NULL;
     }
 
-    for (item = hostlist_next(hli); item; item = hostlist_next(hli))
+    if ((hl = hostlist_create(NULL)) == NULL)
+        return PyErr_NoMemory();
+    if (pyhostlist_push_hosts(hl, hosts) < 0)
+        goto out;
+    if ((names = hostlist_names(hl, &n)) == NULL
+        || (state = malloc(n + 1)) == NULL
+        || (down = hostlist_create(NULL)) == NULL)
     {
-        if ((listitem = PyString_FromString(item)) == NULL)
-        {
-            hostlist_iterator_destroy(hli);
-            Py_DECREF(pylist);
-            return NULL;
-        }
-        if (PyList_Append(pylist, listitem) < 0)
-        {
-            hostlist_iterator_destroy(hli);
-            Py_DECREF(listitem);
-            Py_DECREF(pylist);
-            return NULL;
-        }
-        Py_DECREF(listitem);
+        PyErr_NoMemory();
+        goto out;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    up = liveness_check(names, n, port, (int)(timeout * 1000 + 0.5), state);
+    Py_END_ALLOW_THREADS
+    if (up < 0)
+    {
+        PyErr_SetFromErrno(PyExc_OSError);
+        goto out;
     }
 
-    hostlist_iterator_destroy(hli);
-    return pylist;
+    for (i = 0; i < n; i++)
+        if (state[i] != LIVENESS_UP)
+            hostlist_push_host(down, names[i]);
+    if ((result = pyhostlist_wrap(self, down)) != NULL)
+    {
+        pyhostlist_release(result, 1);
+        down = NULL;
+    }
+
+out:
+    if (down != NULL)
+        hostlist_destroy(down);
+    hostlist_destroy(hl);
+    if (names != NULL)
+        free_names(names, n);
+    free(state);
+    return result;
+}
+
+/* whether unreachable hosts are being remembered (see check_deadhosts()) */
+static int
+deadhosts_on(void)
+{
+    const char *mode = getenv(PDSHPY_ENVIRON_DEADHOSTS);
+
+    return mode != NULL && mode[0] != '\0';
+}
+
+/* Record the hosts in 'hl' as unreachable (with 'down') or reachable, if
+ * PDSHPY_DEADHOSTS is on. Returns -1 with errno set if they can't be. */
+static int
+record_names(hostlist_t hl, int down)
+{
+    unsigned char *flags = NULL;
+    char **names = NULL;
+    size_t n = 0;
+    int rc = -1;
+
+    if (!deadhosts_on())
+        return 0;
+    if ((names = hostlist_names(hl, &n)) == NULL
+        || (flags = malloc(n + 1)) == NULL)
+    {
+        errno = ENOMEM;
+        goto out;
+    }
+    memset(flags, down, n);
+    rc = deadhosts_update(names, n, flags);
+
+out:
+    if (names != NULL)
+        free_names(names, n);
+    free(flags);
+    return rc;
+}
+
+int
+pdshpy_record_hosts(const char *hosts, int down)
+{
+    hostlist_t hl = NULL;
+    int rc = 0;
+
+    if ((hl = hostlist_create(hosts)) == NULL)
+        return -1;
+    rc = record_names(hl, down);
+    hostlist_destroy(hl);
+    return rc;
+}
+
+static PyObject *
+record_hosts(PyObject *self, PyObject *args)
+{
+    PyObject *hosts = NULL;
+    hostlist_t hl = NULL;
+    int down = 1;
+    int rc = 0;
+
+    if (!PyArg_ParseTuple(args, "Oi", &hosts, &down))
+        return NULL;
+    if ((hl = hostlist_create(NULL)) == NULL)
+        return PyErr_NoMemory();
+    if (pyhostlist_push_hosts(hl, hosts) < 0)
+    {
+        hostlist_destroy(hl);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    rc = record_names(hl, down != 0);
+    Py_END_ALLOW_THREADS
+    hostlist_destroy(hl);
+    if (rc < 0)
+        return PyErr_SetFromErrno(PyExc_OSError);
+    Py_RETURN_NONE;
+}
+
+/* Roughly how much memory pdsh's hostlist implementation uses for a list:
+ * for each range of hosts, a slot in the list's array, a struct hostrange
+ * (prefix pointer, lo, hi, width, flag) and the malloc'd prefix, whose length
+ * is guessed from the average host name length.
+ */
+static uint64_t
+hostlist_size_estimate(hostlist_t hl, uint64_t nhosts, uint64_t nbytes)
+{
+    uint64_t nranges = hostlist_nranges(hl);
+    uint64_t avglen = nhosts ? nbytes / nhosts : 0;
+
+    return 64 + nranges * (sizeof(void *) + 2 * sizeof(void *)
+                           + 2 * sizeof(unsigned long) + avglen + 1);
+}
+
+/* Add one host to 'hl'. Returns -1 with a Python exception set if it
+ * can't. */
+static int
+push_pyhost(hostlist_t hl, PyObject *host, uint64_t *nhosts, uint64_t *nbytes)
+{
+    PyObject *hoststrpy = NULL;
+    const char *hoststr = NULL;
+    Py_ssize_t len = 0;
+
+    if ((hoststrpy = pdshpy_host_str(host)) == NULL)
+        return -1;
+
+    /* hoststr belongs to hoststrpy, which may be a brand new object */
+    if ((hoststr = pdshpy_string_and_size(hoststrpy, &len)) == NULL)
+    {
+        Py_DECREF(hoststrpy);
+        return -1;
+    }
+    if (!hostlist_push_host(hl, hoststr))
+    {
+        Py_DECREF(hoststrpy);
+        PyErr_SetString(PyExc_RuntimeError, "Could not add to hostlist");
+        return -1;
+    }
+    *nbytes += len;
+    (*nhosts)++;
+    Py_DECREF(hoststrpy);
+    return 0;
+}
+
+/* Things which collect_hosts() can produce as a batch of hosts rather than
+ * as a single host. Strings are always single hosts. */
+static int
+is_host_batch(PyObject *obj)
+{
+    return PyList_Check(obj) || PyTuple_Check(obj) || PyAnySet_Check(obj)
+        || PyGen_Check(obj);
 }
 
 static hostlist_t
@@ -265,9 +697,12 @@ make_hostlist_from_pyobject(PyObject *pylist)
 {
     hostlist_t hl = NULL;
     PyObject *pyiter = NULL;
+    PyObject *batchiter = NULL;
     PyObject *nexthost = NULL;
-    PyObject *hoststrpy = NULL;
-    const char *hoststr = NULL;
+    PyObject *batchhost = NULL;
+    struct metrics_mark mark;
+    uint64_t nhosts = 0;
+    uint64_t nbytes = 0;
 
     if ((hl = hostlist_create(NULL)) == NULL)
     {
@@ -278,41 +713,143 @@ make_hostlist_from_pyobject(PyObject *pylist)
     if (pylist == Py_None)
         return hl;
 
+    /* already in pdsh's form; nothing to convert */
+    if (pyhostlist_check(pylist))
+    {
+        hostlist_destroy(hl);
+        if ((hl = hostlist_copy(pyhostlist_get(pylist))) == NULL)
+            PyErr_SetString(PyExc_RuntimeError, "Could not allocate hostlist");
+        return hl;
+    }
+
+    metrics_begin(&mark);
+    PDSHPY_PROBE0(hosts_from_python__entry);
+
     if ((pyiter = PyObject_GetIter(pylist)) == NULL)
     {
         hostlist_destroy(hl);
+        metrics_end(PHASE_HOSTS_FROM_PYTHON, &mark);
+        PDSHPY_PROBE2(hosts_from_python__return, nhosts, nbytes);
         return NULL;
     }
 
     while ((nexthost = PyIter_Next(pyiter)) != NULL)
     {
-        hoststrpy = PyObject_Str(nexthost);
-        Py_DECREF(nexthost);
-        if (hoststrpy == NULL)
-            break;
+        if (pyhostlist_check(nexthost))
+        {
+            hostlist_push_list(hl, pyhostlist_get(nexthost));
+            Py_DECREF(nexthost);
+            continue;
+        }
+        if (!is_host_batch(nexthost))
+        {
+            int rc = push_pyhost(hl, nexthost, &nhosts, &nbytes);
 
-        hoststr = PyString_AsString(hoststrpy);
-        Py_DECREF(hoststrpy);
-        if (hoststr == NULL)
-            break;
+            Py_DECREF(nexthost);
+            if (rc < 0)
+                break;
+            continue;
+        }
 
-        if (!hostlist_push_host(hl, hoststr))
-        {
-            PyErr_SetString(PyExc_RuntimeError, "Could not add to hostlist");
+        /* one level of batches only; a batch inside a batch is a host */
+        batchiter = PyObject_GetIter(nexthost);
+        Py_DECREF(nexthost);
+        if (batchiter == NULL)
             break;
+        while ((batchhost = PyIter_Next(batchiter)) != NULL)
+        {
+            int rc = push_pyhost(hl, batchhost, &nhosts, &nbytes);
+
+            Py_DECREF(batchhost);
+            if (rc < 0)
+                break;
         }
+        Py_DECREF(batchiter);
+        if (PyErr_Occurred())
+            break;
     }
 
     Py_DECREF(pyiter);
+    metrics_end(PHASE_HOSTS_FROM_PYTHON, &mark);
+    PDSHPY_PROBE2(hosts_from_python__return, nhosts, nbytes);
     if (PyErr_Occurred())
     {
         hostlist_destroy(hl);
         return NULL;
     }
 
+    metrics_count(COUNT_HOSTS_FROM_PYTHON, nhosts);
+    metrics_count(COUNT_BYTES_FROM_PYTHON, nbytes);
+    metrics_count(COUNT_HOSTLIST_BYTES,
+                  hostlist_size_estimate(hl, nhosts, nbytes));
     return hl;
 }
 
+char *
+pdshpy_hostlist_ranged(hostlist_t hl)
+{
+    size_t bufsize = 1024;
+    char *buf = NULL;
+    char *newbuf = NULL;
+
+    for (;;)
+    {
+        if ((newbuf = realloc(buf, bufsize)) == NULL)
+        {
+            free(buf);
+            return NULL;
+        }
+        buf = newbuf;
+        if (hostlist_ranged_string(hl, bufsize, buf) >= 0)
+            return buf;
+        bufsize *= 2;
+    }
+}
+
+/* keep this in sync with the SETATTR and FILLATTR lists below, and with
+ * OPT_FIELDS in pdshpy/server.py */
+#define OPT_FIELD(name, type) { #name, PDSHPY_OPT_ ## type, \
+                                offsetof(opt_t, name) }
+
+const struct pdshpy_opt_field pdshpy_opt_fields[] = {
+    OPT_FIELD(progname, STR),
+    OPT_FIELD(debug, BOOL),
+    OPT_FIELD(info_only, BOOL),
+    OPT_FIELD(test_range_expansion, BOOL),
+    OPT_FIELD(sdr_verify, BOOL),
+    OPT_FIELD(sdr_global, BOOL),
+    OPT_FIELD(altnames, BOOL),
+    OPT_FIELD(sigint_terminates, BOOL),
+    OPT_FIELD(luser, STR),
+    OPT_FIELD(luid, UID),
+    OPT_FIELD(ruser, STR),
+    OPT_FIELD(fanout, INT),
+    OPT_FIELD(connect_timeout, INT),
+    OPT_FIELD(command_timeout, INT),
+    OPT_FIELD(rcmd_name, STR),
+    OPT_FIELD(misc_modules, STR),
+    OPT_FIELD(resolve_hosts, BOOL),
+    OPT_FIELD(kill_on_fail, BOOL),
+    OPT_FIELD(separate_stderr, BOOL),
+    OPT_FIELD(stdin_unavailable, BOOL),
+    OPT_FIELD(cmd, STR),
+    OPT_FIELD(dshpath, STR),
+    OPT_FIELD(getstat, STR),
+    OPT_FIELD(ret_remote_rc, BOOL),
+    OPT_FIELD(labels, BOOL),
+    OPT_FIELD(preserve, BOOL),
+    OPT_FIELD(recursive, BOOL),
+    OPT_FIELD(outfile_name, STR),
+    OPT_FIELD(pcp_server, BOOL),
+    OPT_FIELD(target_is_directory, BOOL),
+    OPT_FIELD(pcp_client, BOOL),
+    OPT_FIELD(pcp_client_host, STR),
+    OPT_FIELD(local_program_path, STR),
+    OPT_FIELD(remote_program_path, STR),
+    OPT_FIELD(reverse_copy, BOOL),
+    { NULL, 0, 0 }
+};
+
 static PyObject *
 PyString_FromStringOrNull(const char *str)
 {
@@ -330,28 +867,291 @@ PyIntOrNone_AsLong(PyObject *pyint)
         return PyInt_AsLong(pyint);
 }
 
+/* code flag for 'async def' functions */
+#ifdef CO_COROUTINE
+#define PDSHPY_CO_COROUTINE CO_COROUTINE
+#else
+#define PDSHPY_CO_COROUTINE 0x0080
+#endif
+
+/* Whether 'func' is a coroutine function ('async def', or decorated with
+ * asyncio.coroutine), which has to be run on an event loop. Checked without
+ * importing anything, so synchronous drivers pay nothing for it.
+ */
+static int
+is_coroutine_function(PyObject *func)
+{
+    PyObject *marker = NULL;
+    int rc = 0;
+
+    if (PyMethod_Check(func))
+        func = PyMethod_GET_FUNCTION(func);
+    if (PyFunction_Check(func)
+        && (((PyCodeObject *)PyFunction_GET_CODE(func))->co_flags
+            & PDSHPY_CO_COROUTINE))
+        return 1;
+    if ((marker = PyObject_GetAttrString(func, "_is_coroutine")) == NULL)
+    {
+        PyErr_Clear();
+        return 0;
+    }
+    rc = PyObject_IsTrue(marker);
+    Py_DECREF(marker);
+    if (rc < 0)
+        PyErr_Clear();
+    return rc > 0;
+}
+
 static PyObject *
-make_pyobject_from_pdsh_opt(opt_t *pdsh_opts)
+call_driver_va(struct interp *in, const char *phase, int collect,
+               PyObject *obj, const char *method, const char *format,
+               va_list ap)
 {
-    PyObject *pyopts = NULL;
+    PyObject *func = NULL;
+    PyObject *args = NULL;
+    PyObject *callee = NULL;
+    PyObject *callargs = NULL;
+    PyObject *result = NULL;
 
-    pyopts = PyObject_CallMethod(pymodule_util, "PdshOpts", NULL);
-    if (pyopts == NULL)
+    if ((func = PyObject_GetAttrString(obj, method)) == NULL)
         return NULL;
+    if ((args = Py_VaBuildValue(format, ap)) == NULL)
+        goto out;
 
-#define SETATTR(name, pyinitializer) ({                                 \
-    if ((PyObject_SetAttrString(pyopts, #name,                          \
-                                (pyinitializer)(pdsh_opts->name))) < 0) \
-    {                                                                   \
-        Py_DECREF(pyopts);                                              \
-        return NULL;                                                    \
-    }                                                                   \
-})
-
-#define SETATTR_INT(name)  SETATTR(name, PyInt_FromLong)
-#define SETATTR_BOOL(name) SETATTR(name, PyBool_FromLong)
+    /* coroutines are run to completion on the session's event loop */
+    if (is_coroutine_function(func))
+    {
+        PyObject *coroutine_args = NULL;
+
+        coroutine_args = Py_BuildValue("(OOO)", in->data, func, args);
+        Py_DECREF(func);
+        Py_DECREF(args);
+        func = PyObject_GetAttrString(in->util, "_run_coroutine");
+        args = coroutine_args;
+        if (func == NULL)
+        {
+            Py_XDECREF(args);
+            return NULL;
+        }
+        if (args == NULL)
+            goto out;
+    }
 
-#define SETATTR_STR(name)  SETATTR(name, PyString_FromStringOrNull)
+    /* the profiler belongs to the main interpreter */
+    if (profiler == NULL || in != &main_interp)
+    {
+        callee = func;
+        callargs = args;
+        Py_INCREF(callee);
+        Py_INCREF(callargs);
+    }
+    else if ((callee = PyObject_GetAttrString(profiler, "call")) == NULL
+             || (callargs = Py_BuildValue("(sOO)", phase, func, args)) == NULL)
+        goto out;
+
+    if (callback_budget > 0)
+        result = PyObject_CallMethod(in->util, "_call_with_deadline",
+                                     "dOOi", callback_budget, callee,
+                                     callargs, collect);
+    else
+        result = PyObject_CallObject(callee, callargs);
+
+out:
+    Py_XDECREF(callargs);
+    Py_XDECREF(callee);
+    Py_XDECREF(args);
+    Py_DECREF(func);
+    return result;
+}
+
+/* Call obj.method(*args), with args built from 'format' (which must produce
+ * a tuple) like Py_BuildValue, in interpreter 'in' (which must be the
+ * current one). All calls into the driver go through here, so that they can
+ * be profiled and held to PDSHPY_CALLBACK_TIMEOUT; 'phase' names the call
+ * for the profiler.
+ */
+static PyObject *
+call_driver(struct interp *in, const char *phase, PyObject *obj,
+            const char *method, const char *format, ...)
+{
+    PyObject *result = NULL;
+    va_list ap;
+
+    va_start(ap, format);
+    result = call_driver_va(in, phase, 0, obj, method, format, ap);
+    va_end(ap);
+    return result;
+}
+
+/* call_driver() for collect_hosts(). Sets *complete to 0 if it ran out of
+ * time, in which case what's returned is only the hosts it had produced by
+ * then.
+ */
+static PyObject *
+collect_from_driver(struct interp *in, int *complete, PyObject *obj,
+                    const char *method, const char *format, ...)
+{
+    PyObject *result = NULL;
+    PyObject *hosts = NULL;
+    va_list ap;
+
+    *complete = 1;
+    va_start(ap, format);
+    result = call_driver_va(in, "collect_hosts", 1, obj, method, format, ap);
+    va_end(ap);
+    if (result == NULL || callback_budget <= 0)
+        return result;
+
+    /* with a deadline, that's (hosts, done) */
+    if (!PyArg_ParseTuple(result, "Oi", &hosts, complete))
+    {
+        Py_DECREF(result);
+        return NULL;
+    }
+    Py_INCREF(hosts);
+    Py_DECREF(result);
+    return hosts;
+}
+
+static void
+start_profiler(const char *outdir)
+{
+    PyObject *pymodule_profiling = NULL;
+    const char *mode = NULL;
+    const char *intervalenv = NULL;
+    int interval = PDSHPY_PROFILE_DEFAULT_INTERVAL;
+
+    mode = getenv(PDSHPY_ENVIRON_PROFILE_MODE);
+    if (mode == NULL || mode[0] == '\0')
+        mode = "cprofile";
+    intervalenv = getenv(PDSHPY_ENVIRON_PROFILE_INTERVAL);
+    if (intervalenv != NULL && atoi(intervalenv) > 0)
+        interval = atoi(intervalenv);
+
+    pymodule_profiling = PyImport_ImportModule(PDSHPY_PROFILING_MODULE);
+    if (pymodule_profiling == NULL)
+    {
+        PYERR("Failed to import " PDSHPY_PROFILING_MODULE
+              "; not profiling");
+        return;
+    }
+    profiler = PyObject_CallMethod(pymodule_profiling, "Profiler", "ssi",
+                                   outdir, mode, interval);
+    Py_DECREF(pymodule_profiling);
+    if (profiler == NULL)
+    {
+        PYERR("Failed to start profiler; not profiling");
+        return;
+    }
+    DBG("Profiling driver callbacks (%s) into %s", mode, outdir);
+}
+
+static void
+stop_profiler(void)
+{
+    PyObject *written = NULL;
+    Py_ssize_t i;
+
+    if (profiler == NULL)
+        return;
+
+    written = PyObject_CallMethod(profiler, "finish", NULL);
+    if (written == NULL)
+        PYERR("Failed to write profiling results");
+    else
+    {
+        for (i = 0; PyList_Check(written) && i < PyList_GET_SIZE(written); i++)
+        {
+            DBG("Wrote profile %s",
+                PyString_AsString(PyList_GET_ITEM(written, i)));
+        }
+        Py_DECREF(written);
+    }
+    Py_DECREF(profiler);
+    profiler = NULL;
+}
+
+/* for metrics_set_python_memory(). This gets called in the middle of error
+ * handling, so it must leave any pending exception alone. */
+static int64_t
+python_memory(void)
+{
+    PyObject *type, *value, *traceback;
+    PyObject *result = NULL;
+    int64_t current = -1;
+
+    PyErr_Fetch(&type, &value, &traceback);
+    result = PyObject_CallObject(traced_memory, NULL);
+    if (result != NULL && PyTuple_Check(result) && PyTuple_GET_SIZE(result) > 0)
+        current = PyLong_AsLongLong(PyTuple_GET_ITEM(result, 0));
+    Py_XDECREF(result);
+    PyErr_Clear();
+    PyErr_Restore(type, value, traceback);
+    return current;
+}
+
+static void
+start_tracemalloc(void)
+{
+    PyObject *tracemalloc = NULL;
+    PyObject *result = NULL;
+
+    if ((tracemalloc = PyImport_ImportModule("tracemalloc")) == NULL)
+    {
+        PyErr_Clear();
+        ERR("tracemalloc is not available in this Python; not tracing "
+            "allocations");
+        return;
+    }
+    result = PyObject_CallMethod(tracemalloc, "start", NULL);
+    if (result != NULL)
+        traced_memory = PyObject_GetAttrString(tracemalloc,
+                                               "get_traced_memory");
+    Py_XDECREF(result);
+    Py_DECREF(tracemalloc);
+    if (traced_memory == NULL)
+    {
+        PYERR("Failed to start tracemalloc");
+        return;
+    }
+    metrics_set_python_memory(python_memory);
+}
+
+static void
+stop_tracemalloc(void)
+{
+    metrics_set_python_memory(NULL);
+    Py_XDECREF(traced_memory);
+    traced_memory = NULL;
+}
+
+static PyObject *
+make_pyobject_from_pdsh_opt(struct interp *in, opt_t *pdsh_opts)
+{
+    PyObject *pyopts = NULL;
+    PyObject *attrval = NULL;
+    struct metrics_mark mark;
+    int rc = 0;
+
+    metrics_begin(&mark);
+    pyopts = PyObject_CallMethod(in->util, "PdshOpts", NULL);
+    if (pyopts == NULL)
+        goto fail;
+
+#define SETATTR(name, pyinitializer) ({                                 \
+    attrval = (pyinitializer)(pdsh_opts->name);                         \
+    if (attrval == NULL)                                                \
+        goto fail;                                                      \
+    rc = PyObject_SetAttrString(pyopts, #name, attrval);                \
+    Py_DECREF(attrval);                                                 \
+    if (rc < 0)                                                         \
+        goto fail;                                                      \
+})
+
+#define SETATTR_INT(name)  SETATTR(name, PyInt_FromLong)
+#define SETATTR_BOOL(name) SETATTR(name, PyBool_FromLong)
+
+#define SETATTR_STR(name)  SETATTR(name, PyString_FromStringOrNull)
 
     SETATTR_STR(progname);
     SETATTR_BOOL(debug);
@@ -395,7 +1195,20 @@ make_pyobject_from_pdsh_opt(opt_t *pdsh_opts)
     SETATTR_STR(remote_program_path);
     SETATTR_BOOL(reverse_copy);
 
-    SETATTR(wcoll, make_pyobject_from_hostlist);
+    /* the driver works on pdsh's own hostlist, through a HostList, rather
+     * than on a copy; see release_pyopts() */
+    Py_CLEAR(in->wcoll_wrapper);
+    if (pdsh_opts->wcoll == NULL)
+        rc = PyObject_SetAttrString(pyopts, "wcoll", Py_None);
+    else
+    {
+        in->wcoll_wrapper = pyhostlist_wrap(in->internal, pdsh_opts->wcoll);
+        if (in->wcoll_wrapper == NULL)
+            goto fail;
+        rc = PyObject_SetAttrString(pyopts, "wcoll", in->wcoll_wrapper);
+    }
+    if (rc < 0)
+        goto fail;
 
     /* the one option attribute I didn't bother adding:
      *    List infile_names;
@@ -403,23 +1216,34 @@ make_pyobject_from_pdsh_opt(opt_t *pdsh_opts)
      * I don't think I care about it right now.
      */
 
+    metrics_end(PHASE_OPTS_TO_PYTHON, &mark);
     return pyopts;
+
+fail:
+    Py_XDECREF(pyopts);
+    metrics_end(PHASE_OPTS_TO_PYTHON, &mark);
+    return NULL;
 }
 
 static int
-fill_pdshopt_from_pyobject(opt_t *pdsh_opts, PyObject *pyopts)
+fill_pdshopt_from_pyobject(struct interp *in, opt_t *pdsh_opts,
+                           PyObject *pyopts)
 {
     PyObject *val = NULL;
     PyObject *strval = NULL;
+    const char *str = NULL;
+    struct metrics_mark mark;
+
+    metrics_begin(&mark);
 
 #define FILLATTR(name, pyextractor) ({                                  \
     val = PyObject_GetAttrString(pyopts, #name);                        \
     if (val == NULL)                                                    \
-        return 0;                                                       \
+        goto fail;                                                      \
     pdsh_opts->name = (pyextractor)(val);                               \
     Py_DECREF(val);                                                     \
     if (PyErr_Occurred())                                               \
-        return 0;                                                       \
+        goto fail;                                                      \
 })
 
 #define FILLATTR_INT(name)  FILLATTR(name, PyIntOrNone_AsLong)
@@ -428,7 +1252,7 @@ fill_pdshopt_from_pyobject(opt_t *pdsh_opts, PyObject *pyopts)
 #define FILLATTR_STR(name) ({                                           \
     val = PyObject_GetAttrString(pyopts, #name);                        \
     if (val == NULL)                                                    \
-        return 0;                                                       \
+        goto fail;                                                      \
     if (val == Py_None)                                                 \
     {                                                                   \
         if (pdsh_opts->name != NULL)                                    \
@@ -437,21 +1261,25 @@ fill_pdshopt_from_pyobject(opt_t *pdsh_opts, PyObject *pyopts)
     }                                                                   \
     else                                                                \
     {                                                                   \
-        strval = PyObject_Bytes(val);                                   \
+        strval = PyObject_Str(val);                                     \
         Py_DECREF(val);                                                 \
         if (strval == NULL)                                             \
-            return 0;                                                   \
+            goto fail;                                                  \
+        if ((str = PyString_AsString(strval)) == NULL)                  \
+        {                                                               \
+            Py_DECREF(strval);                                          \
+            goto fail;                                                  \
+        }                                                               \
         if (pdsh_opts->name == NULL)                                    \
-            pdsh_opts->name = Strdup(PyBytes_AsString(strval));         \
-        else if (strcmp(pdsh_opts->name, PyBytes_AsString(strval)))     \
+            pdsh_opts->name = Strdup(str);                              \
+        else if (strcmp(pdsh_opts->name, str))                          \
         {                                                               \
             Free((void **)&(pdsh_opts->name));                          \
-            pdsh_opts->name = Strdup(PyBytes_AsString(strval));         \
-            Py_DECREF(strval);                                          \
-            if (pdsh_opts->name == NULL)                                \
-                return 0;                                               \
+            pdsh_opts->name = Strdup(str);                              \
         }                                                               \
         Py_DECREF(strval);                                              \
+        if (pdsh_opts->name == NULL)                                    \
+            goto fail;                                                  \
     }                                                                   \
 })
 
@@ -499,8 +1327,22 @@ fill_pdshopt_from_pyobject(opt_t *pdsh_opts, PyObject *pyopts)
 
     val = PyObject_GetAttrString(pyopts, "wcoll");
     if (val == NULL)
-        return 0;
-    hostlist_destroy(pdsh_opts->wcoll);
+        goto fail;
+    if (val == in->wcoll_wrapper && pdsh_opts->wcoll != NULL
+        && pyhostlist_get(val) == pdsh_opts->wcoll)
+    {
+        /* changed in place, if at all */
+        Py_DECREF(val);
+        metrics_end(PHASE_OPTS_FROM_PYTHON, &mark);
+        return 1;
+    }
+    /* replaced: the old hostlist goes with its HostList, which the driver
+     * may still have hold of */
+    if (in->wcoll_wrapper != NULL
+        && pyhostlist_get(in->wcoll_wrapper) == pdsh_opts->wcoll)
+        pyhostlist_release(in->wcoll_wrapper, 1);
+    else
+        hostlist_destroy(pdsh_opts->wcoll);
     if (val == Py_None)
         pdsh_opts->wcoll = NULL;
     else
@@ -509,21 +1351,191 @@ fill_pdshopt_from_pyobject(opt_t *pdsh_opts, PyObject *pyopts)
         if (pdsh_opts->wcoll == NULL)
         {
             Py_DECREF(val);
-            return 0;
+            goto fail;
         }
     }
     Py_DECREF(val);
+    metrics_end(PHASE_OPTS_FROM_PYTHON, &mark);
     return 1;
+
+fail:
+    metrics_end(PHASE_OPTS_FROM_PYTHON, &mark);
+    return 0;
+}
+
+/* Done with a PdshOpts object. If the driver kept hold of its wcoll, the
+ * HostList takes a copy, so it can't see pdsh's hostlist change under it (or
+ * go away) later.
+ */
+static void
+release_pyopts(struct interp *in, PyObject *pyopts)
+{
+    Py_DECREF(pyopts);
+    if (in->wcoll_wrapper != NULL)
+    {
+        pyhostlist_release(in->wcoll_wrapper, 0);
+        Py_CLEAR(in->wcoll_wrapper);
+    }
+}
+
+/* Close the event loop coroutine callbacks ran on, if there was one. */
+static void
+close_event_loop(struct interp *in)
+{
+    PyObject *result = NULL;
+
+    if (in->util == NULL || in->data == NULL)
+        return;
+    result = PyObject_CallMethod(in->util, "_close_event_loop", "O",
+                                 in->data);
+    if (result == NULL)
+        PYERR("Failed to close the driver's event loop");
+    Py_XDECREF(result);
+}
+
+/* Take the GIL back at an entry point, if it was let go of. */
+static void
+python_acquire(void)
+{
+    if (released_thread != NULL)
+    {
+        PyEval_RestoreThread(released_thread);
+        released_thread = NULL;
+    }
+}
+
+/* Let the GIL go on the way back out to pdsh, if a prefetch needs it. */
+static void
+python_release(void)
+{
+    if (prefetching && released_thread == NULL)
+        released_thread = PyEval_SaveThread();
+}
+
+static void
+start_prefetch(void)
+{
+    PyObject *func = NULL;
+    PyObject *result = NULL;
+    PyThreadState *prev = NULL;
+    struct driver *d = NULL;
+
+    for (d = drivers; d < drivers + ndrivers; d++)
+    {
+        prev = enter_interp(d->interp);
+        func = PyObject_GetAttrString(d->module, "prefetch_hosts");
+        if (func == NULL)
+        {
+            PyErr_Clear();
+            leave_interp(d->interp, prev);
+            continue;
+        }
+
+        DBG("Starting prefetch_hosts() in driver module %s.",
+            PyModule_GetName(d->module));
+
+        PyEval_InitThreads();
+        result = PyObject_CallMethod(d->interp->util, "_start_prefetch",
+                                     "OOs", func, d->interp->data,
+                                     PyModule_GetName(d->module));
+        Py_DECREF(func);
+        if (result == NULL)
+            PYERR("Failed to start driver module %s's prefetch_hosts()",
+                  PyModule_GetName(d->module));
+        else
+        {
+            Py_DECREF(result);
+            prefetching = 1;
+        }
+        leave_interp(d->interp, prev);
+    }
+}
+
+/* Tell the prefetches their answers aren't wanted. */
+static void
+cancel_prefetch(void)
+{
+    PyObject *result = NULL;
+    PyThreadState *prev = NULL;
+    struct driver *d = NULL;
+
+    if (!prefetching)
+        return;
+    prefetching = 0;
+    for (d = drivers; d < drivers + ndrivers; d++)
+    {
+        /* once per interpreter */
+        if (d > drivers && d->interp == d[-1].interp)
+            continue;
+        prev = enter_interp(d->interp);
+        result = PyObject_CallMethod(d->interp->util, "cancel_prefetch", "O",
+                                     d->interp->data);
+        if (result == NULL)
+            PYERR("Failed to cancel prefetch_hosts()");
+        Py_XDECREF(result);
+        leave_interp(d->interp, prev);
+    }
+}
+
+/* Wait for a driver module's prefetch_hosts() to finish (for as long as
+ * the callback budget allows) and return what it found, setting *complete
+ * to 0 if it had to be given up on. Returns NULL if there wasn't one, or it
+ * was cancelled or failed, when collect_hosts() has to be called after all.
+ */
+static PyObject *
+join_prefetch(struct driver *d, int *complete)
+{
+    PyObject *result = NULL;
+    PyObject *hosts = NULL;
+    struct metrics_mark mark;
+    const char *name = PyModule_GetName(d->module);
+
+    metrics_begin(&mark);
+    if (callback_budget > 0)
+        result = PyObject_CallMethod(d->interp->util, "_join_prefetch", "Osd",
+                                     d->interp->data, name, callback_budget);
+    else
+        result = PyObject_CallMethod(d->interp->util, "_join_prefetch", "Os",
+                                     d->interp->data, name);
+    metrics_end(PHASE_PREFETCH_WAIT, &mark);
+
+    if (result == NULL)
+    {
+        PYERR("Driver module %s's prefetch_hosts() function failed; calling "
+              "collect_hosts() instead", name);
+        return NULL;
+    }
+    if (result == Py_None)
+    {
+        Py_DECREF(result);
+        return NULL;
+    }
+    if (!PyArg_ParseTuple(result, "Oi", &hosts, complete))
+    {
+        PYERR("Unexpected result from prefetch");
+        Py_DECREF(result);
+        return NULL;
+    }
+    if (!*complete)
+        ERR("warning: %s prefetch_hosts() did not finish within %gs",
+            name, callback_budget);
+    else
+        DBG("Using hosts from %s prefetch_hosts().", name);
+    Py_INCREF(hosts);
+    Py_DECREF(result);
+    return hosts;
 }
 
 static int
-pdshpy_process_opt(opt_t *pdsh_opts, int opt, char *arg)
+process_opt_in_process(struct interp *in, opt_t *pdsh_opts, int opt,
+                       char *arg)
 {
     PyObject *pyopt = NULL;
     PyObject *result = NULL;
     int result_int = 0;
+    struct metrics_mark mark;
 
-    if ((pyopt = make_pyobject_from_pdsh_opt(pdsh_opts)) == NULL)
+    if ((pyopt = make_pyobject_from_pdsh_opt(in, pdsh_opts)) == NULL)
     {
         PYERR("Failed to construct PdshOpts object");
         return -1;
@@ -531,24 +1543,27 @@ pdshpy_process_opt(opt_t *pdsh_opts, int opt, char *arg)
 
     DBG("Calling process_option(%c, %s) in util module.", opt, arg);
 
-    result = PyObject_CallMethod(pymodule_util, "process_option", "csOO",
-                                 opt, arg, pyopt, pymodule_data);
+    metrics_begin(&mark);
+    result = call_driver(in, "process_option", in->util, "process_option",
+                         "(" PDSHPY_FMT_CHAR "sOO)", opt, arg, pyopt,
+                         in->data);
+    metrics_end(PHASE_PROCESS_OPTION, &mark);
 
     if (result == NULL)
     {
-        Py_DECREF(pyopt);
+        release_pyopts(in, pyopt);
         PYERR("Driver module's processing of option '%c' failed", opt);
         return -1;
     }
 
-    if (!fill_pdshopt_from_pyobject(pdsh_opts, pyopt))
+    if (!fill_pdshopt_from_pyobject(in, pdsh_opts, pyopt))
     {
-        Py_DECREF(pyopt);
+        release_pyopts(in, pyopt);
         Py_DECREF(result);
         PYERR("Driver module put invalid value in PdshOpts object");
         return -1;
     }
-    Py_DECREF(pyopt);
+    release_pyopts(in, pyopt);
 
     result_int = PyIntOrNone_AsLong(result);
     Py_DECREF(result);
@@ -562,225 +1577,1393 @@ pdshpy_process_opt(opt_t *pdsh_opts, int opt, char *arg)
 }
 
 static int
-pdshpy_init(void)
+pdshpy_process_opt(opt_t *pdsh_opts, int opt, char *arg)
 {
-    const char *debugenv = NULL;
-    const char *modulename = NULL;
-    PyObject *init_result = NULL;
-    PyObject *initializer = NULL;
-
-    debugenv = getenv(PDSHPY_ENVIRON_DEBUG);
-    if (debugenv != NULL)
-        debuglevel = atoi(debugenv);
+    struct interp *in = NULL;
+    PyThreadState *prev = NULL;
+    int rc = 0;
 
-    modulename = getenv(PDSHPY_ENVIRON_MODULENAME);
-    if (modulename == NULL)
-        modulename = PDSHPY_PYTHON_MODULE;
+    PDSHPY_PROBE2(process_option__entry, opt, arg);
+    if (server_mode)
+        rc = client_process_opt(pdsh_opts, opt, arg);
+    else
+    {
+        /* run it where the driver which registered it lives */
+        if ((in = option_interp[(unsigned char)opt]) == NULL)
+            in = &main_interp;
+        python_acquire();
+        prev = enter_interp(in);
+        rc = process_opt_in_process(in, pdsh_opts, opt, arg);
+        leave_interp(in, prev);
+        python_release();
+    }
+    PDSHPY_PROBE2(process_option__return, opt, rc);
+    return rc;
+}
 
-    Py_Initialize();
+/* Import the pdshpy modules into the current interpreter, and make its
+ * session object. */
+static int
+setup_interp(struct interp *in)
+{
+    struct metrics_mark mark;
 
     DBG("Initializing internal module object");
 
+#if PY_MAJOR_VERSION >= 3
+    in->internal = PyImport_ImportModule(PDSHPY_PYTHON_INTERNAL);
+    if (in->internal != NULL)
+        *(struct interp **)PyModule_GetState(in->internal) = in;
+#else
     /* borrowed reference */
-    pymodule_internal = Py_InitModule(PDSHPY_PYTHON_INTERNAL, pdshpy_methods);
-    if (pymodule_internal == NULL)
+    in->internal = Py_InitModule(PDSHPY_PYTHON_INTERNAL, pdshpy_methods);
+    Py_XINCREF(in->internal);
+#endif
+    if (in->internal == NULL)
     {
         PYERR("Failed to initialize internal module object");
         return -1;
     }
 
-    DBG("Importing util module");
-
-    pymodule_util = PyImport_ImportModule(PDSHPY_UTIL_MODULE);
-    if (pymodule_util == NULL)
+#if PY_MAJOR_VERSION < 3
+    if (pyhostlist_init(in->internal) < 0)
     {
-        if (debuglevel > 0)
-            PYERR("Failed to import util module " PDSHPY_UTIL_MODULE);
+        PYERR("Failed to initialize HostList type");
         return -1;
     }
-
-    DBG("Loading driver module: %s", modulename);
-
-    pymodule = PyImport_ImportModule(modulename);
-    if (pymodule == NULL)
+    if (pyhostdb_init(in->internal) < 0)
     {
-        if (debuglevel > 0)
-            PYERR("Failed to import driver module %s", modulename);
-        Py_DECREF(pymodule_util);
+        PYERR("Failed to initialize HostDB type");
         return -1;
     }
-
-    DBG("Loaded driver module: %s", PyModule_GetFilename(pymodule));
-
-    pymodule_data = PyObject_CallMethod(pymodule_util,
-                                        "PdshpyModuleData", NULL);
-    if (pymodule_data == NULL)
+    if (pyhostexpr_init(in->internal) < 0)
     {
-        PYERR("Failed to instantiate PdshpyModuleData");
-        Py_DECREF(pymodule);
-        Py_DECREF(pymodule_util);
+        PYERR("Failed to initialize HostExpr type");
         return -1;
     }
-
-    DBG("Calling initialize() in driver module.");
-
-    initializer = PyObject_GetAttrString(pymodule, "initialize");
-    if (initializer == NULL)
+    if (pyhostpat_init(in->internal) < 0)
     {
-        /* that's ok, it's optional */
-        PyErr_Clear();
+        PYERR("Failed to initialize HostPatterns type");
+        return -1;
     }
-    else
+    if (pyhostbatch_init(in->internal) < 0)
     {
-        init_result = PyObject_CallFunction(initializer, "O", pymodule_data);
-        Py_DECREF(initializer);
-
-        if (init_result == NULL)
-        {
-            PYERR("Driver module's initialize() function failed");
-            Py_DECREF(pymodule_data);
-            Py_DECREF(pymodule);
-            Py_DECREF(pymodule_util);
-            return -1;
-        }
-        Py_DECREF(init_result);
+        PYERR("Failed to initialize HostBatch type");
+        return -1;
     }
+#endif
 
-    DBG("Initialization complete.");
+    DBG("Importing util module");
 
+    metrics_begin(&mark);
+    in->util = PyImport_ImportModule(PDSHPY_UTIL_MODULE);
+    metrics_end(PHASE_IMPORT_UTIL, &mark);
+    if (in->util == NULL)
+    {
+        if (pdshpy_debuglevel > 0)
+            PYERR("Failed to import util module " PDSHPY_UTIL_MODULE);
+        return -1;
+    }
+
+    in->data = PyObject_CallMethod(in->util, "PdshpyModuleData", NULL);
+    if (in->data == NULL)
+    {
+        PYERR("Failed to instantiate PdshpyModuleData");
+        return -1;
+    }
     return 0;
 }
 
-static int
-pdshpy_fini(void)
+/* Done with the pdshpy modules in the current interpreter. */
+static void
+teardown_interp(struct interp *in)
 {
-    int i;
+    close_event_loop(in);
+    Py_CLEAR(in->collectors);
+    Py_CLEAR(in->wcoll_wrapper);
+    Py_CLEAR(in->data);
+    Py_CLEAR(in->util);
+    Py_CLEAR(in->internal);
+}
 
-    DBG("Unloading.");
+#if PDSHPY_HAVE_SUBINTERPRETERS
 
-    Py_DECREF(pymodule_data);
-    pymodule_data = NULL;
-    Py_DECREF(pymodule);
-    pymodule = NULL;
-    Py_DECREF(pymodule_util);
-    pymodule_util = NULL;
-    pymodule_internal = NULL;
+/* subinterpreters which couldn't be ended; Py_Finalize() isn't safe with
+ * them around */
+static int interps_left = 0;
 
-    for (i = 0; i < options_registered; ++i)
+/* Start a subinterpreter with a GIL of its own, and set pdshpy up in it.
+ * Returns with the main interpreter current again. */
+static struct interp *
+new_interp(void)
+{
+    PyInterpreterConfig config = {
+        .use_main_obmalloc = 0,
+        .allow_fork = 0,
+        .allow_exec = 1,
+        .allow_threads = 1,
+        .allow_daemon_threads = 1,
+        .check_multi_interp_extensions = 1,
+        .gil = PyInterpreterConfig_OWN_GIL,
+    };
+    PyThreadState *main_tstate = PyThreadState_Get();
+    PyThreadState *tstate = NULL;
+    struct interp *in = NULL;
+    PyStatus status;
+
+    status = Py_NewInterpreterFromConfig(&tstate, &config);
+    if (PyStatus_Exception(status))
     {
-        Free((void **)&pdsh_module_info.opt_table[i].arginfo);
-        Free((void **)&pdsh_module_info.opt_table[i].descr);
+        ERR("Failed to start a subinterpreter: %s",
+            status.err_msg != NULL ? status.err_msg : "unknown error");
+        return NULL;
     }
-    if (options_registered > 0)
-        free(pdsh_module_info.opt_table);
-
-    pdsh_module_info.opt_table = &null_option;
-    options_registered = 0;
 
-    Py_Finalize();
-    return 0;
+    in = Malloc(sizeof(struct interp));
+    memset(in, 0, sizeof(struct interp));
+    in->tstate = tstate;
+    if (setup_interp(in) < 0)
+    {
+        teardown_interp(in);
+        Py_EndInterpreter(tstate);
+        PyEval_RestoreThread(main_tstate);
+        Free((void **)&in);
+        return NULL;
+    }
+    leave_interp(in, main_tstate);
+    return in;
 }
 
-/* Called after option processing, and before postop. Append all appropriate
- * host results onto opt->wcoll.
- */
-static hostlist_t
-pdshpy_wcoll(opt_t *opt)
+/* Shut a subinterpreter down, unless it still has threads running (a
+ * prefetch or host source which was given up on, say), which it can't be
+ * ended under. Those are left be until the process exits. */
+static void
+end_interp(struct interp *in)
 {
-    PyObject *hostlist = NULL;
-    PyObject *pyopt = NULL;
-    hostlist_t hl = NULL;
+    PyThreadState *prev = enter_interp(in);
+    PyInterpreterState *interp = PyThreadState_GetInterpreter(in->tstate);
 
-    if ((pyopt = make_pyobject_from_pdsh_opt(opt)) == NULL)
+    teardown_interp(in);
+    if (PyInterpreterState_ThreadHead(interp) != in->tstate
+        || PyThreadState_Next(in->tstate) != NULL)
     {
-        PYERR("Failed to construct PdshOpts object");
-        return NULL;
+        DBG("Leaving a subinterpreter with threads still running.");
+        leave_interp(in, prev);
+        interps_left++;
+        return;
     }
+    Py_EndInterpreter(in->tstate);
+    PyEval_RestoreThread(prev);
+    Free((void **)&in);
+}
 
-    DBG("Calling collect_hosts() in driver module.");
+#endif /* PDSHPY_HAVE_SUBINTERPRETERS */
+
+/* Whether 'd' is the first driver in its interpreter. Drivers sharing one
+ * are next to each other. */
+static int
+first_in_interp(struct driver *d)
+{
+    return d == drivers || d->interp != d[-1].interp;
+}
 
-    hostlist = PyObject_CallMethod(pymodule, "collect_hosts", "OO",
-                                   pyopt, pymodule_data);
+static void
+unload_drivers(void)
+{
+    PyThreadState *prev = NULL;
+    struct driver *d = NULL;
 
-    if (hostlist == NULL)
+    for (d = drivers; d < drivers + ndrivers; d++)
     {
-        PYERR("Driver module collect_hosts() function failed");
-        Py_DECREF(pyopt);
-        return NULL;
+        prev = enter_interp(d->interp);
+        Py_XDECREF(d->module);
+        leave_interp(d->interp, prev);
+#if PDSHPY_HAVE_SUBINTERPRETERS
+        if (d->interp != &main_interp)
+            end_interp(d->interp);
+#endif
     }
+    Free((void **)&drivers);
+    ndrivers = 0;
+}
 
-    if (!fill_pdshopt_from_pyobject(opt, pyopt))
+/* Import the driver modules named in 'names', separated by commas, each
+ * after the first into a subinterpreter of its own if 'subinterpreters' is
+ * set. */
+static int
+load_drivers(const char *names)
+{
+    struct metrics_mark mark;
+    struct interp *in = NULL;
+    struct driver *d = NULL;
+    PyThreadState *prev = NULL;
+    const char *c = NULL;
+    char *copy = NULL;
+    char *name = NULL;
+    char *saveptr = NULL;
+    int n = 1;
+
+    /* one slot per comma-separated name, at most */
+    for (c = names; *c != '\0'; c++)
+        n += (*c == ',');
+    drivers = Malloc(n * sizeof(struct driver));
+
+    copy = Strdup(names);
+    for (name = strtok_r(copy, ",", &saveptr); name != NULL;
+         name = strtok_r(NULL, ",", &saveptr))
     {
-        Py_DECREF(hostlist);
-        Py_DECREF(pyopt);
-        PYERR("Driver module collect_hosts() function put an invalid value "
-              "in a PdshOpts object.");
-        return NULL;
+        while (*name == ' ')
+            name++;
+        if (*name == '\0')
+            continue;
+
+        in = &main_interp;
+#if PDSHPY_HAVE_SUBINTERPRETERS
+        if (subinterpreters && ndrivers > 0 && (in = new_interp()) == NULL)
+            goto fail;
+#endif
+        d = &drivers[ndrivers++];
+        d->interp = in;
+
+        DBG("Loading driver module: %s", name);
+
+        prev = enter_interp(in);
+        metrics_begin(&mark);
+        d->module = PyImport_ImportModule(name);
+        metrics_end(PHASE_IMPORT_DRIVER, &mark);
+        if (d->module == NULL)
+        {
+            if (pdshpy_debuglevel > 0)
+                PYERR("Failed to import driver module %s", name);
+            leave_interp(in, prev);
+            goto fail;
+        }
+
+        DBG("Loaded driver module: %s", pdshpy_module_filename(d->module));
+        leave_interp(in, prev);
     }
-    Py_DECREF(pyopt);
 
-    /* It's ok if this returns NULL; we're just going to return it anyway */
-    hl = make_hostlist_from_pyobject(hostlist);
-    Py_DECREF(hostlist);
+    if (ndrivers == 0)
+    {
+        ERR("No driver module named in %s", PDSHPY_ENVIRON_MODULENAME);
+        goto fail;
+    }
+    Free((void **)&copy);
+    return 0;
 
-    return hl;
+fail:
+    Free((void **)&copy);
+    unload_drivers();
+    return -1;
 }
 
-/* Can be used to filter the "working collective", as in -v with nodeupdown,
- * or -i with genders. Returns the total number of errors.
- */
+/* Call a driver module's initialize(), if it has one, in its interpreter
+ * (which must be the current one). */
 static int
-pdshpy_postop(opt_t *opt)
+initialize_driver(struct driver *d)
 {
     PyObject *result = NULL;
-    PyObject *pyopt = NULL;
-    int result_int = 0;
+    struct metrics_mark mark;
 
-    if ((pyopt = make_pyobject_from_pdsh_opt(opt)) == NULL)
-    {
-        PYERR("Failed to construct PdshOpts object");
-        return 1;
-    }
+    if (!PyObject_HasAttrString(d->module, "initialize"))
+        return 0;
 
-    DBG("Calling perform_postop() in driver module.");
+    DBG("Calling initialize() in driver module %s.",
+        PyModule_GetName(d->module));
 
-    result = PyObject_CallMethod(pymodule, "perform_postop", "OO",
-                                 pyopt, pymodule_data);
+    metrics_begin(&mark);
+    result = call_driver(d->interp, "initialize", d->module, "initialize",
+                         "(O)", d->interp->data);
+    metrics_end(PHASE_DRIVER_INITIALIZE, &mark);
 
     if (result == NULL)
     {
-        Py_DECREF(pyopt);
-        PYERR("Driver module perform_postop() function failed");
-        return 1;
+        PYERR("Driver module %s's initialize() function failed",
+              PyModule_GetName(d->module));
+        return -1;
     }
+    Py_DECREF(result);
+    return 0;
+}
 
-    if (!fill_pdshopt_from_pyobject(opt, pyopt))
-    {
-        Py_DECREF(pyopt);
-        Py_DECREF(result);
-        PYERR("Driver module perform_postop() function put an invalid value "
-              "in PdshOpts object.");
+static int
+pdshpy_init(void)
+{
+    const char *debugenv = NULL;
+    const char *modulename = NULL;
+    const char *serverpath = NULL;
+    const char *autostart = NULL;
+    const char *python = NULL;
+    const char *profiledir = NULL;
+    const char *tracemallocenv = NULL;
+    const char *budgetenv = NULL;
+    const char *subinterpenv = NULL;
+    PyThreadState *prev = NULL;
+    struct metrics_mark mark;
+    struct driver *d = NULL;
+    int rc = 0;
+#if PY_MAJOR_VERSION >= 3
+    static int inittab_added = 0;
+#endif
+
+    debugenv = getenv(PDSHPY_ENVIRON_DEBUG);
+    if (debugenv != NULL)
+        pdshpy_debuglevel = atoi(debugenv);
+
+    metrics_init();
+
+    callback_budget = 0;
+    budgetenv = getenv(PDSHPY_ENVIRON_CALLBACK_TIMEOUT);
+    if (budgetenv != NULL && atof(budgetenv) > 0)
+        callback_budget = atof(budgetenv);
+
+    modulename = getenv(PDSHPY_ENVIRON_MODULENAME);
+    if (modulename == NULL)
+        modulename = PDSHPY_PYTHON_MODULE;
+    driver_name = modulename;
+
+    serverpath = getenv(PDSHPY_ENVIRON_SERVER);
+    if (serverpath != NULL && serverpath[0] != '\0')
+    {
+        metrics_begin(&mark);
+        rc = client_connect(serverpath);
+        metrics_end(PHASE_SERVER_CONNECT, &mark);
+        if (rc < 0)
+        {
+            /* no server running; just do everything here */
+            DBG("Could not connect to pdshpy server at %s (%s); running "
+                "driver module in-process.", serverpath, strerror(errno));
+
+            /* this run pays full price, but the next ones won't (unless
+             * the socket is someone else's) */
+            autostart = getenv(PDSHPY_ENVIRON_SERVER_AUTOSTART);
+            if (autostart != NULL && atoi(autostart) > 0 && errno != EPERM)
+            {
+                python = getenv(PDSHPY_ENVIRON_PYTHON);
+                if (python == NULL)
+                    python = PDSHPY_PYTHON_EXECUTABLE;
+                DBG("Starting pdshpy server for next time.");
+                if (client_spawn_server(python, serverpath, modulename) < 0)
+                    ERR("Failed to start pdshpy server: %s", strerror(errno));
+            }
+        }
+        else
+        {
+            DBG("Connected to pdshpy server at %s", serverpath);
+            server_mode = 1;
+            if (callback_budget > 0)
+                client_set_timeout(callback_budget);
+            if (client_init() < 0)
+            {
+                ERR("Initialization through pdshpy server failed");
+                return -1;
+            }
+            return 0;
+        }
+    }
+
+    subinterpreters = 0;
+    subinterpenv = getenv(PDSHPY_ENVIRON_SUBINTERPRETERS);
+    if (subinterpenv != NULL && atoi(subinterpenv) > 0)
+    {
+#if PDSHPY_HAVE_SUBINTERPRETERS
+        subinterpreters = 1;
+#else
+        ERR("warning: %s needs Python 3.12 or later; ignored",
+            PDSHPY_ENVIRON_SUBINTERPRETERS);
+#endif
+    }
+
+#if PY_MAJOR_VERSION >= 3
+    if (!inittab_added)
+    {
+        PyImport_AppendInittab(PDSHPY_PYTHON_INTERNAL, internal_init);
+        inittab_added = 1;
+    }
+#endif
+
+    metrics_begin(&mark);
+    Py_Initialize();
+    metrics_end(PHASE_PY_INITIALIZE, &mark);
+
+    tracemallocenv = getenv(PDSHPY_ENVIRON_TRACEMALLOC);
+    if (tracemallocenv != NULL && atoi(tracemallocenv) > 0)
+    {
+        /* it would be asked how much has been allocated from inside other
+         * interpreters */
+        if (subinterpreters)
+            ERR("warning: %s can't be used with %s; not tracing allocations",
+                PDSHPY_ENVIRON_TRACEMALLOC, PDSHPY_ENVIRON_SUBINTERPRETERS);
+        else
+            start_tracemalloc();
+    }
+
+    if (setup_interp(&main_interp) < 0)
+    {
+        teardown_interp(&main_interp);
+        return -1;
+    }
+
+    profiledir = getenv(PDSHPY_ENVIRON_PROFILE);
+    if (profiledir != NULL && profiledir[0] != '\0')
+        start_profiler(profiledir);
+
+    if (load_drivers(modulename) < 0)
+    {
+        teardown_interp(&main_interp);
+        return -1;
+    }
+
+    /* it's optional; chained drivers are initialized in the order given */
+    for (d = drivers; d < drivers + ndrivers; d++)
+    {
+        prev = enter_interp(d->interp);
+        rc = initialize_driver(d);
+        leave_interp(d->interp, prev);
+        if (rc < 0)
+        {
+            unload_drivers();
+            teardown_interp(&main_interp);
+            return -1;
+        }
+    }
+
+    /* also optional; overlaps host collection with the rest of pdsh's
+     * startup */
+    start_prefetch();
+
+    DBG("Initialization complete.");
+
+    python_release();
+    return 0;
+}
+
+static int
+pdshpy_fini(void)
+{
+    struct metrics_mark mark;
+    int finalize = 0;
+    int i;
+
+    DBG("Unloading.");
+
+    if (server_mode)
+        client_fini();
+    else
+    {
+        python_acquire();
+        prefetching = 0;
+        stop_profiler();
+        stop_tracemalloc();
+        unload_drivers();
+        teardown_interp(&main_interp);
+    }
+    memset(option_interp, 0, sizeof(option_interp));
+
+    for (i = 0; i < options_registered; ++i)
+    {
+        Free((void **)&pdsh_module_info.opt_table[i].arginfo);
+        Free((void **)&pdsh_module_info.opt_table[i].descr);
+    }
+    if (options_registered > 0)
+        free(pdsh_module_info.opt_table);
+
+    pdsh_module_info.opt_table = &null_option;
+    options_registered = 0;
+
+    Free((void **)&cache_key);
+    cache_ttl = -1;
+
+    finalize = !server_mode;
+#if PDSHPY_HAVE_SUBINTERPRETERS
+    if (finalize && interps_left > 0)
+    {
+        /* their threads would be pulled out from under them */
+        DBG("Not finalizing Python; %d subinterpreters are still busy.",
+            interps_left);
+        finalize = 0;
+    }
+#endif
+    if (finalize)
+    {
+        metrics_begin(&mark);
+        Py_Finalize();
+        metrics_end(PHASE_FINALIZE, &mark);
+    }
+    metrics_report(driver_name, server_mode ? "server" : "in-process");
+    server_mode = 0;
+    return 0;
+}
+
+/* Start collecting from the host sources registered in interpreter 'in'
+ * (the current one), if any, on threads of their own. They're given a
+ * PdshOpts of their own, with a copy of the wcoll, since they run alongside
+ * the drivers' other callbacks. Returns how many were started.
+ */
+static int
+start_host_sources(struct interp *in, opt_t *opt)
+{
+    PyObject *registered = NULL;
+    PyObject *pyopt = NULL;
+    PyObject *collectors = NULL;
+    int n = 0;
+
+    /* don't bother making a PdshOpts for nothing */
+    registered = PyObject_GetAttrString(in->util, "_host_sources");
+    if (registered == NULL)
+        PyErr_Clear();
+    else if (PyList_Check(registered))
+        n = PyList_GET_SIZE(registered);
+    Py_XDECREF(registered);
+    if (n == 0)
+        return 0;
+
+    if ((pyopt = make_pyobject_from_pdsh_opt(in, opt)) == NULL)
+    {
+        PYERR("Failed to construct PdshOpts object");
+        return 0;
+    }
+    collectors = PyObject_CallMethod(in->util, "_start_host_sources",
+                                     "OO", pyopt, in->data);
+    release_pyopts(in, pyopt);
+    if (collectors == NULL)
+    {
+        PYERR("Failed to start collecting from host sources");
+        return 0;
+    }
+    if (!PyList_Check(collectors) || PyList_GET_SIZE(collectors) == 0)
+    {
+        Py_DECREF(collectors);
+        return 0;
+    }
+    n = PyList_GET_SIZE(collectors);
+    DBG("Collecting from %d host sources.", n);
+    in->collectors = collectors;
+    return n;
+}
+
+/* Wait for the host sources started in interpreter 'in' (the current one)
+ * to finish, and add what they found to 'hl'. Sets *complete to 0 if any of
+ * them failed or had to be given up on.
+ */
+static void
+merge_host_sources(struct interp *in, hostlist_t hl, int *complete)
+{
+    PyObject *results = NULL;
+    PyObject *hosts = NULL;
+    const char *name = NULL;
+    const char *error = NULL;
+    struct metrics_mark mark;
+    hostlist_t part = NULL;
+    Py_ssize_t i;
+    int done = 0;
+
+    metrics_begin(&mark);
+    if (callback_budget > 0)
+        results = PyObject_CallMethod(in->util, "_join_host_sources",
+                                      "Od", in->collectors, callback_budget);
+    else
+        results = PyObject_CallMethod(in->util, "_join_host_sources",
+                                      "O", in->collectors);
+    metrics_end(PHASE_HOST_SOURCES, &mark);
+
+    if (results == NULL || !PyList_Check(results))
+    {
+        PYERR("Failed to collect from host sources");
+        Py_XDECREF(results);
+        *complete = 0;
+        return;
+    }
+
+    for (i = 0; i < PyList_GET_SIZE(results); i++)
+    {
+        if (!PyArg_ParseTuple(PyList_GET_ITEM(results, i), "sOiz",
+                              &name, &hosts, &done, &error))
+        {
+            PYERR("Unexpected result from host source");
+            *complete = 0;
+            continue;
+        }
+        if (error != NULL)
+        {
+            ERR("Host source '%s' failed:\n%s", name, error);
+            *complete = 0;
+            continue;
+        }
+        if ((part = make_hostlist_from_pyobject(hosts)) == NULL)
+        {
+            PYERR("Host source '%s' returned something other than hosts",
+                  name);
+            *complete = 0;
+            continue;
+        }
+        if (!done)
+        {
+            ERR("warning: host source '%s' did not finish in time; using the "
+                "%d hosts it found", name, hostlist_count(part));
+            *complete = 0;
+        }
+        else
+            DBG("Host source '%s' found %d hosts.", name,
+                hostlist_count(part));
+        hostlist_push_list(hl, part);
+        hostlist_destroy(part);
+    }
+    Py_DECREF(results);
+    hostlist_uniq(hl);
+}
+
+/* One driver module's share of the hosts: what its prefetch found, if it
+ * had one going, or else what its collect_hosts() returns. Called in the
+ * driver's interpreter. An empty hostlist if it has neither, and 'optional'
+ * says it needn't; NULL, with the error reported, if it failed.
+ */
+static hostlist_t
+collect_from_module(struct driver *d, opt_t *opt, int joining, int optional,
+                    int *complete)
+{
+    PyObject *hosts = NULL;
+    PyObject *pyopt = NULL;
+    struct metrics_mark mark;
+    hostlist_t hl = NULL;
+    const char *name = PyModule_GetName(d->module);
+
+    if (joining && (hosts = join_prefetch(d, complete)) != NULL)
+        goto convert;
+
+    if (optional && !PyObject_HasAttrString(d->module, "collect_hosts"))
+    {
+        if ((hl = hostlist_create(NULL)) == NULL)
+            ERR("Could not allocate hostlist");
+        return hl;
+    }
+
+    if ((pyopt = make_pyobject_from_pdsh_opt(d->interp, opt)) == NULL)
+    {
+        PYERR("Failed to construct PdshOpts object");
+        return NULL;
+    }
+
+    DBG("Calling collect_hosts() in driver module %s.", name);
+
+    metrics_begin(&mark);
+    hosts = collect_from_driver(d->interp, complete, d->module,
+                                "collect_hosts", "(OO)", pyopt,
+                                d->interp->data);
+    metrics_end(PHASE_COLLECT_HOSTS, &mark);
+    if (hosts == NULL)
+    {
+        PYERR("Driver module %s's collect_hosts() function failed", name);
+        release_pyopts(d->interp, pyopt);
+        return NULL;
+    }
+    if (!*complete)
+        ERR("warning: %s collect_hosts() did not finish within %gs",
+            name, callback_budget);
+
+convert:
+    hl = make_hostlist_from_pyobject(hosts);
+    Py_DECREF(hosts);
+    if (hl == NULL)
+        PYERR("Driver module %s's collect_hosts() returned something other "
+              "than hosts", name);
+    if (pyopt == NULL)
+        return hl;
+
+    if (hl != NULL && !fill_pdshopt_from_pyobject(d->interp, opt, pyopt))
+    {
+        PYERR("Driver module %s's collect_hosts() function put an invalid "
+              "value in a PdshOpts object.", name);
+        hostlist_destroy(hl);
+        hl = NULL;
+    }
+    release_pyopts(d->interp, pyopt);
+    return hl;
+}
+
+/* Collect hosts from every driver module in the chain, and from any host
+ * sources, into one hostlist. Sets *complete to 0 if some of them ran out
+ * of time or didn't come through, and only some of the hosts are returned.
+ */
+static hostlist_t
+wcoll_in_process(opt_t *opt, int *complete)
+{
+    PyThreadState *prev = NULL;
+    struct driver *d = NULL;
+    hostlist_t hl = NULL;
+    hostlist_t part = NULL;
+    int joining = prefetching;
+    int sources = 0;
+    int failed = 0;
+    int done;
+
+    *complete = 1;
+    prefetching = 0;
+
+    if ((hl = hostlist_create(NULL)) == NULL)
+    {
+        ERR("Could not allocate hostlist");
+        return NULL;
+    }
+
+    /* these run while collect_hosts() (or the prefetch) does; in
+     * subinterpreters, while other drivers' do, too */
+    for (d = drivers; d < drivers + ndrivers; d++)
+    {
+        if (!first_in_interp(d))
+            continue;
+        prev = enter_interp(d->interp);
+        sources += start_host_sources(d->interp, opt);
+        leave_interp(d->interp, prev);
+    }
+
+    /* collect_hosts() is optional for drivers with host sources, and in a
+     * chain of drivers, where some may be there just for their options or
+     * perform_postop() */
+    for (d = drivers; d < drivers + ndrivers; d++)
+    {
+        done = 1;
+        prev = enter_interp(d->interp);
+        part = collect_from_module(d, opt, joining,
+                                   sources > 0 || ndrivers > 1, &done);
+        leave_interp(d->interp, prev);
+        if (!done)
+            *complete = 0;
+        if (part == NULL)
+        {
+            failed = 1;
+            continue;
+        }
+        if (hostlist_count(hl) == 0)
+        {
+            hostlist_destroy(hl);
+            hl = part;
+        }
+        else
+        {
+            hostlist_push_list(hl, part);
+            hostlist_destroy(part);
+        }
+    }
+
+    /* one driver failing leaves the others' hosts, which will do if the
+     * cache has nothing better; a lone driver failing is fatal */
+    if (failed && ndrivers > 1)
+        *complete = 0;
+
+    for (d = drivers; d < drivers + ndrivers; d++)
+    {
+        if (!first_in_interp(d) || d->interp->collectors == NULL)
+            continue;
+        prev = enter_interp(d->interp);
+        if (!failed || ndrivers > 1)
+            merge_host_sources(d->interp, hl, complete);
+        Py_CLEAR(d->interp->collectors);
+        leave_interp(d->interp, prev);
+    }
+
+    if (failed && ndrivers == 1)
+    {
+        hostlist_destroy(hl);
+        return NULL;
+    }
+    if (sources == 0 && ndrivers > 1)
+        hostlist_uniq(hl);
+
+    return hl;
+}
+
+#define REFRESH_PREFETCH_WAIT 0.2
+
+/* Serving a stale cache entry: collect the hosts again in a detached
+ * process and store them, so the next run gets fresh ones. pdsh hasn't
+ * started any threads of its own yet when it reads the wcoll, but a
+ * prefetch_hosts() thread may still be running even once cancelled, and
+ * the child could inherit a lock it holds (the import lock, a logging or
+ * socket lock) with nobody left to release it. So it's given
+ * REFRESH_PREFETCH_WAIT seconds to finish, and if it hasn't, there's no
+ * refresh this time; a later run does it instead.
+ */
+static void
+refresh_in_background(opt_t *opt)
+{
+    PyObject *running = NULL;
+    hostlist_t hl = NULL;
+    pid_t pid;
+    int complete = 1;
+    int fd;
+
+    running = PyObject_CallMethod(main_interp.util, "_prefetch_running",
+                                  "Od", main_interp.data,
+                                  REFRESH_PREFETCH_WAIT);
+    if (running == NULL || PyObject_IsTrue(running) != 0)
+    {
+        PyErr_Clear();
+        Py_XDECREF(running);
+        DBG("Not refreshing cached hosts while prefetch_hosts() runs");
+        return;
+    }
+    Py_DECREF(running);
+
+    fflush(stdout);
+    fflush(stderr);
+    if ((pid = fork()) < 0)
+    {
+        DBG("Could not fork to refresh cached hosts: %s", strerror(errno));
+        return;
+    }
+    if (pid > 0)
+    {
+        /* the intermediate child exits right away */
+        waitpid(pid, NULL, 0);
+        return;
+    }
+
+    if (fork() != 0)
+        _exit(0);
+    setsid();
+    if ((fd = open("/dev/null", O_RDWR)) >= 0)
+    {
+        dup2(fd, 0);
+        dup2(fd, 1);
+        dup2(fd, 2);
+        if (fd > 2)
+            close(fd);
+    }
+    PyOS_AfterFork();
+
+    /* the session's event loop, if any, is the parent's; leave it be */
+    if (PyObject_SetAttrString(main_interp.data, "_pdshpy_loop",
+                               Py_None) < 0)
+        PyErr_Clear();
+
+    /* locks aren't inherited, so this is the first point we can tell
+     * whether another run got there first */
+    if (cache_refresh_lock(driver_name, cache_key) < 0)
+        _exit(0);
+    if ((hl = wcoll_in_process(opt, &complete)) != NULL && complete)
+        cache_store(driver_name, cache_key, cache_ttl, hl);
+    _exit(0);
+}
+
+/* Host collection didn't finish (it ran out of time, or a host source
+ * failed), and 'partial' has what was found, if anything. The hosts last
+ * cached for this key, however old, are probably closer to the truth;
+ * failing those, go with what we have.
+ */
+static hostlist_t
+deadline_fallback(hostlist_t partial)
+{
+    struct metrics_mark mark;
+    hostlist_t hl = NULL;
+    long age = 0;
+
+    metrics_count(COUNT_DEADLINES_EXCEEDED, 1);
+    if (cache_key != NULL)
+    {
+        metrics_begin(&mark);
+        hl = cache_lookup_last(driver_name, cache_key, &age);
+        metrics_end(PHASE_CACHE, &mark);
+    }
+    if (hl != NULL)
+    {
+        ERR("warning: host collection did not finish; using the hosts "
+            "cached %lds ago instead", age);
+        if (partial != NULL)
+            hostlist_destroy(partial);
+        return hl;
+    }
+
+    ERR("warning: host collection did not finish; using the %d hosts found",
+        partial ? hostlist_count(partial) : 0);
+    return partial;
+}
+
+/* Called after option processing, and before postop. Append all appropriate
+ * host results onto opt->wcoll.
+ */
+static hostlist_t
+pdshpy_wcoll(opt_t *opt)
+{
+    struct metrics_mark mark;
+    hostlist_t hl = NULL;
+    int complete = 1;
+    int stale = 0;
+
+    PDSHPY_PROBE0(collect_hosts__entry);
+    python_acquire();
+
+    if (cache_key != NULL)
+    {
+        metrics_begin(&mark);
+        hl = cache_lookup(driver_name, cache_key, cache_ttl, &stale);
+        metrics_end(PHASE_CACHE, &mark);
+        if (hl != NULL)
+            cancel_prefetch();
+        if (hl != NULL && stale)
+        {
+            DBG("Using stale cached hosts for key '%s'", cache_key);
+            metrics_count(COUNT_CACHE_STALE_HITS, 1);
+            /* a server's driver can't be shared with a forked child, and
+             * subinterpreters don't survive a fork; in those cases, stale
+             * entries just get served until they're past
+             * PDSHPY_CACHE_MAX_STALE */
+            if (!server_mode && !subinterpreters)
+                refresh_in_background(opt);
+        }
+        else if (hl != NULL)
+        {
+            DBG("Using cached hosts for key '%s'", cache_key);
+            metrics_count(COUNT_CACHE_HITS, 1);
+        }
+        if (hl != NULL)
+        {
+            PDSHPY_PROBE1(collect_hosts__return, hostlist_count(hl));
+            python_release();
+            return hl;
+        }
+        metrics_count(COUNT_CACHE_MISSES, 1);
+    }
+
+    if (server_mode)
+        hl = client_wcoll(opt, &complete);
+    else
+        hl = wcoll_in_process(opt, &complete);
+
+    /* a partial answer is never cached */
+    if (!complete)
+        hl = deadline_fallback(hl);
+
+    /* the key may have been set, or changed, by collect_hosts() itself */
+    else if (cache_key != NULL && hl != NULL)
+    {
+        metrics_begin(&mark);
+        if (cache_store(driver_name, cache_key, cache_ttl, hl) < 0)
+            DBG("Could not cache hosts for key '%s': %s", cache_key,
+                strerror(errno));
+        metrics_end(PHASE_CACHE, &mark);
+    }
+
+    python_release();
+    PDSHPY_PROBE1(collect_hosts__return, hl ? hostlist_count(hl) : -1);
+    return hl;
+}
+
+/* One driver module's perform_postop(), as a stage in the pipeline, called
+ * in the driver's interpreter. Each stage sees the wcoll as the ones before
+ * it left it, without it being converted in between. Returns the number of
+ * errors it reported.
+ */
+static int
+postop_in_module(struct driver *d, opt_t *opt, int optional)
+{
+    PyObject *pyopt = NULL;
+    PyObject *result = NULL;
+    int result_int = 0;
+    struct metrics_mark mark;
+    const char *name = PyModule_GetName(d->module);
+
+    if (optional && !PyObject_HasAttrString(d->module, "perform_postop"))
+        return 0;
+
+    if ((pyopt = make_pyobject_from_pdsh_opt(d->interp, opt)) == NULL)
+    {
+        PYERR("Failed to construct PdshOpts object");
         return 1;
     }
-    Py_DECREF(pyopt);
 
-    result_int = PyIntOrNone_AsLong(result);
-    Py_DECREF(result);
+    DBG("Calling perform_postop() in driver module %s.", name);
+
+    metrics_begin(&mark);
+    result = call_driver(d->interp, "perform_postop", d->module,
+                         "perform_postop", "(OO)", pyopt, d->interp->data);
+    metrics_end(PHASE_PERFORM_POSTOP, &mark);
 
-    if (result_int < 0)
+    if (result == NULL)
+    {
+        PYERR("Driver module %s's perform_postop() function failed", name);
+        result_int = 1;
+    }
+    else if ((result_int = PyIntOrNone_AsLong(result)) < 0)
     {
         if (PyErr_Occurred())
-            PYERR("Value returned from driver module perform_postop() is not "
-                  "an int or None (should be the number of errors)");
+            PYERR("Value returned from driver module %s's perform_postop() "
+                  "is not an int or None (should be the number of errors)",
+                  name);
         else
         {
             /* the value returned was actually negative. that's an error too;
              * it's just that Python won't know what the error is */
-            ERR("Value returned from Python module perform_postop method "
-                "is negative (should be the number of errors)");
+            ERR("Value returned from Python module %s's perform_postop "
+                "method is negative (should be the number of errors)", name);
         }
-        return 1;
+        result_int = 1;
+    }
+    Py_XDECREF(result);
+
+    if (!fill_pdshopt_from_pyobject(d->interp, opt, pyopt))
+    {
+        PYERR("Driver module %s's perform_postop() function put an invalid "
+              "value in PdshOpts object.", name);
+        result_int++;
     }
+    release_pyopts(d->interp, pyopt);
 
     return result_int;
 }
+
+/* One driver module's filter_hosts(), called in the driver's interpreter
+ * before its perform_postop(). The wcoll goes to it PYHOSTBATCH_SIZE hosts
+ * at a time, as HostBatch objects rather than a Python string per host, and
+ * once every batch has been through, the hosts its masks turned down are
+ * removed from the wcoll in place. If it fails, the wcoll is left alone.
+ * Returns the number of errors it reported.
+ */
+static int
+filter_in_module(struct driver *d, opt_t *opt)
+{
+    hostlist_iterator_t it = NULL;
+    PyObject *batch = NULL;
+    PyObject *mask = NULL;
+    unsigned char *keep = NULL;
+    char *host = NULL;
+    const char *name = PyModule_GetName(d->module);
+    struct metrics_mark mark;
+    size_t nhosts = 0, size = 0, i;
+    Py_ssize_t n;
+    int removed = 0, rc = -1;
+
+    if (opt->wcoll == NULL
+        || !PyObject_HasAttrString(d->module, "filter_hosts"))
+        return 0;
+
+    DBG("Calling filter_hosts() in driver module %s.", name);
+    PDSHPY_PROBE0(filter_hosts__entry);
+    metrics_begin(&mark);
+
+    if ((it = hostlist_iterator_create(opt->wcoll)) == NULL)
+    {
+        ERR("Could not allocate hostlist iterator");
+        goto out;
+    }
+    for (;;)
+    {
+        if ((batch = pyhostbatch_fill(d->interp->internal, it,
+                                      PYHOSTBATCH_SIZE)) == NULL)
+        {
+            PYERR("Failed to construct HostBatch object");
+            goto out;
+        }
+        if ((n = pyhostbatch_count(batch)) == 0)
+            break;
+        if (nhosts + n > size)
+        {
+            unsigned char *grown = NULL;
+
+            size = size ? size * 2 : (size_t)hostlist_count(opt->wcoll) + 1;
+            if (size < nhosts + n)
+                size = nhosts + n;
+            if ((grown = realloc(keep, size)) == NULL)
+            {
+                ERR("Out of memory filtering hosts");
+                goto out;
+            }
+            keep = grown;
+        }
+        mask = call_driver(d->interp, "filter_hosts", d->module,
+                           "filter_hosts", "(OO)", batch, d->interp->data);
+        if (mask == NULL)
+        {
+            PYERR("Driver module %s's filter_hosts() function failed", name);
+            goto out;
+        }
+        if (pyhostbatch_mask(batch, mask, keep + nhosts) < 0)
+        {
+            PYERR("Value returned from driver module %s's filter_hosts() "
+                  "is not a mask for the batch", name);
+            goto out;
+        }
+        Py_CLEAR(mask);
+        Py_CLEAR(batch);
+        nhosts += n;
+    }
+    hostlist_iterator_destroy(it);
+
+    /* everything's been decided; now take out the ones turned down */
+    if ((it = hostlist_iterator_create(opt->wcoll)) == NULL)
+    {
+        ERR("Could not allocate hostlist iterator");
+        goto out;
+    }
+    for (i = 0; i < nhosts && (host = hostlist_next(it)) != NULL; i++)
+    {
+        if (!keep[i])
+        {
+            hostlist_remove(it);
+            removed++;
+        }
+        free(host);
+    }
+    metrics_count(COUNT_HOSTS_FILTERED, removed);
+    rc = removed;
+
+out:
+    Py_XDECREF(mask);
+    Py_XDECREF(batch);
+    if (it != NULL)
+        hostlist_iterator_destroy(it);
+    free(keep);
+    metrics_end(PHASE_FILTER_HOSTS, &mark);
+    PDSHPY_PROBE1(filter_hosts__return, rc);
+    return rc < 0;
+}
+
+/* Run filter_hosts() and perform_postop() in each driver module in turn. */
+static int
+postop_in_process(opt_t *opt)
+{
+    PyThreadState *prev = NULL;
+    struct driver *d = NULL;
+    int errors = 0;
+
+    for (d = drivers; d < drivers + ndrivers; d++)
+    {
+        prev = enter_interp(d->interp);
+        errors += filter_in_module(d, opt);
+        /* optional in a chain or after filter_hosts(); a lone driver with
+         * neither fails as ever */
+        errors += postop_in_module(d, opt, ndrivers > 1
+                                   || PyObject_HasAttrString(d->module,
+                                                             "filter_hosts"));
+        leave_interp(d->interp, prev);
+    }
+
+    return errors;
+}
+
+/* With PDSHPY_DEADHOSTS set, leave out the hosts in the wcoll which were
+ * found unreachable lately (see deadhosts.h), or with "last", move them to
+ * the end of it so that pdsh gets to them after the rest. Either way they're
+ * reported once, in a line of their own. Returns the number of errors.
+ */
+static int
+check_deadhosts(opt_t *opt)
+{
+    const char *mode = getenv(PDSHPY_ENVIRON_DEADHOSTS);
+    hostlist_t dead = NULL;
+    hostlist_iterator_t it = NULL;
+    unsigned char *flags = NULL;
+    char **names = NULL;
+    char *ranged = NULL;
+    char *host = NULL;
+    size_t n = 0, i;
+    int skip, ndead;
+    int errors = 0;
+
+    if (mode == NULL || mode[0] == '\0' || opt->wcoll == NULL)
+        return 0;
+    if (strcmp(mode, "skip") == 0)
+        skip = 1;
+    else if (strcmp(mode, "last") == 0)
+        skip = 0;
+    else
+    {
+        ERR("%s should be \"skip\" or \"last\", not \"%s\"",
+            PDSHPY_ENVIRON_DEADHOSTS, mode);
+        return 1;
+    }
+
+    if ((names = hostlist_names(opt->wcoll, &n)) == NULL
+        || (flags = malloc(n + 1)) == NULL
+        || (dead = hostlist_create(NULL)) == NULL)
+    {
+        ERR("Out of memory looking for unreachable hosts");
+        errors = 1;
+        goto out;
+    }
+    if ((ndead = deadhosts_lookup(names, n, flags)) < 0)
+    {
+        ERR("Couldn't read which hosts are unreachable: %s",
+            strerror(errno));
+        errors = 1;
+        goto out;
+    }
+    if (ndead == 0)
+        goto out;
+
+    /* the wcoll is as it was when the names were taken from it */
+    if ((it = hostlist_iterator_create(opt->wcoll)) == NULL)
+        goto out;
+    for (i = 0; i < n && (host = hostlist_next(it)) != NULL; i++)
+    {
+        if (flags[i])
+        {
+            hostlist_push_host(dead, host);
+            hostlist_remove(it);
+        }
+        free(host);
+    }
+    hostlist_iterator_destroy(it);
+    if (!skip)
+        hostlist_push_list(opt->wcoll, dead);
+    metrics_count(COUNT_HOSTS_KNOWN_DOWN, ndead);
+
+    if ((ranged = pdshpy_hostlist_ranged(dead)) != NULL)
+    {
+        ERR("%d %s unreachable lately, %s: %s", ndead,
+            ndead == 1 ? "host" : "hosts", skip ? "left out" : "tried last",
+            ranged);
+        free(ranged);
+    }
+
+out:
+    if (dead != NULL)
+        hostlist_destroy(dead);
+    if (names != NULL)
+        free_names(names, n);
+    free(flags);
+    return errors;
+}
+
+/* With PDSHPY_LIVENESS set, check that the hosts in the wcoll are up (see
+ * liveness.h), after the drivers are done with it so that only the hosts
+ * pdsh will really connect to are checked. The ones which aren't up are
+ * reported, a line for each way of being down, and with "remove", taken out
+ * of the wcoll. Returns the number of errors.
+ */
+static int
+check_liveness(opt_t *opt)
+{
+    const char *mode = getenv(PDSHPY_ENVIRON_LIVENESS);
+    const char *env = NULL;
+    const char *rcmd = NULL;
+    hostlist_t down[LIVENESS_NSTATES];
+    hostlist_iterator_t it = NULL;
+    struct metrics_mark mark;
+    unsigned char *state = NULL;
+    char **names = NULL;
+    char *ranged = NULL;
+    char *host = NULL;
+    size_t n = 0, i;
+    int port, timeout_ms, remove, up, s, count;
+    int errors = 0;
+
+    if (mode == NULL || mode[0] == '\0' || opt->wcoll == NULL)
+        return 0;
+    if (strcmp(mode, "remove") == 0)
+        remove = 1;
+    else if (strcmp(mode, "report") == 0)
+        remove = 0;
+    else
+    {
+        ERR("%s should be \"remove\" or \"report\", not \"%s\"",
+            PDSHPY_ENVIRON_LIVENESS, mode);
+        return 1;
+    }
+
+    rcmd = opt->rcmd_name ? opt->rcmd_name : rcmd_get_default_module();
+    env = getenv(PDSHPY_ENVIRON_LIVENESS_PORT);
+    port = env != NULL ? atoi(env) : liveness_port(rcmd);
+    if (port <= 0 || port > 65535)
+    {
+        ERR("No port to check hosts on for rcmd module %s; set %s",
+            rcmd ? rcmd : "(none)", PDSHPY_ENVIRON_LIVENESS_PORT);
+        return 1;
+    }
+    env = getenv(PDSHPY_ENVIRON_LIVENESS_TIMEOUT);
+    timeout_ms = env != NULL && atoi(env) > 0
+        ? atoi(env) : LIVENESS_DEFAULT_TIMEOUT;
+    /* no point waiting longer than pdsh itself would */
+    if (opt->connect_timeout > 0 && timeout_ms > opt->connect_timeout * 1000)
+        timeout_ms = opt->connect_timeout * 1000;
+
+    memset(down, 0, sizeof(down));
+    metrics_begin(&mark);
+    if ((names = hostlist_names(opt->wcoll, &n)) == NULL
+        || (state = malloc(n + 1)) == NULL)
+    {
+        ERR("Out of memory checking hosts are up");
+        errors = 1;
+        goto out;
+    }
+    PDSHPY_PROBE1(liveness__entry, (int)n);
+    DBG("Checking %d hosts are up on port %d", (int)n, port);
+    up = liveness_check(names, n, port, timeout_ms, state);
+    PDSHPY_PROBE1(liveness__return, up < 0 ? -1 : (int)n - up);
+    if (up < 0)
+    {
+        ERR("Couldn't check hosts are up: %s", strerror(errno));
+        errors = 1;
+        goto out;
+    }
+    if (deadhosts_on() && deadhosts_update(names, n, state) < 0)
+        ERR("Couldn't record which hosts are down: %s", strerror(errno));
+    if ((size_t)up == n)
+        goto out;
+
+    for (i = 0; i < n; i++)
+    {
+        s = state[i];
+        if (s == LIVENESS_UP)
+            continue;
+        if (down[s] == NULL && (down[s] = hostlist_create(NULL)) == NULL)
+            continue;
+        hostlist_push_host(down[s], names[i]);
+    }
+    for (s = 0; s < LIVENESS_NSTATES; s++)
+    {
+        if (down[s] == NULL || (ranged = pdshpy_hostlist_ranged(down[s]))
+            == NULL)
+            continue;
+        count = hostlist_count(down[s]);
+        ERR("%d %s %s on port %d%s: %s", count, count == 1 ? "host" : "hosts",
+            liveness_describe(s), port, remove ? ", left out" : "", ranged);
+        free(ranged);
+    }
+    metrics_count(COUNT_HOSTS_DOWN, n - up);
+
+    /* the wcoll is as it was when the names were taken from it */
+    if (remove && (it = hostlist_iterator_create(opt->wcoll)) != NULL)
+    {
+        for (i = 0; i < n && (host = hostlist_next(it)) != NULL; i++)
+        {
+            if (state[i] != LIVENESS_UP)
+                hostlist_remove(it);
+            free(host);
+        }
+        hostlist_iterator_destroy(it);
+    }
+
+out:
+    for (s = 0; s < LIVENESS_NSTATES; s++)
+        if (down[s] != NULL)
+            hostlist_destroy(down[s]);
+    if (names != NULL)
+        free_names(names, n);
+    free(state);
+    metrics_end(PHASE_LIVENESS, &mark);
+    return errors;
+}
+
+/* Can be used to filter the "working collective", as in -v with nodeupdown,
+ * or -i with genders. Returns the total number of errors.
+ */
+static int
+pdshpy_postop(opt_t *opt)
+{
+    int rc = 0;
+
+    PDSHPY_PROBE0(perform_postop__entry);
+    if (server_mode)
+        rc = client_postop(opt);
+    else
+    {
+        python_acquire();
+        rc = postop_in_process(opt);
+        python_release();
+    }
+    rc += check_deadhosts(opt);
+    rc += check_liveness(opt);
+    PDSHPY_PROBE1(perform_postop__return, rc);
+    return rc;
+}
@@ -0,0 +1,99 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* Declarations shared between the pieces of pdshpy.so. Nothing in here is
+ * visible to pdsh itself; pdsh only knows about the symbols in pdshpy.c.
+ */
+
+#ifndef _PDSHPY_H
+#define _PDSHPY_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "src/common/hostlist.h"
+#include "src/pdsh/opt.h"
+
+/* this will be output in front of output lines */
+#define PDSHPY_LOG_PREFIX "pdshpy"
+
+extern int pdshpy_debuglevel;
+
+#define DBG(tmpl, args...) \
+    ({ if (pdshpy_debuglevel > 0) \
+            fprintf(stderr, PDSHPY_LOG_PREFIX ": " tmpl "\n", ## args); })
+
+#define ERR(tmpl, args...) \
+    ({ fprintf(stderr, PDSHPY_LOG_PREFIX ": " tmpl "\n", ## args); })
+
+/* Add a pdsh option which will be handled by pdshpy_process_opt. Returns
+ * 0 on success, or -1 if pdsh would not accept it.
+ */
+int pdshpy_add_option(char opt, const char *argmeta, int personality,
+                      const char *desc);
+
+/* Cache collect_hosts() results under this key (NULL for no caching) for
+ * 'ttl' seconds, or -1 for the default. See cache.h.
+ */
+void pdshpy_set_cache_key(const char *key, int ttl);
+
+/* Record the hosts in 'hosts' (a hostlist string) as unreachable, with
+ * 'down', or as reachable again, if PDSHPY_DEADHOSTS is on. Returns 0, or
+ * -1 with errno set. See deadhosts.h.
+ */
+int pdshpy_record_hosts(const char *hosts, int down);
+
+/* Return a newly allocated (use free()) ranged string representation of
+ * the given hostlist, like "node[1-10],foo", or NULL on allocation failure.
+ */
+char *pdshpy_hostlist_ranged(hostlist_t hl);
+
+/* The opt_t members which get passed back and forth to the driver module,
+ * for the code which needs to walk over them generically.
+ */
+enum pdshpy_opt_type {
+    PDSHPY_OPT_STR,
+    PDSHPY_OPT_BOOL,
+    PDSHPY_OPT_INT,
+    PDSHPY_OPT_UID,
+};
+
+struct pdshpy_opt_field {
+    const char *name;
+    enum pdshpy_opt_type type;
+    size_t offset;
+};
+
+extern const struct pdshpy_opt_field pdshpy_opt_fields[];
+
+/* the interpreter used to start a pdshpy server, if pdshpy is asked to */
+#ifndef PDSHPY_PYTHON_EXECUTABLE
+#define PDSHPY_PYTHON_EXECUTABLE "python"
+#endif
+
+/* server mode client (client.c) */
+int client_connect(const char *path);
+int client_spawn_server(const char *python, const char *path,
+                        const char *modulename);
+void client_set_timeout(double seconds);
+int client_init(void);
+int client_process_opt(opt_t *opts, int opt, char *arg);
+hostlist_t client_wcoll(opt_t *opts, int *complete);
+int client_postop(opt_t *opts);
+void client_fini(void);
+
+#endif /* !_PDSHPY_H */
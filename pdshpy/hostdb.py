@@ -0,0 +1,543 @@
+# pdshpy host databases
+#
+# A host database is a host inventory compiled into a compact binary file
+# which pdshpy maps into memory rather than parsing, so looking things up in
+# it costs the same whether it holds ten hosts or a million. The format is
+# described in hostdb.h.
+#
+# Compile one from a text inventory with:
+#
+#     python -m pdshpy.hostdb compile inventory.txt inventory.db
+#
+# The text has one entry per line: a hostname or ranged hostlist, then any
+# attributes those hosts have (any words without whitespace, like "gpu" or
+# "rack=12"). Hosts may be listed more than once; they end up with all the
+# attributes they were given. Everything after a "#" is a comment:
+#
+#     node[001-100]   compute rack=1
+#     node[001-004]   gpu
+#     login1          login
+#
+# The new file replaces the old one by rename, so pdsh runs which have the
+# old one mapped aren't disturbed.
+#
+# Drivers open it with util.HostDB(path), which is the native HostDB type
+# in-process, or the HostDB class here (which reads the same files in plain
+# Python) in a pdshpy server.
+
+import argparse
+import binascii
+import mmap
+import os
+import re
+import struct
+import sys
+import tempfile
+
+from pdshpy import hostlist
+
+MAGIC = b'PDSHPYDB'
+VERSION = 1
+BYTE_ORDER = 0x01020304
+
+# keep these in sync with hostdb.h
+SECTION_STRINGS = 1
+SECTION_PREFIXES = 2
+SECTION_RANGES = 3
+SECTION_ATTRS = 4
+SECTION_HOST_ATTRS = 5
+SECTION_INDEX = 6
+SECTION_CONTAINERS = 7
+SECTION_INDEX_DATA = 8
+
+RANGE_BARE = 0x1
+
+# bitmap container types, from bitmap.h
+CONTAINER_ARRAY = 1
+CONTAINER_BITMAP = 2
+CONTAINER_RUN = 3
+BITMAP_WORDS = 1024
+ARRAY_MAX = 4096
+
+MAX_DIGITS = 9
+MAX_NAME = 255
+
+_header = struct.Struct('<8sIIIIQ')
+_section = struct.Struct('<IIQQ')
+_prefix = struct.Struct('<IIII')
+_range = struct.Struct('<IIIHHII')
+_offset = struct.Struct('<I')
+_word = struct.Struct('<Q')
+_posting = struct.Struct('<II')
+_container = struct.Struct('<HHIQ')
+
+_trailing_digits = re.compile(br'^(.*?)([0-9]+)$', re.DOTALL)
+_bad_chars = re.compile(br'[\s\[\],]')
+
+
+def _text(b):
+    return b.decode('utf-8') if sys.version_info[0] >= 3 else b
+
+
+def _bytes(s):
+    return s.encode('utf-8') if not isinstance(s, bytes) else s
+
+
+def _split(name):
+    """
+    Split a hostname (as bytes) into (prefix, bare, width, number), the same
+    way hostdb.c does.
+    """
+    m = _trailing_digits.match(name)
+    if m is None or len(m.group(2)) > MAX_DIGITS:
+        return name, True, 0, 0
+    prefix, digits = m.groups()
+    width = len(digits) if len(digits) > 1 and digits[:1] == b'0' else 0
+    return prefix, False, width, int(digits)
+
+
+def _align(n):
+    return (n + 7) & ~7
+
+
+def _encode_container(lows):
+    """
+    The stored form of a bitmap container holding the (sorted) 16-bit
+    values 'lows': (type, count, data), whichever type is smallest.
+    """
+    runs = []
+    for v in lows:
+        if runs and runs[-1][1] + 1 == v:
+            runs[-1][1] = v
+        else:
+            runs.append([v, v])
+    sizes = [(4 * len(runs), CONTAINER_RUN), (8 * BITMAP_WORDS,
+                                              CONTAINER_BITMAP)]
+    if len(lows) <= ARRAY_MAX:
+        sizes.append((2 * len(lows), CONTAINER_ARRAY))
+    size, ctype = min(sizes)
+    if ctype == CONTAINER_RUN:
+        data = b''.join(struct.pack('<HH', a, b) for a, b in runs)
+        return ctype, len(runs), data
+    if ctype == CONTAINER_ARRAY:
+        return ctype, len(lows), struct.pack('<%dH' % len(lows), *lows)
+    words = [0] * BITMAP_WORDS
+    for v in lows:
+        words[v >> 6] |= 1 << (v & 63)
+    return ctype, BITMAP_WORDS, struct.pack('<%dQ' % BITMAP_WORDS, *words)
+
+
+def _build_index(members):
+    """
+    The INDEX, CONTAINERS and INDEX_DATA sections for 'members', the sorted
+    host IDs with each attribute.
+    """
+    postings = bytearray()
+    containers = bytearray()
+    data = bytearray()
+    ncontainers = 0
+    for ids in members:
+        first = ncontainers
+        groups = []
+        for hid in ids:
+            if not groups or groups[-1][0] != hid >> 16:
+                groups.append((hid >> 16, []))
+            groups[-1][1].append(hid & 0xffff)
+        for key, lows in groups:
+            ctype, count, blob = _encode_container(lows)
+            containers.extend(_container.pack(key, ctype, count, len(data)))
+            data.extend(blob)
+            data.extend(b'\0' * (_align(len(data)) - len(data)))
+            ncontainers += 1
+        postings.extend(_posting.pack(first, ncontainers - first))
+    return postings, containers, data
+
+
+def compile_inventory(lines, path):
+    """
+    Compile the inventory text in 'lines' (an iterable of lines) into a host
+    database at 'path'. Returns the number of hosts.
+    """
+    hosts = {}      # name -> set of attribute names, all as bytes
+    for lineno, line in enumerate(lines, 1):
+        fields = _bytes(line).split(b'#', 1)[0].split()
+        if not fields:
+            continue
+        try:
+            names = hostlist.expand(_text(fields[0]))
+        except ValueError as e:
+            raise ValueError('line %d: %s' % (lineno, e))
+        for name in names:
+            name = _bytes(name)
+            if len(name) > MAX_NAME or _bad_chars.search(name):
+                raise ValueError('line %d: bad hostname %r'
+                                 % (lineno, _text(name)))
+            hosts.setdefault(name, set()).update(fields[1:])
+
+    attrs = sorted(set().union(*hosts.values())) if hosts else []
+    attr_ids = dict((a, i) for i, a in enumerate(attrs))
+    words = (len(attrs) + 63) // 64
+
+    # group hosts by prefix, and then into runs of consecutive numbers
+    groups = {}
+    for name in hosts:
+        prefix, bare, width, num = _split(name)
+        groups.setdefault(prefix, []).append((0 if bare else 1, width, num,
+                                              name))
+
+    strings = bytearray(b'\0')
+    string_offsets = {}
+
+    def intern(s):
+        if s not in string_offsets:
+            string_offsets[s] = len(strings)
+            strings.extend(s + b'\0')
+        return string_offsets[s]
+
+    prefixes = bytearray()
+    ranges = bytearray()
+    host_attrs = bytearray()
+    members = [[] for a in attrs]
+    nranges = 0
+    nhosts = 0
+    for pi, prefix in enumerate(sorted(groups)):
+        first_range = nranges
+        run = None          # [kind, width, lo, hi, first_host]
+        for kind, width, num, name in sorted(groups[prefix]):
+            if (run is not None and kind == 1 and run[0] == 1
+                    and run[1] == width and run[3] + 1 == num):
+                run[3] = num
+            else:
+                if run is not None:
+                    ranges.extend(_range.pack(pi, run[2], run[3], run[1],
+                                              RANGE_BARE if run[0] == 0
+                                              else 0, run[4], 0))
+                    nranges += 1
+                run = [kind, width, num, num, nhosts]
+            bits = 0
+            for a in hosts[name]:
+                bits |= 1 << attr_ids[a]
+                members[attr_ids[a]].append(nhosts)
+            for w in range(words):
+                host_attrs.extend(_word.pack((bits >> (64 * w))
+                                             & 0xffffffffffffffff))
+            nhosts += 1
+        ranges.extend(_range.pack(pi, run[2], run[3], run[1],
+                                  RANGE_BARE if run[0] == 0 else 0, run[4],
+                                  0))
+        nranges += 1
+        prefixes.extend(_prefix.pack(intern(prefix), first_range,
+                                     nranges - first_range, 0))
+
+    attr_table = bytearray()
+    for a in attrs:
+        attr_table.extend(_offset.pack(intern(a)))
+
+    postings, containers, index_data = _build_index(members)
+
+    sections = [(SECTION_STRINGS, strings), (SECTION_PREFIXES, prefixes),
+                (SECTION_RANGES, ranges), (SECTION_ATTRS, attr_table),
+                (SECTION_HOST_ATTRS, host_attrs), (SECTION_INDEX, postings),
+                (SECTION_CONTAINERS, containers),
+                (SECTION_INDEX_DATA, index_data)]
+    offset = _align(_header.size + _section.size * len(sections))
+    table = bytearray()
+    for sid, data in sections:
+        table.extend(_section.pack(sid, 0, offset, len(data)))
+        offset = _align(offset + len(data))
+
+    fd, tmp = tempfile.mkstemp(prefix='.hostdb', dir=os.path.dirname(
+        os.path.abspath(path)))
+    try:
+        with os.fdopen(fd, 'wb') as f:
+            f.write(_header.pack(MAGIC, VERSION, BYTE_ORDER, nhosts,
+                                 len(sections), offset))
+            f.write(table)
+            for sid, data in sections:
+                f.write(b'\0' * (_align(f.tell()) - f.tell()))
+                f.write(data)
+            f.write(b'\0' * (offset - f.tell()))
+        os.chmod(tmp, 0o644)
+        os.rename(tmp, path)
+    except BaseException:
+        os.unlink(tmp)
+        raise
+    return nhosts
+
+
+class HostDB(object):
+    """
+    A host database, read in plain Python. Stands in for pdshpy's native
+    HostDB type outside of pdsh, with the same methods.
+    """
+
+    def __init__(self, path):
+        try:
+            with open(path, 'rb') as f:
+                self._map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        except ValueError:
+            # empty file
+            raise ValueError('%s is not a host database' % path)
+        try:
+            self._read_header()
+        except (ValueError, struct.error):
+            self._map.close()
+            raise ValueError('%s is not a host database' % path)
+
+    def _read_header(self):
+        magic, version, order, self._nhosts, nsections, size = \
+            _header.unpack_from(self._map, 0)
+        if (magic != MAGIC or version != VERSION or order != BYTE_ORDER
+                or size != len(self._map)):
+            raise ValueError()
+        sections = {}
+        for i in range(nsections):
+            sid, _, offset, length = _section.unpack_from(
+                self._map, _header.size + i * _section.size)
+            if offset + length > size:
+                raise ValueError()
+            sections[sid] = (offset, length)
+        for sid in (SECTION_STRINGS, SECTION_PREFIXES, SECTION_RANGES):
+            if sid not in sections:
+                raise ValueError()
+        self._strings = sections[SECTION_STRINGS][0]
+        self._prefixes, length = sections[SECTION_PREFIXES]
+        self._nprefixes = length // _prefix.size
+        self._ranges, length = sections[SECTION_RANGES]
+        self._nranges = length // _range.size
+        self._attrs, length = sections.get(SECTION_ATTRS, (0, 0))
+        self._nattrs = length // _offset.size
+        self._host_attrs = sections.get(SECTION_HOST_ATTRS, (0, 0))[0]
+        self._words = (self._nattrs + 63) // 64
+        self._index = None
+        if SECTION_INDEX in sections:
+            self._index = sections[SECTION_INDEX][0]
+            self._containers = sections[SECTION_CONTAINERS][0]
+            self._index_data = sections[SECTION_INDEX_DATA][0]
+
+    def _db(self):
+        if self._map is None:
+            raise ValueError('HostDB is closed')
+        return self._map
+
+    def _string(self, offset):
+        m = self._db()
+        start = self._strings + offset
+        return m[start:m.find(b'\0', start)]
+
+    def _range(self, i):
+        return _range.unpack_from(self._db(), self._ranges + i * _range.size)
+
+    def _prefix_name(self, i):
+        return self._string(_prefix.unpack_from(
+            self._db(), self._prefixes + i * _prefix.size)[0])
+
+    def _attr_name(self, i):
+        return self._string(_offset.unpack_from(
+            self._db(), self._attrs + i * _offset.size)[0])
+
+    def _host_id(self, name):
+        prefix, bare, width, num = _split(_bytes(name))
+        lo, hi = 0, self._nprefixes
+        while lo < hi:
+            mid = (lo + hi) // 2
+            other = self._prefix_name(mid)
+            if other == prefix:
+                break
+            if other < prefix:
+                lo = mid + 1
+            else:
+                hi = mid
+        else:
+            return None
+        _, first, count, _ = _prefix.unpack_from(
+            self._db(), self._prefixes + mid * _prefix.size)
+        key = (0 if bare else 1, width, num)
+        for i in range(first, first + count):
+            p, rlo, rhi, rwidth, flags, first_host, _ = self._range(i)
+            rkind = 0 if flags & RANGE_BARE else 1
+            if (rkind, rwidth) == key[:2] and rlo <= num <= rhi:
+                return first_host + num - rlo
+        return None
+
+    def _has_attr(self, host, attr):
+        word, = _word.unpack_from(
+            self._db(),
+            self._host_attrs + (host * self._words + attr // 64) * 8)
+        return (word >> (attr % 64)) & 1
+
+    def _ranged(self, want=None):
+        """
+        The hosts for which want(id) is true (all of them, if want is None)
+        as a ranged string.
+        """
+        parts = []
+        for i in range(self._nranges):
+            pi, lo, hi, width, flags, first_host, _ = self._range(i)
+            prefix = _text(self._prefix_name(pi))
+            run = None
+            for n in range(lo, hi + 2):
+                if n <= hi and (want is None or want(first_host + n - lo)):
+                    if run is None:
+                        run = n
+                    continue
+                if run is None:
+                    continue
+                if flags & RANGE_BARE:
+                    parts.append(prefix)
+                elif run == n - 1:
+                    parts.append('%s%0*d' % (prefix, width, run))
+                else:
+                    parts.append('%s[%0*d-%0*d]' % (prefix, width, run,
+                                                    width, n - 1))
+                run = None
+        return ','.join(parts)
+
+    def __len__(self):
+        self._db()
+        return self._nhosts
+
+    def __contains__(self, host):
+        return self._host_id(host) is not None
+
+    def hosts(self):
+        return hostlist.HostList(self._ranged())
+
+    def attributes(self):
+        return [_text(self._attr_name(i)) for i in range(self._nattrs)]
+
+    def with_attribute(self, attr):
+        key = _bytes(attr)
+        for i in range(self._nattrs):
+            if self._attr_name(i) == key:
+                return hostlist.HostList(
+                    self._ranged(lambda host: self._has_attr(host, i)))
+        raise KeyError(attr)
+
+    def attributes_of(self, host):
+        hid = self._host_id(host)
+        if hid is None:
+            raise KeyError(host)
+        return [_text(self._attr_name(i)) for i in range(self._nattrs)
+                if self._has_attr(hid, i)]
+
+    def bitmap(self, attr=None):
+        if attr is None:
+            return HostBitmap(self, (1 << self._nhosts) - 1)
+        key = _bytes(attr)
+        for i in range(self._nattrs):
+            if self._attr_name(i) == key:
+                return HostBitmap(self, self._attr_bits(i))
+        raise KeyError(attr)
+
+    def _attr_bits(self, attr):
+        """
+        The hosts with an attribute, as bits of an int.
+        """
+        m = self._db()
+        if self._index is None:
+            bits = 0
+            for host in range(self._nhosts):
+                if self._has_attr(host, attr):
+                    bits |= 1 << host
+            return bits
+        first, count = _posting.unpack_from(
+            m, self._index + attr * _posting.size)
+        bits = 0
+        for i in range(first, first + count):
+            key, ctype, n, offset = _container.unpack_from(
+                m, self._containers + i * _container.size)
+            base = key << 16
+            start = self._index_data + offset
+            if ctype == CONTAINER_RUN:
+                for j in range(n):
+                    lo, hi = struct.unpack_from('<HH', m, start + j * 4)
+                    bits |= ((1 << (hi - lo + 1)) - 1) << (base + lo)
+            elif ctype == CONTAINER_ARRAY:
+                for v in struct.unpack_from('<%dH' % n, m, start):
+                    bits |= 1 << (base + v)
+            else:
+                words = m[start:start + 8 * BITMAP_WORDS]
+                bits |= int(binascii.hexlify(words[::-1]), 16) << base
+        return bits
+
+    def close(self):
+        if self._map is not None:
+            self._map.close()
+            self._map = None
+
+
+class HostBitmap(object):
+    """
+    Stand-in for pdshpy's native HostBitmap type: a set of hosts from a
+    HostDB, kept as the bits of an int.
+    """
+
+    def __init__(self, db, bits):
+        self._db = db
+        self._bits = bits
+
+    def _combine(self, other, op):
+        if not isinstance(other, HostBitmap):
+            return NotImplemented
+        if other._db is not self._db:
+            raise ValueError('HostBitmaps are from different HostDBs')
+        return HostBitmap(self._db, op(self._bits, other._bits))
+
+    def __and__(self, other):
+        return self._combine(other, lambda a, b: a & b)
+
+    def __or__(self, other):
+        return self._combine(other, lambda a, b: a | b)
+
+    def __sub__(self, other):
+        return self._combine(other, lambda a, b: a & ~b)
+
+    def __len__(self):
+        return bin(self._bits).count('1')
+
+    def __contains__(self, host):
+        hid = self._db._host_id(host)
+        return hid is not None and (self._bits >> hid) & 1 == 1
+
+    __hash__ = None
+
+    def hosts(self):
+        bits = self._bits
+        return hostlist.HostList(
+            self._db._ranged(lambda host: (bits >> host) & 1))
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        description='Compile and inspect pdshpy host databases.')
+    sub = parser.add_subparsers(dest='command')
+    p = sub.add_parser('compile', help='compile a text inventory')
+    p.add_argument('inventory', help="inventory text file ('-' for stdin)")
+    p.add_argument('database', help='host database to write')
+    p = sub.add_parser('show', help='print the hosts in a host database')
+    p.add_argument('database')
+    p.add_argument('attribute', nargs='?',
+                   help='only hosts with this attribute')
+    args = parser.parse_args(argv)
+
+    if args.command == 'compile':
+        if args.inventory == '-':
+            n = compile_inventory(sys.stdin, args.database)
+        else:
+            with open(args.inventory, 'rb') as f:
+                n = compile_inventory(f, args.database)
+        sys.stderr.write('%d hosts written to %s\n' % (n, args.database))
+    elif args.command == 'show':
+        db = HostDB(args.database)
+        if args.attribute is None:
+            print(db.hosts())
+        else:
+            print(db.with_attribute(args.attribute))
+    else:
+        parser.error('no command given')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,510 @@
+# pdshpy host-selection expressions
+#
+# Expressions like "gpu & !down & rack[10-20]", which pick hosts out of a
+# host database by attribute or name, or out of a plain hostlist by name:
+#
+#     expr    := and ('|' and)*
+#     and     := not ('&' not)*
+#     not     := '!' not | '(' expr ')' | '*' | names
+#     names   := a hostlist, like "node[1-10,20],login1"
+#
+# This is the same language, simplified the same way, as pdshpy's native
+# HostExpr type (see hostexpr.h), in plain Python, for code running outside
+# of pdsh. Drivers get whichever is available from util.HostExpr.
+
+import collections
+import re
+
+from pdshpy import hostdb
+from pdshpy import hostlist
+
+# how many compiled expressions are kept
+CACHE_SIZE = 64
+
+MAX_DEPTH = 256
+MAX_DIGITS = hostdb.MAX_DIGITS
+
+# characters which can't be part of a name
+_OPERATORS = '&|!()*'
+_SPACE = ' \t\n\v\f\r'
+
+NONE, ALL, NAMES, NOT, AND, OR = range(6)
+
+_cache = collections.OrderedDict()
+
+_trailing_digits = re.compile(r'^(.*?)([0-9]+)$', re.DOTALL)
+
+
+class _Node(object):
+    def __init__(self, type, kids=None, terms=None):
+        self.type = type
+        self.kids = kids or []
+        # each [prefix, ranges], ranges being [lo, hi, width] lists (or
+        # empty, for just a name)
+        self.terms = terms or []
+        self.text = None
+
+
+class _Parser(object):
+    def __init__(self, text):
+        self.text = text
+        self.p = 0
+        self.depth = 0
+
+    def error(self, message):
+        raise ValueError('%s at column %d' % (message, self.p + 1))
+
+    def peek(self):
+        return self.text[self.p] if self.p < len(self.text) else ''
+
+    def skip_space(self):
+        while self.peek() and self.peek() in _SPACE:
+            self.p += 1
+
+    def parse_or(self):
+        return self.parse_list('|', OR, self.parse_and)
+
+    def parse_and(self):
+        return self.parse_list('&', AND, self.parse_not)
+
+    def parse_list(self, op, type, parse):
+        kid = parse()
+        self.skip_space()
+        if self.peek() != op:
+            return kid
+        n = _Node(type, [kid])
+        while self.peek() == op:
+            self.p += 1
+            n.kids.append(parse())
+            self.skip_space()
+        return n
+
+    def parse_not(self):
+        self.skip_space()
+        self.depth += 1
+        if self.depth > MAX_DEPTH:
+            self.error('expression nested too deeply')
+        c = self.peek()
+        if c == '!':
+            self.p += 1
+            n = _Node(NOT, [self.parse_not()])
+        elif c == '(':
+            self.p += 1
+            n = self.parse_or()
+            self.skip_space()
+            if self.peek() != ')':
+                self.error("missing ')'")
+            self.p += 1
+        elif c == '*':
+            self.p += 1
+            n = _Node(ALL)
+        else:
+            n = self.parse_names()
+        self.depth -= 1
+        return n
+
+    def parse_names(self):
+        start = end = self.p
+        text = self.text
+        while (end < len(text) and text[end] not in _SPACE
+               and text[end] not in _OPERATORS):
+            end += 1
+        if end == start:
+            if start == len(text):
+                self.error('expression ends too soon')
+            self.error("unexpected '%s'" % text[start])
+
+        n = _Node(NAMES)
+        piece = start
+        while piece <= end:
+            # the next comma outside a range
+            comma, depth = piece, 0
+            while comma < end:
+                if text[comma] == '[':
+                    depth += 1
+                elif text[comma] == ']':
+                    depth -= 1
+                elif text[comma] == ',' and depth == 0:
+                    break
+                comma += 1
+            if comma == piece:
+                self.p = piece
+                self.error('empty name')
+            n.terms.append(self.parse_term(piece, comma))
+            piece = comma + 1
+        self.p = end
+        return n
+
+    def parse_term(self, start, end):
+        s = self.text[start:end]
+        open = s.find('[')
+        self.p = start
+        if open < 0 and ']' in s:
+            self.error("unmatched ']'")
+        if open >= 0 and ']' not in s[open:]:
+            self.error("unmatched '['")
+        if open >= 0 and (']' in s[:open] or s[-1] != ']'
+                          or '[' in s[open + 1:]):
+            self.error('only one range, at the end, is allowed in a name')
+
+        if open < 0:
+            # a plain name: any number on the end is made into a range
+            ranges = []
+            m = _trailing_digits.match(s)
+            if m is None or len(m.group(2)) > MAX_DIGITS:
+                return [s, ranges]
+            num, width = _read_number(m.group(2))
+            _add_numbers(ranges, num, num, width)
+            return [m.group(1), ranges]
+
+        ranges = []
+        p, last = open + 1, len(s) - 1
+        while p < last:
+            self.p = start + p
+            digits = _digits_at(s, p, last)
+            if not digits:
+                self.error('expected a number of at most %d digits'
+                           % MAX_DIGITS)
+            lo, width = _read_number(digits)
+            p += len(digits)
+            hi = lo
+            if s[p] == '-':
+                p += 1
+                self.p = start + p
+                digits = _digits_at(s, p, last)
+                if not digits:
+                    self.error('expected a number of at most %d digits'
+                               % MAX_DIGITS)
+                hi, _ = _read_number(digits)
+                p += len(digits)
+                if hi < lo:
+                    self.error('range goes backwards')
+            _add_numbers(ranges, lo, hi, width)
+            if s[p] == ',' and p + 1 < last:
+                p += 1
+            elif p != last:
+                self.p = start + p
+                self.error("unexpected '%s' in range" % s[p])
+        if not ranges:
+            self.p = start + open
+            self.error('empty range')
+        return [s[:open], ranges]
+
+
+def _digits_at(s, p, end):
+    """
+    The number at s[p:end], or '' if there isn't one of at most MAX_DIGITS
+    digits.
+    """
+    n = p
+    while n < end and s[n] in '0123456789':
+        n += 1
+    return s[p:n] if n - p <= MAX_DIGITS else ''
+
+
+def _read_number(digits):
+    width = len(digits) if len(digits) > 1 and digits[0] == '0' else 0
+    return int(digits), width
+
+
+def _add_numbers(ranges, lo, hi, width):
+    """
+    Add numbers lo to hi, written with at least 'width' digits, split into
+    the zero-padded ones and the rest, as hostexpr.c does.
+    """
+    padded = 10 ** (width - 1) if width > 1 else 0
+    if lo < padded:
+        ranges.append([lo, min(hi, padded - 1), width])
+    if hi >= padded:
+        ranges.append([max(lo, padded), hi, 0])
+
+
+def _term_text(term):
+    prefix, ranges = term
+    if len(ranges) == 1 and ranges[0][0] == ranges[0][1]:
+        return '%s%0*d' % (prefix, ranges[0][2], ranges[0][0])
+    if not ranges:
+        return prefix
+    spans = []
+    for lo, hi, width in ranges:
+        if hi > lo:
+            spans.append('%0*d-%0*d' % (width, lo, width, hi))
+        else:
+            spans.append('%0*d' % (width, lo))
+    return '%s[%s]' % (prefix, ','.join(spans))
+
+
+def _kid_text(kid, type):
+    if (kid.type == OR and type != OR) or (kid.type == AND and type == NOT):
+        return '(%s)' % kid.text
+    return kid.text
+
+
+def _set_text(n):
+    if n.type == NONE:
+        n.text = '!*'
+    elif n.type == ALL:
+        n.text = '*'
+    elif n.type == NAMES:
+        n.text = ','.join(_term_text(t) for t in n.terms)
+    elif n.type == NOT:
+        n.text = '!' + _kid_text(n.kids[0], NOT)
+    else:
+        n.text = (' & ' if n.type == AND else ' | ').join(
+            _kid_text(k, n.type) for k in n.kids)
+    return n
+
+
+def _merge_names(n):
+    """
+    Sort and merge the ranges of each prefix, and drop repeated names.
+    """
+    terms = []
+    for prefix, ranges in sorted(n.terms, key=lambda t: (bool(t[1]), t[0])):
+        if terms and bool(terms[-1][1]) == bool(ranges) \
+                and terms[-1][0] == prefix:
+            terms[-1][1].extend(ranges)
+        else:
+            terms.append([prefix, list(ranges)])
+    for term in terms:
+        merged = []
+        for lo, hi, width in sorted(term[1], key=lambda r: (r[2], r[0])):
+            if merged and merged[-1][2] == width and lo <= merged[-1][1] + 1:
+                merged[-1][1] = max(merged[-1][1], hi)
+            else:
+                merged.append([lo, hi, width])
+        term[1] = merged
+    n.terms = terms
+
+
+def _simplify_not(n):
+    kid = n.kids[0] = _simplify(n.kids[0])
+    if kid.type == NOT:
+        return kid.kids[0]
+    if kid.type in (ALL, NONE):
+        return _simplify(_Node(NONE if kid.type == ALL else ALL))
+    return _set_text(n)
+
+
+def _gather_nots(n):
+    """
+    !a & !b is !(a | b), so a and b can be merged and taken away together.
+    """
+    nots = [k for k in n.kids if k.type == NOT]
+    if len(nots) < 2:
+        return
+    n.kids = [k for k in n.kids if k.type != NOT]
+    n.kids.append(_simplify(_Node(NOT, [_Node(OR, [k.kids[0]
+                                                  for k in nots])])))
+
+
+def _simplify_list(n):
+    identity, absorbing = (ALL, NONE) if n.type == AND else (NONE, ALL)
+    kids = []
+    for kid in n.kids:
+        kid = _simplify(kid)
+        if kid.type == n.type:
+            kids.extend(kid.kids)
+        elif kid.type == absorbing:
+            return kid
+        elif kid.type != identity:
+            kids.append(kid)
+    n.kids = kids
+
+    if n.type == OR:
+        # names ORed together are just more names
+        names = None
+        kids = []
+        for kid in n.kids:
+            if kid.type != NAMES or names is None:
+                kids.append(kid)
+                if kid.type == NAMES:
+                    names = kid
+            else:
+                names.terms.extend(kid.terms)
+        n.kids = kids
+        if names is not None:
+            _merge_names(names)
+            _set_text(names)
+    else:
+        _gather_nots(n)
+    for kid in n.kids:
+        if kid.type == absorbing:
+            return kid
+    n.kids = [k for k in n.kids if k.type != identity]
+
+    # drop repeats; and x with !x is nothing (or everything)
+    kids = []
+    for kid in sorted(n.kids, key=lambda k: (k.type == NOT, k.text)):
+        if not kids or kids[-1].text != kid.text:
+            kids.append(kid)
+    n.kids = kids
+    texts = set(k.text for k in kids)
+    for kid in kids:
+        if kid.type == NOT and kid.kids[0].text in texts:
+            return _simplify(_Node(absorbing))
+
+    if not kids:
+        return _simplify(_Node(identity))
+    if len(kids) == 1:
+        return kids[0]
+    return _set_text(n)
+
+
+def _simplify(n):
+    if n.type == NOT:
+        return _simplify_not(n)
+    if n.type in (AND, OR):
+        return _simplify_list(n)
+    if n.type == NAMES:
+        _merge_names(n)
+    return _set_text(n)
+
+
+def _compile(text):
+    root = _cache.get(text)
+    if root is not None:
+        del _cache[text]
+        _cache[text] = root
+        return root
+    ps = _Parser(text)
+    root = ps.parse_or()
+    ps.skip_space()
+    if ps.p < len(text):
+        ps.error("unexpected '%s'" % text[ps.p])
+    root = _simplify(root)
+    if len(_cache) >= CACHE_SIZE:
+        _cache.popitem(last=False)
+    _cache[text] = root
+    return root
+
+
+def _term_matches(term, name):
+    """
+    Whether 'term' names 'name'.
+    """
+    prefix, ranges = term
+    if not ranges:
+        return name == prefix
+    if not name.startswith(prefix):
+        return False
+    rest = name[len(prefix):]
+    if not rest or len(rest) > MAX_DIGITS or rest.strip('0123456789'):
+        return False
+    num, width = _read_number(rest)
+    for lo, hi, rwidth in ranges:
+        if rwidth == width and lo <= num <= hi:
+            return True
+    return False
+
+
+class _DBEval(object):
+    """
+    Picks hosts from a pdshpy.hostdb.HostDB, as the bits of an int.
+    """
+
+    def __init__(self, db):
+        self.db = db
+        self.all = (1 << len(db)) - 1
+        self.attrs = None
+
+    def leaf(self, n):
+        db = self.db
+        if self.attrs is None:
+            self.attrs = [hostdb._text(db._attr_name(i))
+                          for i in range(db._nattrs)]
+        bits = 0
+        for prefix, ranges in n.terms:
+            for i, name in enumerate(self.attrs):
+                if _term_matches([prefix, ranges], name):
+                    bits |= db._attr_bits(i)
+            if not ranges:
+                hid = db._host_id(prefix)
+                if hid is not None:
+                    bits |= 1 << hid
+                continue
+            for i in range(db._nranges):
+                pi, lo, hi, width, flags, first_host, _ = db._range(i)
+                if flags & hostdb.RANGE_BARE or \
+                        db._prefix_name(pi) != hostdb._bytes(prefix):
+                    continue
+                for rlo, rhi, rwidth in ranges:
+                    first, last = max(lo, rlo), min(hi, rhi)
+                    if rwidth != width or first > last:
+                        continue
+                    bits |= (((1 << (last - first + 1)) - 1)
+                             << (first_host + first - lo))
+        return bits
+
+    def select(self, n, cand):
+        if n.type == NONE or not cand:
+            return 0
+        if n.type == ALL:
+            return cand
+        if n.type == NAMES:
+            return self.leaf(n) & cand
+        if n.type == NOT:
+            return cand & ~self.select(n.kids[0], cand)
+        if n.type == AND:
+            for kid in n.kids:
+                cand = self.select(kid, cand)
+            return cand
+        got = 0
+        for kid in n.kids:
+            found = self.select(kid, cand & ~got)
+            got |= found
+        return got
+
+
+class _NameEval(_DBEval):
+    """
+    Picks hosts from a list of hostnames, as the bits of an int.
+    """
+
+    def __init__(self, names):
+        self.names = names
+        self.all = (1 << len(names)) - 1
+
+    def leaf(self, n):
+        bits = 0
+        for i, name in enumerate(self.names):
+            if any(_term_matches(t, name) for t in n.terms):
+                bits |= 1 << i
+        return bits
+
+
+class HostExpr(object):
+    """
+    Stand-in for pdshpy's native HostExpr type: a compiled host-selection
+    expression. str() gives the simplified expression.
+    """
+
+    def __init__(self, expr):
+        try:
+            self._root = _compile(expr)
+        except ValueError as e:
+            raise ValueError("bad host expression '%s': %s" % (expr, e))
+
+    def __str__(self):
+        return self._root.text
+
+    def __repr__(self):
+        return "HostExpr('%s')" % self._root.text
+
+    def select(self, source):
+        """
+        The hosts the expression selects: from a HostDB, as a HostBitmap;
+        from a HostList, ranged string or iterable of hostnames, as a new
+        HostList, in the same order.
+        """
+        if isinstance(source, hostdb.HostDB):
+            ev = _DBEval(source)
+            return hostdb.HostBitmap(source, ev.select(self._root, ev.all))
+        if isinstance(source, hostlist._string_types):
+            names = hostlist.expand(source)
+        else:
+            names = [hostlist._host_str(h) for h in source]
+        ev = _NameEval(names)
+        bits = ev.select(self._root, ev.all)
+        return hostlist.HostList([h for i, h in enumerate(names)
+                                  if (bits >> i) & 1])
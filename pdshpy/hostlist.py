@@ -0,0 +1,414 @@
+# pdshpy hostlist helpers
+#
+# Conversion between lists of hostnames and pdsh's ranged hostlist syntax
+# ("node[1-10,15],foo[01-04]-ib,bar"), for code which runs outside of pdsh
+# and so can't use its hostlist implementation.
+
+import array
+import re
+
+try:
+    _string_types = basestring
+    _text_type = unicode
+except NameError:
+    _string_types = str
+    _text_type = str
+
+_trailing_digits = re.compile(r'^(.*?)(\d+)$')
+
+# the most digits a host number can have, as in rangeset.h
+MAX_DIGITS = 18
+
+_MASK64 = (1 << 64) - 1
+
+
+def _host_str(host):
+    """
+    A hostname given by a driver, as a str: bytes are taken to be UTF-8, as
+    pdshpy itself takes them, rather than becoming "b'node1'".
+    """
+    if isinstance(host, bytes) and not isinstance(host, str):
+        return host.decode('utf-8')
+    return str(host)
+
+
+def _split_toplevel(s):
+    """
+    Split a hostlist expression on commas which aren't inside brackets.
+    """
+    parts = []
+    depth = 0
+    start = 0
+    for i, c in enumerate(s):
+        if c == '[':
+            depth += 1
+        elif c == ']':
+            depth -= 1
+        elif c == ',' and depth == 0:
+            parts.append(s[start:i])
+            start = i + 1
+    parts.append(s[start:])
+    return [p.strip() for p in parts if p.strip()]
+
+
+def _host_key(host):
+    """
+    Hostnames in the order pdshpy's set operations put them: by prefix, then
+    number of digits, then number.
+    """
+    m = _trailing_digits.match(host)
+    if m is None or len(m.group(2)) > MAX_DIGITS:
+        return host, 0, 0
+    return m.group(1), len(m.group(2)), int(m.group(2))
+
+
+def _sample_hash(host, seed):
+    """
+    The hash rangeset_sample() picks hosts by: 64-bit FNV-1a of the name,
+    starting from its offset basis xor the seed, then MurmurHash3's
+    finalizer.
+    """
+    if not isinstance(host, bytes):
+        host = host.encode('utf-8')
+    h = 14695981039346656037 ^ seed
+    for b in bytearray(host):
+        h = ((h ^ b) * 1099511628211) & _MASK64
+    h ^= h >> 33
+    h = (h * 0xff51afd7ed558ccd) & _MASK64
+    h ^= h >> 33
+    h = (h * 0xc4ceb9fe1a85ec53) & _MASK64
+    h ^= h >> 33
+    return h
+
+
+def _check_parts(n):
+    if n <= 0:
+        raise ValueError('must be greater than 0')
+
+
+def _width_of(digits):
+    if len(digits) > 1 and digits.startswith('0'):
+        return len(digits)
+    return 0
+
+
+def expand(ranged):
+    """
+    Expand a ranged hostlist string into a list of hostnames, in order.
+    """
+    hosts = []
+    if not ranged:
+        return hosts
+    for part in _split_toplevel(ranged):
+        open_at = part.find('[')
+        if open_at < 0:
+            hosts.append(part)
+            continue
+        close_at = part.find(']', open_at)
+        if close_at < 0:
+            raise ValueError('unterminated range in %r' % part)
+        prefix = part[:open_at]
+        suffix = part[close_at + 1:]
+        for r in part[open_at + 1:close_at].split(','):
+            lo, sep, hi = r.partition('-')
+            if not sep:
+                hi = lo
+            width = _width_of(lo)
+            for n in range(int(lo), int(hi) + 1):
+                hosts.append('%s%0*d%s' % (prefix, width, n, suffix))
+    return hosts
+
+
+def compress(hosts):
+    """
+    Turn an iterable of hostnames into a ranged hostlist string. Order is
+    preserved, so only runs of adjacent hosts get collapsed; sort first if
+    you want the shortest possible result.
+    """
+    groups = []         # list of [prefix, width, [[lo, hi], ...]]
+    for host in hosts:
+        host = _host_str(host)
+        m = _trailing_digits.match(host)
+        if m is None:
+            groups.append([host, None, None])
+            continue
+        prefix, digits = m.groups()
+        num = int(digits)
+        last = groups[-1] if groups else None
+        if (last is not None and last[1] is not None and last[0] == prefix
+                and '%0*d' % (last[1], num) == digits):
+            ranges = last[2]
+            if ranges[-1][1] + 1 == num:
+                ranges[-1][1] = num
+            else:
+                ranges.append([num, num])
+        else:
+            groups.append([prefix, _width_of(digits), [[num, num]]])
+
+    out = []
+    for prefix, width, ranges in groups:
+        if width is None:
+            out.append(prefix)
+            continue
+        if len(ranges) == 1 and ranges[0][0] == ranges[0][1]:
+            out.append('%s%0*d' % (prefix, width, ranges[0][0]))
+            continue
+        spans = []
+        for lo, hi in ranges:
+            if lo == hi:
+                spans.append('%0*d' % (width, lo))
+            else:
+                spans.append('%0*d-%0*d' % (width, lo, width, hi))
+        out.append('%s[%s]' % (prefix, ','.join(spans)))
+    return ','.join(out)
+
+
+class HostList(list):
+    """
+    Stand-in for pdshpy's native HostList type, for code running outside of
+    pdsh (a pdshpy server, say): a list of hostnames with the same extra
+    methods, so drivers can work on pdsh_opts.wcoll the same way anywhere.
+    """
+
+    def __init__(self, hosts=None):
+        list.__init__(self)
+        if hosts is not None:
+            self.extend(hosts)
+
+    def __str__(self):
+        return compress(self)
+
+    def __repr__(self):
+        return 'HostList(%r)' % compress(self)
+
+    __hash__ = None
+
+    def __getitem__(self, index):
+        if isinstance(index, slice):
+            return HostList(list.__getitem__(self, index))
+        return list.__getitem__(self, index)
+
+    def __setitem__(self, index, hosts):
+        if isinstance(index, slice):
+            # a slice takes hosts as extend() does
+            hosts = HostList(hosts)
+        else:
+            hosts = _host_str(hosts)
+        list.__setitem__(self, index, hosts)
+
+    if bytes is str:
+        # Python 2 slices lists without going through the above
+        def __getslice__(self, i, j):
+            return self.__getitem__(slice(max(i, 0), max(j, 0)))
+
+        def __setslice__(self, i, j, hosts):
+            self.__setitem__(slice(max(i, 0), max(j, 0)), hosts)
+
+    def __add__(self, other):
+        if not isinstance(other, (_string_types, list)):
+            return NotImplemented
+        result = HostList(self)
+        result.extend(other)
+        return result
+
+    def __radd__(self, other):
+        if not isinstance(other, (_string_types, list)):
+            return NotImplemented
+        result = HostList(other)
+        result.extend(self)
+        return result
+
+    def __iadd__(self, hosts):
+        self.extend(hosts)
+        return self
+
+    def add(self, host):
+        self.append(host)
+
+    def append(self, host):
+        list.append(self, _host_str(host))
+
+    def insert(self, i, host):
+        list.insert(self, i, _host_str(host))
+
+    def extend(self, hosts):
+        # a ranged string, in UTF-8, as pdshpy takes it
+        if isinstance(hosts, bytes):
+            hosts = _host_str(hosts)
+        if isinstance(hosts, _string_types):
+            hosts = expand(hosts)
+        list.extend(self, [_host_str(h) for h in hosts])
+
+    def clear(self):
+        del self[:]
+
+    def remove(self, host):
+        if host not in self:
+            raise ValueError(host)
+        self.discard(host)
+
+    def discard(self, host):
+        self[:] = [h for h in self if h != host]
+
+    def delete(self, ranged):
+        doomed = set(expand(ranged))
+        before = len(self)
+        self[:] = [h for h in self if h not in doomed]
+        return before - len(self)
+
+    def sort(self, key=None, reverse=False):
+        list.sort(self, key=_host_key if key is None else key,
+                  reverse=reverse)
+
+    def uniq(self):
+        self[:] = sorted(set(self), key=_host_key)
+
+    def copy(self):
+        return HostList(self)
+
+    def _set_op(self, other, op):
+        if isinstance(other, _string_types):
+            other = expand(other)
+        hosts = op(set(self), set(_host_str(h) for h in other))
+        return HostList(sorted(hosts, key=_host_key))
+
+    def union(self, other):
+        return self._set_op(other, set.union)
+
+    def intersection(self, other):
+        return self._set_op(other, set.intersection)
+
+    def difference(self, other):
+        return self._set_op(other, set.difference)
+
+    def _operand(self, other):
+        if isinstance(other, _string_types):
+            return HostList(other)
+        return other if isinstance(other, HostList) else None
+
+    def __or__(self, other):
+        other = self._operand(other)
+        return NotImplemented if other is None else self.union(other)
+
+    def __and__(self, other):
+        other = self._operand(other)
+        return NotImplemented if other is None else self.intersection(other)
+
+    def __sub__(self, other):
+        other = self._operand(other)
+        return NotImplemented if other is None else self.difference(other)
+
+    def __ror__(self, other):
+        other = self._operand(other)
+        return NotImplemented if other is None else other.union(self)
+
+    def __rand__(self, other):
+        other = self._operand(other)
+        return NotImplemented if other is None else other.intersection(self)
+
+    def __rsub__(self, other):
+        other = self._operand(other)
+        return NotImplemented if other is None else other.difference(self)
+
+    def chunks(self, n):
+        _check_parts(n)
+        size, extra = divmod(len(self), n)
+        parts = []
+        start = 0
+        for k in range(n):
+            end = start + size + (k < extra)
+            parts.append(HostList(self[start:end]))
+            start = end
+        return parts
+
+    def batches(self, n):
+        _check_parts(n)
+        return [HostList(self[i:i + n]) for i in range(0, len(self), n)]
+
+    def interleave(self, n):
+        _check_parts(n)
+        return [HostList(self[k::n]) for k in range(n)]
+
+    def sample(self, percent, seed=0):
+        if not 0 <= percent <= 100:
+            raise ValueError('percent must be from 0 to 100')
+        threshold = int(percent * 1000000 / 100.0 + 0.5)
+        return HostList(h for h in self
+                        if _sample_hash(h, seed) % 1000000 < threshold)
+
+
+# hosts per HostBatch, as PYHOSTBATCH_SIZE in pyhostbatch.h
+BATCH_SIZE = 4096
+
+
+class HostBatch(object):
+    """
+    Stand-in for pdshpy's native HostBatch type, for a driver's
+    filter_hosts() run outside of pdsh: a run of hosts kept in one buffer,
+    'data', each followed by a NUL, with 'offsets' holding len(batch) + 1
+    unsigned ints so that host i is data[offsets[i]:offsets[i + 1] - 1].
+    Indexing or iterating gives the names as strings.
+    """
+
+    def __init__(self, hosts):
+        self._hosts = [_host_str(h) for h in hosts]
+        names = [h if isinstance(h, bytes) else h.encode('utf-8')
+                 for h in self._hosts]
+        offsets = [0]
+        for name in names:
+            offsets.append(offsets[-1] + len(name) + 1)
+        self.data = memoryview(b''.join(name + b'\0' for name in names))
+        self.offsets = array.array('I', offsets)
+
+    def __repr__(self):
+        return '<HostBatch of %d hosts>' % len(self._hosts)
+
+    def __len__(self):
+        return len(self._hosts)
+
+    def __getitem__(self, i):
+        return self._hosts[i]
+
+    def __iter__(self):
+        return iter(self._hosts)
+
+    def _keeps(self, mask):
+        """
+        What filter_hosts() returned for this batch, as a list of whether to
+        keep each host: a buffer of a byte per host (nonzero keeps it) or a
+        bit per host (the low bit of the first byte is host 0), a sequence
+        of a true or false value per host, or None to keep them all.
+        """
+        n = len(self._hosts)
+        if mask is None:
+            return [True] * n
+        if isinstance(mask, _text_type):
+            raise TypeError('mask should be a buffer, a sequence or None, '
+                            'not %s' % type(mask).__name__)
+        try:
+            raw = bytearray(memoryview(mask).tobytes())
+        except TypeError:
+            keep = [bool(k) for k in mask]
+            if len(keep) != n:
+                raise ValueError('mask of %d values for %d hosts'
+                                 % (len(keep), n))
+            return keep
+        if len(raw) == n:
+            return [b != 0 for b in raw]
+        if len(raw) == (n + 7) // 8:
+            return [bool(raw[i // 8] >> (i % 8) & 1) for i in range(n)]
+        raise ValueError('mask of %d bytes for %d hosts' % (len(raw), n))
+
+
+def filter_batches(hosts, func):
+    """
+    The hosts in 'hosts' which func(batch) keeps, calling it with a
+    HostBatch of up to BATCH_SIZE of them at a time, as pdshpy calls a
+    driver's filter_hosts().
+    """
+    hosts = list(hosts)
+    kept = []
+    for start in range(0, len(hosts), BATCH_SIZE):
+        batch = HostBatch(hosts[start:start + BATCH_SIZE])
+        kept.extend(h for h, k in zip(batch, batch._keeps(func(batch))) if k)
+    return kept
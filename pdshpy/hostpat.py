@@ -0,0 +1,106 @@
+# pdshpy host patterns
+#
+# Sets of host patterns, like maintenance lists and exclusions, one per line
+# (blank lines and lines starting with '#' are skipped):
+#
+#     node[1-10],login1    a hostlist: exactly those hosts
+#     rack1*, n?-ib        a glob, for any pattern with '*' or '?', matched
+#                          as fnmatch.fnmatchcase() does
+#     glob:node[12]        a glob, for ones with no '*' or '?'
+#     re:^gpu\d+$          a regular expression, matched as re.search()
+#
+# This is the same thing as pdshpy's native HostPatterns type (see
+# hostpat.h), in plain Python, for code running outside of pdsh; it tries
+# the patterns one at a time rather than compiling them together, and takes
+# any regular expression re does, even the ones the native type turns down.
+# Drivers get whichever is available from util.HostPatterns.
+
+import fnmatch
+import re
+
+from pdshpy import hostlist
+
+try:
+    _string_types = basestring
+except NameError:
+    _string_types = str
+
+# \d, \s and \w are ASCII only, as they are natively
+_FLAGS = getattr(re, 'ASCII', 0)
+
+_SPACE = ' \t\n\v\f\r'
+
+
+class HostPatterns(object):
+    """
+    HostPatterns(patterns, cache=False): a set of host patterns, from a
+    string with one per line or an iterable of them. cache is for the
+    native type's sake, which can keep what it compiles between runs.
+    """
+
+    def __init__(self, patterns, cache=False):
+        if not isinstance(patterns, _string_types):
+            patterns = '\n'.join(patterns)
+        self._text = patterns
+        self._names = set()
+        self._globs = []
+        self._regexes = []
+        self._count = 0
+        for lineno, line in enumerate(patterns.split('\n'), 1):
+            line = line.strip(_SPACE)
+            if not line or line.startswith('#'):
+                continue
+            self._count += 1
+            try:
+                if line.startswith('re:'):
+                    self._regexes.append(re.compile(line[3:], _FLAGS).search)
+                elif line.startswith('glob:'):
+                    self._add_glob(line[5:])
+                elif '*' in line or '?' in line:
+                    self._add_glob(line)
+                else:
+                    self._names.update(hostlist.expand(line))
+            except (re.error, ValueError) as e:
+                raise ValueError("bad host pattern: line %d ('%s'): %s"
+                                 % (lineno, line, e))
+
+    def _add_glob(self, glob):
+        self._globs.append(re.compile(fnmatch.translate(glob)).match)
+
+    def __str__(self):
+        return self._text
+
+    def __repr__(self):
+        return '<HostPatterns of %d patterns>' % self._count
+
+    def __len__(self):
+        return self._count
+
+    def __contains__(self, host):
+        return isinstance(host, _string_types) and self.matches(host)
+
+    def matches(self, host):
+        if host in self._names:
+            return True
+        for match in self._globs:
+            if match(host):
+                return True
+        for search in self._regexes:
+            if search(host):
+                return True
+        return False
+
+    def select(self, hosts):
+        return hostlist.HostList(h for h in hostlist.HostList(hosts)
+                                 if self.matches(h))
+
+    def exclude(self, hosts):
+        return hostlist.HostList(h for h in hostlist.HostList(hosts)
+                                 if not self.matches(h))
+
+    def remove_from(self, hosts):
+        if not isinstance(hosts, hostlist.HostList):
+            raise TypeError('remove_from() takes a HostList')
+        before = len(hosts)
+        hosts[:] = [h for h in hosts if not self.matches(h)]
+        return before - len(hosts)
@@ -0,0 +1,97 @@
+# pdshpy liveness checks
+#
+# Tells which hosts don't accept a TCP connection on a port, trying many at
+# once with non-blocking sockets. This is the same thing as pdshpy's native
+# check (see liveness.h), in plain Python, for code running outside of pdsh;
+# it keeps fewer attempts in flight, and waits on them with select.poll()
+# (or select.select() where there's no poll). Drivers get whichever is
+# available from util.probe_hosts().
+
+import errno
+import select
+import socket
+import time
+
+from pdshpy import hostlist
+
+# the most connection attempts in flight at once; select() can't go past
+# FD_SETSIZE
+MAX_INFLIGHT = 512 if hasattr(select, 'poll') else 256
+
+_IN_PROGRESS = (errno.EINPROGRESS, errno.EALREADY, errno.EWOULDBLOCK)
+
+
+def _start(host, port):
+    """
+    Start connecting to host:port. Returns the socket, which is connected
+    or on its way, or None if the host is already known to be down.
+    """
+    try:
+        addrs = socket.getaddrinfo(host, port, 0, socket.SOCK_STREAM)
+    except (socket.error, UnicodeError):
+        return None
+    for family, type_, proto, _, addr in addrs:
+        try:
+            sock = socket.socket(family, type_, proto)
+        except socket.error:
+            continue
+        sock.setblocking(False)
+        err = sock.connect_ex(addr)
+        if err == 0 or err in _IN_PROGRESS:
+            return sock
+        sock.close()
+    return None
+
+
+def _wait(socks, timeout):
+    """
+    Wait up to timeout seconds for any of socks (a dict by fileno) to
+    finish connecting, and return the filenos of those which have.
+    """
+    if hasattr(select, 'poll'):
+        poller = select.poll()
+        for fd in socks:
+            poller.register(fd, select.POLLOUT)
+        return [fd for fd, _ in poller.poll(max(timeout, 0) * 1000)]
+    _, ready, failed = select.select([], list(socks), list(socks),
+                                     max(timeout, 0))
+    return set(ready) | set(failed)
+
+
+def probe_hosts(hosts, port, timeout=1.0):
+    """
+    A HostList of the given hosts which don't accept a TCP connection on
+    port within timeout seconds of being tried, in the order given.
+    """
+    hosts = list(hostlist.HostList(hosts))
+    down = set()
+    inflight = {}               # fileno -> (socket, host, deadline)
+    pending = iter(hosts)
+    done = False
+    while not done or inflight:
+        while not done and len(inflight) < MAX_INFLIGHT:
+            host = next(pending, None)
+            if host is None:
+                done = True
+                break
+            sock = _start(host, port)
+            if sock is None:
+                down.add(host)
+            else:
+                inflight[sock.fileno()] = (sock, host,
+                                           time.time() + timeout)
+        if not inflight:
+            break
+        soonest = min(deadline for _, _, deadline in inflight.values())
+        for fd in _wait(inflight, soonest - time.time()):
+            sock, host, _ = inflight.pop(fd)
+            if sock.getsockopt(socket.SOL_SOCKET, socket.SO_ERROR) != 0:
+                down.add(host)
+            sock.close()
+        now = time.time()
+        for fd, (sock, host, deadline) in list(inflight.items()):
+            if deadline <= now:
+                del inflight[fd]
+                down.add(host)
+                sock.close()
+    return hostlist.HostList(h for h in hosts if h in down)
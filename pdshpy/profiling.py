@@ -0,0 +1,101 @@
+# pdshpy callback profiling
+#
+# When PDSHPY_PROFILE names a directory, pdshpy runs each driver callback
+# (initialize, process_option, collect_hosts, perform_postop) through a
+# Profiler, and writes out what it found when pdsh is done.
+#
+# Two modes are available, chosen with PDSHPY_PROFILE_MODE:
+#
+#   cprofile  (default) deterministic profiling with cProfile. Writes one
+#             <phase>.<pid>.pstats file per callback, for use with pstats or
+#             any of the usual viewers.
+#
+#   sample    statistical profiling driven by SIGPROF, cheap enough to leave
+#             on in production. Writes one <phase>.<pid>.folded file per
+#             callback, in the collapsed-stack format that flamegraph.pl
+#             reads. Note that SIGPROF measures CPU time, so time spent
+#             blocked on I/O doesn't show up in samples.
+
+import cProfile
+import os
+import signal
+
+
+class Profiler(object):
+
+    MODES = ('cprofile', 'sample')
+
+    def __init__(self, outdir, mode='cprofile', interval_ms=5):
+        if mode not in self.MODES:
+            raise ValueError('unknown profiling mode %r (expected one of %s)'
+                             % (mode, ', '.join(self.MODES)))
+        self.outdir = outdir
+        self.mode = mode
+        self.interval = interval_ms / 1000.0
+        self.profiles = {}      # phase -> cProfile.Profile
+        self.stacks = {}        # phase -> {collapsed stack: sample count}
+        self.phase = None
+        self.old_handler = None
+        if not os.path.isdir(outdir):
+            os.makedirs(outdir)
+        if mode == 'sample':
+            self.old_handler = signal.signal(signal.SIGPROF, self._sample)
+            # don't let samples turn the driver's syscalls into EINTRs
+            signal.siginterrupt(signal.SIGPROF, False)
+
+    def call(self, phase, func, args):
+        """
+        Call func(*args), charging whatever it does to the named phase.
+        """
+        if self.mode == 'cprofile':
+            prof = self.profiles.get(phase)
+            if prof is None:
+                prof = self.profiles[phase] = cProfile.Profile()
+            return prof.runcall(func, *args)
+
+        outer = self.phase
+        self.phase = phase
+        signal.setitimer(signal.ITIMER_PROF, self.interval, self.interval)
+        try:
+            return func(*args)
+        finally:
+            signal.setitimer(signal.ITIMER_PROF, 0)
+            self.phase = outer
+
+    def _sample(self, signum, frame):
+        if self.phase is None:
+            return
+        names = []
+        own_code = self.call.__func__.__code__
+        # everything from call() on out is ours, not the driver's
+        while frame is not None and frame.f_code is not own_code:
+            code = frame.f_code
+            names.append('%s (%s:%d)' % (code.co_name,
+                                         os.path.basename(code.co_filename),
+                                         code.co_firstlineno))
+            frame = frame.f_back
+        names.reverse()
+        stack = ';'.join(names)
+        counts = self.stacks.setdefault(self.phase, {})
+        counts[stack] = counts.get(stack, 0) + 1
+
+    def finish(self):
+        """
+        Write out the results, and return a list of the files written.
+        """
+        written = []
+        pid = os.getpid()
+        for phase, prof in sorted(self.profiles.items()):
+            path = os.path.join(self.outdir, '%s.%d.pstats' % (phase, pid))
+            prof.dump_stats(path)
+            written.append(path)
+        for phase, counts in sorted(self.stacks.items()):
+            path = os.path.join(self.outdir, '%s.%d.folded' % (phase, pid))
+            with open(path, 'w') as f:
+                for stack, count in sorted(counts.items()):
+                    f.write('%s %d\n' % (stack, count))
+            written.append(path)
+        if self.old_handler is not None:
+            signal.signal(signal.SIGPROF, self.old_handler)
+            self.old_handler = None
+        return written
@@ -0,0 +1,673 @@
+# pdshpy server
+#
+# Keeps a driver module loaded in a long-running process, so that pdsh runs
+# don't each have to start an interpreter and import it from scratch. When
+# PDSHPY_SERVER names this server's socket, pdshpy.so connects to it and
+# forwards each callback here instead of running the driver itself.
+#
+# Run it as:
+#
+#     python -m pdshpy.server --socket /path/to/sock [--module pdshpy_module]
+#
+# Each connection (one per pdsh run) gets its own session object and its own
+# call to the driver's initialize(); anything the driver keeps at module level
+# (clients, parsed config, caches) stays warm between runs. Connections are
+# handled on threads of their own, but runs take turns calling into each
+# driver module, as they would each in a process of its own; a driver whose
+# callbacks are safe to call from several runs at once can say so with
+#
+#     threadsafe = True
+#
+# at module level. Prefetches and host sources run on threads of their own
+# either way, as they do in-process.
+#
+# With --fork, the server instead calls initialize() once, up front, and then
+# forks a child to handle each connection. Each run starts from a copy of the
+# fully initialized driver and session, and nothing it does can leak into the
+# next run. When the driver module's file changes, the server re-executes
+# itself so the new code gets picked up.
+#
+# The wire format is described in wire.h.
+
+import argparse
+import errno
+import importlib
+import os
+import select
+import signal
+import socket
+import struct
+import sys
+import threading
+import traceback
+
+from pdshpy import hostlist, util
+
+PROTOCOL_VERSION = 1
+
+# keep this in sync with pdshpy_opt_fields in pdshpy.c
+OPT_FIELDS = (
+    ('progname', str),
+    ('debug', bool),
+    ('info_only', bool),
+    ('test_range_expansion', bool),
+    ('sdr_verify', bool),
+    ('sdr_global', bool),
+    ('altnames', bool),
+    ('sigint_terminates', bool),
+    ('luser', str),
+    ('luid', int),
+    ('ruser', str),
+    ('fanout', int),
+    ('connect_timeout', int),
+    ('command_timeout', int),
+    ('rcmd_name', str),
+    ('misc_modules', str),
+    ('resolve_hosts', bool),
+    ('kill_on_fail', bool),
+    ('separate_stderr', bool),
+    ('stdin_unavailable', bool),
+    ('cmd', str),
+    ('dshpath', str),
+    ('getstat', str),
+    ('ret_remote_rc', bool),
+    ('labels', bool),
+    ('preserve', bool),
+    ('recursive', bool),
+    ('outfile_name', str),
+    ('pcp_server', bool),
+    ('target_is_directory', bool),
+    ('pcp_client', bool),
+    ('pcp_client_host', str),
+    ('local_program_path', str),
+    ('remote_program_path', str),
+    ('reverse_copy', bool),
+)
+
+SO_PEERCRED = getattr(socket, 'SO_PEERCRED', 17)
+
+MAX_MESSAGE = 64 * 1024 * 1024
+
+# the connection whose driver callback is currently running on this thread,
+# so that register_option(), rcmd_register_defaults(), set_cache_key() and
+# record_unreachable() calls can be passed back to the right pdsh process.
+# Prefetches and host sources run on threads of their own, and are told
+# theirs when they start (see Connection.enter()).
+_current = threading.local()
+
+# util._option_map is global; initialize() calls are serialized so each
+# connection can take its own snapshot of it
+_init_lock = threading.Lock()
+
+
+class _NoLock(object):
+    """
+    Stands in for the lock of a driver which is threadsafe.
+    """
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc_info):
+        return False
+
+
+def _capture_register_option(optletter, argmeta, personality, desc):
+    _current.conn.queue(('option', optletter), ('arginfo', argmeta),
+                        ('personality', str(personality)), ('descr', desc))
+
+
+def _capture_rcmd_register_defaults(hosts, rcmd_module, username):
+    _current.conn.queue(('rcmd_hosts', hosts), ('rcmd_module', rcmd_module),
+                        ('rcmd_user', username))
+
+
+def _capture_set_cache_key(key, ttl):
+    if ttl is not None and ttl < 0:
+        raise ValueError('Cache TTL must not be negative')
+    _current.conn.queue(('cache_key', key),
+                        ('cache_ttl', None if ttl is None else str(int(ttl))))
+
+
+def _capture_record_hosts(hosts, down):
+    _current.conn.queue(('unreachable' if down else 'reachable',
+                         str(hostlist.HostList(hosts))))
+
+
+if sys.version_info[0] >= 3:
+    # messages are bytes on the wire, and str (UTF-8) to the driver
+    def _text(data):
+        return data.decode('utf-8', 'surrogateescape')
+
+    def _bytes(text):
+        return text.encode('utf-8', 'surrogateescape')
+else:
+    def _text(data):
+        return data
+
+    def _bytes(text):
+        return text
+
+
+def _read_exactly(sock, n):
+    chunks = []
+    while n > 0:
+        chunk = sock.recv(n)
+        if not chunk:
+            raise EOFError('connection closed')
+        chunks.append(chunk)
+        n -= len(chunk)
+    return b''.join(chunks)
+
+
+def read_message(sock):
+    """
+    Read one message and return it as a list of (name, value) pairs.
+    """
+    (length,) = struct.unpack('>I', _read_exactly(sock, 4))
+    if length > MAX_MESSAGE:
+        raise ValueError('message too large (%d bytes)' % length)
+    payload = _read_exactly(sock, length)
+    fields = []
+    i = 0
+    while i < length:
+        (namelen,) = struct.unpack('B', payload[i:i + 1])
+        name = _text(payload[i + 1:i + 1 + namelen])
+        i += 1 + namelen
+        (vallen,) = struct.unpack('>i', payload[i:i + 4])
+        i += 4
+        if vallen < 0:
+            value = None
+        else:
+            value = _text(payload[i:i + vallen])
+            i += vallen
+        fields.append((name, value))
+    return fields
+
+
+def write_message(sock, fields):
+    parts = []
+    for name, value in fields:
+        name = _bytes(name)
+        parts.append(struct.pack('B', len(name)) + name)
+        if value is None:
+            parts.append(struct.pack('>i', -1))
+        else:
+            value = _bytes(str(value))
+            parts.append(struct.pack('>i', len(value)) + value)
+    payload = b''.join(parts)
+    sock.sendall(struct.pack('>I', len(payload)) + payload)
+
+
+def decode_opts(fields):
+    values = dict(fields)
+    pdshopt = util.PdshOpts()
+    for name, kind in OPT_FIELDS:
+        value = values.get(name)
+        if kind is str:
+            setattr(pdshopt, name, value)
+        else:
+            setattr(pdshopt, name, kind(int(value or 0)))
+    pdshopt.wcoll = None
+    if values.get('wcoll') is not None:
+        pdshopt.wcoll = hostlist.HostList(values['wcoll'])
+    return pdshopt
+
+
+def encode_opts(pdshopt):
+    fields = []
+    for name, kind in OPT_FIELDS:
+        value = getattr(pdshopt, name)
+        if kind is str:
+            fields.append((name, None if value is None else str(value)))
+        else:
+            fields.append((name, int(value or 0)))
+    wcoll = pdshopt.wcoll
+    fields.append(('wcoll', None if wcoll is None else hostlist.compress(wcoll)))
+    return fields
+
+
+class Connection(object):
+    """
+    One pdsh run.
+    """
+
+    def __init__(self, server, sock):
+        self.server = server
+        self.sock = sock
+        self.session = None
+        self.option_map = {}
+        self.host_sources = []
+        # registrations made by the driver, to go out with the next reply;
+        # prefetches and host sources add to them from their own threads
+        self.pending = []
+        self.pending_lock = threading.Lock()
+
+    def enter(self):
+        """
+        Make this the connection registrations made on this thread go to.
+        """
+        _current.conn = self
+
+    def queue(self, *fields):
+        with self.pending_lock:
+            self.pending.extend(fields)
+
+    def take_pending(self):
+        with self.pending_lock:
+            pending, self.pending = self.pending, []
+        return pending
+
+    def handle(self):
+        self.enter()
+        try:
+            while True:
+                try:
+                    request = read_message(self.sock)
+                except EOFError:
+                    return
+                op = dict(request).get('op')
+                if op == 'fini':
+                    return
+                try:
+                    reply = self.dispatch(op, request)
+                except Exception:
+                    reply = [('error', traceback.format_exc())]
+                write_message(self.sock, reply + self.take_pending())
+        except (IOError, OSError, socket.error) as e:
+            if e.errno not in (errno.EPIPE, errno.ECONNRESET):
+                traceback.print_exc()
+        finally:
+            if self.session is not None:
+                util._close_event_loop(self.session)
+            self.sock.close()
+
+    def call(self, func, *args):
+        with self.server.callback_lock(func):
+            # coroutines get run on the session's event loop
+            if util._is_coroutine_function(func):
+                return util._run_coroutine(self.session, func, args)
+            return func(*args)
+
+    def dispatch(self, op, request):
+        if op == 'init':
+            return self.do_init(request)
+        if self.session is None:
+            raise ValueError('%r request before init' % op)
+        if op == 'option':
+            return self.do_option(request)
+        if op == 'wcoll':
+            return self.do_wcoll(request)
+        if op == 'postop':
+            return self.do_postop(request)
+        raise ValueError('unknown request %r' % op)
+
+    def do_init(self, request):
+        version = int(dict(request).get('version') or 0)
+        if version != PROTOCOL_VERSION:
+            raise ValueError('protocol version mismatch (client %d, server %d)'
+                             % (version, PROTOCOL_VERSION))
+        if self.server.prepared is not None:
+            # already initialized before we were forked
+            (self.session, self.option_map, self.host_sources,
+             registrations) = self.server.prepared
+            self.queue(*registrations)
+        else:
+            self.session = util.PdshpyModuleData()
+            with _init_lock:
+                util._option_map.clear()
+                del util._host_sources[:]
+                for driver in self.server.drivers:
+                    initializer = getattr(driver, 'initialize', None)
+                    if initializer is not None:
+                        self.call(initializer, self.session)
+                self.option_map = dict(util._option_map)
+                self.host_sources = list(util._host_sources)
+        for driver in self.server.drivers:
+            prefetcher = getattr(driver, 'prefetch_hosts', None)
+            if prefetcher is not None:
+                util._start_prefetch(prefetcher, self.session,
+                                     driver.__name__, self.enter)
+        return [('status', 0)]
+
+    def do_option(self, request):
+        values = dict(request)
+        opt = values['opt']
+        pdshopt = decode_opts(request)
+        result = self.call(self.option_map[opt], opt, values.get('arg'),
+                           pdshopt, self.session)
+        if result is None:
+            result = 0
+        return [('status', int(result))] + encode_opts(pdshopt)
+
+    def do_wcoll(self, request):
+        pdshopt = decode_opts(request)
+        collectors = util._start_host_sources(pdshopt, self.session,
+                                              self.host_sources, self.enter)
+        drivers = self.server.drivers
+        found = []
+        for driver in drivers:
+            prefetched = None
+            try:
+                # the client gives up on us by itself, if it has a deadline
+                prefetched = util._join_prefetch(self.session,
+                                                 driver.__name__)
+            except Exception:
+                traceback.print_exc()
+            if prefetched is not None:
+                found.append(prefetched[0])
+            elif ((collectors or len(drivers) > 1)
+                  and not hasattr(driver, 'collect_hosts')):
+                continue
+            else:
+                found.append(self.call(driver.collect_hosts, pdshopt,
+                                       self.session))
+        hosts = found[0] if len(found) == 1 else None
+        complete = True
+        if len(found) > 1:
+            hosts = self.merge_hosts(found)
+        if collectors:
+            hosts, complete = self.merge_host_sources(hosts, collectors)
+        if hosts is not None:
+            hosts = hostlist.compress(util.iter_hosts(hosts))
+        reply = [('status', 0), ('hosts', hosts)]
+        if not complete:
+            # so the client doesn't cache it
+            reply.append(('partial', '1'))
+        return reply + encode_opts(pdshopt)
+
+    def merge_hosts(self, results):
+        # sorted and without duplicates, as pdshpy.c merges them
+        merged = hostlist.HostList(host for hosts in results
+                                   for host in util.iter_hosts(hosts))
+        merged.uniq()
+        return merged
+
+    def merge_host_sources(self, hosts, collectors):
+        merged = hostlist.HostList(util.iter_hosts(hosts))
+        complete = True
+        for name, found, done, error in util._join_host_sources(collectors):
+            complete = complete and done
+            if error is not None:
+                sys.stderr.write('Host source %r failed:\n%s' % (name, error))
+                continue
+            if not done:
+                sys.stderr.write('Host source %r did not finish in time; '
+                                 'using the %d hosts it found\n'
+                                 % (name, len(found)))
+            merged.extend(util.iter_hosts(found))
+        merged.uniq()
+        return merged, complete
+
+    def do_postop(self, request):
+        pdshopt = decode_opts(request)
+        errors = 0
+        # a pipeline: each driver sees the wcoll the ones before it left
+        for driver in self.server.drivers:
+            filters = hasattr(driver, 'filter_hosts')
+            if filters and pdshopt.wcoll is not None:
+                # as in pdshpy.c: reported, and the wcoll left alone
+                try:
+                    pdshopt.wcoll[:] = hostlist.filter_batches(
+                        pdshopt.wcoll,
+                        lambda batch: self.call(driver.filter_hosts, batch,
+                                                self.session))
+                except Exception:
+                    sys.stderr.write("Driver module %s's filter_hosts() "
+                                     "failed:\n%s" % (driver.__name__,
+                                                      traceback.format_exc()))
+                    errors += 1
+            if ((len(self.server.drivers) > 1 or filters)
+                    and not hasattr(driver, 'perform_postop')):
+                continue
+            result = self.call(driver.perform_postop, pdshopt, self.session)
+            errors += int(result or 0)
+        return [('status', errors)] + encode_opts(pdshopt)
+
+
+class Server(object):
+
+    def __init__(self, path, modulename):
+        self.path = path
+        self.modulename = modulename
+        # in the order named; --module takes a comma-separated chain
+        self.drivers = []
+        self.listener = None
+        # (session, option map, registrations) from an initialize() call made
+        # ahead of time, if any
+        self.prepared = None
+        # by driver module name; callbacks from anywhere else share one
+        self.locks = {}
+        self.other_lock = threading.RLock()
+
+    def load_driver(self):
+        self.drivers = [importlib.import_module(name.strip())
+                        for name in self.modulename.split(',')
+                        if name.strip()]
+        self.locks = dict((driver.__name__,
+                           _NoLock() if getattr(driver, 'threadsafe', False)
+                           else threading.RLock())
+                          for driver in self.drivers)
+        util._register_option = _capture_register_option
+        util._rcmd_register_defaults = _capture_rcmd_register_defaults
+        util._set_cache_key = _capture_set_cache_key
+        util._record_hosts = _capture_record_hosts
+
+    def callback_lock(self, func):
+        """
+        The lock to hold while calling 'func', one of a driver's callbacks:
+        that of the module it comes from, so runs take turns in each driver.
+        """
+        return self.locks.get(getattr(func, '__module__', None),
+                              self.other_lock)
+
+    def already_running(self):
+        probe = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            probe.connect(self.path)
+        except socket.error:
+            return False
+        finally:
+            probe.close()
+        return True
+
+    def listen(self):
+        try:
+            os.unlink(self.path)
+        except OSError as e:
+            if e.errno != errno.ENOENT:
+                raise
+        self.listener = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        oldmask = os.umask(0o077)
+        try:
+            self.listener.bind(self.path)
+        finally:
+            os.umask(oldmask)
+        self.listener.listen(64)
+
+    def peer_allowed(self, sock):
+        # session state belongs to whoever started the server; don't hand it
+        # out to anyone else
+        creds = sock.getsockopt(socket.SOL_SOCKET, SO_PEERCRED,
+                                struct.calcsize('3i'))
+        pid, uid, gid = struct.unpack('3i', creds)
+        return uid == os.getuid()
+
+    def accept(self):
+        while True:
+            try:
+                return self.listener.accept()[0]
+            except socket.error as e:
+                if e.errno != errno.EINTR:
+                    raise
+
+    def serve_forever(self):
+        while True:
+            sock = self.accept()
+            if not self.peer_allowed(sock):
+                sock.close()
+                continue
+            conn = Connection(self, sock)
+            t = threading.Thread(target=conn.handle)
+            t.daemon = True
+            t.start()
+
+
+def _module_mtime(modules):
+    paths = []
+    for module in modules:
+        path = getattr(module, '__file__', None)
+        if not path:
+            continue
+        paths.append(path)
+        if path.endswith(('.pyc', '.pyo')):
+            paths.append(path[:-1])
+    mtimes = []
+    for p in paths:
+        try:
+            mtimes.append(os.stat(p).st_mtime)
+        except OSError:
+            pass
+    return max(mtimes) if mtimes else None
+
+
+class ForkServer(Server):
+    """
+    Zygote: initialize the driver once, then fork a child per connection.
+    """
+
+    # how often to check for driver changes while idle, in seconds
+    CHECK_INTERVAL = 5
+
+    def __init__(self, path, modulename, listen_fd=None):
+        Server.__init__(self, path, modulename)
+        self.listen_fd = listen_fd
+        self.mtime = None
+
+    def load_driver(self):
+        Server.load_driver(self)
+        self.mtime = _module_mtime(self.drivers)
+
+        conn = Connection(self, None)
+        conn.enter()
+        session = util.PdshpyModuleData()
+        util._option_map.clear()
+        del util._host_sources[:]
+        for driver in self.drivers:
+            initializer = getattr(driver, 'initialize', None)
+            if initializer is None:
+                continue
+            if util._is_coroutine_function(initializer):
+                util._run_coroutine(session, initializer, (session,))
+            else:
+                initializer(session)
+        # children each make their own; a loop can't be shared across a fork
+        util._close_event_loop(session)
+        self.prepared = (session, dict(util._option_map),
+                         list(util._host_sources), conn.take_pending())
+
+    def listen(self):
+        if self.listen_fd is None:
+            return Server.listen(self)
+        # inherited across a re-exec, with any waiting connections intact
+        self.listener = socket.fromfd(self.listen_fd, socket.AF_UNIX,
+                                      socket.SOCK_STREAM)
+        os.close(self.listen_fd)
+
+    def driver_changed(self):
+        return _module_mtime(self.drivers) != self.mtime
+
+    def reexec(self):
+        fd = self.listener.fileno()
+        argv = [sys.executable, '-m', 'pdshpy.server', '--fork',
+                '--socket', self.path, '--module', self.modulename,
+                '--listen-fd', str(fd)]
+        # Python 3 closes fds on exec unless told otherwise (PEP 446)
+        if hasattr(os, 'set_inheritable'):
+            os.set_inheritable(fd, True)
+        signal.signal(signal.SIGCHLD, signal.SIG_DFL)
+        os.execv(sys.executable, argv)
+
+    def reap(self, signum=None, frame=None):
+        while True:
+            try:
+                pid, status = os.waitpid(-1, os.WNOHANG)
+            except OSError:
+                return
+            if pid == 0:
+                return
+
+    def serve_forever(self):
+        signal.signal(signal.SIGCHLD, self.reap)
+        while True:
+            try:
+                ready = select.select([self.listener], [], [],
+                                      self.CHECK_INTERVAL)[0]
+            except select.error as e:
+                if e.args[0] != errno.EINTR:
+                    raise
+                continue
+            if self.driver_changed():
+                # leave the connection (if any) in the backlog for the new
+                # process to pick up
+                self.reexec()
+            if not ready:
+                continue
+            sock = self.accept()
+            if not self.peer_allowed(sock):
+                sock.close()
+                continue
+            pid = os.fork()
+            if pid == 0:
+                status = 0
+                try:
+                    signal.signal(signal.SIGCHLD, signal.SIG_DFL)
+                    self.listener.close()
+                    Connection(self, sock).handle()
+                except BaseException:
+                    traceback.print_exc()
+                    status = 1
+                finally:
+                    os._exit(status)
+            sock.close()
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        description='Serve a pdshpy driver module to pdsh processes.')
+    parser.add_argument('--socket', default=os.environ.get('PDSHPY_SERVER'),
+                        help='path of the UNIX socket to listen on '
+                             '(default: $PDSHPY_SERVER)')
+    parser.add_argument('--module',
+                        default=os.environ.get('PDSHPY_MODULE',
+                                               'pdshpy_module'),
+                        help='driver module to load, or a comma-separated '
+                             'chain of them (default: $PDSHPY_MODULE or '
+                             'pdshpy_module)')
+    parser.add_argument('--fork', action='store_true',
+                        help='initialize the driver once and fork a child '
+                             'for each pdsh run')
+    parser.add_argument('--listen-fd', type=int, help=argparse.SUPPRESS)
+    args = parser.parse_args(argv)
+    if not args.socket:
+        parser.error('no socket path given and PDSHPY_SERVER is not set')
+
+    if args.fork:
+        server = ForkServer(args.socket, args.module, args.listen_fd)
+    else:
+        server = Server(args.socket, args.module)
+    if args.listen_fd is None and server.already_running():
+        # someone else got there first (pdsh runs racing to autostart one)
+        return 0
+    server.load_driver()
+    server.listen()
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        os.unlink(args.socket)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -2,12 +2,77 @@
 #
 # (bits that are easier to implement in straight python)
 
+import signal
+import sys
+import threading
+import time
+import traceback
+import types
+
 try:
-    from _pdshpy_internal import _register_option, _rcmd_register_defaults
+    from _pdshpy_internal import _register_option, _rcmd_register_defaults, \
+        _set_cache_key, _record_hosts
 except ImportError:
     # allow module to be imported without error, for the sake of linting
     # and so on, even when not run under pdshpy proper.
-    _register_option = _rcmd_register_defaults = None
+    _register_option = _rcmd_register_defaults = _set_cache_key = None
+    _record_hosts = None
+
+try:
+    # pdsh's own hostlists, in-process
+    from _pdshpy_internal import HostList
+except ImportError:
+    from pdshpy.hostlist import HostList
+
+try:
+    # batches of hosts for filter_hosts(), kept in one buffer
+    from _pdshpy_internal import HostBatch
+except ImportError:
+    from pdshpy.hostlist import HostBatch
+
+try:
+    # compiled host databases, mapped in natively
+    from _pdshpy_internal import HostDB
+except ImportError:
+    from pdshpy.hostdb import HostDB
+
+try:
+    # host-selection expressions, compiled natively
+    from _pdshpy_internal import HostExpr
+except ImportError:
+    from pdshpy.hostexpr import HostExpr
+
+try:
+    # host patterns, compiled natively
+    from _pdshpy_internal import HostPatterns
+except ImportError:
+    from pdshpy.hostpat import HostPatterns
+
+try:
+    # liveness checks, many hosts at once with epoll
+    from _pdshpy_internal import _probe_hosts
+except ImportError:
+    from pdshpy.liveness import probe_hosts as _probe_hosts
+
+try:
+    _string_types = basestring
+except NameError:
+    _string_types = str
+
+if sys.version_info[0] >= 3:
+    def _reraise(exc_info):
+        raise exc_info[1].with_traceback(exc_info[2])
+else:
+    # a syntax error on Python 3, even where it isn't run
+    exec('def _reraise(exc_info):\n'
+         '    raise exc_info[0], exc_info[1], exc_info[2]\n')
+
+
+class DeadlineExceeded(Exception):
+    """
+    Raised inside a driver callback which has run past PDSHPY_CALLBACK_TIMEOUT.
+    """
+    pass
 
 
 class PdshOpts:
@@ -27,13 +92,20 @@ PCP = 2
 # map of registered options and callbacks
 _option_map = {}
 
+# registered host sources, as (name, func, timeout), in registration order
+_host_sources = []
+
 
 def process_option(opt, arg, pdshopt, data):
     """
     Trampoline called by pdshpy internal code, which calls back into the
     appropriate python handler for an option given on the command line
     """
-    result = _option_map[opt](opt, arg, pdshopt, data)
+    callback = _option_map[opt]
+    if _is_coroutine_function(callback):
+        result = _run_coroutine(data, callback, (opt, arg, pdshopt, data))
+    else:
+        result = callback(opt, arg, pdshopt, data)
     if result is None:
         result = 0
     return result
@@ -44,7 +116,7 @@ def register_option(optletter, argmeta, personality, callback, desc=None):
     Register a command line option for pdsh. This should be called during an
     initialize() function to have any useful effect.
     """
-    if isinstance(personality, basestring):
+    if isinstance(personality, _string_types):
         intpersonality = 0
         for p in personality.split(','):
             p = p.strip().upper()
@@ -57,6 +129,55 @@ def register_option(optletter, argmeta, personality, callback, desc=None):
     return _register_option(optletter, argmeta, personality, desc)
 
 
+class HostExprOption(object):
+    """
+    An option callback for register_option() which takes a host-selection
+    expression:
+
+        select = util.HostExprOption()
+        util.register_option('g', 'expr', 'DSH', select,
+                             'select hosts, like "gpu & !down"')
+
+    and later select.select(db) picks out the hosts. Giving the option more
+    than once selects the hosts all of the expressions match. A bad
+    expression is reported to pdsh as a bad option.
+    """
+
+    def __init__(self):
+        self.args = []
+        self.exprs = []
+
+    def __call__(self, opt, arg, pdshopt, data):
+        # each argument is compiled once, on its own; pasting them together
+        # into one expression would mean compiling them all again, and let
+        # one argument's parentheses close another's
+        try:
+            expr = HostExpr(arg)
+        except ValueError as e:
+            sys.stderr.write('pdsh: -%s: %s\n' % (opt, e))
+            return -1
+        self.args.append(arg)
+        self.exprs.append(expr)
+        return 0
+
+    def select(self, source):
+        """
+        What the expressions all select from source (as HostExpr.select()),
+        or all of it if the option wasn't given.
+        """
+        if isinstance(source, HostDB):
+            if not self.exprs:
+                return source.bitmap()
+            selected = self.exprs[0].select(source)
+            for expr in self.exprs[1:]:
+                selected = selected & expr.select(source)
+            return selected
+        selected = HostList(source)
+        for expr in self.exprs:
+            selected = expr.select(selected)
+        return selected
+
+
 def rcmd_register_defaults(hosts, rcmd_module, username=None):
     """
     Override pdsh's idea of which rcmd module (and, optionally, what username)
@@ -77,3 +198,429 @@ def rcmd_register_defaults(hosts, rcmd_module, username=None):
     @type username str
     """
     _rcmd_register_defaults(hosts, rcmd_module, username)
+
+
+def set_cache_key(key, ttl=None):
+    """
+    Let pdshpy cache the hosts returned by collect_hosts() on disk, under the
+    given key, and hand them back on later runs with the same key without
+    calling collect_hosts() at all. The key should capture everything the
+    result depends on (typically the options given), and should be set from
+    initialize() or an option callback so that it's known before hosts are
+    collected. Only the returned hosts are cached; anything else
+    collect_hosts() does won't happen on a cache hit.
+
+    @param key A string, or None to turn caching back off for this run.
+    @type key str
+    @param ttl How many seconds the cached hosts stay good for. If None,
+               PDSHPY_CACHE_TTL or the default (60) applies.
+    @type ttl int
+    """
+    _set_cache_key(key, ttl)
+
+
+def probe_hosts(hosts, port, timeout=1.0):
+    """
+    Find out which hosts are down, by trying a TCP connection to each on the
+    given port, all at once. Hosts which refuse the connection, can't be
+    reached or looked up, or don't answer in time count as down. Setting
+    PDSHPY_LIVENESS does this for the whole working set after
+    perform_postop(); this is for drivers which want to check some hosts
+    themselves, say to pick a live one from each group.
+
+    @param hosts A HostList or an iterable of hostnames.
+    @param port The port to try, like 22 for ssh.
+    @type port int
+    @param timeout How many seconds each host has to answer in.
+    @type timeout float
+    @return A HostList of the hosts which are down.
+    """
+    return _probe_hosts(hosts, port, timeout)
+
+
+def record_unreachable(hosts):
+    """
+    Tell pdshpy that these hosts couldn't be connected to, so that the next
+    pdsh runs can leave them out, or try them last, for a while (see
+    PDSHPY_DEADHOSTS). Each time a host is recorded again after that while
+    is up, it's taken to be down for twice as long. Does nothing unless
+    PDSHPY_DEADHOSTS is set.
+
+    @param hosts A HostList or an iterable of hostnames.
+    """
+    _record_hosts(hosts, True)
+
+
+def record_reachable(hosts):
+    """
+    Tell pdshpy that these hosts can be connected to after all, undoing
+    record_unreachable().
+
+    @param hosts A HostList or an iterable of hostnames.
+    """
+    _record_hosts(hosts, False)
+
+
+# what can come out of collect_hosts() as a batch of hosts, rather than as
+# a single host
+_BATCH_TYPES = (list, tuple, set, frozenset, types.GeneratorType)
+
+
+def iter_hosts(result):
+    """
+    Iterate over the hosts in what collect_hosts() returned: None, or any
+    iterable of hostnames, in which items that are themselves lists, sets,
+    tuples or generators count as batches of hosts.
+    """
+    for item in result or ():
+        if isinstance(item, _BATCH_TYPES):
+            for host in item:
+                yield host
+        else:
+            yield item
+
+
+def _deadline_passed(signum, frame):
+    raise DeadlineExceeded('callback did not finish within its time budget')
+
+
+def _call_with_deadline(budget, func, args, collect=False):
+    """
+    Trampoline called by pdshpy internal code when PDSHPY_CALLBACK_TIMEOUT is
+    set: call func(*args), interrupting it with DeadlineExceeded if it runs
+    longer than 'budget' seconds.
+
+    With 'collect', func is collect_hosts(), and the hosts in whatever it
+    returns (see iter_hosts()) are gathered within the same budget. Returns
+    (hosts, done), where 'done' is False if the budget ran out, and 'hosts'
+    holds whatever had been produced by then.
+
+    This works off SIGALRM, so it can only interrupt Python code, and system
+    calls which give up on EINTR. A driver which catches every exception
+    can swallow the interruption too.
+    """
+    hosts = []
+    done = False
+    old_handler = signal.getsignal(signal.SIGALRM)
+    if old_handler is None:
+        # installed from outside Python; pdsh doesn't have one yet when
+        # drivers are called
+        old_handler = signal.SIG_DFL
+    try:
+        signal.signal(signal.SIGALRM, _deadline_passed)
+    except ValueError:
+        # not the main interpreter
+        return _call_on_thread(budget, func, args, collect)
+    signal.setitimer(signal.ITIMER_REAL, budget)
+    try:
+        try:
+            result = func(*args)
+            if collect:
+                for host in iter_hosts(result):
+                    hosts.append(host)
+                result = (hosts, True)
+            done = True
+        finally:
+            signal.setitimer(signal.ITIMER_REAL, 0)
+    except DeadlineExceeded:
+        # if the alarm went off between finishing and disarming it, the
+        # result stands
+        if not done:
+            if not collect:
+                raise
+            return hosts, False
+    finally:
+        signal.signal(signal.SIGALRM, old_handler)
+    return result
+
+
+def _call_on_thread(budget, func, args, collect):
+    """
+    _call_with_deadline(), where signal handlers can't be set: in a
+    subinterpreter (see PDSHPY_SUBINTERPRETERS), only the main interpreter
+    can. func is run on a thread of its own, and waited for for up to
+    'budget' seconds; if it runs over, it isn't interrupted, but left to
+    finish on its own.
+    """
+    if collect:
+        collector = _HostCollector('collect_hosts', func, args)
+        collector.start()
+        collector.join(budget)
+        if collector.is_alive():
+            collector.cancelled = True
+            return list(collector.hosts), False
+        if collector.exc_info is not None:
+            _reraise(collector.exc_info)
+        return collector.hosts, True
+
+    outcome = {}
+
+    def run():
+        try:
+            outcome['result'] = func(*args)
+        except BaseException:
+            outcome['exc_info'] = sys.exc_info()
+
+    thread = threading.Thread(target=run, name='pdshpy-callback')
+    thread.daemon = True
+    thread.start()
+    thread.join(budget)
+    if thread.is_alive():
+        raise DeadlineExceeded('callback did not finish within its time '
+                               'budget')
+    if 'exc_info' in outcome:
+        _reraise(outcome['exc_info'])
+    return outcome['result']
+
+
+class _HostCollector(threading.Thread):
+    """
+    Something producing hosts on a thread of its own: a driver's
+    prefetch_hosts(), or one of its host sources. Hosts are gathered as
+    they're produced, so whatever had turned up can still be used if it
+    has to be given up on.
+    """
+
+    def __init__(self, name, func, args, timeout=None, setup=None):
+        threading.Thread.__init__(self, name='pdshpy-' + name)
+        # a cancelled collector is abandoned, not waited for
+        self.daemon = True
+        self.source = name
+        self.func = func
+        self.args = args
+        self.timeout = timeout
+        # called first thing on the new thread, for the pdshpy server to say
+        # which connection anything the collector registers belongs to
+        self.setup = setup
+        self.started = None
+        self.cancelled = False
+        self.hosts = []
+        self.exc_info = None
+
+    def start(self):
+        self.started = time.time()
+        threading.Thread.start(self)
+
+    def run(self):
+        try:
+            if self.setup is not None:
+                self.setup()
+            if _is_coroutine_function(self.func):
+                # the session's loop belongs to the main thread
+                loop = _event_loop_module().new_event_loop()
+                try:
+                    result = loop.run_until_complete(self.func(*self.args))
+                finally:
+                    loop.close()
+            else:
+                result = self.func(*self.args)
+            for host in iter_hosts(result):
+                if self.cancelled:
+                    return
+                self.hosts.append(host)
+        except Exception:
+            self.exc_info = sys.exc_info()
+
+
+def _start_prefetch(func, session, module, setup=None):
+    """
+    Trampoline called by pdshpy internal code after initialize(), when the
+    named driver module has a prefetch_hosts(): start it on its own thread,
+    calling setup() there first if given. Each of a chain of drivers gets
+    its own, kept under the driver's name (not func's module, which may be
+    some helper's) for _join_prefetch().
+    """
+    prefetches = getattr(session, '_pdshpy_prefetch', None)
+    if prefetches is None:
+        prefetches = session._pdshpy_prefetch = {}
+    prefetch = _HostCollector('prefetch', func, (session,), setup=setup)
+    prefetches[module] = prefetch
+    prefetch.start()
+
+
+def _join_prefetch(session, module, timeout=None):
+    """
+    Trampoline called by pdshpy internal code in place of the named driver
+    module's collect_hosts(): wait up to 'timeout' seconds for its
+    prefetch_hosts() to finish. Returns None if there's no prefetch to use,
+    so collect_hosts() should be called after all; otherwise (hosts, done),
+    as for _call_with_deadline(). Raises whatever prefetch_hosts() raised.
+    """
+    prefetches = getattr(session, '_pdshpy_prefetch', None) or {}
+    prefetch = prefetches.get(module)
+    if prefetch is None or prefetch.cancelled:
+        return None
+    prefetch.join(timeout)
+    del prefetches[module]
+    if prefetch.is_alive():
+        prefetch.cancelled = True
+        return list(prefetch.hosts), False
+    if prefetch.exc_info is not None:
+        _reraise(prefetch.exc_info)
+    return prefetch.hosts, True
+
+
+def cancel_prefetch(session):
+    """
+    Throw away what prefetch_hosts() finds, and have collect_hosts() called
+    as usual instead. Option callbacks should call this when the options
+    given change what ought to be collected. With chained drivers, every
+    driver's prefetch is cancelled.
+    """
+    prefetches = getattr(session, '_pdshpy_prefetch', None) or {}
+    for prefetch in prefetches.values():
+        prefetch.cancelled = True
+
+
+def _prefetch_running(session, timeout):
+    """
+    Called by pdshpy internal code before it forks: wait up to 'timeout'
+    seconds, in all, for the prefetch threads (cancelled or not) to finish,
+    and return whether any is still running.
+    """
+    prefetches = getattr(session, '_pdshpy_prefetch', None) or {}
+    deadline = time.time() + timeout
+    for prefetch in prefetches.values():
+        prefetch.join(max(deadline - time.time(), 0))
+    return any(prefetch.is_alive() for prefetch in prefetches.values())
+
+
+def prefetch_cancelled(session):
+    """
+    For prefetch_hosts() to check now and then, so it can stop early once
+    its answer isn't wanted any more.
+    """
+    current = threading.current_thread()
+    if isinstance(current, _HostCollector):
+        return current.cancelled
+    prefetches = getattr(session, '_pdshpy_prefetch', None) or {}
+    return all(prefetch.cancelled for prefetch in prefetches.values())
+
+
+def register_host_source(name, func, timeout=None):
+    """
+    Register a source of hosts, to be collected from alongside
+    collect_hosts() and any other sources, each on a thread of its own, so
+    that several slow backends take only as long as the slowest of them.
+    The hosts from all of them are merged (without duplicates) into the
+    working set. This should be called during an initialize() function.
+
+    Sources run at the same time as each other, so they shouldn't change
+    pdsh_opts, or share state without locking. Most of the waiting a source
+    does (on sockets, say) lets the others run, but CPU-bound Python code
+    still takes turns.
+
+    @param name A name for the source, used in messages. Registering a
+                source with the same name again replaces it.
+    @type name str
+    @param func Called as func(pdsh_opts, session) when hosts are collected,
+                and returns hosts in any of the ways collect_hosts() can.
+    @type func callable
+    @param timeout How many seconds to wait for the source before going
+                   ahead with whatever hosts it has produced so far, with a
+                   warning. None to wait as long as it takes (or as
+                   PDSHPY_CALLBACK_TIMEOUT allows).
+    @type timeout float
+    """
+    for i, (oldname, _, _) in enumerate(_host_sources):
+        if oldname == name:
+            _host_sources[i] = (name, func, timeout)
+            return
+    _host_sources.append((name, func, timeout))
+
+
+def _start_host_sources(pdshopt, session, sources=None, setup=None):
+    """
+    Trampoline called by pdshpy internal code before collect_hosts(): start
+    collecting from each registered host source, calling setup() first on
+    each one's thread if given. Returns the collectors.
+    """
+    if sources is None:
+        sources = _host_sources
+    collectors = []
+    for name, func, timeout in sources:
+        collector = _HostCollector(name, func, (pdshopt, session), timeout,
+                                   setup)
+        collector.start()
+        collectors.append(collector)
+    return collectors
+
+
+def _join_host_sources(collectors, budget=None):
+    """
+    Trampoline called by pdshpy internal code after collect_hosts(): wait
+    for each host source to finish, up to its own timeout or 'budget'
+    seconds from when it started, whichever comes first. Returns a list of
+    (name, hosts, done, error) for them, where 'done' is False if the source
+    had to be given up on, and 'error' is a formatted traceback if it failed.
+    """
+    results = []
+    for collector in collectors:
+        limits = [t for t in (collector.timeout, budget) if t is not None]
+        if limits:
+            remaining = collector.started + min(limits) - time.time()
+            collector.join(max(remaining, 0))
+        else:
+            collector.join()
+        if collector.is_alive():
+            collector.cancelled = True
+            results.append((collector.source, list(collector.hosts), False,
+                            None))
+        elif collector.exc_info is not None:
+            error = ''.join(traceback.format_exception(*collector.exc_info))
+            results.append((collector.source, [], False, error))
+        else:
+            results.append((collector.source, collector.hosts, True, None))
+    return results
+
+
+# code flag for 'async def' functions, from Python 3's code.h
+_CO_COROUTINE = 0x0080
+
+
+def _is_coroutine_function(func):
+    """
+    Whether func is a coroutine function: either 'async def', or decorated
+    with asyncio.coroutine (or trollius.coroutine). Doesn't import anything,
+    so that synchronous drivers don't pay for event loop support.
+    """
+    func = getattr(func, '__func__', func)
+    if getattr(func, '_is_coroutine', False):
+        return True
+    code = getattr(func, '__code__', None)
+    return code is not None and bool(code.co_flags & _CO_COROUTINE)
+
+
+def _event_loop_module():
+    try:
+        import asyncio
+    except ImportError:
+        # the Python 2 backport
+        import trollius as asyncio
+    return asyncio
+
+
+def _run_coroutine(session, func, args):
+    """
+    Trampoline called by pdshpy internal code for driver callbacks which are
+    coroutine functions: run func(*args) to completion on the session's
+    event loop, which is made the first time it's needed and then kept for
+    the rest of the session, so that anything the driver leaves on it (open
+    connections, say) is still there for the next callback.
+    """
+    loop = getattr(session, '_pdshpy_loop', None)
+    if loop is None:
+        asyncio = _event_loop_module()
+        loop = session._pdshpy_loop = asyncio.new_event_loop()
+        asyncio.set_event_loop(loop)
+    return loop.run_until_complete(func(*args))
+
+
+def _close_event_loop(session):
+    """
+    Trampoline called by pdshpy internal code at the end of a session.
+    """
+    loop = getattr(session, '_pdshpy_loop', None)
+    if loop is not None:
+        session._pdshpy_loop = None
+        loop.close()
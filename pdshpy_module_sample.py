@@ -40,6 +40,11 @@ def initialize(session):
                          'Include the hostname "bruce" in the working set.')
     session.extra_hosts_we_want_to_include = []
 
+    # hosts from other backends can be collected while collect_hosts() runs,
+    # each on its own thread, and merged in:
+    #
+    #   util.register_host_source('cmdb', query_cmdb, timeout=10)
+
 
 def say_stuff(opt, arg, pdsh_opts, session):
     """
@@ -50,7 +55,7 @@ def say_stuff(opt, arg, pdsh_opts, session):
     This should return None, or an integer indicating success (negative for
     failure).
     """
-    print arg
+    print(arg)
 
 
 def include_bruce(opt, arg, pdsh_opts, session):
@@ -59,16 +64,59 @@ def include_bruce(opt, arg, pdsh_opts, session):
     """
     session.extra_hosts_we_want_to_include.append('bruce')
 
+    # if collect_hosts() were expensive, its results could be cached for a
+    # while under a key describing what was asked for, so that the next pdsh
+    # runs asking the same thing wouldn't need to call it at all:
+    #
+    #   util.set_cache_key('bruce', ttl=300)
+
 
 def collect_hosts(pdsh_opts, session):
     """
     Called by pdsh after all option processing is done. Should return an
     iterable containing all node names that this module wants to include
     in the working set, or None to do nothing.
+
+    It can also be a generator, yielding hosts (or lists of hosts, in
+    batches) as it finds them. Then, if PDSHPY_CALLBACK_TIMEOUT runs out
+    before it's finished, pdsh can go ahead with the hosts found so far.
     """
     return session.extra_hosts_we_want_to_include
 
 
+# def prefetch_hosts(session):
+#     """
+#     Optional. If the driver can tell what to collect straight after
+#     initialize(), this is started on a background thread right then, so
+#     that the lookup overlaps with the rest of pdsh's startup. It takes the
+#     place of collect_hosts(), returning hosts in the same way, unless an
+#     option callback calls util.cancel_prefetch(session) because the options
+#     changed what should be collected; then collect_hosts() is called as
+#     usual. A long-running prefetch can check util.prefetch_cancelled(session)
+#     to stop early.
+#     """
+#     return ['bruce%d' % i for i in range(1, 11)]
+
+
+# def filter_hosts(hosts, session):
+#     """
+#     Optional. Called just before perform_postop() (which becomes optional
+#     too) with the working set a few thousand hosts at a time, to decide
+#     which to keep without making the whole set into Python strings. 'hosts'
+#     is a util.HostBatch: its names are in one buffer, 'hosts.data', each
+#     followed by a NUL, and host i is data[offsets[i]:offsets[i + 1] - 1];
+#     it can also be indexed or iterated over like a list of names.
+#
+#     Returns a mask: bytes (or any buffer) with a byte per host, nonzero to
+#     keep it, or a bit per host, the low bit of the first byte for host 0;
+#     a list of true or false values per host; or None to keep them all. The
+#     hosts not kept are removed from the working set once every batch has
+#     been through.
+#     """
+#     names = hosts.data.tobytes().split(b'\0')
+#     return bytes(bytearray(not n.startswith(b'perl') for n in names[:-1]))
+
+
 def perform_postop(pdsh_opts, session):
     """
     Called by pdsh after collecting hosts from all modules, but before actually
@@ -76,13 +124,20 @@ def perform_postop(pdsh_opts, session):
     removing things from the working set as instructed by the user.
 
     To remove (or add, whatever) hosts from the working set, change the 'wcoll'
-    attribute on the pdsh_opts object.
+    attribute on the pdsh_opts object. It's a util.HostList, which works on
+    pdsh's own list of hosts, so changing it in place (with remove(),
+    discard(), extend() and so on) is much quicker for big working sets than
+    assigning a new list of hosts to it.
 
     If this function wants to return something, it should return an int
     corresponding to the number of errors encountered.
     """
     if pdsh_opts.wcoll is None:
         return
-    pdsh_opts.wcoll = set(pdsh_opts.wcoll)
     # this module hates nodes named "perl"
     pdsh_opts.wcoll.discard('perl')
+
+    # hosts known from elsewhere to be down can be recorded, so that with
+    # PDSHPY_DEADHOSTS set, this and the next few pdsh runs leave them out:
+    #
+    #   util.record_unreachable(session.hosts_monitoring_says_are_down)
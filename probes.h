@@ -0,0 +1,68 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* USDT (statically defined tracing) probes, for bpftrace, perf, systemtap and
+ * friends. They cost a nop each when nobody is tracing, and compile away
+ * entirely when <sys/sdt.h> isn't available. The provider is "pdshpy":
+ *
+ *   process_option__entry(int opt, char *arg)
+ *   process_option__return(int opt, int rc)
+ *   collect_hosts__entry()
+ *   collect_hosts__return(int nhosts)      -1 on failure
+ *   perform_postop__entry()
+ *   perform_postop__return(int nerrors)
+ *   filter_hosts__entry()
+ *   filter_hosts__return(int nremoved)     -1 on failure
+ *   liveness__entry(int nhosts)
+ *   liveness__return(int ndown)            -1 on failure
+ *   hosts_to_python__entry()
+ *   hosts_to_python__return(uint64 nhosts, uint64 nbytes)
+ *   hosts_from_python__entry()
+ *   hosts_from_python__return(uint64 nhosts, uint64 nbytes)
+ *   rcmd_register(char *hosts, char *rcmd_module, char *user, int rc)
+ *
+ * e.g.: bpftrace -e 'usdt:/usr/lib/pdsh/pdshpy.so:pdshpy:collect_hosts__entry
+ *           { @t = nsecs } usdt:...:collect_hosts__return
+ *           { @ms = hist((nsecs - @t) / 1000000) }'
+ */
+
+#ifndef _PDSHPY_PROBES_H
+#define _PDSHPY_PROBES_H
+
+#ifdef HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define PDSHPY_PROBE0(name) \
+    DTRACE_PROBE(pdshpy, name)
+#define PDSHPY_PROBE1(name, a) \
+    DTRACE_PROBE1(pdshpy, name, a)
+#define PDSHPY_PROBE2(name, a, b) \
+    DTRACE_PROBE2(pdshpy, name, a, b)
+#define PDSHPY_PROBE4(name, a, b, c, d) \
+    DTRACE_PROBE4(pdshpy, name, a, b, c, d)
+
+#else /* !HAVE_SYS_SDT_H */
+
+#define PDSHPY_PROBE0(name)                 do { } while (0)
+#define PDSHPY_PROBE1(name, a)              do { } while (0)
+#define PDSHPY_PROBE2(name, a, b)           do { } while (0)
+#define PDSHPY_PROBE4(name, a, b, c, d)     do { } while (0)
+
+#endif /* HAVE_SYS_SDT_H */
+
+#endif /* !_PDSHPY_PROBES_H */
@@ -0,0 +1,117 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* Lets the rest of pdshpy be written once, against the Python 2 C API, and
+ * built against either Python 2.7 or Python 3 (make PYTHON=python3.12).
+ * Python 2 names are mapped onto their Python 3 equivalents: str is
+ * unicode, handed to and from pdsh as UTF-8, and int is long.
+ *
+ * Include this after <Python.h>.
+ */
+
+#ifndef _PDSHPY_PYCOMPAT_H
+#define _PDSHPY_PYCOMPAT_H
+
+#if PY_MAJOR_VERSION >= 3
+
+#define PyString_Check          PyUnicode_Check
+#define PyString_Type           PyUnicode_Type
+#define PyString_FromString     PyUnicode_FromString
+#define PyString_FromStringAndSize PyUnicode_FromStringAndSize
+#define PyString_FromFormat     PyUnicode_FromFormat
+#define PyString_AsString       PyUnicode_AsUTF8
+#define PyString_AS_STRING      PyUnicode_AsUTF8
+
+#define PyInt_Check             PyLong_Check
+#define PyInt_FromLong          PyLong_FromLong
+#define PyInt_AsLong            PyLong_AsLong
+
+/* Py_BuildValue() format for a single character, as a str */
+#define PDSHPY_FMT_CHAR "C"
+
+#define PyOS_AfterFork          PyOS_AfterFork_Child
+
+/* threads are always initialized from 3.7 on, and asking is deprecated */
+#define PyEval_InitThreads()    ((void)0)
+
+/* A host given by the driver, as a str (a new reference): bytes are taken
+ * to be UTF-8, rather than becoming "b'node1'" as str() would have them. */
+static inline PyObject *
+pdshpy_host_str(PyObject *host)
+{
+    if (PyBytes_Check(host))
+        return PyUnicode_DecodeUTF8(PyBytes_AS_STRING(host),
+                                    PyBytes_GET_SIZE(host), NULL);
+    return PyObject_Str(host);
+}
+
+/* a str's UTF-8, with its length in bytes (not characters) in *len */
+#define pdshpy_string_and_size  PyUnicode_AsUTF8AndSize
+
+#define pdshpy_slice_indices    PySlice_GetIndicesEx
+
+/* for debug messages only */
+static inline const char *
+pdshpy_module_filename(PyObject *module)
+{
+    PyObject *filename = PyModule_GetFilenameObject(module);
+    const char *str = NULL;
+
+    if (filename == NULL)
+    {
+        PyErr_Clear();
+        return "(unknown)";
+    }
+    /* the module holds on to its __file__, so this outlives 'filename' */
+    str = PyUnicode_AsUTF8(filename);
+    Py_DECREF(filename);
+    return str != NULL ? str : "(unknown)";
+}
+
+#else /* Python 2 */
+
+#define PDSHPY_FMT_CHAR "c"
+
+#define pdshpy_host_str         PyObject_Str
+
+static inline const char *
+pdshpy_string_and_size(PyObject *str, Py_ssize_t *len)
+{
+    const char *chars = PyString_AsString(str);
+
+    if (chars != NULL)
+        *len = PyString_GET_SIZE(str);
+    return chars;
+}
+
+#define pdshpy_module_filename  PyModule_GetFilename
+
+/* Python 2's takes a PySliceObject */
+#define pdshpy_slice_indices(slice, length, start, stop, step, slicelength) \
+    PySlice_GetIndicesEx((PySliceObject *)(slice), length, start, stop, \
+                         step, slicelength)
+
+#endif
+
+/* Python 3.12 can give each subinterpreter a GIL of its own */
+#if PY_VERSION_HEX >= 0x030C0000
+#define PDSHPY_HAVE_SUBINTERPRETERS 1
+#else
+#define PDSHPY_HAVE_SUBINTERPRETERS 0
+#endif
+
+#endif /* !_PDSHPY_PYCOMPAT_H */
@@ -0,0 +1,394 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <Python.h>
+#include "pycompat.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pyhostbatch.h"
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *names;    /* bytes: every name, each followed by a NUL */
+    PyObject *offsets;  /* bytes: count + 1 unsigned ints into names */
+    PyObject *data;     /* a memoryview of names */
+    PyObject *index;    /* offsets, as unsigned ints */
+    Py_ssize_t count;
+} pyhostbatch_object;
+
+#define BATCH(obj) ((pyhostbatch_object *)(obj))
+
+/* the offset of host 'i' in a batch's names */
+#define OFFSET(self, i) \
+    (((const unsigned int *)PyBytes_AS_STRING((self)->offsets))[i])
+
+static void
+pyhostbatch_dealloc(PyObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    Py_XDECREF(BATCH(self)->names);
+    Py_XDECREF(BATCH(self)->offsets);
+    Py_XDECREF(BATCH(self)->data);
+    Py_XDECREF(BATCH(self)->index);
+    type->tp_free(self);
+#if PY_MAJOR_VERSION >= 3
+    Py_DECREF(type);
+#endif
+}
+
+static Py_ssize_t
+pyhostbatch_length(PyObject *self)
+{
+    return BATCH(self)->count;
+}
+
+static PyObject *
+pyhostbatch_item(PyObject *self, Py_ssize_t i)
+{
+    pyhostbatch_object *batch = BATCH(self);
+    unsigned int start;
+
+    if (i < 0 || i >= batch->count)
+    {
+        PyErr_SetString(PyExc_IndexError, "HostBatch index out of range");
+        return NULL;
+    }
+    start = OFFSET(batch, i);
+    return PyString_FromStringAndSize(PyBytes_AS_STRING(batch->names) + start,
+                                      OFFSET(batch, i + 1) - start - 1);
+}
+
+static PyObject *
+pyhostbatch_repr(PyObject *self)
+{
+    return PyString_FromFormat("<HostBatch of %d hosts>",
+                               (int)BATCH(self)->count);
+}
+
+static PyObject *
+pyhostbatch_get_data(PyObject *self, void *closure)
+{
+    Py_INCREF(BATCH(self)->data);
+    return BATCH(self)->data;
+}
+
+static PyObject *
+pyhostbatch_get_offsets(PyObject *self, void *closure)
+{
+    Py_INCREF(BATCH(self)->index);
+    return BATCH(self)->index;
+}
+
+static PyGetSetDef pyhostbatch_getset[] = {
+    {"data", pyhostbatch_get_data, NULL,
+     "A read-only memoryview of the names, each followed by a NUL.", NULL},
+    {"offsets", pyhostbatch_get_offsets, NULL,
+     "len(batch) + 1 unsigned ints: host i is\n"
+     "data[offsets[i]:offsets[i + 1] - 1].", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+/* 'offsets' as unsigned ints that can be indexed from Python: a cast
+ * memoryview, or an array on Python 2, where memoryviews can't be cast */
+static PyObject *
+offsets_index(PyObject *offsets)
+{
+    PyObject *view = NULL;
+    PyObject *index = NULL;
+#if PY_MAJOR_VERSION >= 3
+
+    if ((view = PyMemoryView_FromObject(offsets)) == NULL)
+        return NULL;
+    index = PyObject_CallMethod(view, "cast", "s", "I");
+#else
+
+    if ((view = PyImport_ImportModule("array")) == NULL)
+        return NULL;
+    index = PyObject_CallMethod(view, "array", "sO", "I", offsets);
+#endif
+    Py_DECREF(view);
+    return index;
+}
+
+#define PYHOSTBATCH_DOC \
+    "A batch of hosts handed to a driver's filter_hosts(), kept in one\n" \
+    "buffer: host i is data[offsets[i]:offsets[i + 1] - 1]. Indexing or\n" \
+    "iterating gives the names as strings."
+
+#if PY_MAJOR_VERSION >= 3
+
+static PyType_Slot pyhostbatch_slots[] = {
+    {Py_tp_dealloc, pyhostbatch_dealloc},
+    {Py_tp_repr, pyhostbatch_repr},
+    {Py_tp_getset, pyhostbatch_getset},
+    {Py_tp_doc, PYHOSTBATCH_DOC},
+    {Py_sq_length, pyhostbatch_length},
+    {Py_sq_item, pyhostbatch_item},
+    {0, NULL}
+};
+
+/* only pdshpy makes them */
+#ifdef Py_TPFLAGS_DISALLOW_INSTANTIATION
+#define PYHOSTBATCH_FLAGS \
+    (Py_TPFLAGS_DEFAULT | Py_TPFLAGS_DISALLOW_INSTANTIATION)
+#else
+#define PYHOSTBATCH_FLAGS Py_TPFLAGS_DEFAULT
+#endif
+
+static PyType_Spec pyhostbatch_spec = {
+    "_pdshpy_internal.HostBatch",
+    sizeof(pyhostbatch_object),
+    0,
+    PYHOSTBATCH_FLAGS,
+    pyhostbatch_slots,
+};
+
+int
+pyhostbatch_init(PyObject *module)
+{
+    PyObject *type = NULL;
+
+    if ((type = PyType_FromSpec(&pyhostbatch_spec)) == NULL)
+        return -1;
+    if (PyModule_AddObject(module, "HostBatch", type) < 0)
+    {
+        Py_DECREF(type);
+        return -1;
+    }
+    return 0;
+}
+
+static PyTypeObject *
+batch_type(PyObject *module)
+{
+    PyObject *type = NULL;
+
+    if ((type = PyObject_GetAttrString(module, "HostBatch")) == NULL)
+        return NULL;
+    if (!PyType_Check(type)
+        || ((PyTypeObject *)type)->tp_dealloc != pyhostbatch_dealloc)
+    {
+        Py_DECREF(type);
+        PyErr_SetString(PyExc_TypeError, "HostBatch has been replaced");
+        return NULL;
+    }
+    return (PyTypeObject *)type;
+}
+
+#else /* Python 2 */
+
+static PySequenceMethods pyhostbatch_as_sequence = {
+    pyhostbatch_length,         /* sq_length */
+    0,                          /* sq_concat */
+    0,                          /* sq_repeat */
+    pyhostbatch_item,           /* sq_item */
+};
+
+static PyTypeObject pyhostbatch_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "_pdshpy_internal.HostBatch",   /* tp_name */
+    sizeof(pyhostbatch_object),     /* tp_basicsize */
+    0,                              /* tp_itemsize */
+    pyhostbatch_dealloc,            /* tp_dealloc */
+    0,                              /* tp_print */
+    0,                              /* tp_getattr */
+    0,                              /* tp_setattr */
+    0,                              /* tp_compare */
+    pyhostbatch_repr,               /* tp_repr */
+    0,                              /* tp_as_number */
+    &pyhostbatch_as_sequence,       /* tp_as_sequence */
+    0,                              /* tp_as_mapping */
+    0,                              /* tp_hash */
+    0,                              /* tp_call */
+    0,                              /* tp_str */
+    0,                              /* tp_getattro */
+    0,                              /* tp_setattro */
+    0,                              /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,             /* tp_flags */
+    PYHOSTBATCH_DOC,                /* tp_doc */
+    0,                              /* tp_traverse */
+    0,                              /* tp_clear */
+    0,                              /* tp_richcompare */
+    0,                              /* tp_weaklistoffset */
+    0,                              /* tp_iter */
+    0,                              /* tp_iternext */
+    0,                              /* tp_methods */
+    0,                              /* tp_members */
+    pyhostbatch_getset,             /* tp_getset */
+};
+
+int
+pyhostbatch_init(PyObject *module)
+{
+    if (PyType_Ready(&pyhostbatch_type) < 0)
+        return -1;
+    Py_INCREF(&pyhostbatch_type);
+    return PyModule_AddObject(module, "HostBatch",
+                              (PyObject *)&pyhostbatch_type);
+}
+
+static PyTypeObject *
+batch_type(PyObject *module)
+{
+    Py_INCREF(&pyhostbatch_type);
+    return &pyhostbatch_type;
+}
+
+#endif
+
+PyObject *
+pyhostbatch_fill(PyObject *module, hostlist_iterator_t it, Py_ssize_t max)
+{
+    pyhostbatch_object *self = NULL;
+    PyTypeObject *type = NULL;
+    unsigned int *offsets = NULL;
+    char *names = NULL;
+    char *host = NULL;
+    size_t len = 0, size = 0, n;
+    Py_ssize_t count = 0;
+
+    if ((offsets = malloc((max + 1) * sizeof(*offsets))) == NULL)
+        return PyErr_NoMemory();
+    offsets[0] = 0;
+    while (count < max && (host = hostlist_next(it)) != NULL)
+    {
+        n = strlen(host) + 1;
+        if (len + n > UINT_MAX)
+        {
+            free(host);
+            PyErr_SetString(PyExc_OverflowError, "HostBatch is too big");
+            goto fail;
+        }
+        if (len + n > size)
+        {
+            char *grown = NULL;
+
+            size = size ? size * 2 : 32 * (size_t)max;
+            if (size < len + n)
+                size = len + n;
+            if ((grown = realloc(names, size)) == NULL)
+            {
+                free(host);
+                PyErr_NoMemory();
+                goto fail;
+            }
+            names = grown;
+        }
+        memcpy(names + len, host, n);
+        free(host);
+        len += n;
+        offsets[++count] = (unsigned int)len;
+    }
+
+    if ((type = batch_type(module)) == NULL)
+        goto fail;
+    self = PyObject_New(pyhostbatch_object, type);
+    Py_DECREF(type);
+    if (self == NULL)
+        goto fail;
+    self->count = count;
+    self->data = NULL;
+    self->index = NULL;
+    self->names = PyBytes_FromStringAndSize(names, len);
+    self->offsets = PyBytes_FromStringAndSize((const char *)offsets,
+                                              (count + 1) * sizeof(*offsets));
+    free(names);
+    free(offsets);
+    if (self->names == NULL || self->offsets == NULL
+        || (self->data = PyMemoryView_FromObject(self->names)) == NULL
+        || (self->index = offsets_index(self->offsets)) == NULL)
+    {
+        Py_DECREF(self);
+        return NULL;
+    }
+    return (PyObject *)self;
+
+fail:
+    free(names);
+    free(offsets);
+    return NULL;
+}
+
+Py_ssize_t
+pyhostbatch_count(PyObject *batch)
+{
+    return BATCH(batch)->count;
+}
+
+int
+pyhostbatch_mask(PyObject *batch, PyObject *mask, unsigned char *keep)
+{
+    Py_ssize_t count = BATCH(batch)->count;
+    const unsigned char *bytes = NULL;
+    PyObject *seq = NULL;
+    Py_buffer view;
+    Py_ssize_t i;
+    int truth;
+
+    if (mask == Py_None)
+    {
+        memset(keep, 1, count);
+        return 0;
+    }
+
+    /* a byte per host, or a bit */
+    if (PyObject_GetBuffer(mask, &view, PyBUF_SIMPLE) == 0)
+    {
+        bytes = view.buf;
+        if (view.len == count)
+            for (i = 0; i < count; i++)
+                keep[i] = bytes[i] != 0;
+        else if (view.len == (count + 7) / 8)
+            for (i = 0; i < count; i++)
+                keep[i] = (bytes[i / 8] >> (i % 8)) & 1;
+        else
+            PyErr_Format(PyExc_ValueError, "mask of %d bytes for %d hosts",
+                         (int)view.len, (int)count);
+        PyBuffer_Release(&view);
+        return PyErr_Occurred() ? -1 : 0;
+    }
+    PyErr_Clear();
+
+    /* or a true or false value per host */
+    if (PyUnicode_Check(mask) || (seq = PySequence_Fast(mask, "")) == NULL)
+    {
+        PyErr_Format(PyExc_TypeError, "mask should be a buffer, a sequence "
+                     "or None, not %.100s", Py_TYPE(mask)->tp_name);
+        return -1;
+    }
+    if (PySequence_Fast_GET_SIZE(seq) != count)
+    {
+        PyErr_Format(PyExc_ValueError, "mask of %d values for %d hosts",
+                     (int)PySequence_Fast_GET_SIZE(seq), (int)count);
+        Py_DECREF(seq);
+        return -1;
+    }
+    for (i = 0; i < count; i++)
+    {
+        if ((truth = PyObject_IsTrue(PySequence_Fast_GET_ITEM(seq, i))) < 0)
+        {
+            Py_DECREF(seq);
+            return -1;
+        }
+        keep[i] = truth;
+    }
+    Py_DECREF(seq);
+    return 0;
+}
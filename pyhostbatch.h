@@ -0,0 +1,60 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* HostBatch: a run of hosts from the working collective, handed to a
+ * driver's filter_hosts() so it can decide about thousands of hosts in one
+ * call. The names are kept in one buffer rather than as a Python string
+ * each: 'data' is a read-only memoryview of all of them, each followed by a
+ * NUL, and 'offsets' holds len(batch) + 1 unsigned ints, so that host i is
+ * data[offsets[i]:offsets[i + 1] - 1]. Indexing or iterating gives the
+ * names as strings, for drivers which would rather have those.
+ *
+ * What filter_hosts() returns says which hosts to keep: a buffer (bytes,
+ * bytearray, an array of bools...) of one byte per host, nonzero to keep it;
+ * or of one bit per host, the low bit of the first byte for host 0; or a
+ * sequence of one true or false value per host; or None to keep them all.
+ */
+
+#ifndef _PDSHPY_PYHOSTBATCH_H
+#define _PDSHPY_PYHOSTBATCH_H
+
+#include <Python.h>
+
+#include "src/common/hostlist.h"
+
+/* how many hosts go in each batch */
+#define PYHOSTBATCH_SIZE 4096
+
+/* make the type ready, and add it to 'module' as HostBatch. On Python 3,
+ * this makes a new type for each interpreter's module. */
+int pyhostbatch_init(PyObject *module);
+
+/* A new HostBatch, of the type in 'module' (the current interpreter's
+ * internal module), of up to 'max' hosts read from 'it'; it has none once
+ * 'it' is used up. Returns NULL with an exception set on failure. */
+PyObject *pyhostbatch_fill(PyObject *module, hostlist_iterator_t it,
+                           Py_ssize_t max);
+
+/* how many hosts 'batch' holds */
+Py_ssize_t pyhostbatch_count(PyObject *batch);
+
+/* Read what filter_hosts() returned for 'batch' into 'keep', one byte per
+ * host, 1 to keep it and 0 not to. Returns 0, or -1 with an exception set
+ * if 'mask' isn't one of the forms above, or is the wrong length. */
+int pyhostbatch_mask(PyObject *batch, PyObject *mask, unsigned char *keep);
+
+#endif /* !_PDSHPY_PYHOSTBATCH_H */
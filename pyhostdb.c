@@ -0,0 +1,681 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <Python.h>
+#include "pycompat.h"
+#include <errno.h>
+
+#include "pdshpy.h"
+#include "hostdb.h"
+#include "pyhostdb.h"
+#include "pyhostlist.h"
+
+typedef struct {
+    PyObject_HEAD
+    struct hostdb *db;
+} pyhostdb_object;
+
+#define HOSTDB(obj) (((pyhostdb_object *)(obj))->db)
+
+typedef struct {
+    PyObject_HEAD
+    struct hostdb *db;      /* a reference, since bm may point into it */
+    struct bitmap *bm;
+} pyhostbitmap_object;
+
+#define BITMAP(obj) ((pyhostbitmap_object *)(obj))
+
+#if PY_MAJOR_VERSION < 3
+static PyTypeObject pyhostbitmap_type;
+#endif
+
+/* HostBitmaps are only made by HostDB.bitmap() and by operations on other
+ * HostBitmaps, not by calling the type */
+#ifndef Py_TPFLAGS_DISALLOW_INSTANTIATION
+#define Py_TPFLAGS_DISALLOW_INSTANTIATION 0
+#endif
+
+/* the database, or NULL with an exception set if it's been closed */
+static struct hostdb *
+get_db(PyObject *self)
+{
+    if (HOSTDB(self) == NULL)
+        PyErr_SetString(PyExc_ValueError, "HostDB is closed");
+    return HOSTDB(self);
+}
+
+/* a new HostList of this interpreter's type, taking ownership of 'hl' */
+static PyObject *
+adopt_hostlist(PyObject *self, hostlist_t hl)
+{
+    PyObject *module = NULL;
+    PyObject *result = NULL;
+
+    if (hl == NULL)
+    {
+        PyErr_SetString(PyExc_ValueError, "HostDB is damaged");
+        return NULL;
+    }
+#if PY_MAJOR_VERSION >= 3
+    module = PyType_GetModule(Py_TYPE(self));
+#endif
+    if ((result = pyhostlist_wrap(module, hl)) == NULL)
+    {
+        hostlist_destroy(hl);
+        return NULL;
+    }
+    pyhostlist_release(result, 1);
+    return result;
+}
+
+/* a new HostBitmap of 'type' holding 'bm' (which it takes over) */
+static PyObject *
+wrap_bitmap(PyTypeObject *type, struct hostdb *db, struct bitmap *bm)
+{
+    pyhostbitmap_object *self = NULL;
+
+    if (bm == NULL)
+    {
+        if (errno == ENOMEM)
+            return PyErr_NoMemory();
+        PyErr_SetString(PyExc_ValueError, "HostDB is damaged");
+        return NULL;
+    }
+    if ((self = PyObject_New(pyhostbitmap_object, type)) == NULL)
+    {
+        bitmap_free(bm);
+        return NULL;
+    }
+    self->db = hostdb_ref(db);
+    self->bm = bm;
+    return (PyObject *)self;
+}
+
+static void
+pyhostbitmap_dealloc(PyObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    bitmap_free(BITMAP(self)->bm);
+    hostdb_close(BITMAP(self)->db);
+    PyObject_Del(self);
+#if PY_MAJOR_VERSION >= 3
+    Py_DECREF(type);
+#else
+    (void)type;
+#endif
+}
+
+static Py_ssize_t
+pyhostbitmap_length(PyObject *self)
+{
+    return bitmap_count(BITMAP(self)->bm);
+}
+
+static int
+pyhostbitmap_contains(PyObject *self, PyObject *host)
+{
+    const char *name = NULL;
+    int64_t id;
+
+    if (!PyString_Check(host))
+        return 0;
+    if ((name = PyString_AsString(host)) == NULL)
+        return -1;
+    if ((id = hostdb_host_id(BITMAP(self)->db, name)) < 0)
+        return 0;
+    return bitmap_contains(BITMAP(self)->bm, id);
+}
+
+static int
+pyhostbitmap_check(PyObject *obj)
+{
+    return Py_TYPE(obj)->tp_dealloc == pyhostbitmap_dealloc;
+}
+
+static PyObject *
+operate(PyObject *a, PyObject *b,
+        struct bitmap *(*op)(const struct bitmap *, const struct bitmap *))
+{
+    if (!pyhostbitmap_check(a) || !pyhostbitmap_check(b))
+    {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+    if (BITMAP(a)->db != BITMAP(b)->db)
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "HostBitmaps are from different HostDBs");
+        return NULL;
+    }
+    errno = ENOMEM;
+    return wrap_bitmap(Py_TYPE(a), BITMAP(a)->db,
+                       op(BITMAP(a)->bm, BITMAP(b)->bm));
+}
+
+static PyObject *
+pyhostbitmap_and(PyObject *a, PyObject *b)
+{
+    return operate(a, b, bitmap_and);
+}
+
+static PyObject *
+pyhostbitmap_or(PyObject *a, PyObject *b)
+{
+    return operate(a, b, bitmap_or);
+}
+
+static PyObject *
+pyhostbitmap_subtract(PyObject *a, PyObject *b)
+{
+    return operate(a, b, bitmap_andnot);
+}
+
+static PyObject *
+pyhostbitmap_hosts(PyObject *self, PyObject *unused)
+{
+    hostlist_t hl = NULL;
+
+    if ((hl = hostlist_create(NULL)) == NULL)
+        return PyErr_NoMemory();
+    if (hostdb_push_bitmap(BITMAP(self)->db, hl, BITMAP(self)->bm) < 0)
+    {
+        hostlist_destroy(hl);
+        hl = NULL;
+    }
+    return adopt_hostlist(self, hl);
+}
+
+static PyMethodDef pyhostbitmap_methods[] = {
+    {"hosts", pyhostbitmap_hosts, METH_NOARGS,
+     "A HostList of the hosts in the bitmap, in ranged form."},
+    {NULL, NULL, 0, NULL}
+};
+
+#define PYHOSTBITMAP_DOC \
+    "A set of hosts from a HostDB, as a compressed bitmap of host IDs.\n" \
+    "Combine them with & (and), | (or) and - (and not); hosts() gives\n" \
+    "the result as a HostList."
+
+static PyObject *
+pyhostdb_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    pyhostdb_object *self = NULL;
+
+    if ((self = (pyhostdb_object *)type->tp_alloc(type, 0)) == NULL)
+        return NULL;
+    self->db = NULL;
+    return (PyObject *)self;
+}
+
+static int
+pyhostdb_tp_init(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "path", NULL };
+    struct hostdb *db = NULL;
+    const char *path = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s:HostDB", kwlist, &path))
+        return -1;
+    if ((db = hostdb_open(path)) == NULL)
+    {
+        if (errno == EINVAL)
+            PyErr_Format(PyExc_ValueError, "%s is not a host database",
+                         path);
+        else
+            PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+        return -1;
+    }
+    hostdb_close(HOSTDB(self));
+    HOSTDB(self) = db;
+    return 0;
+}
+
+static void
+pyhostdb_dealloc(PyObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    hostdb_close(HOSTDB(self));
+    type->tp_free(self);
+#if PY_MAJOR_VERSION >= 3
+    Py_DECREF(type);
+#endif
+}
+
+int
+pyhostdb_check(PyObject *obj)
+{
+    return Py_TYPE(obj)->tp_dealloc == pyhostdb_dealloc;
+}
+
+struct hostdb *
+pyhostdb_get(PyObject *obj)
+{
+    return get_db(obj);
+}
+
+static Py_ssize_t
+pyhostdb_length(PyObject *self)
+{
+    struct hostdb *db = NULL;
+
+    if ((db = get_db(self)) == NULL)
+        return -1;
+    return hostdb_nhosts(db);
+}
+
+static int
+pyhostdb_contains(PyObject *self, PyObject *host)
+{
+    struct hostdb *db = NULL;
+    const char *name = NULL;
+
+    if ((db = get_db(self)) == NULL)
+        return -1;
+    if (!PyString_Check(host))
+        return 0;
+    if ((name = PyString_AsString(host)) == NULL)
+        return -1;
+    return hostdb_host_id(db, name) >= 0;
+}
+
+static PyObject *
+pyhostdb_hosts(PyObject *self, PyObject *unused)
+{
+    struct hostdb *db = NULL;
+
+    if ((db = get_db(self)) == NULL)
+        return NULL;
+    return adopt_hostlist(self, hostdb_hostlist(db));
+}
+
+static PyObject *
+pyhostdb_attributes(PyObject *self, PyObject *unused)
+{
+    struct hostdb *db = NULL;
+    PyObject *result = NULL;
+    PyObject *item = NULL;
+    uint32_t i;
+
+    if ((db = get_db(self)) == NULL)
+        return NULL;
+    if ((result = PyList_New(0)) == NULL)
+        return NULL;
+    for (i = 0; i < hostdb_nattrs(db); i++)
+    {
+        if (hostdb_attr_name(db, i) == NULL)
+            continue;
+        if ((item = PyString_FromString(hostdb_attr_name(db, i))) == NULL
+            || PyList_Append(result, item) < 0)
+        {
+            Py_XDECREF(item);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+    return result;
+}
+
+static PyObject *
+pyhostdb_with_attribute(PyObject *self, PyObject *args)
+{
+    struct hostdb *db = NULL;
+    const char *name = NULL;
+    int64_t attr;
+
+    if (!PyArg_ParseTuple(args, "s:with_attribute", &name))
+        return NULL;
+    if ((db = get_db(self)) == NULL)
+        return NULL;
+    if ((attr = hostdb_attr_id(db, name)) < 0)
+    {
+        PyErr_SetObject(PyExc_KeyError, PyTuple_GET_ITEM(args, 0));
+        return NULL;
+    }
+    return adopt_hostlist(self, hostdb_with_attr(db, attr));
+}
+
+/* this interpreter's HostBitmap type, as a new reference */
+static PyObject *
+bitmap_type(PyObject *self)
+{
+    PyObject *type = NULL;
+
+#if PY_MAJOR_VERSION >= 3
+    type = PyObject_GetAttrString(PyType_GetModule(Py_TYPE(self)),
+                                  "HostBitmap");
+    if (type == NULL)
+        return NULL;
+    if (!PyType_Check(type)
+        || ((PyTypeObject *)type)->tp_dealloc != pyhostbitmap_dealloc)
+    {
+        Py_DECREF(type);
+        PyErr_SetString(PyExc_TypeError, "HostBitmap has been replaced");
+        return NULL;
+    }
+#else
+    type = (PyObject *)&pyhostbitmap_type;
+    Py_INCREF(type);
+#endif
+    return type;
+}
+
+PyObject *
+pyhostdb_wrap_bitmap(PyObject *self, struct bitmap *bm)
+{
+    PyObject *type = NULL;
+    PyObject *result = NULL;
+
+    if ((type = bitmap_type(self)) == NULL)
+    {
+        bitmap_free(bm);
+        return NULL;
+    }
+    result = wrap_bitmap((PyTypeObject *)type, HOSTDB(self), bm);
+    Py_DECREF(type);
+    return result;
+}
+
+static PyObject *
+pyhostdb_bitmap(PyObject *self, PyObject *args)
+{
+    struct hostdb *db = NULL;
+    struct bitmap *bm = NULL;
+    const char *name = NULL;
+    int64_t attr = 0;
+
+    if (!PyArg_ParseTuple(args, "|z:bitmap", &name))
+        return NULL;
+    if ((db = get_db(self)) == NULL)
+        return NULL;
+    if (name != NULL && (attr = hostdb_attr_id(db, name)) < 0)
+    {
+        PyErr_SetObject(PyExc_KeyError, PyTuple_GET_ITEM(args, 0));
+        return NULL;
+    }
+    bm = (name == NULL) ? hostdb_all_bitmap(db) : hostdb_attr_bitmap(db, attr);
+    return pyhostdb_wrap_bitmap(self, bm);
+}
+
+static PyObject *
+pyhostdb_attributes_of(PyObject *self, PyObject *args)
+{
+    struct hostdb *db = NULL;
+    const char *name = NULL;
+    PyObject *result = NULL;
+    PyObject *item = NULL;
+    int64_t id;
+    uint32_t i;
+
+    if (!PyArg_ParseTuple(args, "s:attributes_of", &name))
+        return NULL;
+    if ((db = get_db(self)) == NULL)
+        return NULL;
+    if ((id = hostdb_host_id(db, name)) < 0)
+    {
+        PyErr_SetObject(PyExc_KeyError, PyTuple_GET_ITEM(args, 0));
+        return NULL;
+    }
+    if ((result = PyList_New(0)) == NULL)
+        return NULL;
+    for (i = 0; i < hostdb_nattrs(db); i++)
+    {
+        if (!hostdb_host_has_attr(db, id, i) || !hostdb_attr_name(db, i))
+            continue;
+        if ((item = PyString_FromString(hostdb_attr_name(db, i))) == NULL
+            || PyList_Append(result, item) < 0)
+        {
+            Py_XDECREF(item);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+    return result;
+}
+
+static PyObject *
+pyhostdb_close(PyObject *self, PyObject *unused)
+{
+    hostdb_close(HOSTDB(self));
+    HOSTDB(self) = NULL;
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef pyhostdb_methods[] = {
+    {"hosts", pyhostdb_hosts, METH_NOARGS,
+     "A HostList of every host in the database."},
+    {"attributes", pyhostdb_attributes, METH_NOARGS,
+     "A list of the attributes hosts can have, sorted."},
+    {"with_attribute", pyhostdb_with_attribute, METH_VARARGS,
+     "A HostList of the hosts with an attribute; KeyError if no host has "
+     "it."},
+    {"bitmap", pyhostdb_bitmap, METH_VARARGS,
+     "A HostBitmap of the hosts with an attribute, or of every host if "
+     "none is given; KeyError if no host has it."},
+    {"attributes_of", pyhostdb_attributes_of, METH_VARARGS,
+     "A list of a host's attributes; KeyError if it isn't in the "
+     "database."},
+    {"close", pyhostdb_close, METH_NOARGS,
+     "Unmap the database."},
+    {NULL, NULL, 0, NULL}
+};
+
+#define PYHOSTDB_DOC \
+    "HostDB(path): a compiled host database (see pdshpy.hostdb), mapped\n" \
+    "into memory. len() is the number of hosts, and 'in' checks whether\n" \
+    "a host is in it."
+
+#if PY_MAJOR_VERSION >= 3
+
+static PyType_Slot pyhostdb_slots[] = {
+    {Py_tp_dealloc, pyhostdb_dealloc},
+    {Py_tp_methods, pyhostdb_methods},
+    {Py_tp_init, pyhostdb_tp_init},
+    {Py_tp_new, pyhostdb_new},
+    {Py_tp_doc, PYHOSTDB_DOC},
+    {Py_sq_length, pyhostdb_length},
+    {Py_sq_contains, pyhostdb_contains},
+    {0, NULL}
+};
+
+static PyType_Spec pyhostdb_spec = {
+    "_pdshpy_internal.HostDB",
+    sizeof(pyhostdb_object),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    pyhostdb_slots,
+};
+
+static PyType_Slot pyhostbitmap_slots[] = {
+    {Py_tp_dealloc, pyhostbitmap_dealloc},
+    {Py_tp_methods, pyhostbitmap_methods},
+    {Py_tp_hash, PyObject_HashNotImplemented},
+    {Py_tp_doc, PYHOSTBITMAP_DOC},
+    {Py_sq_length, pyhostbitmap_length},
+    {Py_sq_contains, pyhostbitmap_contains},
+    {Py_nb_and, pyhostbitmap_and},
+    {Py_nb_or, pyhostbitmap_or},
+    {Py_nb_subtract, pyhostbitmap_subtract},
+    {0, NULL}
+};
+
+static PyType_Spec pyhostbitmap_spec = {
+    "_pdshpy_internal.HostBitmap",
+    sizeof(pyhostbitmap_object),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    pyhostbitmap_slots,
+};
+
+static int
+add_type(PyObject *module, PyType_Spec *spec, const char *name)
+{
+    PyObject *type = NULL;
+
+    /* tied to the module, for adopt_hostlist() to find HostList in */
+    if ((type = PyType_FromModuleAndSpec(module, spec, NULL)) == NULL)
+        return -1;
+    if (PyModule_AddObject(module, name, type) < 0)
+    {
+        Py_DECREF(type);
+        return -1;
+    }
+    return 0;
+}
+
+int
+pyhostdb_init(PyObject *module)
+{
+    if (add_type(module, &pyhostdb_spec, "HostDB") < 0)
+        return -1;
+    return add_type(module, &pyhostbitmap_spec, "HostBitmap");
+}
+
+#else /* Python 2 */
+
+static PySequenceMethods pyhostdb_as_sequence = {
+    pyhostdb_length,            /* sq_length */
+    0,                          /* sq_concat */
+    0,                          /* sq_repeat */
+    0,                          /* sq_item */
+    0,                          /* sq_slice */
+    0,                          /* sq_ass_item */
+    0,                          /* sq_ass_slice */
+    pyhostdb_contains,          /* sq_contains */
+};
+
+static PyTypeObject pyhostdb_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "_pdshpy_internal.HostDB",      /* tp_name */
+    sizeof(pyhostdb_object),        /* tp_basicsize */
+    0,                              /* tp_itemsize */
+    pyhostdb_dealloc,               /* tp_dealloc */
+    0,                              /* tp_print */
+    0,                              /* tp_getattr */
+    0,                              /* tp_setattr */
+    0,                              /* tp_compare */
+    0,                              /* tp_repr */
+    0,                              /* tp_as_number */
+    &pyhostdb_as_sequence,          /* tp_as_sequence */
+    0,                              /* tp_as_mapping */
+    0,                              /* tp_hash */
+    0,                              /* tp_call */
+    0,                              /* tp_str */
+    0,                              /* tp_getattro */
+    0,                              /* tp_setattro */
+    0,                              /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,             /* tp_flags */
+    PYHOSTDB_DOC,                   /* tp_doc */
+    0,                              /* tp_traverse */
+    0,                              /* tp_clear */
+    0,                              /* tp_richcompare */
+    0,                              /* tp_weaklistoffset */
+    0,                              /* tp_iter */
+    0,                              /* tp_iternext */
+    pyhostdb_methods,               /* tp_methods */
+    0,                              /* tp_members */
+    0,                              /* tp_getset */
+    0,                              /* tp_base */
+    0,                              /* tp_dict */
+    0,                              /* tp_descr_get */
+    0,                              /* tp_descr_set */
+    0,                              /* tp_dictoffset */
+    pyhostdb_tp_init,               /* tp_init */
+    0,                              /* tp_alloc */
+    pyhostdb_new,                   /* tp_new */
+};
+
+static PySequenceMethods pyhostbitmap_as_sequence = {
+    pyhostbitmap_length,        /* sq_length */
+    0,                          /* sq_concat */
+    0,                          /* sq_repeat */
+    0,                          /* sq_item */
+    0,                          /* sq_slice */
+    0,                          /* sq_ass_item */
+    0,                          /* sq_ass_slice */
+    pyhostbitmap_contains,      /* sq_contains */
+};
+
+static PyNumberMethods pyhostbitmap_as_number = {
+    0,                          /* nb_add */
+    pyhostbitmap_subtract,      /* nb_subtract */
+    0,                          /* nb_multiply */
+    0,                          /* nb_divide */
+    0,                          /* nb_remainder */
+    0,                          /* nb_divmod */
+    0,                          /* nb_power */
+    0,                          /* nb_negative */
+    0,                          /* nb_positive */
+    0,                          /* nb_absolute */
+    0,                          /* nb_nonzero */
+    0,                          /* nb_invert */
+    0,                          /* nb_lshift */
+    0,                          /* nb_rshift */
+    pyhostbitmap_and,           /* nb_and */
+    0,                          /* nb_xor */
+    pyhostbitmap_or,            /* nb_or */
+};
+
+static PyTypeObject pyhostbitmap_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "_pdshpy_internal.HostBitmap",  /* tp_name */
+    sizeof(pyhostbitmap_object),    /* tp_basicsize */
+    0,                              /* tp_itemsize */
+    pyhostbitmap_dealloc,           /* tp_dealloc */
+    0,                              /* tp_print */
+    0,                              /* tp_getattr */
+    0,                              /* tp_setattr */
+    0,                              /* tp_compare */
+    0,                              /* tp_repr */
+    &pyhostbitmap_as_number,        /* tp_as_number */
+    &pyhostbitmap_as_sequence,      /* tp_as_sequence */
+    0,                              /* tp_as_mapping */
+    PyObject_HashNotImplemented,    /* tp_hash */
+    0,                              /* tp_call */
+    0,                              /* tp_str */
+    0,                              /* tp_getattro */
+    0,                              /* tp_setattro */
+    0,                              /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_CHECKTYPES, /* tp_flags */
+    PYHOSTBITMAP_DOC,               /* tp_doc */
+    0,                              /* tp_traverse */
+    0,                              /* tp_clear */
+    0,                              /* tp_richcompare */
+    0,                              /* tp_weaklistoffset */
+    0,                              /* tp_iter */
+    0,                              /* tp_iternext */
+    pyhostbitmap_methods,           /* tp_methods */
+};
+
+int
+pyhostdb_init(PyObject *module)
+{
+    if (PyType_Ready(&pyhostdb_type) < 0
+        || PyType_Ready(&pyhostbitmap_type) < 0)
+        return -1;
+    Py_INCREF(&pyhostdb_type);
+    if (PyModule_AddObject(module, "HostDB", (PyObject *)&pyhostdb_type) < 0)
+        return -1;
+    Py_INCREF(&pyhostbitmap_type);
+    return PyModule_AddObject(module, "HostBitmap",
+                              (PyObject *)&pyhostbitmap_type);
+}
+
+#endif
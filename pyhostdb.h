@@ -0,0 +1,46 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* HostDB: a Python type for querying a host database (see hostdb.h), so
+ * drivers can get at a compiled inventory without parsing it, and get
+ * HostLists out of it without a Python string per host. pdshpy/hostdb.py
+ * has the same thing in plain Python, for server mode.
+ */
+
+#ifndef _PDSHPY_PYHOSTDB_H
+#define _PDSHPY_PYHOSTDB_H
+
+#include <Python.h>
+
+#include "hostdb.h"
+
+/* make the type ready, and add it to 'module' as HostDB. On Python 3, this
+ * makes a new type for each interpreter's module. */
+int pyhostdb_init(PyObject *module);
+
+int pyhostdb_check(PyObject *obj);
+
+/* the database a HostDB has mapped, or NULL with an exception set if it's
+ * been closed */
+struct hostdb *pyhostdb_get(PyObject *obj);
+
+/* A new HostBitmap of hosts from HostDB 'db', taking over 'bm'. If 'bm' is
+ * NULL, raises the exception for errno (MemoryError, or ValueError for a
+ * damaged database) instead. */
+PyObject *pyhostdb_wrap_bitmap(PyObject *db, struct bitmap *bm);
+
+#endif /* !_PDSHPY_PYHOSTDB_H */
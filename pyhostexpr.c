@@ -0,0 +1,255 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <Python.h>
+#include "pycompat.h"
+#include <errno.h>
+
+#include "hostexpr.h"
+#include "pyhostdb.h"
+#include "pyhostexpr.h"
+#include "pyhostlist.h"
+
+typedef struct {
+    PyObject_HEAD
+    struct hostexpr *expr;
+} pyhostexpr_object;
+
+#define HOSTEXPR(obj) (((pyhostexpr_object *)(obj))->expr)
+
+static PyObject *
+pyhostexpr_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "expr", NULL };
+    pyhostexpr_object *self = NULL;
+    struct hostexpr *expr = NULL;
+    const char *text = NULL;
+    char err[256];
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s:HostExpr", kwlist,
+                                     &text))
+        return NULL;
+    if ((expr = hostexpr_compile(text, err, sizeof(err))) == NULL)
+    {
+        if (errno == ENOMEM)
+            return PyErr_NoMemory();
+        PyErr_Format(PyExc_ValueError, "bad host expression '%s': %s", text,
+                     err);
+        return NULL;
+    }
+    if ((self = (pyhostexpr_object *)type->tp_alloc(type, 0)) == NULL)
+    {
+        hostexpr_release(expr);
+        return NULL;
+    }
+    self->expr = expr;
+    return (PyObject *)self;
+}
+
+static void
+pyhostexpr_dealloc(PyObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    hostexpr_release(HOSTEXPR(self));
+    type->tp_free(self);
+#if PY_MAJOR_VERSION >= 3
+    Py_DECREF(type);
+#endif
+}
+
+static PyObject *
+pyhostexpr_str(PyObject *self)
+{
+    return PyString_FromString(hostexpr_text(HOSTEXPR(self)));
+}
+
+static PyObject *
+pyhostexpr_repr(PyObject *self)
+{
+    return PyString_FromFormat("HostExpr('%s')",
+                               hostexpr_text(HOSTEXPR(self)));
+}
+
+/* the hosts of a HostDB which the expression selects */
+static PyObject *
+select_db(PyObject *self, PyObject *source)
+{
+    struct hostdb *db = NULL;
+    struct bitmap *bm = NULL;
+    int saved_errno;
+
+    if ((db = pyhostdb_get(source)) == NULL)
+        return NULL;
+
+    /* the HostDB might be closed meanwhile */
+    hostdb_ref(db);
+    Py_BEGIN_ALLOW_THREADS
+    bm = hostexpr_select_db(HOSTEXPR(self), db);
+    saved_errno = errno;
+    hostdb_close(db);
+    Py_END_ALLOW_THREADS
+    errno = saved_errno;
+    return pyhostdb_wrap_bitmap(source, bm);
+}
+
+static PyObject *
+pyhostexpr_select(PyObject *self, PyObject *source)
+{
+    PyObject *module = NULL;
+    PyObject *result = NULL;
+    hostlist_t hl = NULL;
+    hostlist_t selected = NULL;
+
+    if (pyhostdb_check(source))
+        return select_db(self, source);
+
+    if (pyhostlist_check(source))
+        selected = hostexpr_select_hostlist(HOSTEXPR(self),
+                                            pyhostlist_get(source));
+    else
+    {
+        if ((hl = hostlist_create(NULL)) == NULL)
+            return PyErr_NoMemory();
+        if (pyhostlist_push_hosts(hl, source) < 0)
+        {
+            hostlist_destroy(hl);
+            return NULL;
+        }
+        selected = hostexpr_select_hostlist(HOSTEXPR(self), hl);
+        hostlist_destroy(hl);
+    }
+    if (selected == NULL)
+        return PyErr_NoMemory();
+
+#if PY_MAJOR_VERSION >= 3
+    module = PyType_GetModule(Py_TYPE(self));
+#endif
+    if ((result = pyhostlist_wrap(module, selected)) == NULL)
+    {
+        hostlist_destroy(selected);
+        return NULL;
+    }
+    pyhostlist_release(result, 1);
+    return result;
+}
+
+static PyMethodDef pyhostexpr_methods[] = {
+    {"select", pyhostexpr_select, METH_O,
+     "The hosts the expression selects: from a HostDB, as a HostBitmap;\n"
+     "from a HostList, ranged string or iterable of hostnames, as a new\n"
+     "HostList, in the same order."},
+    {NULL, NULL, 0, NULL}
+};
+
+#define PYHOSTEXPR_DOC \
+    "HostExpr(expr): a compiled host-selection expression, like\n" \
+    "'gpu & !down & rack[10-20]'. Names are attributes or hostnames, and\n" \
+    "can be combined with & (and), | (or), ! (not) and parentheses; * is\n" \
+    "every host. str() gives the simplified expression."
+
+#if PY_MAJOR_VERSION >= 3
+
+static PyType_Slot pyhostexpr_slots[] = {
+    {Py_tp_dealloc, pyhostexpr_dealloc},
+    {Py_tp_repr, pyhostexpr_repr},
+    {Py_tp_str, pyhostexpr_str},
+    {Py_tp_methods, pyhostexpr_methods},
+    {Py_tp_new, pyhostexpr_new},
+    {Py_tp_doc, PYHOSTEXPR_DOC},
+    {0, NULL}
+};
+
+static PyType_Spec pyhostexpr_spec = {
+    "_pdshpy_internal.HostExpr",
+    sizeof(pyhostexpr_object),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    pyhostexpr_slots,
+};
+
+int
+pyhostexpr_init(PyObject *module)
+{
+    PyObject *type = NULL;
+
+    /* tied to the module, for select() to find HostList in */
+    if ((type = PyType_FromModuleAndSpec(module, &pyhostexpr_spec, NULL))
+        == NULL)
+        return -1;
+    if (PyModule_AddObject(module, "HostExpr", type) < 0)
+    {
+        Py_DECREF(type);
+        return -1;
+    }
+    return 0;
+}
+
+#else /* Python 2 */
+
+static PyTypeObject pyhostexpr_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "_pdshpy_internal.HostExpr",    /* tp_name */
+    sizeof(pyhostexpr_object),      /* tp_basicsize */
+    0,                              /* tp_itemsize */
+    pyhostexpr_dealloc,             /* tp_dealloc */
+    0,                              /* tp_print */
+    0,                              /* tp_getattr */
+    0,                              /* tp_setattr */
+    0,                              /* tp_compare */
+    pyhostexpr_repr,                /* tp_repr */
+    0,                              /* tp_as_number */
+    0,                              /* tp_as_sequence */
+    0,                              /* tp_as_mapping */
+    0,                              /* tp_hash */
+    0,                              /* tp_call */
+    pyhostexpr_str,                 /* tp_str */
+    0,                              /* tp_getattro */
+    0,                              /* tp_setattro */
+    0,                              /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,             /* tp_flags */
+    PYHOSTEXPR_DOC,                 /* tp_doc */
+    0,                              /* tp_traverse */
+    0,                              /* tp_clear */
+    0,                              /* tp_richcompare */
+    0,                              /* tp_weaklistoffset */
+    0,                              /* tp_iter */
+    0,                              /* tp_iternext */
+    pyhostexpr_methods,             /* tp_methods */
+    0,                              /* tp_members */
+    0,                              /* tp_getset */
+    0,                              /* tp_base */
+    0,                              /* tp_dict */
+    0,                              /* tp_descr_get */
+    0,                              /* tp_descr_set */
+    0,                              /* tp_dictoffset */
+    0,                              /* tp_init */
+    0,                              /* tp_alloc */
+    pyhostexpr_new,                 /* tp_new */
+};
+
+int
+pyhostexpr_init(PyObject *module)
+{
+    if (PyType_Ready(&pyhostexpr_type) < 0)
+        return -1;
+    Py_INCREF(&pyhostexpr_type);
+    return PyModule_AddObject(module, "HostExpr",
+                              (PyObject *)&pyhostexpr_type);
+}
+
+#endif
@@ -0,0 +1,33 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* HostExpr: a Python type for compiled host-selection expressions (see
+ * hostexpr.h), so drivers can offer things like -g 'gpu & !down' without
+ * each writing a parser of their own. pdshpy/hostexpr.py has the same thing
+ * in plain Python, for server mode.
+ */
+
+#ifndef _PDSHPY_PYHOSTEXPR_H
+#define _PDSHPY_PYHOSTEXPR_H
+
+#include <Python.h>
+
+/* make the type ready, and add it to 'module' as HostExpr. On Python 3,
+ * this makes a new type for each interpreter's module. */
+int pyhostexpr_init(PyObject *module);
+
+#endif /* !_PDSHPY_PYHOSTEXPR_H */
@@ -0,0 +1,1336 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <Python.h>
+#include "pycompat.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pdshpy.h"
+#include "metrics.h"
+#include "probes.h"
+#include "pyhostlist.h"
+#include "rangeset.h"
+
+typedef struct {
+    PyObject_HEAD
+    hostlist_t hl;
+    int owned;          /* destroy hl along with the object */
+} pyhostlist_object;
+
+#define HOSTLIST(obj) (((pyhostlist_object *)(obj))->hl)
+
+PyObject *
+pyhostlist_to_list(hostlist_t hl)
+{
+    PyObject *pylist = NULL;
+    PyObject *listitem = NULL;
+    char *item = NULL;
+    hostlist_iterator_t hli = NULL;
+    struct metrics_mark mark;
+    uint64_t nhosts = 0;
+    uint64_t nbytes = 0;
+
+    metrics_begin(&mark);
+    PDSHPY_PROBE0(hosts_to_python__entry);
+
+    if ((hli = hostlist_iterator_create(hl)) == NULL)
+    {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "Could not allocate hostlist iterator");
+        goto fail;
+    }
+
+    if ((pylist = PyList_New(0)) == NULL)
+        goto fail;
+
+    for (item = hostlist_next(hli); item; item = hostlist_next(hli))
+    {
+        listitem = PyString_FromString(item);
+        nbytes += strlen(item);
+        free(item);
+        if (listitem == NULL)
+            goto fail;
+        if (PyList_Append(pylist, listitem) < 0)
+        {
+            Py_DECREF(listitem);
+            goto fail;
+        }
+        Py_DECREF(listitem);
+        nhosts++;
+    }
+
+    hostlist_iterator_destroy(hli);
+    metrics_end(PHASE_HOSTS_TO_PYTHON, &mark);
+    PDSHPY_PROBE2(hosts_to_python__return, nhosts, nbytes);
+    metrics_count(COUNT_HOSTS_TO_PYTHON, nhosts);
+    metrics_count(COUNT_BYTES_TO_PYTHON, nbytes);
+    /* the list, its array of pointers, and a string object per host */
+    metrics_count(COUNT_PYTHON_HOSTLIST_BYTES,
+                  Py_TYPE(pylist)->tp_basicsize
+                  + ((PyListObject *)pylist)->allocated * sizeof(PyObject *)
+                  + nhosts * PyString_Type.tp_basicsize + nbytes);
+    return pylist;
+
+fail:
+    if (hli != NULL)
+        hostlist_iterator_destroy(hli);
+    Py_XDECREF(pylist);
+    metrics_end(PHASE_HOSTS_TO_PYTHON, &mark);
+    PDSHPY_PROBE2(hosts_to_python__return, nhosts, nbytes);
+    return NULL;
+}
+
+int
+pyhostlist_push_hosts(hostlist_t hl, PyObject *hosts)
+{
+    PyObject *iter = NULL;
+    PyObject *item = NULL;
+    PyObject *str = NULL;
+    const char *name = NULL;
+    int rc = 0;
+
+    if (PyString_Check(hosts))
+    {
+        if ((name = PyString_AsString(hosts)) == NULL)
+            return -1;
+        hostlist_push(hl, name);
+        return 0;
+    }
+    if (PyBytes_Check(hosts))
+    {
+        /* a ranged string, in UTF-8; not a sequence of ints */
+        if ((str = pdshpy_host_str(hosts)) == NULL)
+            return -1;
+        rc = pyhostlist_push_hosts(hl, str);
+        Py_DECREF(str);
+        return rc;
+    }
+    if (pyhostlist_check(hosts))
+    {
+        hostlist_t copy = NULL;
+
+        /* pdsh's push_list would chase its own tail */
+        if (HOSTLIST(hosts) != hl)
+            hostlist_push_list(hl, HOSTLIST(hosts));
+        else if ((copy = hostlist_copy(hl)) != NULL)
+        {
+            hostlist_push_list(hl, copy);
+            hostlist_destroy(copy);
+        }
+        return 0;
+    }
+
+    if ((iter = PyObject_GetIter(hosts)) == NULL)
+        return -1;
+    while ((item = PyIter_Next(iter)) != NULL)
+    {
+        str = pdshpy_host_str(item);
+        Py_DECREF(item);
+        if (str == NULL)
+            break;
+        if ((name = PyString_AsString(str)) != NULL)
+            hostlist_push_host(hl, name);
+        Py_DECREF(str);
+        if (name == NULL)
+            break;
+    }
+    Py_DECREF(iter);
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+static PyObject *
+pyhostlist_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    pyhostlist_object *self = NULL;
+
+    if ((self = (pyhostlist_object *)type->tp_alloc(type, 0)) == NULL)
+        return NULL;
+    if ((self->hl = hostlist_create(NULL)) == NULL)
+    {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    self->owned = 1;
+    return (PyObject *)self;
+}
+
+static int
+pyhostlist_tp_init(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "hosts", NULL };
+    PyObject *hosts = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O:HostList", kwlist,
+                                     &hosts))
+        return -1;
+    if (hosts == NULL || hosts == Py_None)
+        return 0;
+    return pyhostlist_push_hosts(HOSTLIST(self), hosts);
+}
+
+static void
+pyhostlist_dealloc(PyObject *self)
+{
+    pyhostlist_object *hlo = (pyhostlist_object *)self;
+
+    PyTypeObject *type = Py_TYPE(self);
+
+    if (hlo->owned && hlo->hl != NULL)
+        hostlist_destroy(hlo->hl);
+    type->tp_free(self);
+#if PY_MAJOR_VERSION >= 3
+    /* instances of heap types hold a reference to their type */
+    Py_DECREF(type);
+#endif
+}
+
+static PyObject *
+pyhostlist_str(PyObject *self)
+{
+    PyObject *result = NULL;
+    char *ranged = NULL;
+
+    if ((ranged = pdshpy_hostlist_ranged(HOSTLIST(self))) == NULL)
+        return PyErr_NoMemory();
+    result = PyString_FromString(ranged);
+    free(ranged);
+    return result;
+}
+
+static PyObject *
+pyhostlist_repr(PyObject *self)
+{
+    PyObject *result = NULL;
+    char *ranged = NULL;
+
+    if ((ranged = pdshpy_hostlist_ranged(HOSTLIST(self))) == NULL)
+        return PyErr_NoMemory();
+    result = PyString_FromFormat("HostList('%s')", ranged);
+    free(ranged);
+    return result;
+}
+
+static Py_ssize_t
+pyhostlist_length(PyObject *self)
+{
+    return hostlist_count(HOSTLIST(self));
+}
+
+static PyObject *
+pyhostlist_item(PyObject *self, Py_ssize_t i)
+{
+    PyObject *result = NULL;
+    char *host = NULL;
+
+    if (i < 0 || i >= hostlist_count(HOSTLIST(self)))
+    {
+        PyErr_SetString(PyExc_IndexError, "HostList index out of range");
+        return NULL;
+    }
+    if ((host = hostlist_nth(HOSTLIST(self), (int)i)) == NULL)
+        return PyErr_NoMemory();
+    result = PyString_FromString(host);
+    free(host);
+    return result;
+}
+
+static int
+pyhostlist_contains(PyObject *self, PyObject *host)
+{
+    PyObject *str = NULL;
+    const char *name = NULL;
+    int found = 0;
+
+    if ((str = pdshpy_host_str(host)) == NULL)
+        return -1;
+    if ((name = PyString_AsString(str)) == NULL)
+        found = -1;
+    else
+        found = hostlist_find(HOSTLIST(self), name) >= 0;
+    Py_DECREF(str);
+    return found;
+}
+
+/* Iterates over a snapshot, so that hosts can be removed while looping. */
+static PyObject *
+pyhostlist_iter(PyObject *self)
+{
+    PyObject *hosts = NULL;
+    PyObject *iter = NULL;
+
+    if ((hosts = pyhostlist_to_list(HOSTLIST(self))) == NULL)
+        return NULL;
+    iter = PyObject_GetIter(hosts);
+    Py_DECREF(hosts);
+    return iter;
+}
+
+static PyObject *
+pyhostlist_append(PyObject *self, PyObject *host)
+{
+    PyObject *str = NULL;
+    const char *name = NULL;
+
+    if ((str = pdshpy_host_str(host)) == NULL)
+        return NULL;
+    if ((name = PyString_AsString(str)) != NULL)
+        hostlist_push_host(HOSTLIST(self), name);
+    Py_DECREF(str);
+    if (name == NULL)
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+pyhostlist_extend(PyObject *self, PyObject *hosts)
+{
+    if (pyhostlist_push_hosts(HOSTLIST(self), hosts) < 0)
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+/* delete every occurrence of 'host'; returns how many there were */
+static int
+delete_host(PyObject *self, PyObject *host)
+{
+    PyObject *str = NULL;
+    const char *name = NULL;
+    int n = 0;
+
+    if ((str = pdshpy_host_str(host)) == NULL)
+        return -1;
+    if ((name = PyString_AsString(str)) == NULL)
+        n = -1;
+    else
+        while (hostlist_delete_host(HOSTLIST(self), name) > 0)
+            n++;
+    Py_DECREF(str);
+    return n;
+}
+
+static PyObject *
+pyhostlist_remove(PyObject *self, PyObject *host)
+{
+    int n = delete_host(self, host);
+
+    if (n < 0)
+        return NULL;
+    if (n == 0)
+    {
+        PyErr_SetObject(PyExc_ValueError, host);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+pyhostlist_discard(PyObject *self, PyObject *host)
+{
+    if (delete_host(self, host) < 0)
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+pyhostlist_delete(PyObject *self, PyObject *args)
+{
+    const char *hosts = NULL;
+
+    if (!PyArg_ParseTuple(args, "s:delete", &hosts))
+        return NULL;
+    return PyInt_FromLong(hostlist_delete(HOSTLIST(self), hosts));
+}
+
+static PyObject *
+pyhostlist_uniq(PyObject *self, PyObject *unused)
+{
+    hostlist_uniq(HOSTLIST(self));
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+pyhostlist_copy(PyObject *self, PyObject *unused)
+{
+    pyhostlist_object *copy = NULL;
+
+    copy = PyObject_New(pyhostlist_object, Py_TYPE(self));
+    if (copy == NULL)
+        return NULL;
+    if ((copy->hl = hostlist_copy(HOSTLIST(self))) == NULL)
+    {
+        copy->owned = 0;
+        Py_DECREF(copy);
+        return PyErr_NoMemory();
+    }
+    copy->owned = 1;
+    return (PyObject *)copy;
+}
+
+/* the hosts in a HostList, ranged string or iterable of hostnames, as a
+ * rangeset; NULL with an exception set */
+static struct rangeset *
+to_rangeset(PyObject *hosts)
+{
+    struct rangeset *rs = NULL;
+    hostlist_t hl = NULL;
+    const char *ranged = NULL;
+
+    if (pyhostlist_check(hosts))
+        rs = rangeset_from_hostlist(HOSTLIST(hosts), 0);
+    else if (PyString_Check(hosts))
+    {
+        if ((ranged = PyString_AsString(hosts)) == NULL)
+            return NULL;
+        rs = rangeset_parse(ranged, 0);
+    }
+    else
+    {
+        if ((hl = hostlist_create(NULL)) == NULL)
+        {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        if (pyhostlist_push_hosts(hl, hosts) < 0)
+        {
+            hostlist_destroy(hl);
+            return NULL;
+        }
+        rs = rangeset_from_hostlist(hl, 0);
+        hostlist_destroy(hl);
+    }
+    if (rs == NULL && errno == EINVAL)
+        PyErr_SetString(PyExc_ValueError, "bad hostlist");
+    else if (rs == NULL)
+        PyErr_NoMemory();
+    return rs;
+}
+
+/* a new HostList, of 'type', which owns 'hl' (NULL for no memory) */
+static PyObject *
+wrap_owned(PyTypeObject *type, hostlist_t hl)
+{
+    pyhostlist_object *result = NULL;
+
+    if (hl == NULL)
+        return PyErr_NoMemory();
+    if ((result = PyObject_New(pyhostlist_object, type)) == NULL)
+    {
+        hostlist_destroy(hl);
+        return NULL;
+    }
+    result->hl = hl;
+    result->owned = 1;
+    return (PyObject *)result;
+}
+
+/* a new HostList, of 'type', of op(a, b) */
+static PyObject *
+set_op(PyTypeObject *type, PyObject *a, PyObject *b,
+       struct rangeset *(*op)(const struct rangeset *,
+                              const struct rangeset *))
+{
+    struct rangeset *x = NULL;
+    struct rangeset *y = NULL;
+    struct rangeset *rs = NULL;
+    hostlist_t hl = NULL;
+
+    if ((x = to_rangeset(a)) == NULL)
+        return NULL;
+    if ((y = to_rangeset(b)) == NULL)
+    {
+        rangeset_free(x);
+        return NULL;
+    }
+    rs = op(x, y);
+    rangeset_free(x);
+    rangeset_free(y);
+    if (rs == NULL)
+        return PyErr_NoMemory();
+    hl = rangeset_hostlist(rs);
+    rangeset_free(rs);
+    return wrap_owned(type, hl);
+}
+
+static PyObject *
+pyhostlist_union(PyObject *self, PyObject *other)
+{
+    return set_op(Py_TYPE(self), self, other, rangeset_union);
+}
+
+static PyObject *
+pyhostlist_intersection(PyObject *self, PyObject *other)
+{
+    return set_op(Py_TYPE(self), self, other, rangeset_intersect);
+}
+
+static PyObject *
+pyhostlist_difference(PyObject *self, PyObject *other)
+{
+    return set_op(Py_TYPE(self), self, other, rangeset_difference);
+}
+
+/* |, & and -, between HostLists and ranged strings */
+static PyObject *
+number_op(PyObject *a, PyObject *b,
+          struct rangeset *(*op)(const struct rangeset *,
+                                 const struct rangeset *))
+{
+    if ((!pyhostlist_check(a) && !PyString_Check(a))
+        || (!pyhostlist_check(b) && !PyString_Check(b)))
+    {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+    return set_op(Py_TYPE(pyhostlist_check(a) ? a : b), a, b, op);
+}
+
+static PyObject *
+pyhostlist_or(PyObject *a, PyObject *b)
+{
+    return number_op(a, b, rangeset_union);
+}
+
+static PyObject *
+pyhostlist_and(PyObject *a, PyObject *b)
+{
+    return number_op(a, b, rangeset_intersect);
+}
+
+static PyObject *
+pyhostlist_sub(PyObject *a, PyObject *b)
+{
+    return number_op(a, b, rangeset_difference);
+}
+
+/* the hosts of 'self', in order, as a rangeset; NULL with an exception */
+static struct rangeset *
+ordered_rangeset(PyObject *self)
+{
+    struct rangeset *rs = NULL;
+
+    if ((rs = rangeset_from_hostlist(HOSTLIST(self), 1)) == NULL)
+        PyErr_NoMemory();
+    return rs;
+}
+
+enum partition {
+    PARTITION_CHUNKS,           /* n runs of (nearly) the same size */
+    PARTITION_BATCHES,          /* runs of n */
+    PARTITION_INTERLEAVE,       /* every nth host, from each of the first n */
+};
+
+/* a list of new HostLists of the hosts in 'self', split up 'how' */
+static PyObject *
+partition(PyObject *self, PyObject *args, const char *format,
+          enum partition how)
+{
+    PyObject *parts = NULL;
+    PyObject *part = NULL;
+    struct rangeset *rs = NULL;
+    uint64_t total, nparts, k, start, step, count;
+    long n;
+
+    if (!PyArg_ParseTuple(args, format, &n))
+        return NULL;
+    if (n <= 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "must be greater than 0");
+        return NULL;
+    }
+    if ((rs = ordered_rangeset(self)) == NULL)
+        return NULL;
+    total = rangeset_count(rs);
+    if (how == PARTITION_BATCHES)
+        nparts = (total + n - 1) / n;
+    else
+        nparts = n;
+    if ((parts = PyList_New(nparts)) == NULL)
+        goto fail;
+    for (k = 0; k < nparts; k++)
+    {
+        switch (how)
+        {
+        case PARTITION_CHUNKS:
+            start = k * (total / n) + (k < total % n ? k : total % n);
+            step = 1;
+            count = total / n + (k < total % n);
+            break;
+        case PARTITION_BATCHES:
+            start = k * n;
+            step = 1;
+            count = n;
+            break;
+        default:
+            start = k;
+            step = n;
+            count = k < total ? (total - k + n - 1) / n : 0;
+            break;
+        }
+        part = wrap_owned(Py_TYPE(self),
+                          rangeset_slice(rs, start, step, count));
+        if (part == NULL)
+            goto fail;
+        PyList_SET_ITEM(parts, k, part);
+    }
+    rangeset_free(rs);
+    return parts;
+
+fail:
+    rangeset_free(rs);
+    Py_XDECREF(parts);
+    return NULL;
+}
+
+static PyObject *
+pyhostlist_chunks(PyObject *self, PyObject *args)
+{
+    return partition(self, args, "l:chunks", PARTITION_CHUNKS);
+}
+
+static PyObject *
+pyhostlist_batches(PyObject *self, PyObject *args)
+{
+    return partition(self, args, "l:batches", PARTITION_BATCHES);
+}
+
+static PyObject *
+pyhostlist_interleave(PyObject *self, PyObject *args)
+{
+    return partition(self, args, "l:interleave", PARTITION_INTERLEAVE);
+}
+
+static PyObject *
+pyhostlist_sample(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "percent", "seed", NULL };
+    struct rangeset *rs = NULL;
+    hostlist_t hl = NULL;
+    double percent;
+    unsigned PY_LONG_LONG seed = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "d|K:sample", kwlist,
+                                     &percent, &seed))
+        return NULL;
+    if (!(percent >= 0 && percent <= 100))
+    {
+        PyErr_SetString(PyExc_ValueError, "percent must be from 0 to 100");
+        return NULL;
+    }
+    if ((rs = ordered_rangeset(self)) == NULL)
+        return NULL;
+    hl = rangeset_sample(rs, percent, seed);
+    rangeset_free(rs);
+    return wrap_owned(Py_TYPE(self), hl);
+}
+
+/* Replace the hosts in 'self' with 'hosts' (as pyhostlist_push_hosts()),
+ * keeping the same hostlist: it may be pdsh's working collective. */
+static int
+set_hosts(PyObject *self, PyObject *hosts)
+{
+    hostlist_t hl = HOSTLIST(self);
+    hostlist_t fresh = NULL;
+
+    if ((fresh = hostlist_create(NULL)) == NULL)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (pyhostlist_push_hosts(fresh, hosts) < 0)
+    {
+        hostlist_destroy(fresh);
+        return -1;
+    }
+    while (hostlist_count(hl) > 0)
+        hostlist_delete_nth(hl, 0);
+    hostlist_push_list(hl, fresh);
+    hostlist_destroy(fresh);
+    return 0;
+}
+
+/* For what pdsh's hostlist has no call for: call list method 'method' on
+ * the hosts of 'self' as a Python list, and if 'changes', make the list
+ * what the hosts are afterwards. */
+static PyObject *
+call_as_list(PyObject *self, const char *method, PyObject *args,
+             PyObject *kwds, int changes)
+{
+    PyObject *hosts = NULL;
+    PyObject *func = NULL;
+    PyObject *result = NULL;
+
+    if ((hosts = pyhostlist_to_list(HOSTLIST(self))) == NULL)
+        return NULL;
+    if ((func = PyObject_GetAttrString(hosts, method)) != NULL)
+        result = PyObject_Call(func, args, kwds);
+    if (result != NULL && changes && set_hosts(self, hosts) < 0)
+        Py_CLEAR(result);
+    Py_XDECREF(func);
+    Py_DECREF(hosts);
+    return result;
+}
+
+/* 'args' with its first item, a host, as a str, as the HostList holds */
+static PyObject *
+host_args(PyObject *args)
+{
+    PyObject *result = NULL;
+    PyObject *item = NULL;
+    Py_ssize_t i, n = PyTuple_GET_SIZE(args);
+
+    if ((result = PyTuple_New(n)) == NULL)
+        return NULL;
+    for (i = 0; i < n; i++)
+    {
+        item = PyTuple_GET_ITEM(args, i);
+        if (i == 0)
+            item = pdshpy_host_str(item);
+        else
+            Py_INCREF(item);
+        if (item == NULL)
+        {
+            Py_DECREF(result);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(result, i, item);
+    }
+    return result;
+}
+
+/* index 'i' of 'self', counting from the end if negative; -1 with an
+ * IndexError if there's no such host */
+static Py_ssize_t
+host_index(PyObject *self, Py_ssize_t i)
+{
+    Py_ssize_t n = hostlist_count(HOSTLIST(self));
+
+    if (i < 0)
+        i += n;
+    if (i < 0 || i >= n)
+    {
+        PyErr_SetString(PyExc_IndexError, "HostList index out of range");
+        return -1;
+    }
+    return i;
+}
+
+/* the hosts in slice 'key' of 'self', as a new HostList; a slice going
+ * forwards is taken from the ranges, without listing out the hosts */
+static PyObject *
+get_slice(PyObject *self, PyObject *key)
+{
+    PyObject *hosts = NULL;
+    PyObject *part = NULL;
+    struct rangeset *rs = NULL;
+    hostlist_t hl = NULL;
+    Py_ssize_t start, stop, step, count;
+
+    if (pdshpy_slice_indices(key, hostlist_count(HOSTLIST(self)), &start,
+                             &stop, &step, &count) < 0)
+        return NULL;
+    if (count == 0)
+        return wrap_owned(Py_TYPE(self), hostlist_create(NULL));
+    if (step > 0)
+    {
+        if ((rs = ordered_rangeset(self)) == NULL)
+            return NULL;
+        hl = rangeset_slice(rs, start, step, count);
+        rangeset_free(rs);
+        return wrap_owned(Py_TYPE(self), hl);
+    }
+
+    if ((hosts = pyhostlist_to_list(HOSTLIST(self))) == NULL)
+        return NULL;
+    part = PyObject_GetItem(hosts, key);
+    Py_DECREF(hosts);
+    if (part == NULL)
+        return NULL;
+    if ((hl = hostlist_create(NULL)) != NULL
+        && pyhostlist_push_hosts(hl, part) < 0)
+    {
+        hostlist_destroy(hl);
+        Py_DECREF(part);
+        return NULL;
+    }
+    Py_DECREF(part);
+    return wrap_owned(Py_TYPE(self), hl);
+}
+
+static PyObject *
+pyhostlist_subscript(PyObject *self, PyObject *key)
+{
+    Py_ssize_t i;
+
+    if (PySlice_Check(key))
+        return get_slice(self, key);
+    if (!PyIndex_Check(key))
+    {
+        PyErr_Format(PyExc_TypeError, "HostList indices must be integers "
+                     "or slices, not %.200s", Py_TYPE(key)->tp_name);
+        return NULL;
+    }
+    if ((i = PyNumber_AsSsize_t(key, PyExc_IndexError)) == -1
+        && PyErr_Occurred())
+        return NULL;
+    if ((i = host_index(self, i)) < 0)
+        return NULL;
+    return pyhostlist_item(self, i);
+}
+
+/* self[key] = value, or del self[key] if 'value' is NULL. Hosts are
+ * deleted one by one in place; anything else goes through a list, with a
+ * slice taking hosts as extend() does. */
+static int
+pyhostlist_ass_subscript(PyObject *self, PyObject *key, PyObject *value)
+{
+    PyObject *hosts = NULL;
+    PyObject *items = NULL;
+    hostlist_t hl = NULL;
+    Py_ssize_t i;
+    int rc = -1;
+
+    if (!PySlice_Check(key) && !PyIndex_Check(key))
+    {
+        PyErr_Format(PyExc_TypeError, "HostList indices must be integers "
+                     "or slices, not %.200s", Py_TYPE(key)->tp_name);
+        return -1;
+    }
+    if (!PySlice_Check(key))
+    {
+        if ((i = PyNumber_AsSsize_t(key, PyExc_IndexError)) == -1
+            && PyErr_Occurred())
+            return -1;
+        if ((i = host_index(self, i)) < 0)
+            return -1;
+        if (value == NULL)
+        {
+            hostlist_delete_nth(HOSTLIST(self), (int)i);
+            return 0;
+        }
+        items = pdshpy_host_str(value);
+    }
+    else if (value != NULL)
+    {
+        if ((hl = hostlist_create(NULL)) == NULL)
+        {
+            PyErr_NoMemory();
+            return -1;
+        }
+        if (pyhostlist_push_hosts(hl, value) == 0)
+            items = pyhostlist_to_list(hl);
+        hostlist_destroy(hl);
+    }
+    if (value != NULL && items == NULL)
+        return -1;
+
+    if ((hosts = pyhostlist_to_list(HOSTLIST(self))) != NULL)
+    {
+        if (value == NULL)
+            rc = PyObject_DelItem(hosts, key);
+        else
+            rc = PyObject_SetItem(hosts, key, items);
+        if (rc == 0)
+            rc = set_hosts(self, hosts);
+        Py_DECREF(hosts);
+    }
+    Py_XDECREF(items);
+    return rc;
+}
+
+/* a list of the hosts in a HostList, or a list as it is; NULL, without an
+ * exception, for anything else */
+static PyObject *
+comparable(PyObject *obj)
+{
+    if (pyhostlist_check(obj))
+        return pyhostlist_to_list(HOSTLIST(obj));
+    if (PyList_Check(obj))
+    {
+        Py_INCREF(obj);
+        return obj;
+    }
+    return NULL;
+}
+
+/* compared as lists of hostnames, with each other or with lists */
+static PyObject *
+pyhostlist_richcompare(PyObject *a, PyObject *b, int op)
+{
+    PyObject *x = NULL;
+    PyObject *y = NULL;
+    PyObject *result = NULL;
+
+    if ((x = comparable(a)) == NULL)
+        goto out;
+    if ((y = comparable(b)) == NULL)
+        goto out;
+    result = PyObject_RichCompare(x, y, op);
+
+out:
+    Py_XDECREF(x);
+    Py_XDECREF(y);
+    if (result == NULL && !PyErr_Occurred())
+    {
+        Py_INCREF(Py_NotImplemented);
+        result = Py_NotImplemented;
+    }
+    return result;
+}
+
+/* + between a HostList and another, a ranged string or a list: a new
+ * HostList of the hosts in one and then the other */
+static PyObject *
+pyhostlist_add(PyObject *a, PyObject *b)
+{
+    hostlist_t hl = NULL;
+
+    if ((!pyhostlist_check(a) && !PyString_Check(a) && !PyList_Check(a))
+        || (!pyhostlist_check(b) && !PyString_Check(b) && !PyList_Check(b)))
+    {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+    if ((hl = hostlist_create(NULL)) == NULL)
+        return PyErr_NoMemory();
+    if (pyhostlist_push_hosts(hl, a) < 0 || pyhostlist_push_hosts(hl, b) < 0)
+    {
+        hostlist_destroy(hl);
+        return NULL;
+    }
+    return wrap_owned(Py_TYPE(pyhostlist_check(a) ? a : b), hl);
+}
+
+/* +=, which takes whatever extend() does */
+static PyObject *
+pyhostlist_inplace_add(PyObject *self, PyObject *hosts)
+{
+    if (pyhostlist_push_hosts(HOSTLIST(self), hosts) < 0)
+        return NULL;
+    Py_INCREF(self);
+    return self;
+}
+
+static PyObject *
+pyhostlist_pop(PyObject *self, PyObject *args)
+{
+    PyObject *result = NULL;
+    Py_ssize_t i = -1;
+
+    if (!PyArg_ParseTuple(args, "|n:pop", &i))
+        return NULL;
+    if (hostlist_count(HOSTLIST(self)) == 0)
+    {
+        PyErr_SetString(PyExc_IndexError, "pop from empty HostList");
+        return NULL;
+    }
+    if ((i = host_index(self, i)) < 0)
+        return NULL;
+    if ((result = pyhostlist_item(self, i)) != NULL)
+        hostlist_delete_nth(HOSTLIST(self), (int)i);
+    return result;
+}
+
+static PyObject *
+pyhostlist_insert(PyObject *self, PyObject *args)
+{
+    PyObject *host = NULL;
+    PyObject *str = NULL;
+    PyObject *result = NULL;
+    Py_ssize_t i;
+
+    if (!PyArg_ParseTuple(args, "nO:insert", &i, &host))
+        return NULL;
+    if ((str = pdshpy_host_str(host)) == NULL)
+        return NULL;
+    if ((args = Py_BuildValue("(nO)", i, str)) != NULL)
+        result = call_as_list(self, "insert", args, NULL, 1);
+    Py_XDECREF(args);
+    Py_DECREF(str);
+    return result;
+}
+
+/* index() and count(), of a host as a str */
+static PyObject *
+find_host(PyObject *self, PyObject *args, const char *method)
+{
+    PyObject *result = NULL;
+
+    if ((args = host_args(args)) == NULL)
+        return NULL;
+    result = call_as_list(self, method, args, NULL, 0);
+    Py_DECREF(args);
+    return result;
+}
+
+static PyObject *
+pyhostlist_index(PyObject *self, PyObject *args)
+{
+    return find_host(self, args, "index");
+}
+
+static PyObject *
+pyhostlist_count(PyObject *self, PyObject *args)
+{
+    return find_host(self, args, "count");
+}
+
+static PyObject *
+pyhostlist_reverse(PyObject *self, PyObject *unused)
+{
+    PyObject *args = NULL;
+    PyObject *result = NULL;
+
+    if ((args = PyTuple_New(0)) == NULL)
+        return NULL;
+    result = call_as_list(self, "reverse", args, NULL, 1);
+    Py_DECREF(args);
+    return result;
+}
+
+static PyObject *
+pyhostlist_clear(PyObject *self, PyObject *unused)
+{
+    while (hostlist_count(HOSTLIST(self)) > 0)
+        hostlist_delete_nth(HOSTLIST(self), 0);
+    Py_RETURN_NONE;
+}
+
+/* pdsh's own sort, unless there's a key to sort by */
+static PyObject *
+pyhostlist_sort(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "key", "reverse", NULL };
+    PyObject *key = Py_None;
+    PyObject *result = NULL;
+    PyObject *empty = NULL;
+    PyObject *listkwds = NULL;
+    int reverse = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|Oi:sort", kwlist, &key,
+                                     &reverse))
+        return NULL;
+    if (key == Py_None)
+    {
+        hostlist_sort(HOSTLIST(self));
+        if (!reverse)
+            Py_RETURN_NONE;
+        return pyhostlist_reverse(self, NULL);
+    }
+    if ((empty = PyTuple_New(0)) != NULL
+        && (listkwds = Py_BuildValue("{sOsO}", "key", key, "reverse",
+                                     reverse ? Py_True : Py_False)) != NULL)
+        result = call_as_list(self, "sort", empty, listkwds, 1);
+    Py_XDECREF(empty);
+    Py_XDECREF(listkwds);
+    return result;
+}
+
+static PyMethodDef pyhostlist_methods[] = {
+    {"append", pyhostlist_append, METH_O,
+     "Add a host to the end of the list."},
+    {"add", pyhostlist_append, METH_O,
+     "Same as append()."},
+    {"extend", pyhostlist_extend, METH_O,
+     "Add hosts: a ranged string like 'node[1-10]', another HostList, or "
+     "an iterable of hostnames."},
+    {"remove", pyhostlist_remove, METH_O,
+     "Remove every occurrence of a host; ValueError if there are none."},
+    {"discard", pyhostlist_discard, METH_O,
+     "Remove every occurrence of a host, if there are any."},
+    {"delete", pyhostlist_delete, METH_VARARGS,
+     "Remove the hosts in a ranged string; returns how many were removed."},
+    {"insert", pyhostlist_insert, METH_VARARGS,
+     "insert(i, host): add a host before index i."},
+    {"pop", pyhostlist_pop, METH_VARARGS,
+     "pop(i=-1): remove the host at index i, and return it."},
+    {"index", pyhostlist_index, METH_VARARGS,
+     "index(host, start=0, stop=len): the index of the host's first\n"
+     "occurrence; ValueError if there's none."},
+    {"count", pyhostlist_count, METH_VARARGS,
+     "How many times a host occurs."},
+    {"reverse", pyhostlist_reverse, METH_NOARGS,
+     "Reverse the hosts in place."},
+    {"clear", pyhostlist_clear, METH_NOARGS,
+     "Remove every host."},
+    {"sort", (PyCFunction)pyhostlist_sort, METH_VARARGS | METH_KEYWORDS,
+     "sort(key=None, reverse=False): sort the hosts in place, by pdsh's\n"
+     "order (prefix, then number) unless given a key."},
+    {"uniq", pyhostlist_uniq, METH_NOARGS,
+     "Sort the hosts and drop duplicates."},
+    {"copy", pyhostlist_copy, METH_NOARGS,
+     "A new HostList with the same hosts."},
+    {"union", pyhostlist_union, METH_O,
+     "A new HostList of the hosts in this one or the other (a HostList,\n"
+     "ranged string or iterable), sorted and without duplicates; also |."},
+    {"intersection", pyhostlist_intersection, METH_O,
+     "A new HostList of the hosts in both, as union(); also &."},
+    {"difference", pyhostlist_difference, METH_O,
+     "A new HostList of the hosts in this one but not the other, as\n"
+     "union(); also -."},
+    {"chunks", pyhostlist_chunks, METH_VARARGS,
+     "A list of n new HostLists splitting up the hosts in order, their\n"
+     "sizes differing by at most one."},
+    {"batches", pyhostlist_batches, METH_VARARGS,
+     "A list of new HostLists of the hosts in order, n at a time (the\n"
+     "last may have fewer)."},
+    {"interleave", pyhostlist_interleave, METH_VARARGS,
+     "A list of n new HostLists, the kth of every nth host from the kth."},
+    {"sample", (PyCFunction)pyhostlist_sample, METH_VARARGS | METH_KEYWORDS,
+     "sample(percent, seed=0): a new HostList of about that percentage of\n"
+     "the hosts, in order, picked by a hash of each name and the seed, so\n"
+     "the same seed always picks the same hosts."},
+    {NULL, NULL, 0, NULL}
+};
+
+#define PYHOSTLIST_DOC \
+    "A list of hosts, kept in pdsh's own form. str() gives it in ranged\n" \
+    "form, like 'node[1-10]'."
+
+#if PY_MAJOR_VERSION >= 3
+
+/* any interpreter's HostList type */
+static int
+pyhostlist_check_type(PyTypeObject *type)
+{
+    return type->tp_dealloc == pyhostlist_dealloc;
+}
+
+/* On Python 3, each interpreter gets a HostList type of its own, made from
+ * this spec, since static types can't be shared between interpreters which
+ * don't share a GIL. */
+static PyType_Slot pyhostlist_slots[] = {
+    {Py_tp_dealloc, pyhostlist_dealloc},
+    {Py_tp_repr, pyhostlist_repr},
+    {Py_tp_str, pyhostlist_str},
+    {Py_tp_hash, PyObject_HashNotImplemented},
+    {Py_tp_richcompare, pyhostlist_richcompare},
+    {Py_tp_iter, pyhostlist_iter},
+    {Py_tp_methods, pyhostlist_methods},
+    {Py_tp_init, pyhostlist_tp_init},
+    {Py_tp_new, pyhostlist_new},
+    {Py_tp_doc, PYHOSTLIST_DOC},
+    {Py_sq_length, pyhostlist_length},
+    {Py_sq_item, pyhostlist_item},
+    {Py_sq_contains, pyhostlist_contains},
+    {Py_mp_length, pyhostlist_length},
+    {Py_mp_subscript, pyhostlist_subscript},
+    {Py_mp_ass_subscript, pyhostlist_ass_subscript},
+    {Py_nb_add, pyhostlist_add},
+    {Py_nb_inplace_add, pyhostlist_inplace_add},
+    {Py_nb_or, pyhostlist_or},
+    {Py_nb_and, pyhostlist_and},
+    {Py_nb_subtract, pyhostlist_sub},
+    {0, NULL}
+};
+
+static PyType_Spec pyhostlist_spec = {
+    "_pdshpy_internal.HostList",
+    sizeof(pyhostlist_object),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    pyhostlist_slots,
+};
+
+int
+pyhostlist_init(PyObject *module)
+{
+    PyObject *type = NULL;
+
+    if ((type = PyType_FromSpec(&pyhostlist_spec)) == NULL)
+        return -1;
+    if (PyModule_AddObject(module, "HostList", type) < 0)
+    {
+        Py_DECREF(type);
+        return -1;
+    }
+    return 0;
+}
+
+PyObject *
+pyhostlist_wrap(PyObject *module, hostlist_t hl)
+{
+    pyhostlist_object *self = NULL;
+    PyObject *type = NULL;
+
+    if ((type = PyObject_GetAttrString(module, "HostList")) == NULL)
+        return NULL;
+    if (!PyType_Check(type) || !pyhostlist_check_type((PyTypeObject *)type))
+    {
+        Py_DECREF(type);
+        PyErr_SetString(PyExc_TypeError, "HostList has been replaced");
+        return NULL;
+    }
+    self = PyObject_New(pyhostlist_object, (PyTypeObject *)type);
+    Py_DECREF(type);
+    if (self == NULL)
+        return NULL;
+    self->hl = hl;
+    self->owned = 0;
+    return (PyObject *)self;
+}
+
+int
+pyhostlist_check(PyObject *obj)
+{
+    return pyhostlist_check_type(Py_TYPE(obj));
+}
+
+#else /* Python 2 */
+
+static PyNumberMethods pyhostlist_as_number = {
+    pyhostlist_add,             /* nb_add */
+    pyhostlist_sub,             /* nb_subtract */
+    0,                          /* nb_multiply */
+    0,                          /* nb_divide */
+    0,                          /* nb_remainder */
+    0,                          /* nb_divmod */
+    0,                          /* nb_power */
+    0,                          /* nb_negative */
+    0,                          /* nb_positive */
+    0,                          /* nb_absolute */
+    0,                          /* nb_nonzero */
+    0,                          /* nb_invert */
+    0,                          /* nb_lshift */
+    0,                          /* nb_rshift */
+    pyhostlist_and,             /* nb_and */
+    0,                          /* nb_xor */
+    pyhostlist_or,              /* nb_or */
+    0,                          /* nb_coerce */
+    0,                          /* nb_int */
+    0,                          /* nb_long */
+    0,                          /* nb_float */
+    0,                          /* nb_oct */
+    0,                          /* nb_hex */
+    pyhostlist_inplace_add,     /* nb_inplace_add */
+};
+
+static PySequenceMethods pyhostlist_as_sequence = {
+    pyhostlist_length,          /* sq_length */
+    0,                          /* sq_concat */
+    0,                          /* sq_repeat */
+    pyhostlist_item,            /* sq_item */
+    0,                          /* sq_slice */
+    0,                          /* sq_ass_item */
+    0,                          /* sq_ass_slice */
+    pyhostlist_contains,        /* sq_contains */
+};
+
+static PyMappingMethods pyhostlist_as_mapping = {
+    pyhostlist_length,          /* mp_length */
+    pyhostlist_subscript,       /* mp_subscript */
+    pyhostlist_ass_subscript,   /* mp_ass_subscript */
+};
+
+static PyTypeObject pyhostlist_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "_pdshpy_internal.HostList",    /* tp_name */
+    sizeof(pyhostlist_object),      /* tp_basicsize */
+    0,                              /* tp_itemsize */
+    pyhostlist_dealloc,             /* tp_dealloc */
+    0,                              /* tp_print */
+    0,                              /* tp_getattr */
+    0,                              /* tp_setattr */
+    0,                              /* tp_compare */
+    pyhostlist_repr,                /* tp_repr */
+    &pyhostlist_as_number,          /* tp_as_number */
+    &pyhostlist_as_sequence,        /* tp_as_sequence */
+    &pyhostlist_as_mapping,         /* tp_as_mapping */
+    PyObject_HashNotImplemented,    /* tp_hash */
+    0,                              /* tp_call */
+    pyhostlist_str,                 /* tp_str */
+    0,                              /* tp_getattro */
+    0,                              /* tp_setattro */
+    0,                              /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_CHECKTYPES, /* tp_flags */
+    PYHOSTLIST_DOC,                 /* tp_doc */
+    0,                              /* tp_traverse */
+    0,                              /* tp_clear */
+    pyhostlist_richcompare,         /* tp_richcompare */
+    0,                              /* tp_weaklistoffset */
+    pyhostlist_iter,                /* tp_iter */
+    0,                              /* tp_iternext */
+    pyhostlist_methods,             /* tp_methods */
+    0,                              /* tp_members */
+    0,                              /* tp_getset */
+    0,                              /* tp_base */
+    0,                              /* tp_dict */
+    0,                              /* tp_descr_get */
+    0,                              /* tp_descr_set */
+    0,                              /* tp_dictoffset */
+    pyhostlist_tp_init,             /* tp_init */
+    0,                              /* tp_alloc */
+    pyhostlist_new,                 /* tp_new */
+};
+
+int
+pyhostlist_init(PyObject *module)
+{
+    if (PyType_Ready(&pyhostlist_type) < 0)
+        return -1;
+    Py_INCREF(&pyhostlist_type);
+    return PyModule_AddObject(module, "HostList",
+                              (PyObject *)&pyhostlist_type);
+}
+
+PyObject *
+pyhostlist_wrap(PyObject *module, hostlist_t hl)
+{
+    pyhostlist_object *self = NULL;
+
+    self = PyObject_New(pyhostlist_object, &pyhostlist_type);
+    if (self == NULL)
+        return NULL;
+    self->hl = hl;
+    self->owned = 0;
+    return (PyObject *)self;
+}
+
+int
+pyhostlist_check(PyObject *obj)
+{
+    return PyObject_TypeCheck(obj, &pyhostlist_type);
+}
+
+#endif
+
+hostlist_t
+pyhostlist_get(PyObject *obj)
+{
+    return HOSTLIST(obj);
+}
+
+void
+pyhostlist_release(PyObject *obj, int adopt)
+{
+    pyhostlist_object *self = (pyhostlist_object *)obj;
+    hostlist_t copy = NULL;
+
+    if (self->owned)
+        return;
+    if (adopt)
+        self->owned = 1;
+    else if (Py_REFCNT(obj) > 1)
+    {
+        /* someone's hanging on to it; it can't go on pointing at pdsh's */
+        if ((copy = hostlist_copy(self->hl)) == NULL)
+            copy = hostlist_create(NULL);
+        self->hl = copy;
+        self->owned = 1;
+    }
+}
@@ -0,0 +1,62 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* HostList: a Python type wrapping a pdsh hostlist_t, so that the working
+ * collective can be handed to drivers (and passed from one driver to the
+ * next) without converting every host to a Python string and back. It acts
+ * enough like a list, and a little like a set, for the things drivers do
+ * with pdsh_opts.wcoll.
+ *
+ * A HostList either owns its hostlist, or borrows one that belongs to pdsh.
+ * A borrowed one must be let go of with pyhostlist_release() before pdsh
+ * gets control back, since pdsh might free the hostlist at any time after.
+ */
+
+#ifndef _PDSHPY_PYHOSTLIST_H
+#define _PDSHPY_PYHOSTLIST_H
+
+#include <Python.h>
+
+#include "src/common/hostlist.h"
+
+/* make the type ready, and add it to 'module' as HostList. On Python 3,
+ * this makes a new type for each interpreter's module. */
+int pyhostlist_init(PyObject *module);
+
+/* a new HostList borrowing 'hl', of the type in 'module' (the current
+ * interpreter's internal module) */
+PyObject *pyhostlist_wrap(PyObject *module, hostlist_t hl);
+
+int pyhostlist_check(PyObject *obj);
+
+/* the hostlist a HostList wraps (still belonging to it) */
+hostlist_t pyhostlist_get(PyObject *obj);
+
+/* Done lending a HostList its hostlist. With 'adopt', it gets to keep
+ * it (the caller was going to destroy it anyway); otherwise, if anything
+ * still refers to it, it's given a copy of its own.
+ */
+void pyhostlist_release(PyObject *obj, int adopt);
+
+/* Add 'hosts' to 'hl': a ranged string like "node[1-10]", a HostList, or
+ * an iterable of hostnames. Returns 0, or -1 with an exception set. */
+int pyhostlist_push_hosts(hostlist_t hl, PyObject *hosts);
+
+/* a new Python list of the hosts in 'hl' */
+PyObject *pyhostlist_to_list(hostlist_t hl);
+
+#endif /* !_PDSHPY_PYHOSTLIST_H */
@@ -0,0 +1,338 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <Python.h>
+#include "pycompat.h"
+#include <errno.h>
+
+#include "hostpat.h"
+#include "pyhostlist.h"
+#include "pyhostpat.h"
+
+typedef struct {
+    PyObject_HEAD
+    struct hostpat *pat;
+} pyhostpat_object;
+
+#define HOSTPAT(obj) (((pyhostpat_object *)(obj))->pat)
+
+static PyObject *
+pyhostpat_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "patterns", "cache", NULL };
+    pyhostpat_object *self = NULL;
+    struct hostpat *pat = NULL;
+    PyObject *patterns = NULL;
+    PyObject *newline = NULL;
+    PyObject *joined = NULL;
+    const char *text = NULL;
+    char err[256];
+    int cache = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|i:HostPatterns", kwlist,
+                                     &patterns, &cache))
+        return NULL;
+
+    /* one pattern per line, or an iterable of them */
+    if (PyString_Check(patterns))
+    {
+        Py_INCREF(patterns);
+        joined = patterns;
+    }
+    else
+    {
+        if ((newline = PyString_FromString("\n")) == NULL)
+            return NULL;
+        joined = PyObject_CallMethod(newline, "join", "O", patterns);
+        Py_DECREF(newline);
+        if (joined == NULL)
+            return NULL;
+    }
+    if ((text = PyString_AsString(joined)) == NULL)
+    {
+        Py_DECREF(joined);
+        return NULL;
+    }
+    pat = hostpat_compile(text, cache, err, sizeof(err));
+    Py_DECREF(joined);
+    if (pat == NULL)
+    {
+        if (errno == ENOMEM)
+            return PyErr_NoMemory();
+        PyErr_Format(PyExc_ValueError, "bad host pattern: %s", err);
+        return NULL;
+    }
+    if ((self = (pyhostpat_object *)type->tp_alloc(type, 0)) == NULL)
+    {
+        hostpat_release(pat);
+        return NULL;
+    }
+    self->pat = pat;
+    return (PyObject *)self;
+}
+
+static void
+pyhostpat_dealloc(PyObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    hostpat_release(HOSTPAT(self));
+    type->tp_free(self);
+#if PY_MAJOR_VERSION >= 3
+    Py_DECREF(type);
+#endif
+}
+
+static PyObject *
+pyhostpat_str(PyObject *self)
+{
+    return PyString_FromString(hostpat_text(HOSTPAT(self)));
+}
+
+static PyObject *
+pyhostpat_repr(PyObject *self)
+{
+    return PyString_FromFormat("<HostPatterns of %d patterns>",
+                               (int)hostpat_count(HOSTPAT(self)));
+}
+
+static Py_ssize_t
+pyhostpat_length(PyObject *self)
+{
+    return hostpat_count(HOSTPAT(self));
+}
+
+static int
+pyhostpat_contains(PyObject *self, PyObject *host)
+{
+    const char *name = NULL;
+    int found;
+
+    if (!PyString_Check(host))
+        return 0;
+    if ((name = PyString_AsString(host)) == NULL)
+        return -1;
+    if ((found = hostpat_match(HOSTPAT(self), name)) < 0)
+        PyErr_NoMemory();
+    return found;
+}
+
+static PyObject *
+pyhostpat_matches(PyObject *self, PyObject *host)
+{
+    const char *name = NULL;
+    int found;
+
+    if ((name = PyString_AsString(host)) == NULL)
+        return NULL;
+    if ((found = hostpat_match(HOSTPAT(self), name)) < 0)
+        return PyErr_NoMemory();
+    return PyBool_FromLong(found);
+}
+
+/* a new HostList of the hosts in 'source' which match, or don't */
+static PyObject *
+select_hosts(PyObject *self, PyObject *source, int invert)
+{
+    PyObject *module = NULL;
+    PyObject *result = NULL;
+    hostlist_t hl = NULL;
+    hostlist_t selected = NULL;
+
+    if (pyhostlist_check(source))
+        selected = hostpat_select(HOSTPAT(self), pyhostlist_get(source),
+                                  invert);
+    else
+    {
+        if ((hl = hostlist_create(NULL)) == NULL)
+            return PyErr_NoMemory();
+        if (pyhostlist_push_hosts(hl, source) < 0)
+        {
+            hostlist_destroy(hl);
+            return NULL;
+        }
+        selected = hostpat_select(HOSTPAT(self), hl, invert);
+        hostlist_destroy(hl);
+    }
+    if (selected == NULL)
+        return PyErr_NoMemory();
+
+#if PY_MAJOR_VERSION >= 3
+    module = PyType_GetModule(Py_TYPE(self));
+#endif
+    if ((result = pyhostlist_wrap(module, selected)) == NULL)
+    {
+        hostlist_destroy(selected);
+        return NULL;
+    }
+    pyhostlist_release(result, 1);
+    return result;
+}
+
+static PyObject *
+pyhostpat_select(PyObject *self, PyObject *source)
+{
+    return select_hosts(self, source, 0);
+}
+
+static PyObject *
+pyhostpat_exclude(PyObject *self, PyObject *source)
+{
+    return select_hosts(self, source, 1);
+}
+
+static PyObject *
+pyhostpat_remove_from(PyObject *self, PyObject *hosts)
+{
+    int removed;
+
+    if (!pyhostlist_check(hosts))
+    {
+        PyErr_SetString(PyExc_TypeError, "remove_from() takes a HostList");
+        return NULL;
+    }
+    if ((removed = hostpat_remove(HOSTPAT(self), pyhostlist_get(hosts))) < 0)
+        return PyErr_NoMemory();
+    return PyInt_FromLong(removed);
+}
+
+static PyMethodDef pyhostpat_methods[] = {
+    {"matches", pyhostpat_matches, METH_O,
+     "Whether some pattern matches a hostname; also 'in'."},
+    {"select", pyhostpat_select, METH_O,
+     "A new HostList of the hosts some pattern matches, from a HostList,\n"
+     "ranged string or iterable of hostnames, in the same order."},
+    {"exclude", pyhostpat_exclude, METH_O,
+     "A new HostList of the hosts no pattern matches, as select()."},
+    {"remove_from", pyhostpat_remove_from, METH_O,
+     "Remove the hosts some pattern matches from a HostList, like the\n"
+     "wcoll, in place; returns how many there were."},
+    {NULL, NULL, 0, NULL}
+};
+
+#define PYHOSTPAT_DOC \
+    "HostPatterns(patterns, cache=False): a compiled set of host\n" \
+    "patterns, from a string with one per line or an iterable of them.\n" \
+    "Each is a hostlist, like 'node[1-10]'; a glob, like 'rack1*' (or\n" \
+    "'glob:node[12]' for one with no * or ?); or a regular expression,\n" \
+    "like 're:^gpu\\d+$', which matches anywhere in the name. With cache,\n" \
+    "what's compiled is kept in pdshpy's cache directory for later runs."
+
+#if PY_MAJOR_VERSION >= 3
+
+static PyType_Slot pyhostpat_slots[] = {
+    {Py_tp_dealloc, pyhostpat_dealloc},
+    {Py_tp_repr, pyhostpat_repr},
+    {Py_tp_str, pyhostpat_str},
+    {Py_tp_methods, pyhostpat_methods},
+    {Py_tp_new, pyhostpat_new},
+    {Py_tp_doc, PYHOSTPAT_DOC},
+    {Py_sq_length, pyhostpat_length},
+    {Py_sq_contains, pyhostpat_contains},
+    {0, NULL}
+};
+
+static PyType_Spec pyhostpat_spec = {
+    "_pdshpy_internal.HostPatterns",
+    sizeof(pyhostpat_object),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    pyhostpat_slots,
+};
+
+int
+pyhostpat_init(PyObject *module)
+{
+    PyObject *type = NULL;
+
+    /* tied to the module, for select() to find HostList in */
+    if ((type = PyType_FromModuleAndSpec(module, &pyhostpat_spec, NULL))
+        == NULL)
+        return -1;
+    if (PyModule_AddObject(module, "HostPatterns", type) < 0)
+    {
+        Py_DECREF(type);
+        return -1;
+    }
+    return 0;
+}
+
+#else /* Python 2 */
+
+static PySequenceMethods pyhostpat_as_sequence = {
+    pyhostpat_length,           /* sq_length */
+    0,                          /* sq_concat */
+    0,                          /* sq_repeat */
+    0,                          /* sq_item */
+    0,                          /* sq_slice */
+    0,                          /* sq_ass_item */
+    0,                          /* sq_ass_slice */
+    pyhostpat_contains,         /* sq_contains */
+};
+
+static PyTypeObject pyhostpat_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "_pdshpy_internal.HostPatterns", /* tp_name */
+    sizeof(pyhostpat_object),       /* tp_basicsize */
+    0,                              /* tp_itemsize */
+    pyhostpat_dealloc,              /* tp_dealloc */
+    0,                              /* tp_print */
+    0,                              /* tp_getattr */
+    0,                              /* tp_setattr */
+    0,                              /* tp_compare */
+    pyhostpat_repr,                 /* tp_repr */
+    0,                              /* tp_as_number */
+    &pyhostpat_as_sequence,         /* tp_as_sequence */
+    0,                              /* tp_as_mapping */
+    0,                              /* tp_hash */
+    0,                              /* tp_call */
+    pyhostpat_str,                  /* tp_str */
+    0,                              /* tp_getattro */
+    0,                              /* tp_setattro */
+    0,                              /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,             /* tp_flags */
+    PYHOSTPAT_DOC,                  /* tp_doc */
+    0,                              /* tp_traverse */
+    0,                              /* tp_clear */
+    0,                              /* tp_richcompare */
+    0,                              /* tp_weaklistoffset */
+    0,                              /* tp_iter */
+    0,                              /* tp_iternext */
+    pyhostpat_methods,              /* tp_methods */
+    0,                              /* tp_members */
+    0,                              /* tp_getset */
+    0,                              /* tp_base */
+    0,                              /* tp_dict */
+    0,                              /* tp_descr_get */
+    0,                              /* tp_descr_set */
+    0,                              /* tp_dictoffset */
+    0,                              /* tp_init */
+    0,                              /* tp_alloc */
+    pyhostpat_new,                  /* tp_new */
+};
+
+int
+pyhostpat_init(PyObject *module)
+{
+    if (PyType_Ready(&pyhostpat_type) < 0)
+        return -1;
+    Py_INCREF(&pyhostpat_type);
+    return PyModule_AddObject(module, "HostPatterns",
+                              (PyObject *)&pyhostpat_type);
+}
+
+#endif
@@ -0,0 +1,34 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* HostPatterns: a Python type for compiled sets of host patterns (see
+ * hostpat.h), so drivers can apply exclusion lists of hostlists, globs and
+ * regular expressions to the wcoll in one pass, rather than trying each
+ * pattern on each host with fnmatch and re. pdshpy/hostpat.py has the same
+ * thing in plain Python, for server mode.
+ */
+
+#ifndef _PDSHPY_PYHOSTPAT_H
+#define _PDSHPY_PYHOSTPAT_H
+
+#include <Python.h>
+
+/* make the type ready, and add it to 'module' as HostPatterns. On Python 3,
+ * this makes a new type for each interpreter's module. */
+int pyhostpat_init(PyObject *module);
+
+#endif /* !_PDSHPY_PYHOSTPAT_H */
@@ -0,0 +1,850 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pdshpy.h"
+#include "rangeset.h"
+
+struct range {
+    char *prefix;
+    uint64_t lo;
+    uint64_t hi;                /* inclusive */
+    uint32_t digits;            /* 0 for a name with no number */
+};
+
+struct rangeset {
+    struct range *r;
+    size_t n;
+    size_t cap;
+    uint64_t *starts;           /* where each range starts, once sliced */
+};
+
+/* sampling percentages are kept to four decimal places */
+#define SAMPLE_SCALE 1000000
+
+static const uint64_t power10[RANGESET_MAX_DIGITS + 1] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+    100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL,
+};
+
+static struct rangeset *
+new_set(void)
+{
+    return calloc(1, sizeof(struct rangeset));
+}
+
+void
+rangeset_free(struct rangeset *rs)
+{
+    size_t i;
+
+    if (rs == NULL)
+        return;
+    for (i = 0; i < rs->n; i++)
+        free(rs->r[i].prefix);
+    free(rs->r);
+    free(rs->starts);
+    free(rs);
+}
+
+/* add a range, with a copy of the first 'plen' characters of 'prefix' */
+static int
+add_range(struct rangeset *rs, const char *prefix, size_t plen,
+          uint32_t digits, uint64_t lo, uint64_t hi)
+{
+    struct range *bigger = NULL;
+    size_t cap;
+    char *copy = NULL;
+
+    if (rs->n == rs->cap)
+    {
+        cap = rs->cap ? rs->cap * 2 : 16;
+        if ((bigger = realloc(rs->r, cap * sizeof(*rs->r))) == NULL)
+            return -1;
+        rs->r = bigger;
+        rs->cap = cap;
+    }
+    if ((copy = malloc(plen + 1)) == NULL)
+        return -1;
+    memcpy(copy, prefix, plen);
+    copy[plen] = '\0';
+    rs->r[rs->n].prefix = copy;
+    rs->r[rs->n].lo = lo;
+    rs->r[rs->n].hi = hi;
+    rs->r[rs->n].digits = digits;
+    rs->n++;
+    return 0;
+}
+
+/* how many digits there are at the end of the 'len' characters at 's' */
+static size_t
+trailing_digits(const char *s, size_t len)
+{
+    size_t n = 0;
+
+    while (n < len && isdigit((unsigned char)s[len - n - 1]))
+        n++;
+    return n;
+}
+
+static uint64_t
+read_digits(const char *s, size_t n)
+{
+    uint64_t num = 0;
+
+    while (n-- > 0)
+        num = num * 10 + (*s++ - '0');
+    return num;
+}
+
+static uint32_t
+count_digits(uint64_t num)
+{
+    uint32_t n = 1;
+
+    while (n < RANGESET_MAX_DIGITS && num >= power10[n])
+        n++;
+    return n;
+}
+
+static int
+add_name(struct rangeset *rs, const char *name, size_t len)
+{
+    size_t n = trailing_digits(name, len);
+    uint64_t num;
+
+    if (n == 0 || n > RANGESET_MAX_DIGITS)
+        return add_range(rs, name, len, 0, 0, 0);
+    num = read_digits(name + len - n, n);
+    return add_range(rs, name, len - n, n, num, num);
+}
+
+/* Have pdsh list out the hosts in the 'len' characters at 's', and add them
+ * one by one. */
+static int
+add_listed(struct rangeset *rs, const char *s, size_t len)
+{
+    hostlist_iterator_t it = NULL;
+    hostlist_t hl = NULL;
+    char *piece = NULL;
+    char *name = NULL;
+    int rc = 0;
+
+    if ((piece = malloc(len + 1)) == NULL)
+        return -1;
+    memcpy(piece, s, len);
+    piece[len] = '\0';
+    hl = hostlist_create(piece);
+    free(piece);
+    if (hl == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((it = hostlist_iterator_create(hl)) == NULL)
+    {
+        hostlist_destroy(hl);
+        errno = ENOMEM;
+        return -1;
+    }
+    while (rc == 0 && (name = hostlist_next(it)) != NULL)
+    {
+        if ((rc = add_name(rs, name, strlen(name))) < 0)
+            errno = ENOMEM;
+        free(name);
+    }
+    hostlist_iterator_destroy(it);
+    hostlist_destroy(hl);
+    return rc;
+}
+
+/* Read "lo" or "lo-hi" at *p, before 'end'; *width is set to the number of
+ * digits in lo if it's zero-padded. Returns 0, or -1 if it's not that. */
+static int
+read_span(const char **p, const char *end, uint64_t *lo, uint64_t *hi,
+          uint32_t *width)
+{
+    const char *s = *p;
+    size_t n = 0;
+
+    while (s + n < end && isdigit((unsigned char)s[n]))
+        n++;
+    if (n == 0 || n > RANGESET_MAX_DIGITS)
+        return -1;
+    *lo = *hi = read_digits(s, n);
+    *width = (n > 1 && s[0] == '0') ? n : 0;
+    s += n;
+    if (s < end && *s == '-')
+    {
+        for (s++, n = 0; s + n < end && isdigit((unsigned char)s[n]); n++)
+            ;
+        if (n == 0 || n > RANGESET_MAX_DIGITS)
+            return -1;
+        *hi = read_digits(s, n);
+        s += n;
+    }
+    *p = s;
+    return *hi >= *lo ? 0 : -1;
+}
+
+/* Add "prefix[ranges]". The prefix can end in digits ("node1[0-5]" is
+ * node10 to node15), which become the high digits of each number. Returns
+ * 1 if the piece isn't in that form, or is too big for it. */
+static int
+add_bracketed(struct rangeset *rs, const char *s, size_t len)
+{
+    const char *open = memchr(s, '[', len);
+    const char *end = s + len - 1;
+    const char *p = NULL;
+    uint64_t lo, hi, cur, last, high;
+    uint32_t width, digits;
+    size_t plen, nhigh;
+
+    if (open == NULL || *end != ']' || memchr(s, ']', len - 1) != NULL
+        || memchr(open + 1, '[', end - open - 1) != NULL || open + 1 == end)
+        return 1;
+    plen = open - s;
+    if ((nhigh = trailing_digits(s, plen)) > RANGESET_MAX_DIGITS)
+        return 1;
+    high = read_digits(open - nhigh, nhigh);
+
+    /* check the lot first, so a bad piece isn't half added */
+    for (p = open + 1; p < end; p++)
+    {
+        if (read_span(&p, end, &lo, &hi, &width) < 0
+            || nhigh + count_digits(hi) > RANGESET_MAX_DIGITS
+            || nhigh + width > RANGESET_MAX_DIGITS
+            || (p < end && (*p != ',' || p + 1 == end)))
+            return 1;
+    }
+    for (p = open + 1; p < end; p++)
+    {
+        read_span(&p, end, &lo, &hi, &width);
+        /* a band at a time of numbers written with the same digits */
+        for (cur = lo; cur <= hi; cur = last + 1)
+        {
+            digits = count_digits(cur);
+            if (digits < width)
+                digits = width;
+            last = (hi < power10[digits] - 1) ? hi : power10[digits] - 1;
+            if (add_range(rs, s, plen - nhigh, nhigh + digits,
+                          high * power10[digits] + cur,
+                          high * power10[digits] + last) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static int
+compare_keys(const struct range *a, const struct range *b)
+{
+    int c = strcmp(a->prefix, b->prefix);
+
+    if (c != 0)
+        return c;
+    return (a->digits > b->digits) - (a->digits < b->digits);
+}
+
+static int
+compare_ranges(const void *x, const void *y)
+{
+    const struct range *a = x, *b = y;
+    int c = compare_keys(a, b);
+
+    if (c != 0)
+        return c;
+    return (a->lo > b->lo) - (a->lo < b->lo);
+}
+
+/* Sort, and merge ranges which overlap or meet. */
+static void
+normalize(struct rangeset *rs)
+{
+    struct range *prev = NULL;
+    size_t i, out = 0;
+
+    qsort(rs->r, rs->n, sizeof(*rs->r), compare_ranges);
+    for (i = 0; i < rs->n; i++)
+    {
+        prev = out > 0 ? &rs->r[out - 1] : NULL;
+        if (prev != NULL && compare_keys(prev, &rs->r[i]) == 0
+            && rs->r[i].lo <= prev->hi + 1)
+        {
+            if (rs->r[i].hi > prev->hi)
+                prev->hi = rs->r[i].hi;
+            free(rs->r[i].prefix);
+            continue;
+        }
+        rs->r[out++] = rs->r[i];
+    }
+    rs->n = out;
+}
+
+struct rangeset *
+rangeset_parse(const char *ranged, int keep_order)
+{
+    struct rangeset *rs = NULL;
+    const char *start = ranged;
+    const char *p = ranged;
+    int depth = 0;
+    int rc = 0;
+
+    if ((rs = new_set()) == NULL)
+        return NULL;
+    for (;; p++)
+    {
+        if (*p == '[')
+            depth++;
+        else if (*p == ']')
+            depth--;
+        else if (*p == '\0'
+                 || (depth == 0 && (*p == ',' || isspace((unsigned char)*p))))
+        {
+            if (p > start)
+            {
+                if (memchr(start, '[', p - start) == NULL)
+                    rc = add_name(rs, start, p - start);
+                else if ((rc = add_bracketed(rs, start, p - start)) > 0)
+                    rc = add_listed(rs, start, p - start);
+                else if (rc < 0)
+                    errno = ENOMEM;
+                if (rc < 0)
+                {
+                    rangeset_free(rs);
+                    return NULL;
+                }
+            }
+            if (*p == '\0')
+                break;
+            start = p + 1;
+        }
+    }
+    if (!keep_order)
+        normalize(rs);
+    return rs;
+}
+
+struct rangeset *
+rangeset_from_hostlist(hostlist_t hl, int keep_order)
+{
+    struct rangeset *rs = NULL;
+    char *ranged = NULL;
+
+    if ((ranged = pdshpy_hostlist_ranged(hl)) == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    rs = rangeset_parse(ranged, keep_order);
+    free(ranged);
+    return rs;
+}
+
+/* Add 'r' (or from lo to hi of it) to the end of 'rs', joining it on to the
+ * last range if they meet. */
+static int
+push(struct rangeset *rs, const struct range *r, uint64_t lo, uint64_t hi)
+{
+    struct range *last = rs->n > 0 ? &rs->r[rs->n - 1] : NULL;
+
+    if (last != NULL && compare_keys(last, r) == 0 && lo <= last->hi + 1)
+    {
+        if (hi > last->hi)
+            last->hi = hi;
+        return 0;
+    }
+    return add_range(rs, r->prefix, strlen(r->prefix), r->digits, lo, hi);
+}
+
+struct rangeset *
+rangeset_union(const struct rangeset *a, const struct rangeset *b)
+{
+    struct rangeset *rs = NULL;
+    const struct range *r = NULL;
+    size_t i = 0, j = 0;
+
+    if ((rs = new_set()) == NULL)
+        return NULL;
+    while (i < a->n || j < b->n)
+    {
+        if (j == b->n || (i < a->n && compare_ranges(&a->r[i], &b->r[j]) <= 0))
+            r = &a->r[i++];
+        else
+            r = &b->r[j++];
+        if (push(rs, r, r->lo, r->hi) < 0)
+        {
+            rangeset_free(rs);
+            return NULL;
+        }
+    }
+    return rs;
+}
+
+struct rangeset *
+rangeset_intersect(const struct rangeset *a, const struct rangeset *b)
+{
+    struct rangeset *rs = NULL;
+    const struct range *x = NULL;
+    const struct range *y = NULL;
+    size_t i = 0, j = 0;
+    int c;
+
+    if ((rs = new_set()) == NULL)
+        return NULL;
+    while (i < a->n && j < b->n)
+    {
+        x = &a->r[i];
+        y = &b->r[j];
+        if ((c = compare_keys(x, y)) != 0)
+        {
+            if (c < 0)
+                i++;
+            else
+                j++;
+            continue;
+        }
+        if (x->lo <= y->hi && y->lo <= x->hi
+            && push(rs, x, x->lo > y->lo ? x->lo : y->lo,
+                    x->hi < y->hi ? x->hi : y->hi) < 0)
+        {
+            rangeset_free(rs);
+            return NULL;
+        }
+        if (x->hi < y->hi)
+            i++;
+        else
+            j++;
+    }
+    return rs;
+}
+
+struct rangeset *
+rangeset_difference(const struct rangeset *a, const struct rangeset *b)
+{
+    struct rangeset *rs = NULL;
+    const struct range *x = NULL;
+    const struct range *y = NULL;
+    uint64_t lo;
+    size_t i, j = 0, k;
+    int c;
+
+    if ((rs = new_set()) == NULL)
+        return NULL;
+    for (i = 0; i < a->n; i++)
+    {
+        x = &a->r[i];
+        lo = x->lo;
+        /* skip what's wholly before this range */
+        while (j < b->n && ((c = compare_keys(&b->r[j], x)) < 0
+                            || (c == 0 && b->r[j].hi < lo)))
+            j++;
+        for (k = j; k < b->n && lo <= x->hi; k++)
+        {
+            y = &b->r[k];
+            if (compare_keys(y, x) != 0 || y->lo > x->hi)
+                break;
+            if (y->lo > lo && push(rs, x, lo, y->lo - 1) < 0)
+                goto fail;
+            if (y->hi >= x->hi)
+                lo = x->hi + 1;
+            else if (y->hi + 1 > lo)
+                lo = y->hi + 1;
+        }
+        if (lo <= x->hi && push(rs, x, lo, x->hi) < 0)
+            goto fail;
+    }
+    return rs;
+
+fail:
+    rangeset_free(rs);
+    return NULL;
+}
+
+uint64_t
+rangeset_count(const struct rangeset *rs)
+{
+    uint64_t count = 0;
+    size_t i;
+
+    for (i = 0; i < rs->n; i++)
+        count += rs->r[i].hi - rs->r[i].lo + 1;
+    return count;
+}
+
+/* How 'r' sorts against the name made of the 'plen' characters at
+ * 'prefix' and 'num' in 'digits' digits: less than 0 if before it, 0 if it
+ * holds it, or more than 0 if after it. */
+static int
+compare_name(const struct range *r, const char *prefix, size_t plen,
+             uint32_t digits, uint64_t num)
+{
+    int c = strncmp(r->prefix, prefix, plen);
+
+    if (c == 0)
+        c = (unsigned char)r->prefix[plen];
+    if (c != 0)
+        return c;
+    if (r->digits != digits)
+        return (r->digits > digits) - (r->digits < digits);
+    return (r->lo > num) - (r->hi < num);
+}
+
+int
+rangeset_contains(const struct rangeset *rs, const char *name)
+{
+    size_t len = strlen(name), n = trailing_digits(name, len);
+    size_t lo = 0, hi = rs->n, mid;
+    uint64_t num = 0;
+    int c;
+
+    if (n == 0 || n > RANGESET_MAX_DIGITS)
+        n = 0;
+    else
+        num = read_digits(name + len - n, n);
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if ((c = compare_name(&rs->r[mid], name, len - n, n, num)) == 0)
+            return 1;
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return 0;
+}
+
+struct buf {
+    char *s;
+    size_t len;
+    size_t cap;
+    int failed;
+};
+
+static void
+buf_printf(struct buf *b, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void
+buf_printf(struct buf *b, const char *fmt, ...)
+{
+    va_list ap;
+    char *bigger = NULL;
+    size_t cap;
+    int n;
+
+    if (b->failed)
+        return;
+    for (;;)
+    {
+        va_start(ap, fmt);
+        n = vsnprintf(b->s + b->len, b->cap - b->len, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+        {
+            b->failed = 1;
+            return;
+        }
+        if (b->len + n < b->cap)
+        {
+            b->len += n;
+            return;
+        }
+        for (cap = b->cap ? b->cap : 256; cap <= b->len + n; cap *= 2)
+            ;
+        if ((bigger = realloc(b->s, cap)) == NULL)
+        {
+            b->failed = 1;
+            return;
+        }
+        b->s = bigger;
+        b->cap = cap;
+    }
+}
+
+/* Writes out ranges one after another as a ranged string, putting those
+ * with the same prefix in one set of brackets, and joining up ranges which
+ * run on from one to the next, even from one number of digits to the next
+ * (like node[1-9] and node[10-20]) when they aren't zero-padded. */
+struct writer {
+    struct buf out;
+    struct buf spans;           /* of the group being written */
+    const char *prefix;         /* of that group, or NULL */
+    size_t nspans;
+    int pending;                /* whether there's a span in lo..hi */
+    uint64_t lo;
+    uint64_t hi;
+    uint32_t lo_digits;
+    uint32_t hi_digits;
+    int natural;                /* written without leading zeroes */
+};
+
+static void
+buf_number(struct buf *b, uint64_t num, uint32_t digits, int natural)
+{
+    if (natural)
+        buf_printf(b, "%llu", (unsigned long long)num);
+    else
+        buf_printf(b, "%0*llu", (int)digits, (unsigned long long)num);
+}
+
+static void
+write_span(struct writer *w)
+{
+    if (w->nspans++ > 0)
+        buf_printf(&w->spans, ",");
+    buf_number(&w->spans, w->lo, w->lo_digits, w->natural);
+    if (w->hi > w->lo)
+    {
+        buf_printf(&w->spans, "-");
+        buf_number(&w->spans, w->hi, w->hi_digits, w->natural);
+    }
+    w->pending = 0;
+}
+
+static void
+write_group(struct writer *w)
+{
+    int brackets;
+
+    if (w->pending)
+        write_span(w);
+    if (w->prefix == NULL)
+        return;
+    brackets = w->nspans > 1 || strchr(w->spans.s, '-') != NULL;
+    buf_printf(&w->out, "%s%s%s%s%s", w->out.len > 0 ? "," : "",
+               w->prefix, brackets ? "[" : "", w->spans.s,
+               brackets ? "]" : "");
+    w->prefix = NULL;
+    w->nspans = 0;
+    w->spans.len = 0;
+}
+
+/* Add from lo to hi of 'r', which has to outlive 'w'. */
+static void
+writer_add(struct writer *w, const struct range *r, uint64_t lo, uint64_t hi)
+{
+    int natural = r->digits == 1 || (r->digits > 1
+                                     && lo >= power10[r->digits - 1]);
+
+    if (r->digits == 0)
+    {
+        write_group(w);
+        buf_printf(&w->out, "%s%s", w->out.len > 0 ? "," : "", r->prefix);
+        return;
+    }
+    if (w->prefix != NULL && strcmp(w->prefix, r->prefix) == 0)
+    {
+        if (w->pending && lo == w->hi + 1
+            && (r->digits == w->hi_digits
+                || (w->natural && natural && r->digits == w->hi_digits + 1)))
+        {
+            w->hi = hi;
+            w->hi_digits = r->digits;
+            return;
+        }
+        if (w->pending)
+            write_span(w);
+    }
+    else
+    {
+        write_group(w);
+        w->prefix = r->prefix;
+    }
+    w->pending = 1;
+    w->lo = lo;
+    w->hi = hi;
+    w->lo_digits = w->hi_digits = r->digits;
+    w->natural = natural;
+}
+
+/* what was written, as a string (use free()), or NULL */
+static char *
+writer_finish(struct writer *w)
+{
+    write_group(w);
+    buf_printf(&w->out, "%s", "");
+    free(w->spans.s);
+    if (w->out.failed || w->spans.failed)
+    {
+        free(w->out.s);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return w->out.s;
+}
+
+/* what was written, as a new hostlist, or NULL */
+static hostlist_t
+writer_hostlist(struct writer *w)
+{
+    hostlist_t hl = NULL;
+    char *ranged = NULL;
+
+    if ((ranged = writer_finish(w)) == NULL)
+        return NULL;
+    hl = hostlist_create(*ranged != '\0' ? ranged : NULL);
+    free(ranged);
+    return hl;
+}
+
+char *
+rangeset_ranged(const struct rangeset *rs)
+{
+    struct writer w;
+    size_t i;
+
+    memset(&w, 0, sizeof(w));
+    for (i = 0; i < rs->n; i++)
+        writer_add(&w, &rs->r[i], rs->r[i].lo, rs->r[i].hi);
+    return writer_finish(&w);
+}
+
+hostlist_t
+rangeset_hostlist(const struct rangeset *rs)
+{
+    struct writer w;
+    size_t i;
+
+    memset(&w, 0, sizeof(w));
+    for (i = 0; i < rs->n; i++)
+        writer_add(&w, &rs->r[i], rs->r[i].lo, rs->r[i].hi);
+    return writer_hostlist(&w);
+}
+
+/* the index of the range holding host number 'pos', or rs->n */
+static size_t
+find_position(struct rangeset *rs, uint64_t pos)
+{
+    uint64_t at = 0;
+    size_t i, lo = 0, hi = rs->n;
+
+    if (rs->starts == NULL)
+    {
+        if ((rs->starts = malloc((rs->n + 1) * sizeof(uint64_t))) == NULL)
+            return (size_t)-1;
+        for (i = 0; i < rs->n; i++)
+        {
+            rs->starts[i] = at;
+            at += rs->r[i].hi - rs->r[i].lo + 1;
+        }
+        rs->starts[rs->n] = at;
+    }
+    while (lo < hi)
+    {
+        i = lo + (hi - lo) / 2;
+        if (rs->starts[i + 1] <= pos)
+            lo = i + 1;
+        else
+            hi = i;
+    }
+    return lo;
+}
+
+hostlist_t
+rangeset_slice(struct rangeset *rs, uint64_t start, uint64_t step,
+               uint64_t count)
+{
+    struct writer w;
+    const struct range *r = NULL;
+    uint64_t pos = start, off, take;
+    size_t i;
+
+    memset(&w, 0, sizeof(w));
+    if ((i = find_position(rs, start)) == (size_t)-1)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    while (count > 0 && i < rs->n)
+    {
+        r = &rs->r[i];
+        if ((off = pos - rs->starts[i]) > r->hi - r->lo)
+        {
+            i++;
+            continue;
+        }
+        take = (step == 1) ? r->hi - r->lo + 1 - off : 1;
+        if (take > count)
+            take = count;
+        writer_add(&w, r, r->lo + off, r->lo + off + take - 1);
+        pos += (step == 1) ? take : step;
+        count -= take;
+    }
+    return writer_hostlist(&w);
+}
+
+/* the FNV-1a hash of 'len' bytes at 's', carrying on from 'h' */
+static uint64_t
+fnv1a(uint64_t h, const char *s, size_t len)
+{
+    while (len-- > 0)
+    {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t
+fmix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+hostlist_t
+rangeset_sample(const struct rangeset *rs, double percent, uint64_t seed)
+{
+    struct writer w;
+    const struct range *r = NULL;
+    uint64_t threshold, h, num;
+    char digits[RANGESET_MAX_DIGITS + 1];
+    size_t i;
+
+    memset(&w, 0, sizeof(w));
+    threshold = (uint64_t)(percent * SAMPLE_SCALE / 100 + 0.5);
+    for (i = 0; i < rs->n; i++)
+    {
+        r = &rs->r[i];
+        h = fnv1a(14695981039346656037ULL ^ seed, r->prefix,
+                  strlen(r->prefix));
+        for (num = r->lo; num <= r->hi; num++)
+        {
+            snprintf(digits, sizeof(digits), "%0*llu", (int)r->digits,
+                     (unsigned long long)num);
+            if (fmix64(fnv1a(h, digits, r->digits)) % SAMPLE_SCALE
+                < threshold)
+                writer_add(&w, r, num, num);
+        }
+    }
+    return writer_hostlist(&w);
+}
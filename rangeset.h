@@ -0,0 +1,91 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* Sets of hostnames kept as ranges, for union, intersection and difference
+ * without listing out the hosts. Each range is a prefix, a number of digits
+ * and the numbers from lo to hi written with exactly that many digits, so
+ * that any one hostname has only one way of being written: "node[01-03]"
+ * and "node0[1-3]" are the same three hosts, and "node[8-12]" is held as
+ * node[8-9] (one digit) and node[10-12] (two). Names without a number on
+ * the end (or with more than RANGESET_MAX_DIGITS digits) are kept as they
+ * are. Sets are sorted by prefix, then digits, then number, with no range
+ * overlapping or running into another, so the operations are sweeps over
+ * both sets together, costing time in proportion to their ranges.
+ */
+
+#ifndef _PDSHPY_RANGESET_H
+#define _PDSHPY_RANGESET_H
+
+#include <stdint.h>
+
+#include "src/common/hostlist.h"
+
+/* the most digits a host number can have */
+#define RANGESET_MAX_DIGITS 18
+
+struct rangeset;
+
+/* The hosts in a ranged string, like "node[1-10],login1", or NULL with
+ * errno set to EINVAL if pdsh couldn't parse it either, or ENOMEM. Pieces
+ * in forms other than plain names and "prefix[ranges]" are listed out by
+ * pdsh and added host by host. With 'keep_order' the hosts are left in the
+ * order given, repeats and all, and the set can only be counted, written
+ * out, sliced or sampled, not used in the set operations. */
+struct rangeset *rangeset_parse(const char *ranged, int keep_order);
+
+/* the hosts in 'hl', as rangeset_parse() */
+struct rangeset *rangeset_from_hostlist(hostlist_t hl, int keep_order);
+
+void rangeset_free(struct rangeset *rs);
+
+/* new sets of the hosts in either, both, or 'a' and not 'b'; NULL if
+ * there's no memory */
+struct rangeset *rangeset_union(const struct rangeset *a,
+                                const struct rangeset *b);
+struct rangeset *rangeset_intersect(const struct rangeset *a,
+                                    const struct rangeset *b);
+struct rangeset *rangeset_difference(const struct rangeset *a,
+                                     const struct rangeset *b);
+
+uint64_t rangeset_count(const struct rangeset *rs);
+
+/* whether 'name' is in the set, found by binary search; not for sets made
+ * with 'keep_order' */
+int rangeset_contains(const struct rangeset *rs, const char *name);
+
+/* the set as a ranged string, in order (use free()), or NULL */
+char *rangeset_ranged(const struct rangeset *rs);
+
+/* a new hostlist of the set, in order, or NULL */
+hostlist_t rangeset_hostlist(const struct rangeset *rs);
+
+/* A new hostlist of 'count' hosts (or as many as there are) taken 'step'
+ * apart from host number 'start' on, or NULL if there's no memory. The
+ * first slice notes where each range starts, and each one after that finds
+ * its first host by binary search, so slicing a set into pieces costs time
+ * in proportion to its ranges and the pieces written, not its hosts. */
+hostlist_t rangeset_slice(struct rangeset *rs, uint64_t start, uint64_t step,
+                          uint64_t count);
+
+/* A new hostlist of about 'percent' (0 to 100) of the hosts, or NULL. The
+ * hosts are picked by a hash of each name and 'seed', so the same host is
+ * picked for the same seed and percentage whatever list it is in, and a
+ * larger percentage picks all the hosts a smaller one did. */
+hostlist_t rangeset_sample(const struct rangeset *rs, double percent,
+                           uint64_t seed);
+
+#endif /* !_PDSHPY_RANGESET_H */
@@ -0,0 +1,280 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "wire.h"
+
+void
+wire_init(struct wire_msg *msg)
+{
+    msg->buf = NULL;
+    msg->len = msg->cap = msg->pos = 0;
+}
+
+void
+wire_free(struct wire_msg *msg)
+{
+    free(msg->buf);
+    wire_init(msg);
+}
+
+static int
+wire_reserve(struct wire_msg *msg, size_t extra)
+{
+    size_t newcap = msg->cap ? msg->cap : 256;
+    char *newbuf = NULL;
+
+    while (newcap < msg->len + extra)
+        newcap *= 2;
+    if (newcap == msg->cap)
+        return 0;
+    if ((newbuf = realloc(msg->buf, newcap)) == NULL)
+        return -1;
+    msg->buf = newbuf;
+    msg->cap = newcap;
+    return 0;
+}
+
+static void
+put_be32(char *p, uint32_t val)
+{
+    p[0] = (val >> 24) & 0xff;
+    p[1] = (val >> 16) & 0xff;
+    p[2] = (val >> 8) & 0xff;
+    p[3] = val & 0xff;
+}
+
+static uint32_t
+get_be32(const char *p)
+{
+    const unsigned char *u = (const unsigned char *)p;
+    return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16)
+         | ((uint32_t)u[2] << 8) | (uint32_t)u[3];
+}
+
+int
+wire_add(struct wire_msg *msg, const char *name, const char *value)
+{
+    size_t namelen = strlen(name);
+    size_t vallen = value ? strlen(value) : 0;
+
+    if (namelen > 255)
+        return -1;
+    /* leave room for the length header on the first field */
+    if (msg->len == 0)
+    {
+        if (wire_reserve(msg, 4) < 0)
+            return -1;
+        msg->len = 4;
+    }
+    if (wire_reserve(msg, 1 + namelen + 4 + vallen) < 0)
+        return -1;
+
+    msg->buf[msg->len++] = (char)namelen;
+    memcpy(msg->buf + msg->len, name, namelen);
+    msg->len += namelen;
+    put_be32(msg->buf + msg->len, value ? (uint32_t)vallen : 0xffffffffU);
+    msg->len += 4;
+    if (value)
+    {
+        memcpy(msg->buf + msg->len, value, vallen);
+        msg->len += vallen;
+    }
+    return 0;
+}
+
+int
+wire_add_int(struct wire_msg *msg, const char *name, long value)
+{
+    char numbuf[32];
+
+    snprintf(numbuf, sizeof(numbuf), "%ld", value);
+    return wire_add(msg, name, numbuf);
+}
+
+static int
+write_all(int fd, const char *buf, size_t n)
+{
+    ssize_t w;
+
+    while (n > 0)
+    {
+        if ((w = write(fd, buf, n)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += w;
+        n -= w;
+    }
+    return 0;
+}
+
+static int
+read_all(int fd, char *buf, size_t n)
+{
+    ssize_t r;
+
+    while (n > 0)
+    {
+        if ((r = read(fd, buf, n)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (r == 0)
+        {
+            errno = ECONNRESET;
+            return -1;
+        }
+        buf += r;
+        n -= r;
+    }
+    return 0;
+}
+
+int
+wire_send(int fd, struct wire_msg *msg)
+{
+    if (msg->len == 0)
+    {
+        if (wire_reserve(msg, 4) < 0)
+            return -1;
+        msg->len = 4;
+    }
+    put_be32(msg->buf, msg->len - 4);
+    return write_all(fd, msg->buf, msg->len);
+}
+
+/* The received payload is rewritten into a form that is easier to hand out
+ * pieces of: for each field, a flag byte (1 if there is a value), the name
+ * NUL-terminated, and then the value NUL-terminated if there is one.
+ */
+int
+wire_recv(int fd, struct wire_msg *msg)
+{
+    char hdr[4];
+    char *raw = NULL;
+    uint32_t rawlen, namelen, vallen;
+    size_t i = 0;
+
+    if (read_all(fd, hdr, 4) < 0)
+        return -1;
+    rawlen = get_be32(hdr);
+    if (rawlen > WIRE_MAX_MESSAGE)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if ((raw = malloc(rawlen ? rawlen : 1)) == NULL)
+        return -1;
+    if (read_all(fd, raw, rawlen) < 0)
+    {
+        free(raw);
+        return -1;
+    }
+
+    msg->len = msg->pos = 0;
+    while (i < rawlen)
+    {
+        namelen = (unsigned char)raw[i++];
+        if (i + namelen + 4 > rawlen)
+            goto malformed;
+        vallen = get_be32(raw + i + namelen);
+        if (vallen != 0xffffffffU && i + namelen + 4 + vallen > rawlen)
+            goto malformed;
+        if (wire_reserve(msg, 1 + namelen + 1
+                              + (vallen == 0xffffffffU ? 0 : vallen + 1)) < 0)
+        {
+            free(raw);
+            return -1;
+        }
+        msg->buf[msg->len++] = (vallen != 0xffffffffU);
+        memcpy(msg->buf + msg->len, raw + i, namelen);
+        msg->len += namelen;
+        msg->buf[msg->len++] = '\0';
+        i += namelen + 4;
+        if (vallen != 0xffffffffU)
+        {
+            memcpy(msg->buf + msg->len, raw + i, vallen);
+            msg->len += vallen;
+            msg->buf[msg->len++] = '\0';
+            i += vallen;
+        }
+    }
+    free(raw);
+    return 0;
+
+malformed:
+    free(raw);
+    msg->len = 0;
+    errno = EPROTO;
+    return -1;
+}
+
+int
+wire_next(struct wire_msg *msg, const char **name, const char **value)
+{
+    int hasval;
+
+    if (msg->pos >= msg->len)
+        return 0;
+    hasval = msg->buf[msg->pos++];
+    *name = msg->buf + msg->pos;
+    msg->pos += strlen(*name) + 1;
+    if (hasval)
+    {
+        *value = msg->buf + msg->pos;
+        msg->pos += strlen(*value) + 1;
+    }
+    else
+        *value = NULL;
+    if (msg->pos > msg->len)
+        return -1;
+    return 1;
+}
+
+const char *
+wire_get(struct wire_msg *msg, const char *name, int *found)
+{
+    size_t saved = msg->pos;
+    const char *fname, *fvalue;
+
+    msg->pos = 0;
+    while (wire_next(msg, &fname, &fvalue) > 0)
+    {
+        if (strcmp(fname, name) == 0)
+        {
+            msg->pos = saved;
+            if (found)
+                *found = 1;
+            return fvalue;
+        }
+    }
+    msg->pos = saved;
+    if (found)
+        *found = 0;
+    return NULL;
+}
@@ -0,0 +1,71 @@
+/* Copyright (c) 2012 by Space Monkey, Inc.
+ *
+ *  Pdshpy is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdshpy is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdshpy; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/* Framing for messages between pdshpy.so and a pdshpy server (see
+ * pdshpy/server.py, which has the other half of this).
+ *
+ * A message is a 4-byte big-endian payload length followed by the payload.
+ * The payload is a sequence of fields, each of which is:
+ *
+ *     1 byte         length of the field name (N)
+ *     N bytes        field name
+ *     4 bytes        big-endian signed length of the value (V), -1 for NULL
+ *     V bytes        value
+ *
+ * Field names may repeat; order is significant.
+ */
+
+#ifndef _PDSHPY_WIRE_H
+#define _PDSHPY_WIRE_H
+
+#include <stddef.h>
+
+/* refuse to receive anything bigger than this */
+#define WIRE_MAX_MESSAGE (64 * 1024 * 1024)
+
+struct wire_msg {
+    char *buf;
+    size_t len;
+    size_t cap;
+    size_t pos;         /* read position, for wire_next() */
+};
+
+void wire_init(struct wire_msg *msg);
+void wire_free(struct wire_msg *msg);
+
+/* append a field. value may be NULL. return 0, or -1 on allocation failure */
+int wire_add(struct wire_msg *msg, const char *name, const char *value);
+int wire_add_int(struct wire_msg *msg, const char *name, long value);
+
+/* return 0 on success, -1 on error (errno set) */
+int wire_send(int fd, struct wire_msg *msg);
+
+/* replace the contents of msg with the next message read from fd. return 0
+ * on success, -1 on error or premature EOF */
+int wire_recv(int fd, struct wire_msg *msg);
+
+/* Step through the fields of a received message. Returns 1 and fills in the
+ * name and value (NUL-terminated in place; value is NULL for a NULL value)
+ * for each field, then 0 at the end, or -1 if the message is malformed.
+ */
+int wire_next(struct wire_msg *msg, const char **name, const char **value);
+
+/* return the value of the first field with the given name, or NULL if it is
+ * missing or NULL. *found is set to whether the field was there at all. */
+const char *wire_get(struct wire_msg *msg, const char *name, int *found);
+
+#endif /* !_PDSHPY_WIRE_H */